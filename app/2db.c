@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <sqlite3.h>
 
@@ -18,6 +19,9 @@
 
 #include <zsv/utils/mem.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/compress.h>
+#include <zsv/utils/prop.h>
+#include <zsv/utils/blockpool.h>
 
 #include <yajl_helper.h>
 
@@ -59,6 +63,7 @@ struct zsv_2db_options {
   char overwrite; // overwrite old db if it exists
 #define ZSV_2DB_DEFAULT_BATCH_SIZE 10000
   size_t batch_size;
+  int page_size; // if non-zero, set before the table is created
 };
 
 typedef struct zsv_2db_data *zsv_2db_handle;
@@ -87,9 +92,13 @@ struct zsv_2db_data {
     struct zsv_2db_ix current_index;
     char have_row_data;
 
-    char **row_values;
+    char **row_values;     // values for up to multi_rows rows
+    size_t row_values_count;
+    unsigned pending_rows; // number of rows in row_values waiting to be inserted
 
     sqlite3_stmt *insert_stmt;
+    sqlite3_stmt *multi_insert_stmt; // inserts multi_rows rows at once
+    unsigned multi_rows;
     unsigned stmt_colcount;
 
   } json_parser;
@@ -97,7 +106,9 @@ struct zsv_2db_data {
   size_t rows_processed;
   size_t row_insert_attempts;
   size_t rows_inserted;
+  unsigned int insert_errors_printed;
 #define ZSV_2DB_MSG_BATCH_SIZE 10000 // number of rows between each console update (if verbose)
+  double start_time;
 
   int err;
 };
@@ -142,6 +153,10 @@ static void zsv_2db_delete(zsv_2db_handle data) {
 
   free(data->opts.table_name);
   free(data->db_fn_tmp);
+  if(data->json_parser.insert_stmt)
+    sqlite3_finalize(data->json_parser.insert_stmt);
+  if(data->json_parser.multi_insert_stmt)
+    sqlite3_finalize(data->json_parser.multi_insert_stmt);
   if(data->db)
     sqlite3_close(data->db);
 
@@ -151,15 +166,39 @@ static void zsv_2db_delete(zsv_2db_handle data) {
   zsv_2db_ixes_delete(&data->json_parser.indexes);
   zsv_2db_ix_free(&data->json_parser.current_index);
 
-  free(data->json_parser.row_values);
+  if(data->json_parser.row_values) {
+    for(size_t i = 0; i < data->json_parser.row_values_count; i++)
+      free(data->json_parser.row_values[i]);
+    free(data->json_parser.row_values);
+  }
 
   yajl_helper_parse_state_free(&data->json_parser.st);
 
   free(data);
 }
 
+static double zsv_2db_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
 /* sqlite3 helper functions */
 
+/*
+ * number of rows to insert per statement: as many as fit within sqlite3's
+ * bound-variable limit, up to ZSV_2DB_MAX_INSERT_ROWS (beyond which there is
+ * little further gain)
+ */
+#define ZSV_2DB_MAX_INSERT_ROWS 256
+static unsigned zsv_2db_multi_rows(sqlite3 *db, unsigned col_count) {
+  int max_vars = sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+  unsigned rows = col_count && max_vars > 0 ? (unsigned)max_vars / col_count : 1;
+  if(rows > ZSV_2DB_MAX_INSERT_ROWS)
+    rows = ZSV_2DB_MAX_INSERT_ROWS;
+  return rows ? rows : 1;
+}
+
 static int zsv_2db_sqlite3_exec_2db(sqlite3 *db, const char *sql) {
   char *err_msg = NULL;
   int rc = sqlite3_exec(db, sql, NULL, NULL, &err_msg);
@@ -171,8 +210,18 @@ static int zsv_2db_sqlite3_exec_2db(sqlite3 *db, const char *sql) {
   return 1;
 }
 // add_db_indexes: return 0 on success, else error code
+#define ZSV_2DB_INDEX_CACHE_KB (256 * 1024)
 static int zsv_2db_add_indexes(struct zsv_2db_data *data) {
   int err = 0;
+  double start = zsv_2db_seconds();
+  if(data->json_parser.indexes) {
+    // indexes are built after the data is loaded, which is faster than
+    // updating them row by row; give the sort more memory than the default
+    char *sql = sqlite3_mprintf("PRAGMA cache_size = -%d", ZSV_2DB_INDEX_CACHE_KB);
+    if(sql)
+      sqlite3_exec(data->db, sql, NULL, NULL, NULL);
+    sqlite3_free(sql);
+  }
   for(struct zsv_2db_ix *ix = data->json_parser.indexes; !err && ix; ix = ix->next) {
     sqlite3_str *pStr = sqlite3_str_new(data->db);
     sqlite3_str_appendf(pStr, "create%s index \"%w_%w\" on \"%w\"(%s)",
@@ -186,6 +235,8 @@ static int zsv_2db_add_indexes(struct zsv_2db_data *data) {
       data->json_parser.index_sequence_num_max++;
     sqlite3_free(sqlite3_str_finish(pStr));
   }
+  if(!err && data->opts.verbose && data->json_parser.indexes)
+    fprintf(stderr, "Indexes created in %.2f seconds\n", zsv_2db_seconds() - start);
   return err;
 }
 
@@ -230,7 +281,8 @@ static sqlite3_str *build_create_table_statement(sqlite3 *db, const char *tname,
           err = 1;
         } else
           sqlite3_str_appendf(pStr, " %s%s%s", datatype, collate ? " collate " : "", collate ? collate : "");
-      }
+      } else if(datatypes && datatypes[i])
+        sqlite3_str_appendf(pStr, " %s", datatype);
     }
   }
   if(err) {
@@ -252,9 +304,12 @@ static int zsv_2db_finish_header(struct zsv_2db_data *data) {
   }
 
   data->json_parser.state = zsv_2db_state_data;
-  if((data->json_parser.row_values = calloc(data->json_parser.col_count,
+  data->json_parser.multi_rows = zsv_2db_multi_rows(data->db, data->json_parser.col_count);
+  data->json_parser.row_values_count = (size_t)data->json_parser.multi_rows * data->json_parser.col_count;
+  if((data->json_parser.row_values = calloc(data->json_parser.row_values_count,
                                             sizeof(*data->json_parser.row_values))))
     return 1;
+  data->json_parser.row_values_count = 0;
 
   data->err = 1;
   return 0;
@@ -264,14 +319,18 @@ static int zsv_2db_finish_header(struct zsv_2db_data *data) {
 /* json parser functions */
 
 static sqlite3_stmt *create_insert_statement(sqlite3 *db, const char *tname,
-                                             unsigned int col_count) {
+                                             unsigned int col_count,
+                                             unsigned int row_count) {
   sqlite3_stmt *insert_stmt = NULL;
   sqlite3_str *insert_sql = sqlite3_str_new(db);
   if(insert_sql) {
-    sqlite3_str_appendf(insert_sql, "insert into \"%w\" values(?", tname);
-    for(unsigned int i = 1; i < col_count; i++)
-      sqlite3_str_appendf(insert_sql, ", ?");
-    sqlite3_str_appendf(insert_sql, ")");
+    sqlite3_str_appendf(insert_sql, "insert into \"%w\" values", tname);
+    for(unsigned int r = 0; r < row_count; r++) {
+      sqlite3_str_appendf(insert_sql, r ? ",(?" : "(?");
+      for(unsigned int i = 1; i < col_count; i++)
+        sqlite3_str_appendf(insert_sql, ", ?");
+      sqlite3_str_appendf(insert_sql, ")");
+    }
     int status = sqlite3_prepare_v2(db, sqlite3_str_value(insert_sql),
                                     -1, &insert_stmt, NULL);
     if(status != SQLITE_OK) {
@@ -290,6 +349,8 @@ static int zsv_2db_set_insert_stmt(struct zsv_2db_data *data) {
     fprintf(stderr, "insert statement called with no columns to insert");
     err = 1;
   } else {
+    if(!data->opts.table_name)
+      data->opts.table_name = strdup(ZSV_2DB_DEFAULT_TABLE_NAME);
     const char **colnames = calloc(data->json_parser.col_count, sizeof(*colnames));
     const char **datatypes = calloc(data->json_parser.col_count, sizeof(*datatypes));
     const char **collates = calloc(data->json_parser.col_count, sizeof(*collates));
@@ -308,14 +369,25 @@ static int zsv_2db_set_insert_stmt(struct zsv_2db_data *data) {
     if(!create_sql)
       err = 1;
     else {
-      if(!(err = zsv_2db_sqlite3_exec_2db(data->db, sqlite3_str_value(create_sql)))
-            && !(data->json_parser.insert_stmt =
-                 create_insert_statement(data->db, data->opts.table_name,
-                                         data->json_parser.col_count))) {
-        err = 1;
-        zsv_2db_start_transaction(data);
-      } else
-        data->json_parser.stmt_colcount = data->json_parser.col_count;
+      if(!(err = zsv_2db_sqlite3_exec_2db(data->db, sqlite3_str_value(create_sql)))) {
+        if(!(data->json_parser.insert_stmt =
+             create_insert_statement(data->db, data->opts.table_name,
+                                     data->json_parser.col_count, 1)))
+          err = 1;
+        else {
+          data->json_parser.stmt_colcount = data->json_parser.col_count;
+          if(!data->json_parser.multi_rows)
+            data->json_parser.multi_rows = zsv_2db_multi_rows(data->db, data->json_parser.col_count);
+          if(data->json_parser.multi_rows > 1
+             && !(data->json_parser.multi_insert_stmt =
+                  create_insert_statement(data->db, data->opts.table_name,
+                                          data->json_parser.col_count,
+                                          data->json_parser.multi_rows)))
+            data->json_parser.multi_rows = 1; // fall back to single-row inserts
+          data->start_time = zsv_2db_seconds();
+          zsv_2db_start_transaction(data);
+        }
+      }
       sqlite3_free(sqlite3_str_finish(create_sql));
     }
 
@@ -327,75 +399,138 @@ static int zsv_2db_set_insert_stmt(struct zsv_2db_data *data) {
 }
 
 
+// step a fully-bound insert statement: return sqlite3 error, or 0 on ok
+// a failed multi-row insert is retried one row at a time, so its error is not
+// printed (quiet); only the errors of the rows that fail on retry are
+static int zsv_2db_step_insert(struct zsv_2db_data *data, sqlite3_stmt *stmt, char quiet) {
+  int status = sqlite3_step(stmt);
+  if(status == SQLITE_DONE)
+    status = 0;
+  else if(quiet)
+    ;
+  else if(data->insert_errors_printed < 10) {
+    data->insert_errors_printed++;
+    fprintf(stderr, "Unable to insert: %s\n", sqlite3_errmsg(data->db));
+  } else if(data->insert_errors_printed != 100) {
+    data->insert_errors_printed = 100;
+    fprintf(stderr, "Too many insert errors to print\n");
+  }
+
+  sqlite3_reset(stmt);
+
+  return status;
+}
+
+/*
+  step a fully-bound multi-row insert statement. Because the database is written
+  with journal_mode = OFF, a statement that fails is not rolled back, so remove
+  any rows it inserted before the failing one; the caller then retries the rows
+  one at a time, which would otherwise insert those rows twice
+*/
+static int zsv_2db_step_multi_insert(struct zsv_2db_data *data, sqlite3_stmt *stmt) {
+  sqlite3_int64 last_rowid = sqlite3_last_insert_rowid(data->db);
+  int status = zsv_2db_step_insert(data, stmt, 1);
+  if(status) {
+    char *sql = sqlite3_mprintf("delete from \"%w\" where _rowid_ > %lld",
+                                data->opts.table_name, last_rowid);
+    if(!sql || zsv_2db_sqlite3_exec_2db(data->db, sql))
+      data->err = 1;
+    sqlite3_free(sql);
+  }
+  return status;
+}
+
 /*
-  add_local_db_row(): return sqlite3 error, or 0 on ok
+  zsv_2db_bind_row_values(): bind one row of values, starting at the given
+  (1-based) parameter index
 */
-static int zsv_2db_insert_row_values(sqlite3_stmt *stmt, unsigned stmt_colcount,
-                                     char const *const *const values,
-                                     unsigned int values_count
-                                     ) {
-  if(!stmt)
-    return -1;
-
-  int status = 0;
-  unsigned int errors_printed = 0;
+static void zsv_2db_bind_row_values(sqlite3_stmt *stmt, int first_param, unsigned stmt_colcount,
+                                    char const *const *const values,
+                                    unsigned int values_count
+                                    ) {
   if(values_count > stmt_colcount)
     values_count = stmt_colcount;
 
   for(unsigned int i = 0; i < values_count; i++) {
     const char *val = values[i];
     if(val && *val)
-      sqlite3_bind_text(stmt, (int)i+1, val, (int)strlen(val), SQLITE_STATIC);
+      sqlite3_bind_text(stmt, first_param + (int)i, val, (int)strlen(val), SQLITE_STATIC);
     else
       // don't use sqlite3_bind_null, else x = ? will fail if value is ""/null
-      sqlite3_bind_text(stmt, (int)i+1, "", 0, SQLITE_STATIC);
+      sqlite3_bind_text(stmt, first_param + (int)i, "", 0, SQLITE_STATIC);
   }
 
   for(unsigned int i = values_count; i < stmt_colcount; i++)
-    sqlite3_bind_null(stmt, (int)i+1);
+    sqlite3_bind_null(stmt, first_param + (int)i);
+}
 
-  status = sqlite3_step(stmt);
-  if(status == SQLITE_DONE)
-    status = 0;
-  else if(errors_printed < 10) {
-    errors_printed++;
-    fprintf(stderr, "Unable to insert: %s\n", sqlite3_errstr(status));
-  } else if(errors_printed != 100) {
-    errors_printed = 100;
-    fprintf(stderr, "Too many insert errors to print\n");
+// update counters after inserting row_count rows, and commit every batch_size rows
+static void zsv_2db_rows_inserted(struct zsv_2db_data *data, int rc, unsigned row_count) {
+  data->row_insert_attempts += row_count;
+  if(!rc) {
+    size_t before = data->rows_inserted;
+    data->rows_inserted += row_count;
+    if(data->opts.verbose && before / ZSV_2DB_MSG_BATCH_SIZE != data->rows_inserted / ZSV_2DB_MSG_BATCH_SIZE) {
+      double elapsed = zsv_2db_seconds() - data->start_time;
+      fprintf(stderr, "%zu rows inserted (%.0f rows/sec)\n", data->rows_inserted,
+              elapsed > 0 ? (double)data->rows_inserted / elapsed : 0);
+    }
+    if(data->opts.batch_size && before / data->opts.batch_size != data->rows_inserted / data->opts.batch_size) {
+      zsv_2db_end_transaction(data);
+      if(data->opts.verbose)
+        fprintf(stderr, "%zu rows committed\n", data->rows_inserted);
+      zsv_2db_start_transaction(data);
+    }
   }
+}
 
-  sqlite3_reset(stmt);
+/*
+  insert the pending JSON rows: all at once if there are multi_rows of them,
+  else (or if the multi-row insert failed) one at a time
+*/
+static int zsv_2db_flush_rows(struct zsv_2db_data *data) {
+  unsigned row_count = data->json_parser.pending_rows;
+  unsigned col_count = data->json_parser.col_count;
+  if(!row_count)
+    return 0;
+  if(!data->json_parser.insert_stmt && !data->err)
+    data->err = zsv_2db_set_insert_stmt(data);
+
+  if(!data->err && data->db) {
+    char const *const *const values = (char const *const *const) data->json_parser.row_values;
+    unsigned stmt_colcount = data->json_parser.stmt_colcount;
+    int rc = -1;
+    if(row_count == data->json_parser.multi_rows && data->json_parser.multi_insert_stmt) {
+      sqlite3_stmt *stmt = data->json_parser.multi_insert_stmt;
+      for(unsigned r = 0; r < row_count; r++)
+        zsv_2db_bind_row_values(stmt, (int)(r * stmt_colcount) + 1, stmt_colcount,
+                                values + (size_t)r * col_count, col_count);
+      if(!(rc = zsv_2db_step_multi_insert(data, stmt)))
+        zsv_2db_rows_inserted(data, rc, row_count);
+    }
+    if(rc && !data->err) {
+      sqlite3_stmt *stmt = data->json_parser.insert_stmt;
+      for(unsigned r = 0; r < row_count; r++) {
+        zsv_2db_bind_row_values(stmt, 1, stmt_colcount, values + (size_t)r * col_count, col_count);
+        zsv_2db_rows_inserted(data, zsv_2db_step_insert(data, stmt, 0), 1);
+      }
+    }
+  }
 
-  return status;
+  for(size_t i = 0; i < (size_t)row_count * col_count; i++) {
+    free(data->json_parser.row_values[i]);
+    data->json_parser.row_values[i] = NULL;
+  }
+  data->json_parser.pending_rows = 0;
+  return data->err;
 }
 
 static int zsv_2db_insert_row(struct zsv_2db_data *data) {
   if(!data->err) {
     data->rows_processed++;
     if(data->json_parser.have_row_data) {
-      if(!data->json_parser.insert_stmt)
-        data->err = zsv_2db_set_insert_stmt(data);
-
-      if(!data->db)
-        return 0;
-      int rc =
-        zsv_2db_insert_row_values(data->json_parser.insert_stmt,
-                                  data->json_parser.stmt_colcount,
-                                  (char const *const *const) data->json_parser.row_values,
-                                  data->json_parser.col_count);
-      data->row_insert_attempts++;
-      if(!rc) {
-        data->rows_inserted++;
-        if(data->opts.verbose && (data->rows_inserted % ZSV_2DB_MSG_BATCH_SIZE == 0))
-          fprintf(stderr, "%zu rows inserted\n", data->rows_inserted);
-        if(data->opts.batch_size && (data->rows_inserted % data->opts.batch_size == 0)) {
-          zsv_2db_end_transaction(data);
-          if(data->opts.verbose)
-            fprintf(stderr, "%zu rows committed\n", data->rows_inserted);
-          zsv_2db_start_transaction(data);
-        }
-      }
+      if(++data->json_parser.pending_rows >= data->json_parser.multi_rows)
+        zsv_2db_flush_rows(data);
     }
   }
 
@@ -474,10 +609,12 @@ static int json_start_array(struct yajl_helper_parse_state *st) {
 }
 
 static void reset_row_values(struct zsv_2db_data *data) {
-  if(data->json_parser.row_values) {
+  // if the row was added to the pending rows, its values are freed once inserted
+  if(data->json_parser.row_values && !data->json_parser.have_row_data) {
+    char **values = data->json_parser.row_values + (size_t)data->json_parser.pending_rows * data->json_parser.col_count;
     for(unsigned int i = 0; i < data->json_parser.col_count; i++) {
-      free(data->json_parser.row_values[i]);
-      data->json_parser.row_values[i] = NULL;
+      free(values[i]);
+      values[i] = NULL;
     }
   }
   data->json_parser.have_row_data = 0;
@@ -506,7 +643,9 @@ static int json_process_value(struct yajl_helper_parse_state *st,
       if(jsstr && len) {
         unsigned int j = yajl_helper_array_index_plus_1(st, 0);
         if(j && j-1 < data->json_parser.col_count) {
-          data->json_parser.row_values[j-1] = zsv_memdup(jsstr, len);
+          char **values = data->json_parser.row_values + (size_t)data->json_parser.pending_rows * data->json_parser.col_count;
+          free(values[j-1]);
+          values[j-1] = zsv_memdup(jsstr, len);
           data->json_parser.have_row_data = 1;
         }
       }
@@ -608,6 +747,12 @@ static zsv_2db_handle zsv_2db_new(struct zsv_2db_options *opts) {
       // performance tweaks
       sqlite3_exec(data->db, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
       sqlite3_exec(data->db, "PRAGMA journal_mode = OFF", NULL, NULL, NULL);
+      if(data->opts.page_size) { // must be set before the table is created
+        char *sql = sqlite3_mprintf("PRAGMA page_size = %d", data->opts.page_size);
+        if(sql)
+          sqlite3_exec(data->db, sql, NULL, NULL, NULL);
+        sqlite3_free(sql);
+      }
 
       // parse the input and create & populate the database table
       if(yajl_helper_parse_state_init(&data->json_parser.st, 32,
@@ -640,13 +785,24 @@ static int zsv_2db_err(zsv_2db_handle h) {
 
 // exportable
 static int zsv_2db_finish(zsv_2db_handle data) {
+  int err = zsv_2db_flush_rows(data);
+  if(!err && data->opts.verbose && data->json_parser.insert_stmt) {
+    double elapsed = zsv_2db_seconds() - data->start_time;
+    fprintf(stderr, "%zu rows inserted in %.2f seconds (%.0f rows/sec)\n", data->rows_inserted,
+            elapsed, elapsed > 0 ? (double)data->rows_inserted / elapsed : 0);
+  }
+
   // add indexes
-  int err = zsv_2db_add_indexes(data);
+  if(!err)
+    err = zsv_2db_add_indexes(data);
   if(!err) {
     if(data->db) {
       zsv_2db_end_transaction(data);
       if(data->json_parser.insert_stmt)
         sqlite3_finalize(data->json_parser.insert_stmt);
+      if(data->json_parser.multi_insert_stmt)
+        sqlite3_finalize(data->json_parser.multi_insert_stmt);
+      data->json_parser.insert_stmt = data->json_parser.multi_insert_stmt = NULL;
 
       sqlite3_close(data->db);
       data->db = NULL;
@@ -669,24 +825,445 @@ static yajl_handle zsv_2db_yajl_handle(zsv_2db_handle data) {
   return data->json_parser.st.yajl;
 }
 
+/*
+ * CSV input: the header row defines the columns, and data rows are loaded
+ * directly, without a JSON intermediate. Column types are taken from the
+ * file's saved "columns" property (see `prop --column-types`) if it matches
+ * the header, or else chosen by sampling the initial rows with the same type
+ * detection used by `prop`. Numeric columns are declared without a type, so
+ * that sqlite3 does not convert the values stored in them: each value in such
+ * a column is bound as an integer or real only if sqlite3 would give back the
+ * same text, and otherwise as text. Text is bound using its known length.
+ *
+ * Rows are copied from the parser into blocks; unless built with NO_THREADING,
+ * the blocks are passed through a zsv_blockpool to a separate thread that
+ * inserts them, so that parsing and sqlite3 inserts overlap
+ */
+#define ZSV_2DB_CSV_BLOCK_SIZE (1024 * 1024)
+#define ZSV_2DB_CSV_BLOCK_COUNT 4
+#define ZSV_2DB_TYPE_SAMPLE_ROWS 1000
+
+enum zsv_2db_coltype {
+  zsv_2db_coltype_text = 0,
+  zsv_2db_coltype_integer,
+  zsv_2db_coltype_real
+};
+
+struct zsv_2db_csv {
+  struct zsv_2db_data *data;
+  zsv_parser parser;
+  struct zsv_prop_columns saved_columns; // as saved by `prop --column-types`
+  enum zsv_2db_coltype *coltypes;
+  size_t *batch; // indexes of the rows to insert in one statement
+  char got_header;
+  char table_created;
+
+  struct zsv_block block; // rows are copied here if there is no inserter thread; each cell is followed by a NUL
+#ifndef NO_THREADING
+  zsv_blockpool pool; // else here
+#endif
+  char err;
+};
+
+/*
+ * strict conversions of a NUL-terminated cell value: the value is converted
+ * only if sqlite3 would output the result as exactly the same text, so that
+ * values such as "02134", "+1", "1e5" or "1.50" are kept as text
+ */
+static char zsv_2db_parse_int(const char *s, size_t len, sqlite3_int64 *v) {
+  char buff[24];
+  if(len >= sizeof(buff))
+    return 0;
+  char *end;
+  errno = 0;
+  long long n = strtoll(s, &end, 10);
+  if(errno || end != s + len)
+    return 0;
+  sqlite3_snprintf(sizeof(buff), buff, "%lld", n);
+  if(strcmp(buff, s))
+    return 0;
+  *v = (sqlite3_int64)n;
+  return 1;
+}
+
+static char zsv_2db_parse_real(const char *s, size_t len, double *v) {
+  char buff[32];
+  const char *digits = *s == '-' ? s + 1 : s;
+  if(len >= sizeof(buff) || !(*digits >= '0' && *digits <= '9')) // no inf, nan or hex
+    return 0;
+  char *end;
+  errno = 0;
+  double d = strtod(s, &end);
+  if(errno || end != s + len)
+    return 0;
+  sqlite3_snprintf(sizeof(buff), buff, "%!.15g", d); // as sqlite3 converts a real to text
+  if(strcmp(buff, s))
+    return 0;
+  *v = d;
+  return 1;
+}
+
+static void zsv_2db_csv_bind(sqlite3_stmt *stmt, int ix, enum zsv_2db_coltype t,
+                             const unsigned char *s, size_t len) {
+  if(!len) {
+    if(t == zsv_2db_coltype_text)
+      // as with JSON input, bind blank text values as "" rather than null
+      sqlite3_bind_text(stmt, ix, "", 0, SQLITE_STATIC);
+    else
+      sqlite3_bind_null(stmt, ix);
+    return;
+  }
+  if(t != zsv_2db_coltype_text) {
+    sqlite3_int64 i;
+    double d;
+    if(zsv_2db_parse_int((const char *)s, len, &i)) {
+      sqlite3_bind_int64(stmt, ix, i);
+      return;
+    }
+    if(zsv_2db_parse_real((const char *)s, len, &d)) {
+      sqlite3_bind_double(stmt, ix, d);
+      return;
+    }
+  }
+  sqlite3_bind_text(stmt, ix, (const char *)s, (int)len, SQLITE_STATIC);
+}
+
+// use the saved column types, if their names match the header. return 1 if used
+static char zsv_2db_csv_saved_coltypes(struct zsv_2db_csv *csv) {
+  const struct zsv_prop_columns *saved = &csv->saved_columns;
+  if(!saved->count || saved->count != csv->data->json_parser.col_count)
+    return 0;
+  unsigned i = 0;
+  for(struct zsv_2db_column *e = csv->data->json_parser.columns; e; e = e->next, i++)
+    if(!saved->columns[i].name || strcmp((const char *)saved->columns[i].name, e->name))
+      return 0;
+  for(i = 0; i < saved->count; i++) {
+    switch(saved->columns[i].type) {
+    case zsv_prop_column_type_integer:
+      csv->coltypes[i] = zsv_2db_coltype_integer;
+      break;
+    case zsv_prop_column_type_real:
+      csv->coltypes[i] = zsv_2db_coltype_real;
+      break;
+    default:
+      csv->coltypes[i] = zsv_2db_coltype_text;
+      break;
+    }
+  }
+  if(csv->data->opts.verbose)
+    fprintf(stderr, "Using saved column types\n");
+  return 1;
+}
+
+// choose column types from the saved properties or the initial rows, then create the table and insert statement
+static int zsv_2db_csv_create_table(struct zsv_2db_csv *csv, const struct zsv_block *b) {
+  struct zsv_2db_data *data = csv->data;
+  unsigned col_count = data->json_parser.col_count;
+  char *seen = calloc(col_count, 1);
+  if(!seen || !(csv->coltypes = calloc(col_count, sizeof(*csv->coltypes)))) {
+    free(seen);
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+  for(unsigned i = 0; i < col_count; i++)
+    csv->coltypes[i] = zsv_2db_coltype_integer;
+
+  char use_saved = zsv_2db_csv_saved_coltypes(csv);
+  size_t sample_rows = use_saved ? 0 :
+    b && b->row_count < ZSV_2DB_TYPE_SAMPLE_ROWS ? b->row_count : b ? ZSV_2DB_TYPE_SAMPLE_ROWS : 0;
+  for(size_t r = 0, c = 0; r < sample_rows; r++) {
+    for(unsigned i = 0; c < b->row_ends[r]; c++, i++) {
+      const struct zsv_block_cell *cell = &b->cells[c];
+      const char *s = (const char *)b->raw + cell->offset;
+      if(!cell->len || csv->coltypes[i] == zsv_2db_coltype_text)
+        continue;
+      seen[i] = 1;
+      sqlite3_int64 n;
+      double d;
+      if(!(zsv_prop_type_detect((const unsigned char *)s, cell->len) & ZSV_PROP_TYPE_CHECK_NUM))
+        csv->coltypes[i] = zsv_2db_coltype_text;
+      else if(zsv_2db_parse_int(s, cell->len, &n))
+        ; // integers are also valid in a real column
+      else if(zsv_2db_parse_real(s, cell->len, &d))
+        csv->coltypes[i] = zsv_2db_coltype_real;
+      else
+        csv->coltypes[i] = zsv_2db_coltype_text;
+    }
+  }
+
+  // numeric columns get no declared type, and so no affinity: an integer or
+  // real affinity would convert values such as "02134" that are bound as text
+  unsigned i = 0;
+  for(struct zsv_2db_column *e = data->json_parser.columns; e; e = e->next, i++) {
+    if(!use_saved && !seen[i])
+      csv->coltypes[i] = zsv_2db_coltype_text;
+    if(csv->coltypes[i] == zsv_2db_coltype_text)
+      e->datatype = strdup("text");
+  }
+  free(seen);
+
+  csv->table_created = 1;
+  if(zsv_2db_set_insert_stmt(data))
+    return 1;
+  if(!(csv->batch = calloc(data->json_parser.multi_rows, sizeof(*csv->batch)))) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+  return 0;
+}
+
+// bind row r of a block, starting at the given (1-based) parameter index
+static void zsv_2db_csv_bind_row(struct zsv_2db_csv *csv, sqlite3_stmt *stmt, int first_param,
+                                 const struct zsv_block *b, size_t r) {
+  unsigned stmt_colcount = csv->data->json_parser.stmt_colcount;
+  unsigned i = 0;
+  for(size_t c = r ? b->row_ends[r-1] : 0; c < b->row_ends[r]; c++, i++)
+    zsv_2db_csv_bind(stmt, first_param + (int)i, csv->coltypes[i], b->raw + b->cells[c].offset, b->cells[c].len);
+  for(; i < stmt_colcount; i++)
+    sqlite3_bind_null(stmt, first_param + (int)i);
+}
+
+// insert the given rows of a block: all at once if there are multi_rows of
+// them, else (or if the multi-row insert failed) one at a time
+static void zsv_2db_csv_insert_rows(struct zsv_2db_csv *csv, const struct zsv_block *b,
+                                    const size_t *rows, unsigned row_count) {
+  struct zsv_2db_data *data = csv->data;
+  unsigned stmt_colcount = data->json_parser.stmt_colcount;
+  int rc = -1;
+  if(row_count == data->json_parser.multi_rows && data->json_parser.multi_insert_stmt) {
+    sqlite3_stmt *stmt = data->json_parser.multi_insert_stmt;
+    for(unsigned k = 0; k < row_count; k++)
+      zsv_2db_csv_bind_row(csv, stmt, (int)(k * stmt_colcount) + 1, b, rows[k]);
+    if(!(rc = zsv_2db_step_multi_insert(data, stmt)))
+      zsv_2db_rows_inserted(data, rc, row_count);
+  }
+  if(rc && !data->err) {
+    sqlite3_stmt *stmt = data->json_parser.insert_stmt;
+    for(unsigned k = 0; k < row_count; k++) {
+      zsv_2db_csv_bind_row(csv, stmt, 1, b, rows[k]);
+      zsv_2db_rows_inserted(data, zsv_2db_step_insert(data, stmt, 0), 1);
+    }
+  }
+}
+
+// insert all rows in a block. return 0 on success
+static int zsv_2db_csv_insert_block(struct zsv_2db_csv *csv, struct zsv_block *b) {
+  struct zsv_2db_data *data = csv->data;
+  if(!csv->table_created && zsv_2db_csv_create_table(csv, b))
+    return 1;
+
+  unsigned batch_count = 0;
+  for(size_t r = 0, c = 0; r < b->row_count; r++) {
+    char have_row_data = 0;
+    for(; c < b->row_ends[r]; c++)
+      if(b->cells[c].len)
+        have_row_data = 1;
+
+    data->rows_processed++;
+    if(have_row_data) {
+      csv->batch[batch_count++] = r;
+      if(batch_count == data->json_parser.multi_rows) {
+        zsv_2db_csv_insert_rows(csv, b, csv->batch, batch_count);
+        batch_count = 0;
+      }
+    }
+  }
+  if(batch_count)
+    zsv_2db_csv_insert_rows(csv, b, csv->batch, batch_count);
+  zsv_block_clear(b);
+  return data->err;
+}
+
+#ifndef NO_THREADING
+static int zsv_2db_csv_insert_next(void *ctx, unsigned worker, struct zsv_block *b) {
+  (void)(worker);
+  return zsv_2db_csv_insert_block(ctx, b);
+}
+#endif
+
+// hand the block being filled to the inserter or, if there is none, insert it now
+static int zsv_2db_csv_submit_block(struct zsv_2db_csv *csv, struct zsv_block *b) {
+#ifndef NO_THREADING
+  if(csv->pool)
+    return zsv_blockpool_submit(csv->pool);
+#endif
+  return zsv_2db_csv_insert_block(csv, b);
+}
+
+static char *zsv_2db_csv_colname(struct zsv_2db_data *data, const unsigned char *s, size_t len) {
+  char *name = NULL;
+  if(len)
+    name = zsv_memdup(s, len);
+  else
+    asprintf(&name, "column_%u", data->json_parser.col_count + 1);
+
+  // column names must be unique (case-insensitive)
+  for(unsigned suffix = 2; name; suffix++) {
+    struct zsv_2db_column *e = data->json_parser.columns;
+    while(e && sqlite3_stricmp(e->name, name))
+      e = e->next;
+    if(!e)
+      break;
+    free(name);
+    name = NULL;
+    if(len)
+      asprintf(&name, "%.*s_%u", (int)len, s, suffix);
+    else
+      asprintf(&name, "column_%u_%u", data->json_parser.col_count + 1, suffix);
+  }
+  return name;
+}
+
+static void zsv_2db_csv_header_row(struct zsv_2db_csv *csv) {
+  struct zsv_2db_data *data = csv->data;
+  size_t cols = zsv_cell_count(csv->parser);
+  for(size_t i = 0; i < cols; i++) {
+    struct zsv_cell cell = zsv_get_cell(csv->parser, i);
+    struct zsv_2db_column *e = calloc(1, sizeof(*e));
+    if(!e || !(e->name = zsv_2db_csv_colname(data, cell.str, cell.len))) {
+      free(e);
+      fprintf(stderr, "Out of memory!\n");
+      csv->err = 1;
+      return;
+    }
+    *data->json_parser.last_column = e;
+    data->json_parser.last_column = &e->next;
+    data->json_parser.col_count++;
+  }
+  if(!data->json_parser.col_count) {
+    fprintf(stderr, "No columns found!\n");
+    csv->err = 1;
+  }
+  csv->got_header = 1;
+}
+
+static void zsv_2db_csv_row(void *ctx) {
+  struct zsv_2db_csv *csv = ctx;
+  if(VERY_UNLIKELY(csv->err))
+    return;
+  if(VERY_UNLIKELY(!csv->got_header)) {
+    zsv_2db_csv_header_row(csv);
+    return;
+  }
+
+  struct zsv_block *b = &csv->block;
+#ifndef NO_THREADING
+  if(csv->pool && !(b = zsv_blockpool_fill_block(csv->pool))) { // the inserter failed
+    csv->err = 1;
+    return;
+  }
+#endif
+  size_t cols = zsv_cell_count(csv->parser);
+  if(cols > csv->data->json_parser.col_count)
+    cols = csv->data->json_parser.col_count;
+  if(zsv_block_add_row(b, csv->parser, (unsigned)cols, 1)) {
+    fprintf(stderr, "Out of memory!\n");
+    csv->err = 1;
+    return;
+  }
+  if(b->raw_len >= ZSV_2DB_CSV_BLOCK_SIZE && zsv_2db_csv_submit_block(csv, b))
+    csv->err = 1;
+}
+
+static void zsv_2db_csv_delete(struct zsv_2db_csv *csv) {
+#ifndef NO_THREADING
+  zsv_blockpool_delete(csv->pool);
+#endif
+  zsv_block_free(&csv->block);
+  free(csv->coltypes);
+  free(csv->batch);
+  zsv_prop_columns_free(&csv->saved_columns);
+}
+
+// load CSV input into the database. return 0 on success
+static int zsv_2db_load_csv(zsv_2db_handle data, FILE *f_in, const char *input_path,
+                            struct zsv_opts *zsv_opts, const char *opts_used) {
+  struct zsv_2db_csv csv = { 0 };
+  int err = 0;
+  csv.data = data;
+#ifndef NO_THREADING
+  struct zsv_blockpool_opts pool_opts = { 0 };
+  pool_opts.block_count = ZSV_2DB_CSV_BLOCK_COUNT;
+  pool_opts.process = zsv_2db_csv_insert_next;
+  pool_opts.ctx = &csv;
+  pool_opts.worker_count = 1; // rows must be inserted in order
+  csv.pool = zsv_blockpool_new(&pool_opts); // if NULL, blocks are inserted in this thread
+#endif
+
+  zsv_opts->stream = f_in;
+  zsv_opts->row_handler = zsv_2db_csv_row;
+  zsv_opts->ctx = &csv;
+  if(input_path && zsv_cache_load_columns(input_path, &csv.saved_columns) != zsv_status_ok)
+    err = 1;
+  else if(zsv_new_with_properties(zsv_opts, input_path, opts_used, &csv.parser) != zsv_status_ok)
+    err = 1;
+  else {
+    enum zsv_status status = zsv_status_ok;
+    while(!csv.err && (status = zsv_parse_more(csv.parser)) == zsv_status_ok)
+      ;
+    if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+      csv.err = 1;
+    zsv_finish(csv.parser);
+    zsv_delete(csv.parser);
+
+    if(!csv.err) {
+#ifndef NO_THREADING
+      if(csv.pool) {
+        if(zsv_blockpool_finish(csv.pool))
+          csv.err = 1;
+      } else
+#endif
+      if(csv.block.row_count && zsv_2db_csv_insert_block(&csv, &csv.block))
+        csv.err = 1;
+    }
+    if(!csv.err && !csv.got_header) {
+      fprintf(stderr, "No columns found!\n");
+      csv.err = 1;
+    }
+    if(!csv.err && !csv.table_created && zsv_2db_csv_create_table(&csv, NULL))
+      csv.err = 1;
+    if(csv.err)
+      err = 1;
+  }
+  zsv_2db_csv_delete(&csv);
+  return err;
+}
+
+enum zsv_2db_input_format {
+  zsv_2db_input_format_auto = 0,
+  zsv_2db_input_format_json,
+  zsv_2db_input_format_csv
+};
+
 int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *zsv_opts, const char *opts_used) {
-  (void)(zsv_opts);
-  (void)(opts_used);
   FILE *f_in = NULL;
+  const char *input_path = NULL;
+  enum zsv_2db_input_format input_format = zsv_2db_input_format_auto;
   int err = 0;
   struct zsv_2db_options opts = { 0 };
-  opts.verbose = zsv_get_default_opts().verbose;
+  opts.verbose = zsv_opts->verbose;
 
   const char *usage[] =
     {
-     APPNAME ": convert JSON to sqlite3",
+     APPNAME ": convert JSON or CSV to sqlite3",
+     "",
+     "Usage: " APPNAME " -o <output path> [-t <table name>] [input.json | input.csv]\n",
      "",
-     "Usage: " APPNAME " -o <output path> [-t <table name>] [input.json]\n",
+     "JSON input must be in the database schema format output by `2json --database`.",
+     "Input is treated as JSON if the filename ends in .json or the data starts with '['",
+     "and otherwise as CSV, whose header row defines the column names. CSV columns",
+     "whose initial values are all numeric (or that have been saved as numeric using",
+     "`prop --column-types auto --save`) are created without a declared type. Values",
+     "in them are stored as numbers only if they convert without loss, so that values",
+     "such as 02134 or 1e5 are kept as text",
      "",
      "Options:",
      "  -h,--help",
      "  --table <table_name> : save as specified table name",
      "  --overwrite          : overwrite existing database",
+     "  --csv                : treat input as CSV",
+     "  --json               : treat input as JSON",
+     "  --page-size <n>      : database page size in bytes (power of 2 from 512 to 65536)",
      // to do:
      // --sql to output sql statements
      // --append: append to existing db
@@ -711,6 +1288,16 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *zs
         opts.db_fn = (char *)argv[i]; // we won't free this
     } else if(!strcmp(argv[i], "--overwrite")) {
       opts.overwrite = 1;
+    } else if(!strcmp(argv[i], "--page-size")) {
+      int n = ++i < argc ? atoi(argv[i]) : 0;
+      if(n < 512 || n > 65536 || (n & (n - 1)))
+        fprintf(stderr, "%s option requires a power of 2 from 512 to 65536\n", argv[i-1]), err = 1;
+      else
+        opts.page_size = n;
+    } else if(!strcmp(argv[i], "--csv")) {
+      input_format = zsv_2db_input_format_csv;
+    } else if(!strcmp(argv[i], "--json")) {
+      input_format = zsv_2db_input_format_json;
     } else if(!strcmp(argv[i], "--table")) {
       if(++i >= argc)
         fprintf(stderr, "%s option requires a filename value\n", argv[i-1]), err = 1;
@@ -721,10 +1308,10 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *zs
         opts.table_name = (char *)argv[i]; // we won't free this
     } else if(f_in)
       fprintf(stderr, "Input file specified more than once\n"), err = 1;
-    else if(!(f_in = fopen(argv[i], "rb")))
+    else if(!(f_in = zsv_input_open(argv[i])))
       fprintf(stderr, "Unable to open for reading: %s\n", argv[i]), err = 1;
-    else if(!(strlen(argv[i]) > 5 && !zsv_stricmp((const unsigned char *)argv[i] + strlen(argv[i]) - 5, (const unsigned char *)".json")))
-      fprintf(stderr, "Warning: input filename does not end with .json (%s)\n", argv[i]);
+    else
+      input_path = argv[i];
   }
 
   if(!f_in) {
@@ -736,11 +1323,27 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *zs
 #endif
   }
 
+  if(!err && input_format == zsv_2db_input_format_auto) {
+    if(input_path && strlen(input_path) > 5
+       && !zsv_stricmp((const unsigned char *)input_path + strlen(input_path) - 5, (const unsigned char *)".json"))
+      input_format = zsv_2db_input_format_json;
+    else { // peek at the first byte
+      int c = getc(f_in);
+      if(c != EOF)
+        ungetc(c, f_in);
+      input_format = c == '[' ? zsv_2db_input_format_json : zsv_2db_input_format_csv;
+    }
+  }
+
   if(!err) {
     zsv_2db_handle data = zsv_2db_new(&opts);
     if(!data)
       err = 1;
-    else {
+    else if(input_format == zsv_2db_input_format_csv) {
+      if(zsv_2db_load_csv(data, f_in, input_path, zsv_opts, opts_used) || zsv_2db_finish(data))
+        err = 1;
+      zsv_2db_delete(data);
+    } else {
       size_t chunk_size = 4096*16;
       unsigned char *buff = malloc(chunk_size);
       if(!buff)
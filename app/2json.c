@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <jsonwriter.h>
 #include <sqlite3.h>
 
@@ -14,16 +15,271 @@
 #include "zsv_command.h"
 
 #include <zsv/utils/writer.h>
+#include <zsv/utils/compress.h>
 #include <zsv/utils/mem.h>
 #include <zsv/utils/db.h>
+#include <zsv/utils/blockpool.h>
+#include <zsv/utils/vector.h>
 
 struct zsv_2json_header {
   struct zsv_2json_header *next;
   char *name;
+  unsigned char *key; // pre-rendered output for this key, including indentation
+  size_t key_len;
 };
 
 #define LQ_2JSON_MAX_INDEXES 32
 
+/*
+ * Data rows are not written through jsonwriter. Instead, each row is rendered
+ * straight into a large output buffer, using pre-rendered fragments for the
+ * indentation and (with --object) for each escaped key. Output is identical
+ * to what jsonwriter would produce
+ */
+#define ZSV_2JSON_BUFF_SIZE (1024 * 1024)
+
+struct zsv_2json_buff {
+  unsigned char *buff;
+  size_t used;
+  size_t size;
+  // if write is NULL, the buffer grows as needed instead of being flushed
+  size_t (*write)(const void *restrict, size_t, size_t, void *restrict);
+  void *stream;
+  char err;
+};
+
+static void zsv_2json_flush(struct zsv_2json_buff *b) {
+  if(b->used && b->write)
+    b->write(b->buff, b->used, 1, b->stream);
+  b->used = 0;
+}
+
+// make room for n more bytes. returns 0 if there is no room even after flushing
+static int zsv_2json_reserve(struct zsv_2json_buff *b, size_t n) {
+  if(n + b->used <= b->size)
+    return 1;
+  if(b->write) {
+    zsv_2json_flush(b);
+    return n <= b->size;
+  }
+  size_t new_size = b->size ? b->size * 2 : 4096;
+  while(new_size < b->used + n)
+    new_size *= 2;
+  unsigned char *tmp = realloc(b->buff, new_size);
+  if(!tmp) {
+    b->err = 1;
+    return 0;
+  }
+  b->buff = tmp;
+  b->size = new_size;
+  return 1;
+}
+
+static inline void zsv_2json_write(struct zsv_2json_buff *b, const unsigned char *s, size_t n) {
+  if(VERY_LIKELY(n + b->used <= b->size) || zsv_2json_reserve(b, n)) {
+    memcpy(b->buff + b->used, s, n);
+    b->used += n;
+  } else if(b->write) // n too big, so write directly
+    b->write(s, n, 1, b->stream);
+}
+
+/*
+ * vectorized scan for the bytes that need attention in JSON string output:
+ * double-quote, backslash and control characters, which must be escaped, and
+ * non-ascii bytes, which must be checked for valid UTF8 lead bytes
+ */
+#define ZSV_2JSON_SPECIAL_CHAR(c) ((c) < 32 || (c) >= 128 || (c) == '"' || (c) == '\\')
+
+// return the offset of the first byte that needs attention, or len if none
+static inline size_t zsv_2json_scan(const unsigned char *s, size_t len) {
+  size_t i = 0;
+  if(len >= sizeof(zsv_uc_vector)) {
+    zsv_uc_vector space, high, quote, backslash;
+    memset(&space, ' ', sizeof(space));
+    memset(&high, 127, sizeof(high));
+    memset(&quote, '"', sizeof(quote));
+    memset(&backslash, '\\', sizeof(backslash));
+    for(; i + sizeof(zsv_uc_vector) <= len; i += sizeof(zsv_uc_vector)) {
+      zsv_uc_vector v;
+      memcpy(&v, s + i, sizeof(v));
+      zsv_uc_vector m = (zsv_uc_vector)((v < space) | (v > high) | (v == quote) | (v == backslash));
+      if(zsv_vector_any(m))
+        break; // the scalar loop below will locate the match
+    }
+  }
+  for(; i < len; i++)
+    if(ZSV_2JSON_SPECIAL_CHAR(s[i]))
+      return i;
+  return len;
+}
+
+static inline int zsv_2json_utf8_char_len(unsigned char c) {
+  if(c < 128) return 1;
+  if((c & 224) == 192) return 2;
+  if((c & 240) == 224) return 3;
+  if((c & 248) == 240) return 4;
+  if((c & 252) == 248) return 5;
+  if((c & 254) == 252) return 6;
+  return -1;
+}
+
+/*
+ * write the body of a JSON string, escaped the same way as jsonwriter does:
+ * an invalid UTF8 lead byte is dropped, and a NUL or an incomplete trailing
+ * UTF8 sequence ends the value. Unlike jsonwriter, a lead byte that is not
+ * followed by the continuation bytes it requires is also dropped, so that a
+ * control character or quote can never be copied unescaped into the output
+ */
+static void zsv_2json_write_escaped(struct zsv_2json_buff *b, const unsigned char *s, size_t len) {
+  while(len) {
+    size_t run = zsv_2json_scan(s, len);
+    zsv_2json_write(b, s, run);
+    s += run;
+    len -= run;
+    if(!len)
+      break;
+
+    unsigned char c = *s;
+    if(c >= 128) {
+      int char_len = zsv_2json_utf8_char_len(c);
+      if(char_len < 0)
+        char_len = 1;
+      else if((size_t)char_len > len)
+        break;
+      else {
+        for(int i = 1; i < char_len; i++)
+          if((s[i] & 192) != 128) {
+            char_len = 1;
+            break;
+          }
+        if(char_len > 1)
+          zsv_2json_write(b, s, char_len);
+      }
+      s += char_len;
+      len -= char_len;
+      continue;
+    }
+    if(!c)
+      break;
+
+    unsigned char esc[6] = { '\\', c };
+    size_t esc_len = 2;
+    switch(c) {
+    case '"':
+    case '\\':
+      break;
+    case '\b': esc[1] = 'b'; break;
+    case '\f': esc[1] = 'f'; break;
+    case '\n': esc[1] = 'n'; break;
+    case '\r': esc[1] = 'r'; break;
+    case '\t': esc[1] = 't'; break;
+    default:
+      esc[1] = 'u';
+      esc[2] = esc[3] = '0';
+      esc[4] = "0123456789abcdef"[c >> 4];
+      esc[5] = "0123456789abcdef"[c & 15];
+      esc_len = 6;
+    }
+    zsv_2json_write(b, esc, esc_len);
+    s++;
+    len--;
+  }
+}
+
+static inline void zsv_2json_write_str(struct zsv_2json_buff *b, const unsigned char *s, size_t len,
+                                       char no_escape) {
+  if(VERY_LIKELY(no_escape) && (len + 2 + b->used <= b->size || zsv_2json_reserve(b, len + 2))) {
+    unsigned char *p = b->buff + b->used;
+    *p = '"';
+    memcpy(p + 1, s, len);
+    p[len + 1] = '"';
+    b->used += len + 2;
+  } else {
+    zsv_2json_write(b, (const unsigned char *)"\"", 1);
+    zsv_2json_write_escaped(b, s, len);
+    zsv_2json_write(b, (const unsigned char *)"\"", 1);
+  }
+}
+
+// the fixed parts of each data row's output
+struct zsv_2json_format {
+  unsigned char row_prefix[16];  // if not compact, newline and indentation of each row
+  size_t row_prefix_len;
+  unsigned char cell_prefix[16]; // if not compact, newline and indentation of each value
+  size_t cell_prefix_len;
+  unsigned char row_open;
+  unsigned char row_close;
+  char object;   // ZSV_JSON_SCHEMA_OBJECT: each row is an object keyed by the header names
+  char no_empty;
+  char lines;    // --jsonl: each row is output on its own line, with no enclosing array
+};
+
+/*
+ * JSON rows in a data array are output in the form `[,]{prefix}{open}{cells}{prefix}{close}`
+ * or, with --jsonl, `{open}{cells}{close}\n`
+ */
+static inline void zsv_2json_row_start(struct zsv_2json_buff *out, const struct zsv_2json_format *fmt,
+                                       char first) {
+  if(!first && !fmt->lines)
+    zsv_2json_write(out, (const unsigned char *)",", 1);
+  zsv_2json_write(out, fmt->row_prefix, fmt->row_prefix_len);
+  zsv_2json_write(out, &fmt->row_open, 1);
+}
+
+/*
+ * write the i-th cell of a row. In object mode, h is the cell's header (or
+ * NULL if the row has more cells than the header), and *written tracks the
+ * number of properties written so far
+ */
+static inline void zsv_2json_row_cell(struct zsv_2json_buff *out, const struct zsv_2json_format *fmt,
+                                      const struct zsv_2json_header *h, unsigned i, unsigned *written,
+                                      const unsigned char *s, size_t len, char no_escape) {
+  if(fmt->object) {
+    if(!h || (!len && fmt->no_empty))
+      return;
+    if((*written)++)
+      zsv_2json_write(out, (const unsigned char *)",", 1);
+    zsv_2json_write(out, h->key, h->key_len);
+  } else {
+    if(i)
+      zsv_2json_write(out, (const unsigned char *)",", 1);
+    zsv_2json_write(out, fmt->cell_prefix, fmt->cell_prefix_len);
+  }
+  zsv_2json_write_str(out, s, len, no_escape);
+}
+
+static inline void zsv_2json_row_end(struct zsv_2json_buff *out, const struct zsv_2json_format *fmt) {
+  zsv_2json_write(out, fmt->row_prefix, fmt->row_prefix_len);
+  zsv_2json_write(out, &fmt->row_close, 1);
+  if(fmt->lines)
+    zsv_2json_write(out, (const unsigned char *)"\n", 1);
+}
+
+#ifndef NO_THREADING
+/*
+ * parallel mode: the parser thread copies data rows into a zsv_blockpool,
+ * worker threads render each block into its own JSON buffer, and the parser
+ * thread writes rendered blocks in order
+ */
+#define ZSV_2JSON_BLOCK_SIZE (256 * 1024)
+#define ZSV_2JSON_MAX_THREADS 64
+
+struct zsv_2json_block {
+  struct zsv_block rows; // must be first
+  size_t first_row; // number of data rows output before this block
+  struct zsv_2json_buff out; // grows as needed
+};
+
+struct zsv_2json_parallel {
+  zsv_blockpool pool;
+
+  // read-only while workers are running
+  struct zsv_2json_format fmt;
+  const struct zsv_2json_header *headers;
+};
+#endif
+
+
 struct zsv_2json_data {
   zsv_parser parser;
   jsonwriter_handle jsw;
@@ -36,11 +292,18 @@ struct zsv_2json_data {
     unsigned count;
   } indexes;
 
-  struct zsv_2json_header *headers, *current_header;
+  struct zsv_2json_header *headers;
   struct zsv_2json_header **headers_next;
 
   char *db_tablename;
 
+  struct zsv_2json_buff out; // data rows are rendered here instead of via jsw
+  struct zsv_2json_format fmt;
+  size_t rows_emitted; // number of items written so far to the array that holds the data rows
+#ifndef NO_THREADING
+  struct zsv_2json_parallel *parallel;
+#endif
+
 #define ZSV_JSON_SCHEMA_OBJECT 1
 #define ZSV_JSON_SCHEMA_DATABASE 2
   unsigned char schema:2;
@@ -49,7 +312,8 @@ struct zsv_2json_data {
   unsigned char err:1;
   unsigned char from_db:1;
   unsigned char compact:1;
-  unsigned char _:1;
+  unsigned char direct:1; // set once output has switched from jsw to out
+  unsigned char jsonl:1;  // newline-delimited output; jsw is not used
 };
 
 static void zsv_2json_cleanup(struct zsv_2json_data *data) {
@@ -57,6 +321,7 @@ static void zsv_2json_cleanup(struct zsv_2json_data *data) {
     next = h->next;
     if(h->name)
       free(h->name);
+    free(h->key);
     free(h);
   }
   free(data->db_tablename);
@@ -75,6 +340,20 @@ static void write_header_cell(struct zsv_2json_data *data, const unsigned char *
         memcpy(h->name, utf8_value, len);
         h->name[len] = '\0';
       }
+
+      struct zsv_2json_buff key = { 0 };
+      zsv_2json_write(&key, data->fmt.cell_prefix, data->fmt.cell_prefix_len);
+      zsv_2json_write_str(&key, utf8_value, len, 0);
+      if(data->compact)
+        zsv_2json_write(&key, (const unsigned char *)":", 1);
+      else
+        zsv_2json_write(&key, (const unsigned char *)": ", 2);
+      if(key.err || !h->name) {
+        fprintf(stderr, "Out of memory!\n");
+        data->err = 1;
+      }
+      h->key = key.buff;
+      h->key_len = key.used;
     }
   } else {
     // to do: add options to set data type, etc
@@ -85,19 +364,169 @@ static void write_header_cell(struct zsv_2json_data *data, const unsigned char *
   }
 }
 
-static void write_data_cell(struct zsv_2json_data *data, const unsigned char *utf8_value, size_t len) {
-  if(data->schema == ZSV_JSON_SCHEMA_OBJECT) {
-    if(!data->current_header)
-      return;
-    char *current_header_name = data->current_header->name;
-    data->current_header = data->current_header->next;
+static void zsv_2json_set_format(struct zsv_2json_data *data) {
+  struct zsv_2json_format *fmt = &data->fmt;
+  unsigned depth = data->schema == ZSV_JSON_SCHEMA_DATABASE ? 2 : 1; // depth of each row
+  if(!data->compact) {
+    fmt->row_prefix[0] = fmt->cell_prefix[0] = '\n';
+    fmt->row_prefix_len = 1 + depth * 2;
+    fmt->cell_prefix_len = 1 + (depth + 1) * 2;
+    memset(fmt->row_prefix + 1, ' ', fmt->row_prefix_len - 1);
+    memset(fmt->cell_prefix + 1, ' ', fmt->cell_prefix_len - 1);
+  }
+  fmt->object = data->schema == ZSV_JSON_SCHEMA_OBJECT;
+  fmt->no_empty = data->no_empty;
+  fmt->lines = data->jsonl;
+  fmt->row_open = fmt->object ? '{' : '[';
+  fmt->row_close = fmt->object ? '}' : ']';
+}
 
-    if(len || !data->no_empty)
-      jsonwriter_object_key(data->jsw, current_header_name);
-    else
-      return;
+// render a data row directly into the output buffer
+static void zsv_2json_data_row(struct zsv_2json_data *data, unsigned int cols) {
+  struct zsv_2json_buff *out = &data->out;
+  const struct zsv_2json_format *fmt = &data->fmt;
+
+  // one scan of the row's span usually shows that no cell needs escaping
+  struct zsv_cell first = zsv_get_cell(data->parser, 0);
+  struct zsv_cell last = zsv_get_cell(data->parser, cols-1);
+  size_t row_len = last.str + last.len - first.str;
+  char no_escape = zsv_2json_scan(first.str, row_len) == row_len;
+
+  zsv_2json_row_start(out, fmt, !data->rows_emitted++);
+  const struct zsv_2json_header *h = data->headers;
+  unsigned written = 0;
+  for(unsigned int i = 0; i < cols; i++) {
+    struct zsv_cell cell = zsv_get_cell(data->parser, i);
+    zsv_2json_row_cell(out, fmt, h, i, &written, cell.str, cell.len, no_escape);
+    if(h)
+      h = h->next;
+  }
+  zsv_2json_row_end(out, fmt);
+}
+
+#ifndef NO_THREADING
+static int zsv_2json_convert_block(void *ctx, unsigned worker, struct zsv_block *rows) {
+  const struct zsv_2json_parallel *par = ctx;
+  const struct zsv_2json_format *fmt = &par->fmt;
+  struct zsv_2json_block *b = (struct zsv_2json_block *)rows;
+  (void)(worker);
+  b->out.used = 0;
+  for(size_t r = 0, c = 0; r < rows->row_count; r++) {
+    size_t row_start = c, row_end = rows->row_ends[r];
+    const struct zsv_block_cell *first = &rows->cells[row_start], *last = &rows->cells[row_end - 1];
+    const unsigned char *start = rows->raw + first->offset;
+    size_t row_len = last->offset + last->len - first->offset;
+    char no_escape = zsv_2json_scan(start, row_len) == row_len;
+
+    zsv_2json_row_start(&b->out, fmt, b->first_row + r == 0);
+    const struct zsv_2json_header *h = par->headers;
+    unsigned written = 0;
+    for(; c < row_end; c++) {
+      zsv_2json_row_cell(&b->out, fmt, h, (unsigned)(c - row_start), &written,
+                         rows->raw + rows->cells[c].offset, rows->cells[c].len, no_escape);
+      if(h)
+        h = h->next;
+    }
+    zsv_2json_row_end(&b->out, fmt);
+  }
+  return 0;
+}
+
+/*
+ * wait for the oldest outstanding block to be converted, then write it
+ * Returns 0 if there was no such block
+ */
+static int zsv_2json_write_next_block(struct zsv_2json_data *data) {
+  struct zsv_2json_block *b = (struct zsv_2json_block *)zsv_blockpool_next(data->parallel->pool);
+  if(!b)
+    return 0;
+  if(VERY_UNLIKELY(b->out.err)) {
+    if(!data->err)
+      fprintf(stderr, "Out of memory!\n");
+    data->err = 1;
+  } else if(b->out.used) // in parallel mode, data->out.buff holds no data rows, so write directly
+    data->out.write(b->out.buff, b->out.used, 1, data->out.stream);
+  zsv_blockpool_release(data->parallel->pool, &b->rows);
+  return 1;
+}
+
+// hand the block being filled to the workers, and make the next block available for filling
+static void zsv_2json_submit_block(struct zsv_2json_data *data, struct zsv_2json_block *b) {
+  b->first_row = data->rows_emitted;
+  data->rows_emitted += b->rows.row_count;
+
+  zsv_blockpool_submit(data->parallel->pool);
+  if(zsv_blockpool_full(data->parallel->pool)) // all blocks are in use: wait for the oldest and write it
+    zsv_2json_write_next_block(data);
+}
+
+// copy a data row into the block being filled
+static void zsv_2json_data_row_parallel(struct zsv_2json_data *data, unsigned int cols) {
+  struct zsv_2json_block *b = (struct zsv_2json_block *)zsv_blockpool_fill_block(data->parallel->pool);
+  if(zsv_block_add_row(&b->rows, data->parser, cols, 0)) {
+    fprintf(stderr, "Out of memory!\n");
+    data->err = 1;
+    return;
+  }
+  if(b->rows.raw_len >= ZSV_2JSON_BLOCK_SIZE)
+    zsv_2json_submit_block(data, b);
+}
+
+static void zsv_2json_free_block(struct zsv_block *rows) {
+  free(((struct zsv_2json_block *)rows)->out.buff);
+}
+
+static void zsv_2json_parallel_delete(struct zsv_2json_parallel *par) {
+  if(par) {
+    zsv_blockpool_delete(par->pool);
+    free(par);
+  }
+}
+
+static struct zsv_2json_parallel *zsv_2json_parallel_new(unsigned thread_count) {
+  struct zsv_2json_parallel *par = calloc(1, sizeof(*par));
+  if(!par)
+    return NULL;
+  struct zsv_blockpool_opts opts = { 0 };
+  opts.block_size = sizeof(struct zsv_2json_block);
+  opts.block_count = thread_count * 2;
+  opts.process = zsv_2json_convert_block;
+  opts.ctx = par;
+  opts.worker_count = thread_count;
+  opts.ordered = 1;
+  opts.free_block = zsv_2json_free_block;
+  if(!(par->pool = zsv_blockpool_new(&opts))) {
+    free(par);
+    return NULL;
+  }
+  return par;
+}
+
+// convert and write any data rows that have not yet been output
+static void zsv_2json_parallel_finish(struct zsv_2json_data *data) {
+  struct zsv_2json_block *b = (struct zsv_2json_block *)zsv_blockpool_fill_block(data->parallel->pool);
+  if(b->rows.row_count)
+    zsv_2json_submit_block(data, b);
+  zsv_blockpool_finish(data->parallel->pool);
+  while(zsv_2json_write_next_block(data))
+    ;
+}
+#endif
+
+// with --jsonl, output the header row in the default schema (an array of column objects) as the first line
+static void zsv_2json_header_line(struct zsv_2json_data *data, unsigned int cols) {
+  struct zsv_2json_buff *out = &data->out;
+  zsv_2json_write(out, (const unsigned char *)"[", 1);
+  for(unsigned int i = 0; i < cols; i++) {
+    struct zsv_cell cell = zsv_get_cell(data->parser, i);
+    if(i)
+      zsv_2json_write(out, (const unsigned char *)",", 1);
+    zsv_2json_write(out, (const unsigned char *)"{\"name\":", 8);
+    zsv_2json_write_str(out, cell.str, cell.len, 0);
+    zsv_2json_write(out, (const unsigned char *)"}", 1);
   }
-  jsonwriter_strn(data->jsw, utf8_value, len);
+  zsv_2json_write(out, (const unsigned char *)"]\n", 2);
+  zsv_2json_flush(out); // in parallel mode, data rows are written without going through out
 }
 
 static char *zsv_2json_db_first_tname(sqlite3 *db) {
@@ -124,75 +553,95 @@ static void zsv_2json_row(void *ctx) {
   if(cols) {
     char obj = 0;
     char arr = 0;
-    if(!data->rows_processed) { // header row
+    if(!data->rows_processed && data->jsw) // header row
       jsonwriter_start_array(data->jsw); // start array of rows
-      if(data->schema == ZSV_JSON_SCHEMA_DATABASE) {
-        jsonwriter_start_object(data->jsw); // start this row
-        obj = 1;
-
-        if(data->db_tablename)
-          jsonwriter_object_cstr(data->jsw, "name", data->db_tablename);
-
-        // to do: check index syntax (as of now, we just take argument value
-        // as-is and assume it will translate into a valid SQLITE3 command)
-        char have_index = 0;
-        for(unsigned i = 0; i < data->indexes.count; i++) {
-          const char *name_start = data->indexes.clauses[i];
-          const char *on = strstr(name_start, " on ");
-          if(on) {
-            on += 4;
-            while(*on == ' ')
-              on++;
-          }
-          if(!on || !*on)
-            continue;
-
-          const char *name_end = name_start;
-          while(name_end && *name_end && *name_end != ' ')
-            name_end++;
-
-          if(name_end > name_start) {
-            if(!have_index) {
-              have_index = 1;
-              jsonwriter_object_object(data->jsw, "indexes");
-            }
-            char *tmp = zsv_memdup(name_start, name_end - name_start);
-            jsonwriter_object_object(data->jsw, tmp); // this index
-            free(tmp);
-            jsonwriter_object_cstr(data->jsw, "on", on);
-            if(data->indexes.unique[i])
-              jsonwriter_object_bool(data->jsw, "unique", 1);
-            jsonwriter_end_object(data->jsw); // end this index
-          }
+    if(data->rows_processed || data->no_header) { // processing a data row
+      if(!data->direct) { // switch output from jsw to the direct output buffer
+        if(data->jsw) {
+          if(data->schema == ZSV_JSON_SCHEMA_DATABASE)
+            jsonwriter_start_array(data->jsw); // start the table-data element
+          jsonwriter_flush(data->jsw);
         }
-        if(have_index)
-          jsonwriter_end_object(data->jsw); // indexes
-
-        jsonwriter_object_array(data->jsw, "columns");
-        arr = 1;
-      } else if(data->schema != ZSV_JSON_SCHEMA_OBJECT) {
-        jsonwriter_start_array(data->jsw); // start this row
-        arr = 1;
+        data->direct = 1;
+#ifndef NO_THREADING
+        if(data->parallel) {
+          // headers are complete and the format is set, so workers can now use them
+          data->parallel->fmt = data->fmt;
+          data->parallel->headers = data->headers;
+        }
+#endif
       }
-    } else { // processing a data row, not header row
-      if(data->schema == ZSV_JSON_SCHEMA_OBJECT) {
-        jsonwriter_start_object(data->jsw); // start this row
-        obj = 1;
-      } else {
-        if(data->rows_processed == 1 && data->schema == ZSV_JSON_SCHEMA_DATABASE)
-          jsonwriter_start_array(data->jsw); // start the table-data element
-        jsonwriter_start_array(data->jsw); // start this row
-        arr = 1;
+#ifndef NO_THREADING
+      if(data->parallel)
+        zsv_2json_data_row_parallel(data, cols);
+      else
+#endif
+        zsv_2json_data_row(data, cols);
+      if(VERY_UNLIKELY(data->out.err))
+        data->err = 1;
+      data->rows_processed++;
+      return;
+    }
+
+    // header row
+    if(data->jsonl && data->schema != ZSV_JSON_SCHEMA_OBJECT) {
+      zsv_2json_header_line(data, cols);
+      data->rows_processed++;
+      return;
+    }
+    if(data->schema == ZSV_JSON_SCHEMA_DATABASE) {
+      jsonwriter_start_object(data->jsw); // start this row
+      obj = 1;
+
+      if(data->db_tablename)
+        jsonwriter_object_cstr(data->jsw, "name", data->db_tablename);
+
+      // to do: check index syntax (as of now, we just take argument value
+      // as-is and assume it will translate into a valid SQLITE3 command)
+      char have_index = 0;
+      for(unsigned i = 0; i < data->indexes.count; i++) {
+        const char *name_start = data->indexes.clauses[i];
+        const char *on = strstr(name_start, " on ");
+        if(on) {
+          on += 4;
+          while(*on == ' ')
+            on++;
+        }
+        if(!on || !*on)
+          continue;
+
+        const char *name_end = name_start;
+        while(name_end && *name_end && *name_end != ' ')
+          name_end++;
+
+        if(name_end > name_start) {
+          if(!have_index) {
+            have_index = 1;
+            jsonwriter_object_object(data->jsw, "indexes");
+          }
+          char *tmp = zsv_memdup(name_start, name_end - name_start);
+          jsonwriter_object_object(data->jsw, tmp); // this index
+          free(tmp);
+          jsonwriter_object_cstr(data->jsw, "on", on);
+          if(data->indexes.unique[i])
+            jsonwriter_object_bool(data->jsw, "unique", 1);
+          jsonwriter_end_object(data->jsw); // end this index
+        }
       }
+      if(have_index)
+        jsonwriter_end_object(data->jsw); // indexes
+
+      jsonwriter_object_array(data->jsw, "columns");
+      arr = 1;
+    } else if(data->schema != ZSV_JSON_SCHEMA_OBJECT) {
+      jsonwriter_start_array(data->jsw); // start this row
+      arr = 1;
+      data->rows_emitted = 1; // data rows follow the header row
     }
 
     for(unsigned int i = 0; i < cols; i++) {
       struct zsv_cell cell = zsv_get_cell(data->parser, i);
-      // output this cell
-      if(!data->rows_processed && !data->no_header) // this is header row
-        write_header_cell(data, cell.str, cell.len);
-      else
-        write_data_cell(data, cell.str, cell.len);
+      write_header_cell(data, cell.str, cell.len);
     }
 
     // end this row
@@ -202,7 +651,6 @@ static void zsv_2json_row(void *ctx) {
       jsonwriter_end_object(data->jsw);
     data->rows_processed++;
   }
-  data->current_header = data->headers;
 }
 
 static int zsv_db2json(const char *input_filename, char **tname, jsonwriter_handle jsw) {
@@ -238,8 +686,9 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
      "",
      "Options:",
      "  -h, --help",
-     "  -o, --output <filename>       : output to specified filename",
+     "  -o, --output <filename>       : output to specified filename (compressed if it ends in .gz or .zst)",
      "  --compact                     : output compact JSON",
+     "  --jsonl, --ndjson             : output each row as compact JSON on its own line, with no enclosing array",
      "  --from-db                     : input is sqlite3 database",
      "  --db-table <table_name>       : name of table in input database to convert",
      "  --object                      : output as array of objects",
@@ -248,11 +697,13 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
      "  --no-header                   : treat the header row as a data row",
      "  --index <name on expr>        : add index to database schema",
      "  --unique-index <name on expr> : add unique index to database schema",
+     "  --threads <n>                 : render rows in n worker threads, in parallel with parsing",
      NULL
     };
 
-  FILE *out = NULL;
+  zsv_output_sink out = NULL;
   const char *input_path = NULL;
+  unsigned thread_count = 1;
   enum zsv_status err = zsv_status_ok;
 
   for(int i = 1; !err && i < argc; i++) {
@@ -263,10 +714,10 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     } else if(!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
       if(++i >= argc)
         fprintf(stderr, "%s option requires a filename value\n", argv[i-1]), err = zsv_status_error;
-      else if(out && out != stdout)
+      else if(out)
         fprintf(stderr, "Output file specified more than once\n"), err = zsv_status_error;
-      else if(!(out = fopen(argv[i], "wb")))
-        fprintf(stderr, "Unable to open for writing: %s\n", argv[i]), err = zsv_status_error;
+      else if(!(out = zsv_output_sink_open(argv[i])))
+        err = zsv_status_error;
     } else if(!strcmp(argv[i], "--index") || !strcmp(argv[i], "--unique-index")) {
       if(++i >= argc)
         fprintf(stderr, "%s option requires a filename value\n", argv[i-1]), err = zsv_status_error;
@@ -293,7 +744,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         fprintf(stderr, "%s option requires a filename value\n", argv[i-1]), err = zsv_status_error;
       else if(opts->stream)
         fprintf(stderr, "Input file specified more than once\n"), err = zsv_status_error;
-      else if(!(opts->stream = fopen(argv[i], "rb")))
+      else if(!(opts->stream = zsv_input_open(argv[i])))
         fprintf(stderr, "Unable to open for reading: %s\n", argv[i]), err = zsv_status_error;
       else {
         input_path = argv[i];
@@ -306,14 +757,21 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         data.schema = ZSV_JSON_SCHEMA_DATABASE;
       else
         data.schema = ZSV_JSON_SCHEMA_OBJECT;
+    } else if(!strcmp(argv[i], "--threads")) {
+      if(++i >= argc || atoi(argv[i]) < 1)
+        fprintf(stderr, "%s option requires a positive integer value\n", argv[i-1]), err = zsv_status_error;
+      else
+        thread_count = (unsigned)atoi(argv[i]);
     } else if(!strcmp(argv[i], "--no-header"))
       data.no_header = 1;
     else if(!strcmp(argv[i], "--compact"))
       data.compact = 1;
+    else if(!strcmp(argv[i], "--jsonl") || !strcmp(argv[i], "--ndjson"))
+      data.jsonl = 1;
     else {
       if(opts->stream)
         fprintf(stderr, "Input file specified more than once\n"), err = zsv_status_error;
-      else if(!(opts->stream = fopen(argv[i], "rb")))
+      else if(!(opts->stream = zsv_input_open(argv[i])))
         fprintf(stderr, "Unable to open for reading: %s\n", argv[i]), err = zsv_status_error;
       else
         input_path = argv[i];
@@ -328,6 +786,8 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     fprintf(stderr, "--no-header cannot be used together with --object or --database\n"), err = zsv_status_error;
   else if(data.no_empty && data.schema != ZSV_JSON_SCHEMA_OBJECT)
     fprintf(stderr, "--no-empty can only be used with --object\n"), err = zsv_status_error;
+  else if(data.jsonl && (data.schema == ZSV_JSON_SCHEMA_DATABASE || data.from_db))
+    fprintf(stderr, "--jsonl cannot be used together with --database or --from-db\n"), err = zsv_status_error;
   else if(!opts->stream) {
     if(data.from_db)
       fprintf(stderr, "Database input specified, but no input file provided\n"), err = zsv_status_error;
@@ -341,13 +801,26 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
   }
 
   if(!err) {
-    if(!out)
-      out = stdout;
-    if(!(data.jsw = jsonwriter_new(out)))
+    if(data.jsonl)
+      data.compact = 1;
+    else if(out)
+      data.jsw = jsonwriter_new_stream(zsv_output_sink_write, out);
+    else
+      data.jsw = jsonwriter_new(stdout);
+    if((!data.jsw && !data.jsonl) || !(data.out.buff = malloc(ZSV_2JSON_BUFF_SIZE)))
       err = zsv_status_error;
     else {
-      if(data.compact)
+      data.out.size = ZSV_2JSON_BUFF_SIZE;
+      if(out) {
+        data.out.write = zsv_output_sink_write;
+        data.out.stream = out;
+      } else {
+        data.out.write = (size_t (*)(const void *restrict, size_t, size_t, void *restrict))fwrite;
+        data.out.stream = stdout;
+      }
+      if(data.compact && data.jsw)
         jsonwriter_set_option(data.jsw, jsonwriter_option_compact);
+      zsv_2json_set_format(&data);
       if(data.from_db) {
         if(opts->stream != stdin) {
           fclose(opts->stream);
@@ -357,26 +830,50 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       } else {
         opts->row_handler = zsv_2json_row;
         opts->ctx = &data;
+#ifndef NO_THREADING
+        if(thread_count > 1) {
+          if(thread_count > ZSV_2JSON_MAX_THREADS)
+            thread_count = ZSV_2JSON_MAX_THREADS;
+          data.parallel = zsv_2json_parallel_new(thread_count);
+        }
+#else
+        if(thread_count > 1)
+          fprintf(stderr, "Warning: --threads is not supported in this build and will be ignored\n");
+#endif
         if(zsv_new_with_properties(opts, input_path, opts_used, &data.parser) == zsv_status_ok) {
           zsv_handle_ctrl_c_signal();
+          enum zsv_status status = zsv_status_ok;
           while(!data.err
                 && !zsv_signal_interrupted
-                && zsv_parse_more(data.parser) == zsv_status_ok)
+                && (status = zsv_parse_more(data.parser)) == zsv_status_ok)
             ;
+          if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+            data.err = 1;
           zsv_finish(data.parser);
           zsv_delete(data.parser);
-          jsonwriter_end_all(data.jsw);
+#ifndef NO_THREADING
+          if(data.parallel && !data.err)
+            zsv_2json_parallel_finish(&data);
+#endif
+          zsv_2json_flush(&data.out);
+          if(data.jsw)
+            jsonwriter_end_all(data.jsw);
         }
         err = data.err;
       }
     }
-    jsonwriter_delete(data.jsw);
+#ifndef NO_THREADING
+    zsv_2json_parallel_delete(data.parallel);
+#endif
+    if(data.jsw)
+      jsonwriter_delete(data.jsw);
+    free(data.out.buff);
   }
 
   zsv_2json_cleanup(&data);
   if(opts->stream && opts->stream != stdin)
     fclose(opts->stream);
-  if(out && out != stdout)
-    fclose(out);
+  if(zsv_output_sink_close(out) && !err)
+    err = zsv_status_error;
   return err;
 }
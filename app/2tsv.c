@@ -9,40 +9,63 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #define ZSV_COMMAND 2tsv
 #include "zsv_command.h"
 
 #include <zsv/utils/utf8.h>
+#include <zsv/utils/compress.h>
+#include <zsv/utils/blockpool.h>
+#include <zsv/utils/vector.h>
 
-enum zsv_2tsv_status {
-  zsv_2tsv_status_ok = 0,
-  zsv_2tsv_status_out_of_memory
-};
-
-#define ZSV_2TSV_BUFF_SIZE 65536
+#define ZSV_2TSV_BUFF_SIZE (1024 * 1024)
 
 struct static_buff {
-  char *buff; // will be ZSV_2TSV_BUFF_SIZE
+  unsigned char *buff;
+  size_t size;
   size_t used;
-  FILE *stream;
+  size_t (*write)(const void *restrict, size_t, size_t, void *restrict);
+  void *stream;
 };
 
+#ifndef NO_THREADING
+/*
+ * parallel mode: the parser thread copies rows into a zsv_blockpool, worker
+ * threads convert each block to TSV, and the parser thread writes converted
+ * blocks in order
+ */
+#define ZSV_2TSV_BLOCK_SIZE (256 * 1024)
+#define ZSV_2TSV_MAX_THREADS 64
+
+struct zsv_2tsv_block {
+  struct zsv_block rows; // must be first
+  struct static_buff out;
+  size_t out_cap;
+};
+#endif
+
 struct zsv_2tsv_data {
   zsv_parser parser;
   struct static_buff out;
+  zsv_output_sink sink; // set if -o was specified
+#ifndef NO_THREADING
+  zsv_blockpool pool;
+#endif
+  char tab_delimited; // if the input delimiter is tab, cells must be scanned individually
+  char err;
 };
 
 __attribute__((always_inline)) static inline void zsv_2tsv_flush(struct static_buff *b) {
-  fwrite(b->buff, b->used, 1, b->stream);
+  b->write(b->buff, b->used, 1, b->stream);
   b->used = 0;
 }
 
 static inline void zsv_2tsv_write(struct static_buff *b, const unsigned char *s, size_t n) {
   if(n) {
-    if(VERY_UNLIKELY(n + b->used > ZSV_2TSV_BUFF_SIZE)) {
+    if(VERY_UNLIKELY(n + b->used > b->size)) {
       zsv_2tsv_flush(b);
-      if(VERY_UNLIKELY(n > ZSV_2TSV_BUFF_SIZE)) { // n too big, so write directly
-        fwrite(s, n, 1, b->stream);
+      if(VERY_UNLIKELY(n > b->size)) { // n too big, so write directly
+        b->write(s, n, 1, b->stream);
         return;
       }
     }
@@ -52,88 +75,181 @@ static inline void zsv_2tsv_write(struct static_buff *b, const unsigned char *s,
   }
 }
 
-// zsv_to_tsv(): convert, if necessary, to text suitable for tab-delimited output.
-// - return NULL if nothing to convert
-// - else, return allocated char * of converted tsv (caller must free), and update *lenp
-// - on error, set *err
-__attribute__((always_inline)) static inline
-unsigned char *zsv_to_tsv(const unsigned char *utf8, size_t *len, enum zsv_2tsv_status *err) {
-  // replace tab, newline and lf with \t, \n or \r or backslash
-  size_t do_convert = 0;
-  for(size_t i = 0; i < *len; i++) {
-    if(UNLIKELY(utf8[i] == '\t' || utf8[i] == '\n' || utf8[i] == '\r' || utf8[i] == '\\'))
-      do_convert++;
-  }
-  if(LIKELY(do_convert == 0))
-    return NULL;
-
-  unsigned char *converted = malloc(*len + do_convert + 1);
-  if(!converted)
-    *err = zsv_2tsv_status_out_of_memory;
-  else {
-    size_t j = 0;
-    for(size_t i = 0; i < *len; i++) {
-      if(UNLIKELY(utf8[i] == '\t' || utf8[i] == '\n' || utf8[i] == '\r' || utf8[i] == '\\')) {
-        converted[j++] = '\\';
-        converted[j++] = utf8[i] == '\t' ? 't' : utf8[i] == '\n' ? 'n' : utf8[i] == '\r' ? 'r' : '\\';
-      } else
-        converted[j++] = utf8[i];
+/*
+ * vectorized scan for the bytes that must be escaped in TSV output (tab, LF,
+ * CR and backslash). Multi-byte UTF8 sequences never contain any of these
+ * ascii values, so the scan can operate on raw bytes
+ */
+// return the offset of the first byte that must be escaped, or len if none
+static inline size_t zsv_2tsv_scan(const unsigned char *s, size_t len) {
+  size_t i = 0;
+  if(len >= sizeof(zsv_uc_vector)) {
+    zsv_uc_vector tab, lf, cr, backslash;
+    memset(&tab, '\t', sizeof(tab));
+    memset(&lf, '\n', sizeof(lf));
+    memset(&cr, '\r', sizeof(cr));
+    memset(&backslash, '\\', sizeof(backslash));
+    for(; i + sizeof(zsv_uc_vector) <= len; i += sizeof(zsv_uc_vector)) {
+      zsv_uc_vector v;
+      memcpy(&v, s + i, sizeof(v));
+      zsv_uc_vector m = (zsv_uc_vector)((v == tab) | (v == lf) | (v == cr) | (v == backslash));
+      if(zsv_vector_any(m))
+        break; // the scalar loop below will locate the match
     }
-    converted[j] = '\0';
-    *len = j;
   }
-  return converted;
-}
-
-__attribute__((always_inline)) static inline
-void zsv_2tsv_cell(struct zsv_2tsv_data *data, unsigned char *utf8_value, size_t len,
-                   char no_newline_or_slash) {
-  // output cell contents (converted if necessary)
-  if(len) {
-    enum zsv_2tsv_status err = zsv_2tsv_status_ok;
-    if(VERY_LIKELY(no_newline_or_slash && !memchr(utf8_value, '\t', len))) {
-      zsv_2tsv_write(&data->out, utf8_value, len);
-      return;
+  for(; i < len; i++) {
+    switch(s[i]) {
+    case '\t':
+    case '\n':
+    case '\r':
+    case '\\':
+      return i;
     }
+  }
+  return len;
+}
 
-    // if we're here, there either definitely an embedded tab, or maybe an embedded \n or \r
-    unsigned char *converted = zsv_to_tsv(utf8_value, &len, &err);
-    if(converted != NULL) {
-      zsv_2tsv_write(&data->out, converted, len);
-      free(converted);
-    } else if(UNLIKELY(err))
-      fprintf(stderr, "Out of memory!\n");
-    else
-      zsv_2tsv_write(&data->out, utf8_value, len);
+// write a value, escaping tab, newline, CR and backslash as \t, \n, \r or \\ directly into the output buffer
+static void zsv_2tsv_write_escaped(struct static_buff *b, const unsigned char *s, size_t len) {
+  while(len) {
+    size_t run = zsv_2tsv_scan(s, len);
+    zsv_2tsv_write(b, s, run);
+    if(run == len)
+      break;
+    unsigned char c = s[run];
+    unsigned char escaped[2] = { '\\', c == '\t' ? 't' : c == '\n' ? 'n' : c == '\r' ? 'r' : '\\' };
+    zsv_2tsv_write(b, escaped, 2);
+    s += run + 1;
+    len -= run + 1;
   }
 }
 
+static inline void zsv_2tsv_cell(struct static_buff *out, const unsigned char *utf8_value, size_t len,
+                                 char row_needs_no_escape) {
+  if(VERY_LIKELY(row_needs_no_escape))
+    zsv_2tsv_write(out, utf8_value, len);
+  else
+    zsv_2tsv_write_escaped(out, utf8_value, len);
+}
+
+// unless the delimiter is a tab, a single scan of the row's span usually shows that no cell needs escaping
+static inline char zsv_2tsv_row_needs_no_escape(const unsigned char *start, size_t row_len, char tab_delimited) {
+  return !tab_delimited && zsv_2tsv_scan(start, row_len) == row_len;
+}
+
 static void zsv_2tsv_row(void *ctx) {
   struct zsv_2tsv_data *data = ctx;
   unsigned int cols = zsv_cell_count(data->parser);
   if(cols) {
     struct zsv_cell cell = zsv_get_cell(data->parser, 0);
     struct zsv_cell end = zsv_get_cell(data->parser, cols-1);
-    unsigned char *start = cell.str;
-    size_t row_len = end.str + end.len - start;
-    char no_newline_or_slash = 0;
-    if(LIKELY(!(
-                memchr(start, '\n', row_len) ||
-                memchr(start, '\r', row_len) ||
-                memchr(start, '\\', row_len)
-                )))
-      no_newline_or_slash = 1;
-
-    zsv_2tsv_cell(ctx, cell.str, cell.len, no_newline_or_slash);
+    size_t row_len = end.str + end.len - cell.str;
+    char no_escape = zsv_2tsv_row_needs_no_escape(cell.str, row_len, data->tab_delimited);
+
+    zsv_2tsv_cell(&data->out, cell.str, cell.len, no_escape);
     for(unsigned int i = 1; i < cols; i++) {
       zsv_2tsv_write(&data->out, (const unsigned char *)"\t", 1);
       cell = zsv_get_cell(data->parser, i);
-      zsv_2tsv_cell(ctx, cell.str, cell.len, no_newline_or_slash);
+      zsv_2tsv_cell(&data->out, cell.str, cell.len, no_escape);
     }
   }
   zsv_2tsv_write(&data->out, (const unsigned char *) "\n", 1);
 }
 
+#ifndef NO_THREADING
+static int zsv_2tsv_convert_block(void *ctx, unsigned worker, struct zsv_block *rows) {
+  struct zsv_2tsv_data *data = ctx;
+  struct zsv_2tsv_block *b = (struct zsv_2tsv_block *)rows;
+  (void)(worker);
+  // each byte is escaped to at most 2 bytes, plus a tab or newline after each cell / row
+  b->out.used = 0;
+  for(size_t r = 0, c = 0; r < rows->row_count; r++) {
+    size_t row_end = rows->row_ends[r];
+    if(c < row_end) {
+      const struct zsv_block_cell *first = &rows->cells[c], *last = &rows->cells[row_end - 1];
+      const unsigned char *start = rows->raw + first->offset;
+      char no_escape = zsv_2tsv_row_needs_no_escape(start, last->offset + last->len - first->offset,
+                                                     data->tab_delimited);
+      zsv_2tsv_cell(&b->out, start, first->len, no_escape);
+      for(c++; c < row_end; c++) {
+        zsv_2tsv_write(&b->out, (const unsigned char *)"\t", 1);
+        zsv_2tsv_cell(&b->out, rows->raw + rows->cells[c].offset, rows->cells[c].len, no_escape);
+      }
+    }
+    zsv_2tsv_write(&b->out, (const unsigned char *)"\n", 1);
+  }
+  return 0;
+}
+
+// wait for the oldest outstanding block to be converted, then write it. Returns 0 if there was no such block
+static int zsv_2tsv_write_next_block(struct zsv_2tsv_data *data) {
+  struct zsv_2tsv_block *b = (struct zsv_2tsv_block *)zsv_blockpool_next(data->pool);
+  if(!b)
+    return 0;
+  if(b->out.used) // in parallel mode, data->out.buff is unused, so write directly
+    data->out.write(b->out.buff, b->out.used, 1, data->out.stream);
+  zsv_blockpool_release(data->pool, &b->rows);
+  return 1;
+}
+
+// hand the block being filled to the workers, and make the next block available for filling
+static int zsv_2tsv_submit_block(struct zsv_2tsv_data *data, struct zsv_2tsv_block *b) {
+  size_t out_needed = b->rows.raw_len * 2 + b->rows.cell_count + b->rows.row_count;
+  if(out_needed > b->out_cap) {
+    free(b->out.buff);
+    if(!(b->out.buff = malloc(out_needed)))
+      return 1;
+    b->out_cap = out_needed;
+  }
+  b->out.size = b->out_cap;
+
+  zsv_blockpool_submit(data->pool);
+  if(zsv_blockpool_full(data->pool)) // all blocks are in use: wait for the oldest and write it
+    zsv_2tsv_write_next_block(data);
+  return 0;
+}
+
+static void zsv_2tsv_row_parallel(void *ctx) {
+  struct zsv_2tsv_data *data = ctx;
+  if(VERY_UNLIKELY(data->err))
+    return;
+  struct zsv_2tsv_block *b = (struct zsv_2tsv_block *)zsv_blockpool_fill_block(data->pool);
+
+  if(zsv_block_add_row(&b->rows, data->parser, zsv_cell_count(data->parser), 0)
+     || (b->rows.raw_len >= ZSV_2TSV_BLOCK_SIZE && zsv_2tsv_submit_block(data, b))) {
+    fprintf(stderr, "Out of memory!\n");
+    data->err = 1;
+  }
+}
+
+static void zsv_2tsv_free_block(struct zsv_block *rows) {
+  free(((struct zsv_2tsv_block *)rows)->out.buff);
+}
+
+static zsv_blockpool zsv_2tsv_parallel_new(unsigned thread_count, struct zsv_2tsv_data *data) {
+  struct zsv_blockpool_opts opts = { 0 };
+  opts.block_size = sizeof(struct zsv_2tsv_block);
+  opts.block_count = thread_count * 2;
+  opts.process = zsv_2tsv_convert_block;
+  opts.ctx = data;
+  opts.worker_count = thread_count;
+  opts.ordered = 1;
+  opts.free_block = zsv_2tsv_free_block;
+  return zsv_blockpool_new(&opts);
+}
+
+// convert and write any rows that have not yet been output
+static int zsv_2tsv_parallel_finish(struct zsv_2tsv_data *data) {
+  struct zsv_2tsv_block *b = (struct zsv_2tsv_block *)zsv_blockpool_fill_block(data->pool);
+  if(b->rows.row_count && zsv_2tsv_submit_block(data, b))
+    return 1;
+  zsv_blockpool_finish(data->pool);
+  while(zsv_2tsv_write_next_block(data))
+    ;
+  return 0;
+}
+#endif
+
 int zsv_2tsv_usage(int rc) {
   static const char *zsv_2tsv_usage_msg[] =
     {
@@ -141,7 +257,9 @@ int zsv_2tsv_usage(int rc) {
       "       text processing. By default, embedded tabs or multilines will be escaped",
       "       to \\t, \\n or \\r, respectively",
       "",
-      "Usage: " APPNAME " [filename] [-o <output_filename>]",
+      "Usage: " APPNAME " [filename] [-o <output_filename>] [--threads <n>]",
+      "  (output is compressed if output_filename ends in .gz or .zst)",
+      "  --threads <n>: convert rows in n worker threads, in parallel with parsing",
       "  e.g. " APPNAME " < myfile.csv > myfile.tsv",
       NULL
     };
@@ -154,6 +272,7 @@ int zsv_2tsv_usage(int rc) {
 int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *opts, const char *opts_used) {
   struct zsv_2tsv_data data = { 0 };
   const char *input_path = NULL;
+  unsigned thread_count = 1;
   int err = 0;
   for(int i = 1; !err && i < argc; i++) {
     if(!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
@@ -161,14 +280,19 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     } else if(!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
       if(++i >= argc)
         fprintf(stderr, "%s option requires a filename value\n", argv[i-1]), err = 1;
-      else if(data.out.stream && data.out.stream != stdout)
+      else if(data.sink)
         fprintf(stderr, "Output file specified more than once\n"), err = 1;
-      else if(!(data.out.stream = fopen(argv[i], "wb")))
-        fprintf(stderr, "Unable to open for writing: %s\n", argv[i]), err = 1;
+      else if(!(data.sink = zsv_output_sink_open(argv[i])))
+        err = 1;
+    } else if(!strcmp(argv[i], "--threads")) {
+      if(++i >= argc || atoi(argv[i]) < 1)
+        fprintf(stderr, "%s option requires a positive integer value\n", argv[i-1]), err = 1;
+      else
+        thread_count = (unsigned)atoi(argv[i]);
     } else {
       if(opts->stream)
         fprintf(stderr, "Input file specified more than once\n"), err = 1;
-      else if(!(opts->stream = fopen(argv[i], "rb")))
+      else if(!(opts->stream = zsv_input_open(argv[i])))
         fprintf(stderr, "Unable to open for reading: %s\n", argv[i]), err = 1;
       else
        input_path = argv[i];
@@ -189,29 +313,63 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
 #endif
   }
 
-  if(!data.out.stream)
+  if(data.sink) {
+    data.out.write = zsv_output_sink_write;
+    data.out.stream = data.sink;
+  } else {
+    data.out.write = (size_t (*)(const void *restrict, size_t, size_t, void *restrict))fwrite;
     data.out.stream = stdout;
+  }
+  if(!(data.out.buff = malloc(ZSV_2TSV_BUFF_SIZE))) {
+    fprintf(stderr, "Out of memory!\n");
+    err = 1;
+    goto exit_2tsv;
+  }
+  data.out.size = ZSV_2TSV_BUFF_SIZE;
 
+  data.tab_delimited = opts->delimiter == '\t';
   opts->row_handler = zsv_2tsv_row;
+#ifndef NO_THREADING
+  if(thread_count > 1) {
+    if(thread_count > ZSV_2TSV_MAX_THREADS)
+      thread_count = ZSV_2TSV_MAX_THREADS;
+    if((data.pool = zsv_2tsv_parallel_new(thread_count, &data)))
+      opts->row_handler = zsv_2tsv_row_parallel;
+  }
+#else
+  if(thread_count > 1)
+    fprintf(stderr, "Warning: --threads is not supported in this build and will be ignored\n");
+#endif
   opts->ctx = &data;
   if(zsv_new_with_properties(opts, input_path, opts_used, &data.parser) == zsv_status_ok) {
-    char output[ZSV_2TSV_BUFF_SIZE];
-    data.out.buff = output;
-
     zsv_handle_ctrl_c_signal();
-    enum zsv_status status;
-    while(!zsv_signal_interrupted
+    enum zsv_status status = zsv_status_ok;
+    while(!zsv_signal_interrupted && !data.err
           && (status = zsv_parse_more(data.parser)) == zsv_status_ok)
       ;
+    if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+      data.err = 1;
     zsv_finish(data.parser);
     zsv_delete(data.parser);
+#ifndef NO_THREADING
+    if(data.pool && !data.err && zsv_2tsv_parallel_finish(&data)) {
+      fprintf(stderr, "Out of memory!\n");
+      data.err = 1;
+    }
+#endif
     zsv_2tsv_flush(&data.out);
+    if(data.err)
+      err = 1;
   }
 
  exit_2tsv:
+#ifndef NO_THREADING
+  zsv_blockpool_delete(data.pool);
+#endif
+  free(data.out.buff);
   if(opts->stream && opts->stream != stdin)
     fclose(opts->stream);
-  if(data.out.stream && data.out.stream != stdout)
-    fclose(data.out.stream);
+  if(zsv_output_sink_close(data.sink) && !err)
+    err = 1;
   return err;
 }
@@ -9,13 +9,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include <jsonwriter.h>
 
-#include <sqlite3.h>
-extern sqlite3_module CsvModule;
-
 #include <zsv/utils/string.h>
+#include <zsv/utils/file.h>
 #include <zsv/utils/writer.h>
+#include <zsv/utils/compress.h>
 
 #define ZSV_COMMAND compare
 #include "zsv_command.h"
@@ -26,6 +28,8 @@ extern sqlite3_module CsvModule;
 #include "compare_unique_colname.c"
 #include "compare_added_column.c"
 #include "compare_sort.c"
+#include "compare_hash.c"
+#include "compare_parallel.c"
 
 #define ZSV_COMPARE_OUTPUT_TYPE_JSON 'j'
 
@@ -159,7 +163,7 @@ static void zsv_compare_output_tuple(struct zsv_compare_data *data,
 
   for(unsigned i = 0; i < data->input_count; i++) {
     struct zsv_compare_input *input = &data->inputs[i];
-    if(input->done || !input->row_loaded) { // no data for this input
+    if(!values[i].str && (input->done || !input->row_loaded)) { // no data for this input
       zsv_compare_output_str(data, NULL, ZSV_WRITER_SAME_ROW, 0);
     } else {
       struct zsv_cell *value = &values[i];
@@ -249,21 +253,26 @@ static void zsv_compare_print_row(struct zsv_compare_data *data,
 }
 
 static void zsv_compare_input_free(struct zsv_compare_input *input) {
+#ifndef NO_THREADING
+  zsv_compare_reader_delete(input->reader); // before the parser it reads from
+#endif
   zsv_delete(input->parser);
   zsv_compare_unique_colnames_delete(&input->colnames);
   free(input->out2in);
   if(input->stream)
     fclose(input->stream);
   free(input->output_colnames);
+  for(unsigned i = 0; i < input->key_count; i++)
+    free(input->keys[i].collation_buff);
   free(input->keys);
-  if(input->sort_stmt) {
-    sqlite3_finalize(input->sort_stmt);
-  }
+  zsv_compare_sorter_delete(input->sorter);
 }
 
 static enum zsv_compare_status zsv_compare_set_inputs(struct zsv_compare_data *data, unsigned input_count) {
   if(!input_count || !(data->inputs = calloc(input_count, sizeof(*data->inputs)))
-     || !(data->inputs_to_sort = calloc(input_count, sizeof(*data->inputs_to_sort))))
+     || !(data->inputs_to_sort = calloc(input_count, sizeof(*data->inputs_to_sort)))
+     || !(data->merge_heap = calloc(input_count, sizeof(*data->merge_heap)))
+     || !(data->merge_group = calloc(input_count, sizeof(*data->merge_group))))
     return zsv_compare_status_memory;
   data->input_count = input_count;
   for(unsigned i = 0; i < input_count; i++) {
@@ -287,7 +296,8 @@ static int zsv_compare_cell(void *ctx, struct zsv_cell c1, struct zsv_cell c2);
 
 static void zsv_compare_output_begin(struct zsv_compare_data *data) {
   if(data->writer.type == ZSV_COMPARE_OUTPUT_TYPE_JSON) {
-    if(!(data->writer.handle.jsw = jsonwriter_new(stdout))) // to do: data->out
+    if(!(data->writer.handle.jsw = data->writer.out ?
+         jsonwriter_new_stream(zsv_output_sink_write, data->writer.out) : jsonwriter_new(stdout)))
       data->status = zsv_compare_status_memory;
     else {
       if(data->writer.compact)
@@ -295,7 +305,12 @@ static void zsv_compare_output_begin(struct zsv_compare_data *data) {
       jsonwriter_start_array(data->writer.handle.jsw);
     }
   } else {
-    if(!(data->writer.handle.csv = zsv_writer_new(NULL)))
+    struct zsv_csv_writer_options writer_opts = zsv_writer_get_default_opts();
+    if(data->writer.out) {
+      writer_opts.write = zsv_output_sink_write;
+      writer_opts.stream = data->writer.out;
+    }
+    if(!(data->writer.handle.csv = zsv_writer_new(&writer_opts)))
       data->status = zsv_compare_status_memory;
   }
 
@@ -371,8 +386,9 @@ input_init_unsorted(struct zsv_compare_data *data,
                     struct zsv_compare_input *input,
                     struct zsv_opts *opts,
                     const char *opts_used) {
+  (void)(data);
   (void)(opts_used);
-  if(!(input->stream = fopen(input->path, "rb"))) {
+  if(!(input->stream = zsv_input_open(input->path))) {
     perror(input->path);
     return zsv_compare_status_error;
   }
@@ -382,7 +398,7 @@ input_init_unsorted(struct zsv_compare_data *data,
   if(stat != zsv_status_ok)
     return zsv_compare_status_error;
 
-  if(data->next_row(input) != zsv_status_row)
+  if(zsv_compare_next_unsorted_row(input) != zsv_status_row) // header
     return zsv_compare_status_error;
 
   return zsv_compare_status_ok;
@@ -410,37 +426,49 @@ static void zsv_compare_set_sorted_callbacks(struct zsv_compare_data *data) {
 }
 
 static enum zsv_compare_status zsv_compare_init_sorted(struct zsv_compare_data *data) {
-  int rc;
-  const char *db_url = data->sort_in_memory ? "file::memory:" : "";
-  if((rc = sqlite3_open_v2(db_url, &data->sort_db, SQLITE_OPEN_URI | SQLITE_OPEN_READWRITE, NULL)) == SQLITE_OK
-     && data->sort_db
-     && (rc = sqlite3_create_module(data->sort_db, "csv", &CsvModule, 0) == SQLITE_OK)) {
-    zsv_compare_set_sorted_callbacks(data);
-    return zsv_compare_status_ok;
-  }
-  return zsv_compare_status_error;
+  if(!data->sort_buffer_size)
+    data->sort_buffer_size = (size_t)ZSV_COMPARE_SORT_BUFFER_MB_DEFAULT * 1024 * 1024;
+  zsv_compare_set_sorted_callbacks(data);
+  return zsv_compare_status_ok;
 }
 
-static void zsv_compare_data_free(struct zsv_compare_data *data) {
+static enum zsv_compare_status zsv_compare_init_hashed(struct zsv_compare_data *data) {
+  if(!(data->hash_join = calloc(1, sizeof(*data->hash_join))))
+    return zsv_compare_status_memory;
+  zsv_compare_init_sorted(data);
+  data->input_init = input_init_hashed;
+  return zsv_compare_status_ok;
+}
+
+// flush and free the output writer, and close the output file (if any)
+static int zsv_compare_output_close(struct zsv_compare_data *data) {
   if(data->writer.type == ZSV_COMPARE_OUTPUT_TYPE_JSON) {
     if(data->writer.handle.jsw)
       jsonwriter_delete(data->writer.handle.jsw);
-  } else
+    data->writer.handle.jsw = NULL;
+  } else {
     zsv_writer_delete(data->writer.handle.csv);
+    data->writer.handle.csv = NULL;
+  }
+  int err = zsv_output_sink_close(data->writer.out);
+  data->writer.out = NULL;
+  return err;
+}
+
+static void zsv_compare_data_free(struct zsv_compare_data *data) {
+  zsv_compare_output_close(data);
 
   for(unsigned i = 0; i < data->input_count; i++)
     zsv_compare_input_free(&data->inputs[i]);
   free(data->inputs);
   free(data->inputs_to_sort);
+  free(data->merge_heap);
+  free(data->merge_group);
+  zsv_compare_hash_delete(data->hash_join);
   for(unsigned i = 0; i < data->writer.properties.used; i++)
     free(data->writer.properties.names[i]);
   free(data->writer.properties.names);
 
-  if(data->sort) {
-    if(data->sort_db)
-      sqlite3_close(data->sort_db);
-  }
-
   zsv_compare_added_column_delete(data->added_columns);
 
   zsv_compare_unique_colnames_delete(&data->output_colnames);
@@ -472,9 +500,107 @@ static int zsv_compare_cell(void *ctx, struct zsv_cell c1, struct zsv_cell c2) {
                       c2.str, c2.len);
 }
 
+/**
+ * Set a key's collation value, against which keys are compared with
+ * zsv_strincmp_lower(). Non-ascii values are converted to lower case once per
+ * row here, rather than upon every comparison
+ */
+static enum zsv_compare_status zsv_compare_set_collation(struct zsv_compare_input_key *k) {
+  free(k->collation_buff);
+  k->collation_buff = NULL;
+  k->collation = k->value;
+
+  unsigned char c = 0;
+  for(size_t i = 0; i < k->value.len; i++)
+    c |= k->value.str[i];
+  if(c & 0x80) {
+    size_t len = k->value.len;
+    if(!(k->collation_buff = zsv_strtolowercase(k->value.str, &len)))
+      return zsv_compare_status_memory;
+    k->collation.str = k->collation_buff;
+    k->collation.len = len;
+  }
+  return zsv_compare_status_ok;
+}
+
+static int zsv_compare_input_key_cmp(const struct zsv_compare_input *x,
+                                     const struct zsv_compare_input *y) {
+  int cmp = 0;
+  for(unsigned i = 0; !cmp && i < x->key_count && i < y->key_count; i++)
+    // for multibyte input, the input must be also sorted lexicographically
+    // to avoid potential mismatches
+    // see e.g. https://stackoverflow.com/questions/4611302/sorting-utf-8-strings
+    cmp = zsv_strincmp_lower(x->keys[i].collation.str, x->keys[i].collation.len,
+                             y->keys[i].collation.str, y->keys[i].collation.len);
+  return cmp;
+}
+
+/**
+ * The inputs that have a row loaded are kept in a min-heap (merge_heap) ordered
+ * by key value first, and input position second. Only the inputs that advanced
+ * are re-sifted, rather than sorting all inputs for every row
+ */
+static int zsv_compare_input_less(const struct zsv_compare_input *x,
+                                  const struct zsv_compare_input *y) {
+  int cmp = zsv_compare_input_key_cmp(x, y);
+  return cmp ? cmp < 0 : x->index < y->index;
+}
+
+static void zsv_compare_heap_up(struct zsv_compare_data *data, unsigned i) {
+  struct zsv_compare_input **heap = data->merge_heap;
+  struct zsv_compare_input *input = heap[i];
+  while(i > 0) {
+    unsigned parent = (i - 1) / 2;
+    if(!zsv_compare_input_less(input, heap[parent]))
+      break;
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = input;
+}
+
+static void zsv_compare_heap_down(struct zsv_compare_data *data, unsigned i) {
+  struct zsv_compare_input **heap = data->merge_heap;
+  struct zsv_compare_input *input = heap[i];
+  unsigned count = data->merge_heap_count;
+  while(1) {
+    unsigned child = 2 * i + 1;
+    if(child >= count)
+      break;
+    if(child + 1 < count && zsv_compare_input_less(heap[child + 1], heap[child]))
+      child++;
+    if(!zsv_compare_input_less(heap[child], input))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = input;
+}
+
+static void zsv_compare_heapify(struct zsv_compare_data *data) {
+  for(unsigned i = data->merge_heap_count / 2; i-- > 0; )
+    zsv_compare_heap_down(data, i);
+}
+
+static void zsv_compare_heap_pop(struct zsv_compare_data *data) {
+  if(--data->merge_heap_count) {
+    data->merge_heap[0] = data->merge_heap[data->merge_heap_count];
+    zsv_compare_heap_down(data, 0);
+  }
+}
+
+// whether it is cheaper to sift n items one at a time into (or out of) a heap of
+// the given size, than to rebuild the heap
+static int zsv_compare_heap_sift_cheaper(unsigned n, unsigned heap_size) {
+  unsigned log2 = 1;
+  for(unsigned size = heap_size; size >>= 1; )
+    log2++;
+  return n * log2 < heap_size + n;
+}
+
 static enum zsv_compare_status zsv_compare_advance(struct zsv_compare_data *data) {
   // advance each input (if not row_loaded) to their next row
-  char got = 0;
+  unsigned heap_count = data->merge_heap_count;
   for(unsigned i = 0; i < data->input_count; i++) {
     struct zsv_compare_input *input = &data->inputs[i];
     if(input->done) continue;
@@ -482,66 +608,86 @@ static enum zsv_compare_status zsv_compare_advance(struct zsv_compare_data *data
     if(data->next_row(input) != zsv_status_row)
       input->done = 1;
     else {
-      for(unsigned idx = 0; idx < input->key_count; idx++)
+      for(unsigned idx = 0; idx < input->key_count; idx++) {
         input->keys[idx].value = data->get_cell(input, input->keys[idx].col_ix);
+        if(zsv_compare_set_collation(&input->keys[idx]) != zsv_compare_status_ok)
+          return zsv_compare_status_memory;
+      }
       input->row_loaded = 1;
-      got = 1;
+      data->merge_heap[data->merge_heap_count++] = input;
     }
   }
-  return got ? zsv_compare_status_ok : zsv_compare_status_no_more_input;
-}
-
-static int zsv_compare_inputp_cmp(const void *inputpx, const void* inputpy) {
-  struct zsv_compare_input * const *xp = inputpx;
-  struct zsv_compare_input * const *yp = inputpy;
-  const struct zsv_compare_input *x = *xp;
-  const struct zsv_compare_input *y = *yp;
-
-  if(!x->row_loaded && !y->row_loaded) return 0;
-  if(!x->row_loaded) return 1;
-  if(!y->row_loaded) return -1;
 
-  int cmp = 0;
-  for(unsigned i = 0; !cmp && i < x->key_count && i < y->key_count; i++)
-    // for multibyte input, the input must be also sorted lexicographically
-    // to avoid potential mismatches
-    // see e.g. https://stackoverflow.com/questions/4611302/sorting-utf-8-strings
-    cmp = zsv_strincmp(x->keys[i].value.str, x->keys[i].value.len,
-                       y->keys[i].value.str, y->keys[i].value.len);
-  return cmp;
+  // add the inputs that advanced to the heap
+  unsigned added = data->merge_heap_count - heap_count;
+  if(added) {
+    if(zsv_compare_heap_sift_cheaper(added, data->merge_heap_count)) {
+      for(unsigned i = heap_count; i < data->merge_heap_count; i++)
+        zsv_compare_heap_up(data, i);
+    } else
+      zsv_compare_heapify(data);
+  }
+  return data->merge_heap_count ? zsv_compare_status_ok : zsv_compare_status_no_more_input;
 }
 
-
 static enum zsv_compare_status zsv_compare_next(struct zsv_compare_data *data) {
+  if(data->hash_join)
+    return zsv_compare_next_hashed(data);
+
   data->status = zsv_compare_advance(data);
   if(data->status != zsv_compare_status_ok) return data->status;
 
   data->row_count++;
-  // sort the inputs by ID value first, and input position second
-  // for as many inputs have the same smallest ID values, output them as a group
-  //   and set input->row_loaded to 0
-  qsort(data->inputs_to_sort, data->input_count,
-        sizeof(*data->inputs_to_sort), zsv_compare_inputp_cmp);
-
-  // find the next subset of inputs with identical id values and process those inputs
-  unsigned last = 0;
-  struct zsv_compare_input *min_input = data->inputs_to_sort[0];
-  for(unsigned tmp_i = 1; tmp_i < data->input_count; tmp_i++) {
-    struct zsv_compare_input *tmp = data->inputs_to_sort[tmp_i];
-    if(!tmp->row_loaded) continue;
-    if(!zsv_compare_inputp_cmp(&min_input, &tmp)) { // keys are the same
-      last = tmp_i;
-      continue;
-    }
 
-    // keys are different
-    break;
+  // find the subset of inputs with the smallest ID values, and output them as a
+  // group. A heap entry's children never have smaller keys, so this subset is
+  // a subtree at the top of the heap
+  struct zsv_compare_input **heap = data->merge_heap;
+  unsigned *group = data->merge_group;
+  unsigned group_count = 1;
+  group[0] = 0;
+  for(unsigned i = 0; i < group_count; i++) {
+    for(unsigned child = 2 * group[i] + 1; child <= 2 * group[i] + 2 && child < data->merge_heap_count; child++)
+      if(!zsv_compare_input_key_cmp(heap[child], heap[0]))
+        group[group_count++] = child;
+  }
+
+  // list the group first, starting with the input in the first position (which is
+  // at the top of the heap), followed by the remaining inputs
+  const unsigned last = group_count - 1;
+  for(unsigned i = 0; i < group_count; i++)
+    data->inputs_to_sort[i] = heap[group[i]];
+
+  if(group_count == data->merge_heap_count)
+    data->merge_heap_count = 0;
+  else if(zsv_compare_heap_sift_cheaper(group_count, data->merge_heap_count)) {
+    // the group members are the first to be popped
+    for(unsigned i = 0; i < group_count; i++)
+      zsv_compare_heap_pop(data);
+  } else {
+    for(unsigned i = 0; i < group_count; i++)
+      heap[group[i]] = NULL;
+    unsigned count = 0;
+    for(unsigned i = 0; i < data->merge_heap_count; i++)
+      if(heap[i])
+        heap[count++] = heap[i];
+    data->merge_heap_count = count;
+    zsv_compare_heapify(data);
+  }
+
+  if(group_count < data->input_count) {
+    unsigned i = group_count;
+    for(unsigned j = 0; j < data->merge_heap_count; j++)
+      data->inputs_to_sort[i++] = heap[j];
+    for(unsigned j = 0; j < data->input_count; j++)
+      if(data->inputs[j].done)
+        data->inputs_to_sort[i++] = &data->inputs[j];
   }
 
   // print row
   zsv_compare_print_row(data, last);
 
-  // reset row_loaded
+  // reset row_loaded, so that these inputs are advanced next
   for(unsigned tmp = 0; tmp <= last; tmp++)
     data->inputs_to_sort[tmp]->row_loaded = 0;
 
@@ -558,11 +704,17 @@ static int compare_usage() {
     "  -a,--add <field> : specify an additional field to output",
     "                     will use the [first input] source",
     "  --sort           : sort on keys before comparing",
-    "  --sort-in-memory : for sorting,  use in-memory instead of temporary db",
-    "                     (see https://www.sqlite.org/inmemorydb.html)",
+    "  --hash           : match rows on keys with a hash table, without sorting",
+    "                     (requires exactly two inputs)",
+    "  --parallel       : parse (or, with --sort, load and sort) each input in",
+    "                     its own thread",
+    "  --sort-buffer-mb <n>: memory, in MB, to use for --sort or --hash before",
+    "                     spilling to temporary files (default: 256)",
     "  --json           : output as JSON",
     "  --json-compact   : output as compact JSON",
     "  --json-object    : output as an array of objects",
+    "  -o,--output <filename>: name of file to save output to (compressed if it",
+    "                     ends in .gz or .zst)",
     "",
     "NOTES",
     "",
@@ -576,12 +728,17 @@ static int compare_usage() {
     "    for the output to be correct (unless the --sort option is used). However, it",
     "    is not required for each input to contain the same population of row keys",
     "",
-    "    The --sort option uses sqlite3 (unindexed) sort and is intended to be a",
-    "    convenience rather than performance feature. If you need high performance",
-    "    sorting, other solutions, such as a multi-threaded parallel sort, are likely",
-    "    superior. For handling quoted data, `2tsv` can be used to convert to a delimited",
-    "    format without quotes, that can be directly parsed with common UNIX utilities",
-    "    (such as `sort`), and `select --unescape` can be used to convert back",
+    "    The --sort option sorts each input on its keys (case-insensitively, in the",
+    "    same order used to match rows) with an external merge sort. Inputs that do",
+    "    not fit within the sort buffer are sorted in runs that are written to",
+    "    temporary files (in $TMPDIR, if set) and then merged",
+    "",
+    "    The --hash option loads the rows of the smaller input into a hash table on",
+    "    their keys, and then reads the other input, matching each of its rows as",
+    "    it is read. Output follows the order of the larger input, followed by any",
+    "    rows of the smaller input that were not matched. If the smaller input does",
+    "    not fit within the buffer, both inputs are first partitioned on their keys",
+    "    into temporary files, and the output is grouped by partition",
     NULL
   };
 
@@ -594,9 +751,6 @@ static int compare_usage() {
 // TO DO: consolidate common code w sql.c-- move to utils/db.c?
 int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *opts,
                                const char *opts_used) {
-  /**
-   * See sql.c re passing options to sqlite3 when sorting is used
-   */
   (void)(opts_used);
   if(argc < 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
     compare_usage();
@@ -648,6 +802,20 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       }
     } else if(!strcmp(arg, "--sort")) {
       data->sort = 1;
+    } else if(!strcmp(arg, "--hash")) {
+      data->hash = 1;
+    } else if(!strcmp(arg, "--parallel")) {
+      data->parallel = 1;
+    } else if(!strcmp(arg, "--sort-buffer-mb")) {
+      const char *next_arg = zsv_next_arg(++arg_i, argc, argv, &err);
+      if(next_arg) {
+        long long mb = atoll(next_arg);
+        if(mb < 1) {
+          fprintf(stderr, "Invalid sort buffer size: %s\n", next_arg);
+          err = 1;
+        } else
+          data->sort_buffer_size = (size_t)mb * 1024 * 1024;
+      }
     } else if(!strcmp(arg, "--json")) {
       data->writer.type = ZSV_COMPARE_OUTPUT_TYPE_JSON;
     } else if(!strcmp(arg, "--json-object")) {
@@ -656,22 +824,46 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     } else if(!strcmp(arg, "--json-compact")) {
       data->writer.type = ZSV_COMPARE_OUTPUT_TYPE_JSON;
       data->writer.compact = 1;
+    } else if(!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
+      const char *next_arg = zsv_next_arg(++arg_i, argc, argv, &err);
+      if(next_arg) {
+        if(data->writer.out) {
+          fprintf(stderr, "Output file specified more than once\n");
+          err = 1;
+        } else if(!(data->writer.out = zsv_output_sink_open(next_arg)))
+          err = 1;
+      }
     } else
       input_filenames[input_count++] = arg;
   }
 
-  struct zsv_opts original_default_opts;
-  if(data->sort) {
+  if(data->sort && data->hash) {
+    fprintf(stderr, "Error: --sort and --hash cannot be used together\n");
+    data->status = zsv_compare_status_error;
+  } else if(data->sort) {
     if(!data->key_count) {
       fprintf(stderr, "Error: --sort requires one or more keys\n");
       data->status = zsv_compare_status_error;
-    } else {
-      original_default_opts = zsv_get_default_opts();
-      zsv_set_default_opts(*opts);
+    } else if(data->status == zsv_compare_status_ok)
+      data->status = zsv_compare_init_sorted(data);
+  } else if(data->hash) {
+    if(!data->key_count) {
+      fprintf(stderr, "Error: --hash requires one or more keys\n");
+      data->status = zsv_compare_status_error;
+    } else if(input_count != 2) {
+      fprintf(stderr, "Error: --hash requires exactly two inputs\n");
+      data->status = zsv_compare_status_error;
+    } else if(data->status == zsv_compare_status_ok)
+      data->status = zsv_compare_init_hashed(data);
+  }
 
-      if(data->status == zsv_compare_status_ok)
-        data->status = zsv_compare_init_sorted(data);
-    }
+  if(data->parallel && data->status == zsv_compare_status_ok) {
+#ifndef NO_THREADING
+    data->status = zsv_compare_init_parallel(data);
+#else
+    fprintf(stderr, "Warning: --parallel is not supported in this build and will be ignored\n");
+    data->parallel = 0;
+#endif
   }
 
   if(err && data->status == zsv_compare_status_ok)
@@ -681,11 +873,15 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
   else if(data->status == zsv_compare_status_ok) {
     if((data->status = zsv_compare_set_inputs(data, input_count)) == zsv_compare_status_ok) {
       // initialize parsers
-      for(unsigned ix = 0; data->status == zsv_compare_status_ok && ix < input_count; ix++) {
-        struct zsv_compare_input *input = &data->inputs[ix];
-        input->path = input_filenames[ix];
-        data->status = data->input_init(data, input, opts, opts_used);
-      }
+      for(unsigned ix = 0; ix < input_count; ix++)
+        data->inputs[ix].path = input_filenames[ix];
+#ifndef NO_THREADING
+      if(data->parallel && data->sort)
+        data->status = zsv_compare_init_inputs_parallel(data, opts, opts_used);
+      else
+#endif
+      for(unsigned ix = 0; data->status == zsv_compare_status_ok && ix < input_count; ix++)
+        data->status = data->input_init(data, &data->inputs[ix], opts, opts_used);
     }
 
     if(data->status == zsv_compare_status_ok) {
@@ -838,11 +1034,10 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
 
   free(input_filenames);
 
+  if(zsv_compare_output_close(data) && data->status == zsv_compare_status_ok)
+    data->status = zsv_compare_status_error;
   err = data->status == zsv_compare_status_ok ? 0 : 1;
 
-  if(data->sort)
-    zsv_set_default_opts(original_default_opts); // restore default options
-
   zsv_compare_delete(data);
   return err;
 }
@@ -0,0 +1,474 @@
+/**
+ * With --hash, two inputs are compared on their keys without sorting them. The
+ * rows of the smaller input (by file size) are loaded into a hash table on their
+ * keys, and the rows of the other input are streamed against it: each streamed
+ * row is output together with its matching row, if any. Rows of the smaller
+ * input that were not matched are output last
+ *
+ * If the smaller input does not fit within the memory budget (--sort-buffer-mb),
+ * both inputs are first partitioned on a hash of their keys into temporary files
+ * (a "grace" hash join), and each pair of partitions is then compared in turn
+ *
+ * Rows are held in the same records, and read with the same callbacks, as --sort
+ * uses (see compare_sort.c)
+ */
+
+#define ZSV_COMPARE_HASH_PARTITION_BUFFER (64 * 1024)
+#define ZSV_COMPARE_HASH_PARTITIONS_MIN 8
+#define ZSV_COMPARE_HASH_PARTITIONS_MAX 256
+#define ZSV_COMPARE_HASH_PROBE_BUFFER (4 * 1024 * 1024)
+
+static void zsv_compare_print_row(struct zsv_compare_data *data, const unsigned last_ix);
+
+// a contiguous series of a partition's records in a partition file
+struct zsv_compare_hash_chunk {
+  uint64_t offset;
+  size_t len;
+};
+
+struct zsv_compare_hash_partition {
+  unsigned char *buff; // records not yet written
+  size_t buff_len;
+  struct zsv_compare_hash_chunk *chunks;
+  size_t chunk_count;
+  size_t chunks_size;
+};
+
+// the partitions of one input, all of which are written to one file
+struct zsv_compare_hash_partitions {
+  struct zsv_compare_hash *hash;
+  char *filename;
+  FILE *file;
+  uint64_t file_len;
+  struct zsv_compare_hash_partition *partitions;
+};
+
+struct zsv_compare_hash {
+  struct zsv_compare_input *build; // the smaller input, which is loaded into the hash table
+  struct zsv_compare_input *probe; // the larger input, which is streamed against the hash table
+
+  // hash table over the build rows in memory. heads[] and next[] hold 1-based row
+  // numbers, and each chain is in row order
+  uint32_t *heads;
+  uint32_t *next;
+  size_t mask;
+  size_t rows_size;
+  unsigned char *matched;
+  size_t unmatched_ix; // next build row to check for being unmatched
+
+  unsigned partition_count; // zero if the build rows fit in memory
+  unsigned partition;
+  struct zsv_compare_hash_partitions parts[2]; // build, probe
+
+  // current chunk of the current probe partition
+  unsigned char *probe_buff;
+  size_t probe_buff_size;
+  size_t probe_buff_len;
+  size_t probe_buff_pos;
+  size_t probe_chunk;
+
+  unsigned char started:1;
+  unsigned char probing:1;
+  unsigned char _:6;
+};
+
+static uint64_t zsv_compare_hash_record(const unsigned char *record) {
+  size_t len;
+  const unsigned char *keys = zsv_compare_sort_record_keys(record, &len);
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  for(size_t i = 0; i < len; i++) {
+    h ^= keys[i];
+    h *= 1099511628211ULL;
+  }
+  return h ^ (h >> 29);
+}
+
+// size of a file, or zero if unknown
+static uint64_t zsv_compare_hash_file_size(const char *path) {
+  struct stat st;
+  return stat(path, &st) ? 0 : (uint64_t)st.st_size;
+}
+
+static unsigned zsv_compare_hash_partition_of(struct zsv_compare_hash *h, const unsigned char *record) {
+  return (unsigned)((zsv_compare_hash_record(record) >> 32) % h->partition_count);
+}
+
+static void zsv_compare_hash_partitions_free(struct zsv_compare_hash_partitions *parts,
+                                             unsigned partition_count) {
+  if(parts->partitions) {
+    for(unsigned i = 0; i < partition_count; i++) {
+      free(parts->partitions[i].buff);
+      free(parts->partitions[i].chunks);
+    }
+    free(parts->partitions);
+  }
+  if(parts->file)
+    fclose(parts->file);
+  if(parts->filename) {
+    remove(parts->filename);
+    free(parts->filename);
+  }
+}
+
+static void zsv_compare_hash_delete(struct zsv_compare_hash *h) {
+  if(h) {
+    for(int i = 0; i < 2; i++)
+      zsv_compare_hash_partitions_free(&h->parts[i], h->partition_count);
+    free(h->heads);
+    free(h->next);
+    free(h->matched);
+    free(h->probe_buff);
+    free(h);
+  }
+}
+
+static enum zsv_compare_status
+zsv_compare_hash_partition_write(struct zsv_compare_hash_partitions *parts,
+                                 struct zsv_compare_hash_partition *partition,
+                                 const unsigned char *data, size_t len) {
+  if(partition->chunk_count == partition->chunks_size) {
+    size_t new_size = partition->chunks_size ? partition->chunks_size * 2 : 16;
+    struct zsv_compare_hash_chunk *chunks = realloc(partition->chunks, new_size * sizeof(*chunks));
+    if(!chunks)
+      return zsv_compare_status_memory;
+    partition->chunks = chunks;
+    partition->chunks_size = new_size;
+  }
+  if(fwrite(data, 1, len, parts->file) != len) {
+    perror(parts->filename);
+    return zsv_compare_status_error;
+  }
+  struct zsv_compare_hash_chunk *chunk = &partition->chunks[partition->chunk_count++];
+  chunk->offset = parts->file_len;
+  chunk->len = len;
+  parts->file_len += len;
+  return zsv_compare_status_ok;
+}
+
+static enum zsv_compare_status
+zsv_compare_hash_partition_flush(struct zsv_compare_hash_partitions *parts,
+                                 struct zsv_compare_hash_partition *partition) {
+  enum zsv_compare_status stat = zsv_compare_status_ok;
+  if(partition->buff_len)
+    stat = zsv_compare_hash_partition_write(parts, partition, partition->buff, partition->buff_len);
+  partition->buff_len = 0;
+  return stat;
+}
+
+/**
+ * Sorter spill callback: move the buffered rows into their partitions
+ */
+static enum zsv_compare_status zsv_compare_hash_spill(struct zsv_compare_sorter *s) {
+  struct zsv_compare_hash_partitions *parts = s->spill_ctx;
+  struct zsv_compare_hash *h = parts->hash;
+  if(!parts->partitions) {
+    if(!h->partition_count) {
+      // this is the build input: choose the number of partitions, aiming for each
+      // partition (whose rows take more room than its text) to fit in half the budget
+      uint64_t size = zsv_compare_hash_file_size(h->build->path);
+      uint64_t count = size ? 4 * size / s->max_bytes + 1 : ZSV_COMPARE_HASH_PARTITIONS_MAX;
+      if(count < ZSV_COMPARE_HASH_PARTITIONS_MIN)
+        count = ZSV_COMPARE_HASH_PARTITIONS_MIN;
+      if(count > ZSV_COMPARE_HASH_PARTITIONS_MAX)
+        count = ZSV_COMPARE_HASH_PARTITIONS_MAX;
+      h->partition_count = (unsigned)count;
+    }
+    if(!(parts->partitions = calloc(h->partition_count, sizeof(*parts->partitions))))
+      return zsv_compare_status_memory;
+    if(!(parts->filename = zsv_get_temp_filename("zsv_compare_hash")))
+      return zsv_compare_status_error;
+    if(!(parts->file = fopen(parts->filename, "w+b"))) {
+      perror(parts->filename);
+      return zsv_compare_status_error;
+    }
+  }
+
+  enum zsv_compare_status stat = zsv_compare_status_ok;
+  for(size_t i = 0; stat == zsv_compare_status_ok && i < s->row_count; i++) {
+    const unsigned char *record = s->arena + s->offsets[i];
+    size_t size = zsv_compare_sort_record_u32(record, 0);
+    struct zsv_compare_hash_partition *partition =
+      &parts->partitions[zsv_compare_hash_partition_of(h, record)];
+    if(partition->buff_len + size > ZSV_COMPARE_HASH_PARTITION_BUFFER)
+      stat = zsv_compare_hash_partition_flush(parts, partition);
+    if(stat != zsv_compare_status_ok)
+      break;
+    if(size > ZSV_COMPARE_HASH_PARTITION_BUFFER)
+      stat = zsv_compare_hash_partition_write(parts, partition, record, size);
+    else {
+      if(!partition->buff && !(partition->buff = malloc(ZSV_COMPARE_HASH_PARTITION_BUFFER)))
+        return zsv_compare_status_memory;
+      memcpy(partition->buff + partition->buff_len, record, size);
+      partition->buff_len += size;
+    }
+  }
+  s->arena_len = 0;
+  s->row_count = 0;
+  return stat;
+}
+
+// write out all of an input's partitioned rows
+static enum zsv_compare_status zsv_compare_hash_spill_all(struct zsv_compare_sorter *s) {
+  struct zsv_compare_hash_partitions *parts = s->spill_ctx;
+  enum zsv_compare_status stat = zsv_compare_hash_spill(s);
+  for(unsigned i = 0; stat == zsv_compare_status_ok && i < parts->hash->partition_count; i++) {
+    stat = zsv_compare_hash_partition_flush(parts, &parts->partitions[i]);
+    free(parts->partitions[i].buff);
+    parts->partitions[i].buff = NULL;
+  }
+  if(stat == zsv_compare_status_ok && fflush(parts->file)) {
+    perror(parts->filename);
+    stat = zsv_compare_status_error;
+  }
+  return stat;
+}
+
+static enum zsv_compare_status zsv_compare_hash_read_chunk(struct zsv_compare_hash_partitions *parts,
+                                                           struct zsv_compare_hash_chunk *chunk,
+                                                           unsigned char *buff) {
+  if(zsv_compare_sort_fseek(parts->file, chunk->offset, SEEK_SET)
+     || fread(buff, 1, chunk->len, parts->file) != chunk->len) {
+    perror(parts->filename);
+    return zsv_compare_status_error;
+  }
+  return zsv_compare_status_ok;
+}
+
+// build the hash table over the build rows in memory
+static enum zsv_compare_status zsv_compare_hash_index(struct zsv_compare_hash *h) {
+  struct zsv_compare_sorter *s = h->build->sorter;
+  size_t table_size = 16;
+  while(table_size < s->row_count * 2)
+    table_size *= 2;
+  if(table_size - 1 > h->mask) {
+    free(h->heads);
+    if(!(h->heads = malloc(table_size * sizeof(*h->heads))))
+      return zsv_compare_status_memory;
+    h->mask = table_size - 1;
+  }
+  if(s->row_count > h->rows_size) {
+    free(h->next);
+    free(h->matched);
+    if(!(h->next = malloc(s->row_count * sizeof(*h->next)))
+       || !(h->matched = malloc(s->row_count)))
+      return zsv_compare_status_memory;
+    h->rows_size = s->row_count;
+  }
+  memset(h->heads, 0, (h->mask + 1) * sizeof(*h->heads));
+  if(s->row_count)
+    memset(h->matched, 0, s->row_count);
+  for(size_t i = s->row_count; i-- > 0; ) {
+    size_t bucket = zsv_compare_hash_record(s->arena + s->offsets[i]) & h->mask;
+    h->next[i] = h->heads[bucket];
+    h->heads[bucket] = (uint32_t)(i + 1);
+  }
+  h->unmatched_ix = 0;
+  return zsv_compare_status_ok;
+}
+
+// load the current partition of the build input into memory, and index it
+static enum zsv_compare_status zsv_compare_hash_load_partition(struct zsv_compare_hash *h) {
+  struct zsv_compare_sorter *s = h->build->sorter;
+  struct zsv_compare_hash_partitions *parts = &h->parts[0];
+  struct zsv_compare_hash_partition *partition = &parts->partitions[h->partition];
+  enum zsv_compare_status stat = zsv_compare_status_ok;
+
+  size_t total = 0;
+  for(size_t i = 0; i < partition->chunk_count; i++)
+    total += partition->chunks[i].len;
+  if(total > s->arena_size) {
+    unsigned char *arena = realloc(s->arena, total);
+    if(!arena)
+      return zsv_compare_status_memory;
+    s->arena = arena;
+    s->arena_size = total;
+  }
+  s->arena_len = 0;
+  s->row_count = 0;
+  for(size_t i = 0; stat == zsv_compare_status_ok && i < partition->chunk_count; i++) {
+    stat = zsv_compare_hash_read_chunk(parts, &partition->chunks[i], s->arena + s->arena_len);
+    s->arena_len += partition->chunks[i].len;
+  }
+
+  // index the records
+  for(size_t offset = 0; stat == zsv_compare_status_ok && offset < s->arena_len;
+      offset += zsv_compare_sort_record_u32(s->arena + offset, 0)) {
+    if(s->row_count == s->rows_size) {
+      size_t new_size = s->rows_size ? s->rows_size * 2 : 1024;
+      size_t *offsets = realloc(s->offsets, new_size * sizeof(*offsets));
+      if(!offsets)
+        return zsv_compare_status_memory;
+      s->offsets = offsets;
+      free(s->rows); // unused
+      s->rows = NULL;
+      s->rows_size = new_size;
+    }
+    s->offsets[s->row_count++] = offset;
+  }
+
+  if(stat == zsv_compare_status_ok)
+    stat = zsv_compare_hash_index(h);
+  h->probe_chunk = 0;
+  h->probe_buff_len = h->probe_buff_pos = 0;
+  return stat;
+}
+
+static enum zsv_compare_status zsv_compare_hash_start(struct zsv_compare_data *data) {
+  struct zsv_compare_hash *h = data->hash_join;
+  enum zsv_compare_status stat;
+
+  // build the hash table over the smaller input
+  struct zsv_compare_input *input0 = &data->inputs[0], *input1 = &data->inputs[1];
+  if(zsv_compare_hash_file_size(input1->path) < zsv_compare_hash_file_size(input0->path))
+    h->build = input1, h->probe = input0;
+  else
+    h->build = input0, h->probe = input1;
+
+  struct zsv_compare_sorter *build = h->build->sorter, *probe = h->probe->sorter;
+  build->max_bytes = data->sort_buffer_size;
+  probe->max_bytes = ZSV_COMPARE_HASH_PROBE_BUFFER;
+  for(int i = 0; i < 2; i++)
+    h->parts[i].hash = h;
+  build->spill = probe->spill = zsv_compare_hash_spill;
+  build->spill_ctx = &h->parts[0];
+  probe->spill_ctx = &h->parts[1];
+  if((stat = zsv_compare_sorter_load(h->build)) != zsv_compare_status_ok)
+    return stat;
+
+  if(!h->partition_count) // everything fit in memory
+    stat = zsv_compare_hash_index(h);
+  else {
+    // partition the rest of the build input, then the probe input
+    if((stat = zsv_compare_hash_spill_all(build)) == zsv_compare_status_ok
+       && (stat = zsv_compare_sorter_load(h->probe)) == zsv_compare_status_ok
+       && (stat = zsv_compare_hash_spill_all(probe)) == zsv_compare_status_ok)
+      stat = zsv_compare_hash_load_partition(h);
+  }
+  h->probing = 1;
+  return stat;
+}
+
+// get the next probe row, or NULL if there are no more in the current partition
+static const unsigned char *zsv_compare_hash_next_probe(struct zsv_compare_data *data) {
+  struct zsv_compare_hash *h = data->hash_join;
+  struct zsv_compare_sorter *s = h->probe->sorter;
+  if(!h->partition_count) {
+    // stream the input, one row at a time
+    s->arena_len = 0;
+    s->row_count = 0;
+    if(zsv_next_row(h->probe->parser) != zsv_status_row)
+      return NULL;
+    if((data->status = zsv_compare_sorter_add_row(s, h->probe->parser)) != zsv_compare_status_ok)
+      return NULL;
+    return s->arena;
+  }
+
+  if(h->probe_buff_pos < h->probe_buff_len) {
+    h->probe_buff_pos += zsv_compare_sort_record_u32(h->probe_buff + h->probe_buff_pos, 0);
+  }
+  if(h->probe_buff_pos >= h->probe_buff_len) {
+    struct zsv_compare_hash_partition *partition = &h->parts[1].partitions[h->partition];
+    if(h->probe_chunk >= partition->chunk_count)
+      return NULL;
+    struct zsv_compare_hash_chunk *chunk = &partition->chunks[h->probe_chunk++];
+    if(chunk->len > h->probe_buff_size) {
+      free(h->probe_buff);
+      if(!(h->probe_buff = malloc(chunk->len))) {
+        data->status = zsv_compare_status_memory;
+        h->probe_buff_size = 0;
+        return NULL;
+      }
+      h->probe_buff_size = chunk->len;
+    }
+    if((data->status = zsv_compare_hash_read_chunk(&h->parts[1], chunk, h->probe_buff)) != zsv_compare_status_ok)
+      return NULL;
+    h->probe_buff_len = chunk->len;
+    h->probe_buff_pos = 0;
+    // the position is advanced past the current record upon the next call
+    return h->probe_buff;
+  }
+  return h->probe_buff + h->probe_buff_pos;
+}
+
+static void zsv_compare_hash_output(struct zsv_compare_data *data,
+                                    const unsigned char *build_row,
+                                    const unsigned char *probe_row) {
+  struct zsv_compare_hash *h = data->hash_join;
+  h->build->sorter->row = build_row;
+  h->probe->sorter->row = probe_row;
+
+  // list the inputs that have this row, in order of input position, followed by the other input
+  unsigned n = 0;
+  for(int with_row = 1; with_row >= 0; with_row--) {
+    for(unsigned i = 0; i < data->input_count; i++) {
+      struct zsv_compare_input *input = &data->inputs[i];
+      if((input->sorter->row != NULL) == with_row) {
+        data->inputs_to_sort[n++] = input;
+        input->row_loaded = 1;
+        for(unsigned idx = 0; with_row && idx < input->key_count; idx++)
+          input->keys[idx].value = data->get_cell(input, input->keys[idx].col_ix);
+      }
+    }
+  }
+  data->row_count++;
+  zsv_compare_print_row(data, (build_row && probe_row) ? 1 : 0);
+}
+
+static enum zsv_compare_status zsv_compare_next_hashed(struct zsv_compare_data *data) {
+  struct zsv_compare_hash *h = data->hash_join;
+  if(!h->started) {
+    h->started = 1;
+    if((data->status = zsv_compare_hash_start(data)) != zsv_compare_status_ok)
+      return data->status;
+  }
+
+  struct zsv_compare_sorter *build = h->build->sorter;
+  while(1) {
+    if(h->probing) {
+      const unsigned char *probe_row = zsv_compare_hash_next_probe(data);
+      if(data->status != zsv_compare_status_ok)
+        return data->status;
+      if(probe_row) {
+        // match the first build row with the same keys that has not yet been matched
+        const unsigned char *build_row = NULL;
+        for(uint32_t row = h->heads[zsv_compare_hash_record(probe_row) & h->mask]; row; row = h->next[row - 1]) {
+          if(!h->matched[row - 1]
+             && !zsv_compare_sort_record_cmp(build->arena + build->offsets[row - 1], probe_row)) {
+            h->matched[row - 1] = 1;
+            build_row = build->arena + build->offsets[row - 1];
+            break;
+          }
+        }
+        zsv_compare_hash_output(data, build_row, probe_row);
+        return data->status;
+      }
+      h->probing = 0;
+    }
+
+    // output the build rows that were not matched
+    while(h->unmatched_ix < build->row_count) {
+      size_t ix = h->unmatched_ix++;
+      if(!h->matched[ix]) {
+        zsv_compare_hash_output(data, build->arena + build->offsets[ix], NULL);
+        return data->status;
+      }
+    }
+
+    if(!h->partition_count || ++h->partition >= h->partition_count)
+      return zsv_compare_status_no_more_input;
+    if((data->status = zsv_compare_hash_load_partition(h)) != zsv_compare_status_ok)
+      return data->status;
+    h->probing = 1;
+  }
+}
+
+static enum zsv_compare_status
+input_init_hashed(struct zsv_compare_data *data,
+                  struct zsv_compare_input *input,
+                  struct zsv_opts *opts,
+                  const char *opts_used
+                  ) {
+  (void)(opts_used);
+  // rows are read when the comparison starts, after choosing which input to load
+  return zsv_compare_sorter_open(data, input, opts, data->sort_buffer_size);
+}
@@ -2,7 +2,6 @@
 #define ZSV_COMPARE_PRIVATE_H
 
 #include <sglib.h>
-#include <sqlite3.h>
 
 typedef struct zsv_compare_unique_colname {
   struct zsv_compare_unique_colname *next; // retain order via linked list
@@ -29,6 +28,8 @@ static void zsv_compare_unique_colnames_delete(zsv_compare_unique_colname **tree
 struct zsv_compare_input_key {
   struct zsv_compare_key *key;
   struct zsv_cell value;
+  struct zsv_cell collation; // value, with any non-ascii text converted to lower case
+  unsigned char *collation_buff;
   unsigned col_ix;
   unsigned char found;
   unsigned char is_key;
@@ -48,7 +49,10 @@ struct zsv_compare_input {
   unsigned key_count;
   struct zsv_compare_input_key *keys;
 
-  sqlite3_stmt *sort_stmt;
+  struct zsv_compare_sorter *sorter; // used when --sort or --hash option was specified
+#ifndef NO_THREADING
+  struct zsv_compare_reader *reader; // used when --parallel option was specified
+#endif
 
   unsigned char row_loaded:1;
   unsigned char done:1;
@@ -81,6 +85,9 @@ struct zsv_compare_data {
   unsigned input_count; // number of allocated compare_input structs
   struct zsv_compare_input *inputs;
   struct zsv_compare_input **inputs_to_sort;
+  struct zsv_compare_input **merge_heap; // inputs with a row loaded, smallest key first
+  unsigned merge_heap_count;
+  unsigned *merge_group; // heap positions of the inputs with the smallest key
 
   unsigned key_count;
   struct zsv_compare_key *keys;
@@ -109,7 +116,8 @@ struct zsv_compare_data {
                                         const char *opts_used);
 
 //  struct zsv_compare_sort *sort;
-  sqlite3 *sort_db; // used when --sort option was specified
+  size_t sort_buffer_size; // total memory budget for sorting, split between inputs
+  struct zsv_compare_hash *hash_join; // used when --hash option was specified
 
   struct {
     char type; // 'j' for json
@@ -117,6 +125,7 @@ struct zsv_compare_data {
       zsv_csv_writer csv;
       jsonwriter_handle jsw;
     } handle;
+    zsv_output_sink out; // set if -o was specified
 
     struct {
       unsigned used;
@@ -131,8 +140,9 @@ struct zsv_compare_data {
   } writer;
 
   unsigned char sort:1;
-  unsigned char sort_in_memory:1;
-  unsigned char _:6;
+  unsigned char hash:1;
+  unsigned char parallel:1;
+  unsigned char _:5;
 };
 
 #endif
@@ -0,0 +1,205 @@
+#ifndef NO_THREADING
+/**
+ * With --parallel, each input is parsed in its own thread, so that comparing
+ * multiple large inputs is not limited to one core
+ *
+ * Without --sort or --hash, each input's parser thread copies its rows into a
+ * zsv_blockpool, from which the comparison takes blocks in order. Cells are
+ * trimmed as they are read. A row's cells remain valid until that input's next
+ * row is read, as they would be if read directly from the parser
+ *
+ * With --sort, each input is loaded and sorted in its own thread
+ */
+#include <pthread.h>
+#include <zsv/utils/blockpool.h>
+
+#define ZSV_COMPARE_READER_BLOCK_SIZE (256 * 1024)
+#define ZSV_COMPARE_READER_BLOCK_COUNT 4
+
+static enum zsv_compare_status input_init_unsorted(struct zsv_compare_data *data,
+                                                   struct zsv_compare_input *input,
+                                                   struct zsv_opts *opts,
+                                                   const char *opts_used);
+
+struct zsv_compare_reader_block {
+  struct zsv_block rows;
+  size_t next_row; // next row to be read by the comparison
+  enum zsv_status status; // if not zsv_status_row, status of the parser after this block's last row
+};
+
+struct zsv_compare_reader {
+  struct zsv_compare_input *input;
+  zsv_blockpool pool;
+  struct zsv_compare_reader_block *current; // block containing the current row, if any
+
+  pthread_t thread;
+  char started;
+};
+
+// copy rows from the parser into a block until it is full or the input ends
+static enum zsv_status zsv_compare_reader_fill(zsv_parser parser, struct zsv_compare_reader_block *b) {
+  struct zsv_block *rows = &b->rows;
+  enum zsv_status stat = zsv_status_row;
+  b->next_row = 0;
+  while(rows->raw_len + rows->cell_count * sizeof(*rows->cells) < ZSV_COMPARE_READER_BLOCK_SIZE
+        && (stat = zsv_next_row(parser)) == zsv_status_row) {
+    if(zsv_block_add_row(rows, parser, zsv_cell_count(parser), 0))
+      return zsv_status_memory;
+  }
+  return stat;
+}
+
+static void *zsv_compare_reader_run(void *p) {
+  struct zsv_compare_reader *r = p;
+  enum zsv_status stat = zsv_status_row;
+  while(stat == zsv_status_row) {
+    struct zsv_compare_reader_block *b = (struct zsv_compare_reader_block *)zsv_blockpool_fill_block(r->pool);
+    if(!b) // the comparison ended before the input did
+      break;
+    b->status = stat = zsv_compare_reader_fill(r->input->parser, b);
+    if(stat == zsv_status_memory)
+      fprintf(stderr, "Out of memory!\n");
+    if(zsv_blockpool_submit(r->pool))
+      break;
+  }
+  zsv_blockpool_finish(r->pool);
+  return NULL;
+}
+
+static void zsv_compare_reader_delete(struct zsv_compare_reader *r) {
+  if(r) {
+    if(r->started) {
+      zsv_blockpool_stop(r->pool);
+      pthread_join(r->thread, NULL);
+    }
+    zsv_blockpool_delete(r->pool);
+    free(r);
+  }
+}
+
+static enum zsv_status zsv_compare_next_parallel_row(struct zsv_compare_input *input) {
+  struct zsv_compare_reader *r = input->reader;
+  if(!r->started) {
+    // the header has been read, so the parser now belongs to the parser thread
+    if(pthread_create(&r->thread, NULL, zsv_compare_reader_run, r)) {
+      fprintf(stderr, "Unable to start thread for %s\n", input->path);
+      return zsv_status_error;
+    }
+    r->started = 1;
+  }
+
+  struct zsv_compare_reader_block *b = r->current;
+  while(1) {
+    if(b) {
+      if(b->next_row < b->rows.row_count) {
+        b->next_row++;
+        return zsv_status_row;
+      }
+      if(b->status != zsv_status_row) // end of input
+        return b->status;
+
+      // release this block to the parser thread
+      r->current = NULL;
+      zsv_blockpool_release(r->pool, &b->rows);
+    }
+
+    if(!(b = (struct zsv_compare_reader_block *)zsv_blockpool_next(r->pool)))
+      return zsv_status_error;
+    r->current = b;
+  }
+}
+
+static struct zsv_cell zsv_compare_get_parallel_cell(struct zsv_compare_input *input, unsigned ix) {
+  struct zsv_cell c = { 0 };
+  struct zsv_compare_reader_block *b = input->reader->current;
+  if(b && b->next_row) {
+    size_t row = b->next_row - 1;
+    size_t start = row ? b->rows.row_ends[row - 1] : 0;
+    if(start + ix < b->rows.row_ends[row]) {
+      const struct zsv_block_cell *cell = &b->rows.cells[start + ix];
+      c.len = cell->len;
+      c.str = (unsigned char *)zsv_strtrim(b->rows.raw + cell->offset, &c.len);
+      c.quoted = cell->quoted;
+    }
+  }
+  return c;
+}
+
+static enum zsv_compare_status
+input_init_parallel(struct zsv_compare_data *data,
+                    struct zsv_compare_input *input,
+                    struct zsv_opts *opts,
+                    const char *opts_used) {
+  enum zsv_compare_status stat = input_init_unsorted(data, input, opts, opts_used);
+  if(stat == zsv_compare_status_ok) {
+    struct zsv_blockpool_opts pool_opts = { 0 };
+    pool_opts.block_size = sizeof(struct zsv_compare_reader_block);
+    pool_opts.block_count = ZSV_COMPARE_READER_BLOCK_COUNT;
+    if(!(input->reader = calloc(1, sizeof(*input->reader)))
+       || !(input->reader->pool = zsv_blockpool_new(&pool_opts)))
+      return zsv_compare_status_memory;
+    input->reader->input = input;
+  }
+  return stat;
+}
+
+struct zsv_compare_input_init_ctx {
+  struct zsv_compare_data *data;
+  struct zsv_compare_input *input;
+  struct zsv_opts *opts;
+  const char *opts_used;
+  enum zsv_compare_status status;
+};
+
+static void *zsv_compare_input_init_run(void *p) {
+  struct zsv_compare_input_init_ctx *ctx = p;
+  ctx->status = ctx->data->input_init(ctx->data, ctx->input, ctx->opts, ctx->opts_used);
+  return NULL;
+}
+
+/**
+ * Initialize each input in its own thread. Used with --sort, where each input
+ * is loaded and sorted upon initialization
+ */
+static enum zsv_compare_status zsv_compare_init_inputs_parallel(struct zsv_compare_data *data,
+                                                                struct zsv_opts *opts,
+                                                                const char *opts_used) {
+  struct zsv_compare_input_init_ctx *ctx = calloc(data->input_count, sizeof(*ctx));
+  pthread_t *threads = calloc(data->input_count, sizeof(*threads));
+  char *started = calloc(data->input_count, sizeof(*started));
+  enum zsv_compare_status stat = zsv_compare_status_ok;
+  if(!ctx || !threads || !started)
+    stat = zsv_compare_status_memory;
+  else {
+    for(unsigned i = 0; i < data->input_count; i++) {
+      ctx[i].data = data;
+      ctx[i].input = &data->inputs[i];
+      ctx[i].opts = opts;
+      ctx[i].opts_used = opts_used;
+      if(!pthread_create(&threads[i], NULL, zsv_compare_input_init_run, &ctx[i]))
+        started[i] = 1;
+      else // run it in this thread instead
+        zsv_compare_input_init_run(&ctx[i]);
+    }
+    for(unsigned i = 0; i < data->input_count; i++) {
+      if(started[i])
+        pthread_join(threads[i], NULL);
+      if(stat == zsv_compare_status_ok)
+        stat = ctx[i].status;
+    }
+  }
+  free(ctx);
+  free(threads);
+  free(started);
+  return stat;
+}
+
+static enum zsv_compare_status zsv_compare_init_parallel(struct zsv_compare_data *data) {
+  if(!data->sort && !data->hash) {
+    data->next_row = zsv_compare_next_parallel_row;
+    data->get_cell = zsv_compare_get_parallel_cell;
+    data->input_init = input_init_parallel;
+  }
+  return zsv_compare_status_ok;
+}
+#endif
@@ -1,76 +1,563 @@
 /**
- * To implement sorting, we will use sqlite, create a table for each CSV file and run "select * order by ..."
+ * To implement sorting, each input is read in full and sorted with an external
+ * merge sort: parsed rows are collected in a buffer and, each time the buffer
+ * reaches its share of the memory budget (see --sort-buffer-mb), the buffered
+ * rows are sorted and written to a temporary file as a sorted run. The runs are
+ * then merged, one row at a time, as the compare proceeds. If an input fits in
+ * its buffer, it is sorted and compared entirely in memory
+ *
+ * Rows are ordered the same way that zsv_compare_inputp_cmp() matches them:
+ * by each key's trimmed value, compared case-insensitively
  */
 
-static int zsv_compare_sort_prep_table(struct zsv_compare_data *data,
-                                       const char *fname,
-                                       const char *opts_used,
-                                       int max_columns,
-                                       char **err_msg,
-                                       unsigned int table_ix
-                                       ) {
-#define ZSV_COMPARE_MAX_TABLES 1000
-  char *sql = NULL;
-  if(table_ix > ZSV_COMPARE_MAX_TABLES)
-    return -1;
+#define ZSV_COMPARE_SORT_BUFFER_MB_DEFAULT 256
+#define ZSV_COMPARE_SORT_READ_BUFFER_MIN (64 * 1024)
+#define ZSV_COMPARE_SORT_READ_BUFFER_MAX (1024 * 1024)
 
-  if(max_columns == 0)
-    max_columns = 2048;
+#if defined(_WIN32) || defined(WIN32) || defined(WIN)
+#define zsv_compare_sort_fseek _fseeki64
+#else
+#define zsv_compare_sort_fseek fseeko
+#endif
 
-  sql = sqlite3_mprintf("CREATE VIRTUAL TABLE data%i USING csv(filename=%Q,options_used=%Q,max_columns=%i)", table_ix, fname, opts_used, max_columns);
-  if(!sql)
-    return -1;
+/**
+ * A sorted row is stored as a record, in the same format in memory and in run
+ * files. A record is a sequence of uint32 values:
+ *   size (in bytes, of the whole record, padded to a multiple of 4)
+ *   cell count
+ *   key count
+ *   end offset of each cell's value, relative to the end of the preceding cell
+ *   end offset of each key's value, relative to the end of the preceding key
+ * followed by the (trimmed) cell values and the (lower-cased) key values
+ */
+#define ZSV_COMPARE_SORT_RECORD_HEADER 3
+
+struct zsv_compare_sort_run {
+  uint64_t offset; // position, in the run file, of the next unread data
+  uint64_t end;    // end of this run in the run file
+  unsigned char *buff;
+  size_t buff_size;
+  size_t buff_len;
+  size_t buff_pos;
+  const unsigned char *row; // current record, or NULL if the run is exhausted
+};
+
+struct zsv_compare_sorter {
+  size_t max_bytes;
+
+  // called to empty the buffer when it is full; zsv_compare_sorter_spill() by default
+  enum zsv_compare_status (*spill)(struct zsv_compare_sorter *s);
+  void *spill_ctx;
+
+  // header
+  unsigned col_count;
+  struct zsv_cell *colnames;
+  unsigned char *colnames_buff;
+
+  unsigned key_count;
+  unsigned *key_col_ix;     // key_col_ix[key ix] = column ix, or UINT_MAX if not found
+  unsigned char **key_tmp;  // lower-cased non-ascii key values of the row being added
+  size_t *key_lens;
+
+  struct zsv_cell *cells;   // cells of the row being added
+  unsigned cells_size;
+
+  // buffered rows
+  unsigned char *arena;
+  size_t arena_len;
+  size_t arena_size;
+  size_t *offsets;          // offsets[i] = offset of row i in arena
+  const unsigned char **rows; // sorted rows, allocated with the same size as offsets
+  size_t row_count;
+  size_t rows_size;
+  size_t next_row;          // used if there are no runs
+
+  // sorted runs
+  char *filename;
+  FILE *file;
+  uint64_t file_len;
+  struct zsv_compare_sort_run *runs;
+  unsigned run_count;
+  unsigned runs_size;
+  unsigned *heap;           // min-heap of indexes of non-exhausted runs
+  unsigned heap_count;
+  unsigned char started:1;  // whether a merged row has been returned yet
+  unsigned char _:7;
+
+  const unsigned char *row; // current record
+};
+
+static inline uint32_t zsv_compare_sort_record_u32(const unsigned char *record, size_t i) {
+  uint32_t v;
+  memcpy(&v, record + i * sizeof(v), sizeof(v));
+  return v;
+}
+
+static inline void zsv_compare_sort_record_set_u32(unsigned char *record, size_t i, uint32_t v) {
+  memcpy(record + i * sizeof(v), &v, sizeof(v));
+}
+
+static inline const unsigned char *zsv_compare_sort_record_data(const unsigned char *record,
+                                                                uint32_t cell_count,
+                                                                uint32_t key_count) {
+  return record + (ZSV_COMPARE_SORT_RECORD_HEADER + cell_count + key_count) * sizeof(uint32_t);
+}
+
+static struct zsv_cell zsv_compare_sort_record_cell(const unsigned char *record, unsigned ix) {
+  struct zsv_cell c = { 0 };
+  c.quoted = 1;
+  uint32_t cell_count = zsv_compare_sort_record_u32(record, 1);
+  if(ix < cell_count) {
+    uint32_t start = ix ? zsv_compare_sort_record_u32(record, ZSV_COMPARE_SORT_RECORD_HEADER + ix - 1) : 0;
+    uint32_t end = zsv_compare_sort_record_u32(record, ZSV_COMPARE_SORT_RECORD_HEADER + ix);
+    c.str = (unsigned char *)zsv_compare_sort_record_data(record, cell_count,
+                                                          zsv_compare_sort_record_u32(record, 2)) + start;
+    c.len = end - start;
+  }
+  return c;
+}
+
+// get the (lower-cased) key values of a record, which are stored contiguously
+static const unsigned char *zsv_compare_sort_record_keys(const unsigned char *record, size_t *len) {
+  uint32_t cell_count = zsv_compare_sort_record_u32(record, 1);
+  uint32_t key_count = zsv_compare_sort_record_u32(record, 2);
+  *len = key_count ? zsv_compare_sort_record_u32(record, ZSV_COMPARE_SORT_RECORD_HEADER + cell_count + key_count - 1) : 0;
+  return zsv_compare_sort_record_data(record, cell_count, key_count)
+    + (cell_count ? zsv_compare_sort_record_u32(record, ZSV_COMPARE_SORT_RECORD_HEADER + cell_count - 1) : 0);
+}
+
+static int zsv_compare_sort_record_cmp(const unsigned char *x, const unsigned char *y) {
+  uint32_t x_cells = zsv_compare_sort_record_u32(x, 1);
+  uint32_t y_cells = zsv_compare_sort_record_u32(y, 1);
+  uint32_t key_count = zsv_compare_sort_record_u32(x, 2);
+  const uint32_t x_keys_ix = ZSV_COMPARE_SORT_RECORD_HEADER + x_cells;
+  const uint32_t y_keys_ix = ZSV_COMPARE_SORT_RECORD_HEADER + y_cells;
+  const unsigned char *x_key = zsv_compare_sort_record_data(x, x_cells, key_count)
+    + (x_cells ? zsv_compare_sort_record_u32(x, x_keys_ix - 1) : 0);
+  const unsigned char *y_key = zsv_compare_sort_record_data(y, y_cells, key_count)
+    + (y_cells ? zsv_compare_sort_record_u32(y, y_keys_ix - 1) : 0);
+
+  uint32_t x_start = 0, y_start = 0;
+  for(uint32_t i = 0; i < key_count; i++) {
+    uint32_t x_end = zsv_compare_sort_record_u32(x, x_keys_ix + i);
+    uint32_t y_end = zsv_compare_sort_record_u32(y, y_keys_ix + i);
+    uint32_t x_len = x_end - x_start, y_len = y_end - y_start;
+    int cmp = memcmp(x_key + x_start, y_key + y_start, x_len < y_len ? x_len : y_len);
+    if(cmp)
+      return cmp;
+    if(x_len != y_len)
+      return x_len < y_len ? -1 : 1;
+    x_start = x_end, y_start = y_end;
+  }
+  return 0;
+}
+
+static int zsv_compare_sort_rowp_cmp(const void *xp, const void *yp) {
+  const unsigned char *x = *(const unsigned char * const *)xp;
+  const unsigned char *y = *(const unsigned char * const *)yp;
+  int cmp = zsv_compare_sort_record_cmp(x, y);
+  if(!cmp) // keep rows with the same keys in their original order
+    cmp = x < y ? -1 : x > y ? 1 : 0;
+  return cmp;
+}
+
+static void zsv_compare_sorter_delete(struct zsv_compare_sorter *s) {
+  if(s) {
+    free(s->colnames);
+    free(s->colnames_buff);
+    free(s->key_col_ix);
+    free(s->key_tmp);
+    free(s->key_lens);
+    free(s->cells);
+    free(s->arena);
+    free(s->offsets);
+    free(s->rows);
+    if(s->file)
+      fclose(s->file);
+    if(s->filename) {
+      remove(s->filename);
+      free(s->filename);
+    }
+    for(unsigned i = 0; i < s->run_count; i++)
+      free(s->runs[i].buff);
+    free(s->runs);
+    free(s->heap);
+    free(s);
+  }
+}
+
+static enum zsv_compare_status zsv_compare_sorter_set_header(struct zsv_compare_sorter *s,
+                                                             zsv_parser parser,
+                                                             struct zsv_compare_key *keys) {
+  s->col_count = zsv_cell_count(parser);
+  size_t total = 0;
+  for(unsigned i = 0; i < s->col_count; i++)
+    total += zsv_get_cell_trimmed(parser, i).len + 1;
+  if((s->col_count && !(s->colnames = calloc(s->col_count, sizeof(*s->colnames))))
+     || !(s->colnames_buff = malloc(total + 1)))
+    return zsv_compare_status_memory;
+
+  unsigned char *p = s->colnames_buff;
+  for(unsigned i = 0; i < s->col_count; i++) {
+    struct zsv_cell c = zsv_get_cell_trimmed(parser, i);
+    if(c.len)
+      memcpy(p, c.str, c.len);
+    p[c.len] = '\0';
+    s->colnames[i].str = p;
+    s->colnames[i].len = c.len;
+    s->colnames[i].quoted = 1;
+    p += c.len + 1;
+  }
+
+  // assign columns to keys in the same manner as compare's main routine does
+  for(unsigned j = 0; j < s->key_count; j++)
+    s->key_col_ix[j] = UINT_MAX;
+  for(unsigned i = 0; i < s->col_count; i++) {
+    unsigned j = 0;
+    for(struct zsv_compare_key *key = keys; key && j < s->key_count; key = key->next, j++) {
+      if(s->key_col_ix[j] == UINT_MAX
+         && !zsv_strincmp(s->colnames[i].str, s->colnames[i].len,
+                          (const unsigned char *)key->name, strlen(key->name))) {
+        s->key_col_ix[j] = i;
+        break;
+      }
+    }
+  }
+  return zsv_compare_status_ok;
+}
+
+static enum zsv_compare_status zsv_compare_sorter_open_file(struct zsv_compare_sorter *s) {
+  if(!(s->filename = zsv_get_temp_filename("zsv_compare_sort")))
+    return zsv_compare_status_error;
+  if(!(s->file = fopen(s->filename, "w+b"))) {
+    perror(s->filename);
+    return zsv_compare_status_error;
+  }
+  setvbuf(s->file, NULL, _IOFBF, ZSV_COMPARE_SORT_READ_BUFFER_MAX);
+  return zsv_compare_status_ok;
+}
+
+static enum zsv_compare_status zsv_compare_sorter_sort(struct zsv_compare_sorter *s) {
+  if(!s->row_count)
+    return zsv_compare_status_ok;
+  if(!s->rows && !(s->rows = malloc(s->rows_size * sizeof(*s->rows))))
+    return zsv_compare_status_memory;
+  for(size_t i = 0; i < s->row_count; i++)
+    s->rows[i] = s->arena + s->offsets[i];
+  qsort(s->rows, s->row_count, sizeof(*s->rows), zsv_compare_sort_rowp_cmp);
+  return zsv_compare_status_ok;
+}
+
+// sort the buffered rows, write them to the run file and empty the buffer
+static enum zsv_compare_status zsv_compare_sorter_spill(struct zsv_compare_sorter *s) {
+  enum zsv_compare_status stat;
+  if(!s->file && (stat = zsv_compare_sorter_open_file(s)) != zsv_compare_status_ok)
+    return stat;
+  if((stat = zsv_compare_sorter_sort(s)) != zsv_compare_status_ok)
+    return stat;
+
+  if(s->run_count == s->runs_size) {
+    unsigned new_size = s->runs_size ? s->runs_size * 2 : 16;
+    struct zsv_compare_sort_run *runs = realloc(s->runs, new_size * sizeof(*runs));
+    if(!runs)
+      return zsv_compare_status_memory;
+    s->runs = runs;
+    s->runs_size = new_size;
+  }
 
-  int rc = sqlite3_exec(data->sort_db, sql, NULL, NULL, err_msg);
-  sqlite3_free(sql);
-  return rc;
+  struct zsv_compare_sort_run *run = &s->runs[s->run_count++];
+  memset(run, 0, sizeof(*run));
+  run->offset = s->file_len;
+  for(size_t i = 0; i < s->row_count; i++) {
+    uint32_t size = zsv_compare_sort_record_u32(s->rows[i], 0);
+    if(fwrite(s->rows[i], 1, size, s->file) != size) {
+      perror(s->filename);
+      return zsv_compare_status_error;
+    }
+    s->file_len += size;
+  }
+  run->end = s->file_len;
+  s->arena_len = 0;
+  s->row_count = 0;
+  return zsv_compare_status_ok;
 }
 
-/*
-static
-struct zsv_compare_sort **zsv_compare_sort_add(struct zsv_compare_sort **next,
-                                               const char *by,
-                                               enum zsv_compare_status *stat) {
-  struct zsv_compare_sort *e = calloc(1, sizeof(*e));
-  if(!e)
-    *stat = zsv_compare_status_memory;
-  else {
-    e->by = by;
-    *next = e;
-    next = &e->next;
+static enum zsv_compare_status zsv_compare_sorter_add_row(struct zsv_compare_sorter *s,
+                                                          zsv_parser parser) {
+  unsigned cell_count = zsv_cell_count(parser);
+  if(cell_count > s->cells_size) {
+    free(s->cells);
+    if(!(s->cells = malloc(cell_count * sizeof(*s->cells))))
+      return zsv_compare_status_memory;
+    s->cells_size = cell_count;
+  }
+
+  size_t data_len = 0;
+  for(unsigned i = 0; i < cell_count; i++) {
+    s->cells[i] = zsv_get_cell_trimmed(parser, i);
+    data_len += s->cells[i].len;
+  }
+
+  // lower-case the keys; ascii values are converted in place when copied into the record
+  enum zsv_compare_status stat = zsv_compare_status_ok;
+  for(unsigned j = 0; j < s->key_count; j++) {
+    struct zsv_cell c = { 0 };
+    if(s->key_col_ix[j] < cell_count)
+      c = s->cells[s->key_col_ix[j]];
+    s->key_lens[j] = c.len;
+    s->key_tmp[j] = NULL;
+    for(size_t k = 0; k < c.len; k++) {
+      if(c.str[k] & 0x80) {
+        if(!(s->key_tmp[j] = zsv_strtolowercase(c.str, &s->key_lens[j])))
+          stat = zsv_compare_status_memory;
+        break;
+      }
+    }
+    data_len += s->key_lens[j];
+  }
+
+  size_t size = (ZSV_COMPARE_SORT_RECORD_HEADER + cell_count + s->key_count) * sizeof(uint32_t) + data_len;
+  size = (size + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+  if(stat == zsv_compare_status_ok && size > UINT32_MAX) {
+    fprintf(stderr, "Row too large to sort\n");
+    stat = zsv_compare_status_error;
+  }
+
+  // spill the buffered rows if this row would put us over budget
+  if(stat == zsv_compare_status_ok && s->row_count
+     && s->arena_len + size + (s->row_count + 1) * (sizeof(*s->offsets) + sizeof(*s->rows)) > s->max_bytes)
+    stat = s->spill(s);
+
+  if(stat == zsv_compare_status_ok && s->arena_len + size > s->arena_size) {
+    size_t new_size = s->arena_size * 2;
+    if(new_size > s->max_bytes)
+      new_size = s->max_bytes;
+    if(new_size < s->arena_len + size)
+      new_size = s->arena_len + size;
+    unsigned char *arena = realloc(s->arena, new_size);
+    if(!arena)
+      stat = zsv_compare_status_memory;
+    else {
+      s->arena = arena;
+      s->arena_size = new_size;
+    }
+  }
+
+  if(stat == zsv_compare_status_ok && s->row_count == s->rows_size) {
+    size_t new_size = s->rows_size ? s->rows_size * 2 : 1024;
+    size_t *offsets = realloc(s->offsets, new_size * sizeof(*offsets));
+    if(!offsets)
+      stat = zsv_compare_status_memory;
+    else {
+      s->offsets = offsets;
+      free(s->rows); // will be reallocated when sorted
+      s->rows = NULL;
+      s->rows_size = new_size;
+    }
+  }
+
+  if(stat == zsv_compare_status_ok) {
+    unsigned char *record = s->arena + s->arena_len;
+    zsv_compare_sort_record_set_u32(record, 0, (uint32_t)size);
+    zsv_compare_sort_record_set_u32(record, 1, cell_count);
+    zsv_compare_sort_record_set_u32(record, 2, s->key_count);
+
+    unsigned char *p = (unsigned char *)zsv_compare_sort_record_data(record, cell_count, s->key_count);
+    uint32_t end = 0;
+    for(unsigned i = 0; i < cell_count; i++) {
+      if(s->cells[i].len)
+        memcpy(p + end, s->cells[i].str, s->cells[i].len);
+      end += s->cells[i].len;
+      zsv_compare_sort_record_set_u32(record, ZSV_COMPARE_SORT_RECORD_HEADER + i, end);
+    }
+
+    p += end;
+    end = 0;
+    for(unsigned j = 0; j < s->key_count; j++) {
+      if(s->key_tmp[j])
+        memcpy(p + end, s->key_tmp[j], s->key_lens[j]);
+      else if(s->key_lens[j]) {
+        const unsigned char *src = s->cells[s->key_col_ix[j]].str;
+        for(size_t k = 0; k < s->key_lens[j]; k++)
+          p[end + k] = src[k] >= 'A' && src[k] <= 'Z' ? src[k] + ('a' - 'A') : src[k];
+      }
+      end += s->key_lens[j];
+      zsv_compare_sort_record_set_u32(record, ZSV_COMPARE_SORT_RECORD_HEADER + cell_count + j, end);
+    }
+    p += end;
+    memset(p, 0, record + size - p); // padding
+
+    s->offsets[s->row_count++] = s->arena_len;
+    s->arena_len += size;
   }
-  return next;
+
+  for(unsigned j = 0; j < s->key_count; j++)
+    free(s->key_tmp[j]);
+  return stat;
 }
 
-static void zsv_compare_sort_delete(struct zsv_compare_sort *sort) {
-  for(struct zsv_compare_sort *next; sort; sort = next) {
-    next = sort->next;
-    free(sort);
+/**
+ * Make the run's next record current. Returns non-zero on error
+ */
+static int zsv_compare_sort_run_next(struct zsv_compare_sorter *s,
+                                     struct zsv_compare_sort_run *run) {
+  if(run->row)
+    run->buff_pos += zsv_compare_sort_record_u32(run->row, 0);
+  run->row = NULL;
+
+  size_t needed = sizeof(uint32_t);
+  for(int i = 0; i < 2; i++) {
+    if(run->buff_len - run->buff_pos < needed) {
+      // refill the buffer, keeping whatever part of the record we already have
+      memmove(run->buff, run->buff + run->buff_pos, run->buff_len - run->buff_pos);
+      run->buff_len -= run->buff_pos;
+      run->buff_pos = 0;
+      if(needed > run->buff_size) {
+        unsigned char *buff = realloc(run->buff, needed);
+        if(!buff) {
+          fprintf(stderr, "Out of memory!\n");
+          return 1;
+        }
+        run->buff = buff;
+        run->buff_size = needed;
+      }
+      size_t want = run->buff_size - run->buff_len;
+      if(want > run->end - run->offset)
+        want = run->end - run->offset;
+      if(want) {
+        if(zsv_compare_sort_fseek(s->file, run->offset, SEEK_SET)
+           || fread(run->buff + run->buff_len, 1, want, s->file) != want) {
+          perror(s->filename);
+          return 1;
+        }
+        run->offset += want;
+        run->buff_len += want;
+      }
+      if(run->buff_len < needed) {
+        if(run->buff_len) {
+          fprintf(stderr, "%s: unexpected end of sorted run\n", s->filename);
+          return 1;
+        }
+        return 0; // exhausted
+      }
+    }
+    if(i == 0)
+      needed = zsv_compare_sort_record_u32(run->buff + run->buff_pos, 0);
   }
+  run->row = run->buff + run->buff_pos;
+  return 0;
 }
 
-*/
+static int zsv_compare_sort_heap_cmp(struct zsv_compare_sorter *s, unsigned x, unsigned y) {
+  int cmp = zsv_compare_sort_record_cmp(s->runs[x].row, s->runs[y].row);
+  if(!cmp) // earlier runs hold earlier rows
+    cmp = x < y ? -1 : 1;
+  return cmp;
+}
 
-static int zsv_compare_sort_stmt_prep(sqlite3 *db, sqlite3_stmt **stmtp,
-                                      // struct zsv_compare_sort *sort,
-                                      struct zsv_compare_key *keys,
-                                      unsigned ix) {
-  sqlite3_str *select_clause = sqlite3_str_new(db);
-  if(!select_clause) {
-    fprintf(stderr, "Out of memory!\n");
-    return -1;
+static void zsv_compare_sort_heap_down(struct zsv_compare_sorter *s, unsigned i) {
+  unsigned *heap = s->heap;
+  while(1) {
+    unsigned min = i, left = 2 * i + 1, right = left + 1;
+    if(left < s->heap_count && zsv_compare_sort_heap_cmp(s, heap[left], heap[min]) < 0)
+      min = left;
+    if(right < s->heap_count && zsv_compare_sort_heap_cmp(s, heap[right], heap[min]) < 0)
+      min = right;
+    if(min == i)
+      break;
+    unsigned tmp = heap[i];
+    heap[i] = heap[min];
+    heap[min] = tmp;
+    i = min;
+  }
+}
+
+// called after all rows have been added
+static enum zsv_compare_status zsv_compare_sorter_finish(struct zsv_compare_sorter *s) {
+  enum zsv_compare_status stat;
+  if(!s->run_count) // everything fit in memory
+    return zsv_compare_sorter_sort(s);
+
+  if(s->row_count && (stat = zsv_compare_sorter_spill(s)) != zsv_compare_status_ok)
+    return stat;
+  if(fflush(s->file)) {
+    perror(s->filename);
+    return zsv_compare_status_error;
   }
 
-  sqlite3_str_appendf(select_clause, "select * from data%i order by ", ix);
-//  for(struct zsv_compare_sort *tmp = sort; tmp; tmp = tmp->next)
-  for(struct zsv_compare_key *key = keys; key; key = key->next)
-    sqlite3_str_appendf(select_clause, "%s\"%w\"", key == keys ? "" : ", ", key->name);
+  // release the sort buffer before allocating merge buffers
+  free(s->arena);
+  free(s->offsets);
+  free(s->rows);
+  s->arena = NULL, s->offsets = NULL, s->rows = NULL;
+  s->arena_size = s->rows_size = 0;
 
-  int rc = sqlite3_prepare_v2(db, sqlite3_str_value(select_clause), -1, stmtp, NULL);
-  if(rc != SQLITE_OK)
-    fprintf(stderr, "%s: %s\n", sqlite3_errstr(rc), sqlite3_str_value(select_clause));
-  sqlite3_free(sqlite3_str_finish(select_clause));
-  return rc;
+  size_t buff_size = s->max_bytes / s->run_count;
+  if(buff_size < ZSV_COMPARE_SORT_READ_BUFFER_MIN)
+    buff_size = ZSV_COMPARE_SORT_READ_BUFFER_MIN;
+  if(buff_size > ZSV_COMPARE_SORT_READ_BUFFER_MAX)
+    buff_size = ZSV_COMPARE_SORT_READ_BUFFER_MAX;
+  if(!(s->heap = malloc(s->run_count * sizeof(*s->heap))))
+    return zsv_compare_status_memory;
+  for(unsigned i = 0; i < s->run_count; i++) {
+    struct zsv_compare_sort_run *run = &s->runs[i];
+    if(!(run->buff = malloc(buff_size)))
+      return zsv_compare_status_memory;
+    run->buff_size = buff_size;
+    if(zsv_compare_sort_run_next(s, run))
+      return zsv_compare_status_error;
+    if(run->row)
+      s->heap[s->heap_count++] = i;
+  }
+  for(unsigned i = s->heap_count / 2; i-- > 0; )
+    zsv_compare_sort_heap_down(s, i);
+  return zsv_compare_status_ok;
+}
+
+/**
+ * Open an input and read its header, ready for its rows to be added to a sorter
+ */
+static enum zsv_compare_status
+zsv_compare_sorter_open(struct zsv_compare_data *data,
+                        struct zsv_compare_input *input,
+                        struct zsv_opts *opts,
+                        size_t max_bytes) {
+  struct zsv_compare_sorter *s = input->sorter = calloc(1, sizeof(*input->sorter));
+  if(!s)
+    return zsv_compare_status_memory;
+  s->max_bytes = max_bytes;
+  s->spill = zsv_compare_sorter_spill;
+  s->key_count = data->key_count;
+  if(s->key_count && (!(s->key_col_ix = calloc(s->key_count, sizeof(*s->key_col_ix)))
+                      || !(s->key_tmp = calloc(s->key_count, sizeof(*s->key_tmp)))
+                      || !(s->key_lens = calloc(s->key_count, sizeof(*s->key_lens)))))
+    return zsv_compare_status_memory;
+
+  if(!(input->stream = zsv_input_open(input->path))) {
+    perror(input->path);
+    return zsv_compare_status_error;
+  }
+  struct zsv_opts these_opts = *opts;
+  these_opts.stream = input->stream;
+  if(zsv_new_with_properties(&these_opts, input->path, NULL, &input->parser) != zsv_status_ok
+     || zsv_next_row(input->parser) != zsv_status_row)
+    return zsv_compare_status_error;
+
+  return zsv_compare_sorter_set_header(s, input->parser, data->keys);
+}
+
+// add all of an input's remaining rows to its sorter, and close the input
+static enum zsv_compare_status zsv_compare_sorter_load(struct zsv_compare_input *input) {
+  enum zsv_compare_status stat = zsv_compare_status_ok;
+  while(stat == zsv_compare_status_ok && zsv_next_row(input->parser) == zsv_status_row)
+    stat = zsv_compare_sorter_add_row(input->sorter, input->parser);
+
+  // the input has been consumed
+  zsv_delete(input->parser);
+  input->parser = NULL;
+  fclose(input->stream);
+  input->stream = NULL;
+  return stat;
 }
 
 static enum zsv_compare_status
@@ -79,50 +566,58 @@ input_init_sorted(struct zsv_compare_data *data,
                   struct zsv_opts *opts,
                   const char *opts_used
                   ) {
-  (void)(opts);
-  char *err_msg = NULL;
-  int rc = zsv_compare_sort_prep_table(data, input->path, opts_used, 0, &err_msg, input->index);
-  if(err_msg) {
-    fprintf(stderr, "%s\n", err_msg);
-    sqlite3_free(err_msg);
-  }
-  if(rc == SQLITE_OK)
-    rc = zsv_compare_sort_stmt_prep(data->sort_db, &input->sort_stmt,
-                                    data->keys, // data->sort,
-                                    input->index);
-  return rc == SQLITE_OK ? zsv_compare_status_ok : zsv_compare_status_error;
+  (void)(opts_used);
+  enum zsv_compare_status stat =
+    zsv_compare_sorter_open(data, input, opts, data->sort_buffer_size / data->input_count);
+  if(stat == zsv_compare_status_ok)
+    stat = zsv_compare_sorter_load(input);
+  if(stat == zsv_compare_status_ok)
+    stat = zsv_compare_sorter_finish(input->sorter);
+  return stat;
 }
 
 static enum zsv_status zsv_compare_next_sorted_row(struct zsv_compare_input *input) {
-  if(sqlite3_step(input->sort_stmt) == SQLITE_ROW)
-    return zsv_status_row;
-
-  // to do: check if error; if so return zsv_status_error
-  return zsv_status_done;
+  struct zsv_compare_sorter *s = input->sorter;
+  s->row = NULL;
+  if(!s->run_count) {
+    if(s->next_row < s->row_count)
+      s->row = s->rows[s->next_row++];
+  } else {
+    // advance the run whose row was returned last. This is deferred until now
+    // so that cells of the current row remain valid until the next row is requested
+    if(s->started && s->heap_count) {
+      struct zsv_compare_sort_run *run = &s->runs[s->heap[0]];
+      if(zsv_compare_sort_run_next(s, run)) {
+        s->heap_count = 0;
+        return zsv_status_error;
+      }
+      if(!run->row)
+        s->heap[0] = s->heap[--s->heap_count];
+      zsv_compare_sort_heap_down(s, 0);
+    }
+    s->started = 1;
+    if(s->heap_count)
+      s->row = s->runs[s->heap[0]].row;
+  }
+  return s->row ? zsv_status_row : zsv_status_done;
 }
 
 static struct zsv_cell zsv_compare_get_sorted_colname(struct zsv_compare_input *input, unsigned ix) {
-  struct zsv_cell c;
-  c.str = (unsigned char *)sqlite3_column_name(input->sort_stmt, (int)ix);
-  c.len = c.str ? strlen((const char *)c.str) : 0;
-  c.quoted = 1;
+  struct zsv_compare_sorter *s = input->sorter;
+  if(ix < s->col_count)
+    return s->colnames[ix];
+  struct zsv_cell c = { 0 };
   return c;
 }
 
 static unsigned zsv_compare_get_sorted_colcount(struct zsv_compare_input *input) {
-  int col_count = sqlite3_column_count(input->sort_stmt);
-  if(col_count >= 0)
-    return (unsigned) col_count;
-  return 0;
+  return input->sorter->col_count;
 }
 
-
 static struct zsv_cell zsv_compare_get_sorted_cell(struct zsv_compare_input *input, unsigned ix) {
-  struct zsv_cell c;
-  c.str = (unsigned char *)sqlite3_column_text(input->sort_stmt, (int)ix);
-  c.len = c.str ? sqlite3_column_bytes(input->sort_stmt, (int)ix) : 0;
-  if(c.len)
-    c.str = (unsigned char *)zsv_strtrim(c.str, &c.len);
-  c.quoted = 1;
+  struct zsv_compare_sorter *s = input->sorter;
+  if(s->row)
+    return zsv_compare_sort_record_cell(s->row, ix);
+  struct zsv_cell c = { 0 };
   return c;
 }
@@ -12,6 +12,7 @@
 
 #define ZSV_COMMAND count_pull
 #include "zsv_command.h"
+#include <zsv/utils/compress.h>
 
 static int count_usage() {
   static const char *usage =
@@ -38,7 +39,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       else {
         if(opts->stream)
           fprintf(stderr, "Input may not be specified more than once\n");
-        else if(!(opts->stream = fopen(argv[i], "rb")))
+        else if(!(opts->stream = zsv_input_open(argv[i])))
           fprintf(stderr, "Unable to open for reading: %s\n", argv[i]);
         else {
           input_path = argv[i];
@@ -66,11 +67,15 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       err = 1;
     } else {
       size_t count = 0;
+      enum zsv_status status;
 //      zsv_pull_row r;
-      while(zsv_next_row(parser) == zsv_status_row)
+      while((status = zsv_next_row(parser)) == zsv_status_row)
         count++;
       zsv_delete(parser);
-      printf("%zu\n", count  > 0 ? count - 1 : 0);
+      if(status == zsv_status_error)
+        err = 1;
+      else
+        printf("%zu\n", count  > 0 ? count - 1 : 0);
     }
   }
 
@@ -12,6 +12,7 @@
 
 #define ZSV_COMMAND count
 #include "zsv_command.h"
+#include <zsv/utils/compress.h>
 
 struct data {
   zsv_parser parser;
@@ -48,7 +49,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       else {
         if(opts->stream)
           fprintf(stderr, "Input may not be specified more than once\n");
-        else if(!(opts->stream = fopen(argv[i], "rb")))
+        else if(!(opts->stream = zsv_input_open(argv[i])))
           fprintf(stderr, "Unable to open for reading: %s\n", argv[i]);
         else {
           input_path = argv[i];
@@ -80,7 +81,10 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         ;
       zsv_finish(data.parser);
       zsv_delete(data.parser);
-      printf("%zu\n", data.rows  > 0 ? data.rows - 1 : 0);
+      if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+        err = 1;
+      else
+        printf("%zu\n", data.rows  > 0 ? data.rows - 1 : 0);
     }
   }
 
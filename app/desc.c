@@ -6,10 +6,9 @@
  * https://opensource.org/licenses/MIT
  */
 
-#include <sglib.h>
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
 #include <fenv.h>
@@ -23,72 +22,197 @@
 #include <zsv/utils/file.h>
 #include <zsv/utils/mem.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/compress.h>
+#include <zsv/utils/sketch.h>
+#include <zsv/utils/blockpool.h>
 
 #define ZSV_DESC_MAX_COLS_DEFAULT 32768
 #define ZSV_DESC_MAX_COLS_DEFAULT_S "32768"
 
 #define ZSV_DESC_FLAG_MINMAX 1
 #define ZSV_DESC_FLAG_MINMAXLEN 2
+#define ZSV_DESC_FLAG_SKETCH 4
 #define ZSV_DESC_FLAG_UNIQUE 32
 #define ZSV_DESC_FLAG_UNIQUE_CI 64
 
-struct zsv_desc_string_list {
-  struct zsv_desc_string_list *next;
-  unsigned char *value;
-  size_t count;
+/**
+ * Distinct values of a column are tracked in an open-addressing hash set. Values
+ * are copied into a single arena, and each slot holds a value's hash, offset and
+ * length, so that most probes are resolved without touching the value itself
+ */
+struct zsv_desc_unique_slot {
+  uint64_t hash; // zero if the slot is empty
+  size_t offset; // offset of the value in the arena
+  size_t len;
 };
 
-void zsv_desc_string_list_free(struct zsv_desc_string_list *e) {
-  struct zsv_desc_string_list *n;
-  for( ; e; e = n) {
-    n = e->next;
-    if(e->value)
-      free(e->value);
-    free(e);
-  }
-}
-
-typedef struct zsv_desc_unique_key {
-  unsigned char color:1;
-  unsigned char _:7;
-  unsigned char *value;
-  struct zsv_desc_unique_key *left;
-  struct zsv_desc_unique_key *right;
-} zsv_desc_unique_key;
-
 struct zsv_desc_unique_key_container {
-  struct zsv_desc_unique_key *key;
+  struct zsv_desc_unique_slot *slots;
+  size_t mask;  // slot count - 1
+  unsigned char *arena;
+  size_t arena_len;
+  size_t arena_size;
+
   size_t max_count;
   size_t count;
   unsigned char not_enum:1;
   unsigned char dummy:7;
 };
 
-static struct zsv_desc_unique_key *zsv_desc_unique_key_new(const unsigned char *value, size_t len) {
-  zsv_desc_unique_key *key = calloc(1, sizeof(*key));
-  if(!key || !(key->value = malloc(len + 1)))
-    ; // handle out-of-memory error!
-  else {
-    memcpy(key->value, value, len);
-    key->value[len] = '\0';
+// FNV-1a hash, optionally of the value's ascii-lowercase form. Never zero
+static inline uint64_t zsv_desc_hash(const unsigned char *value, size_t len, char fold) {
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i = 0; i < len; i++) {
+    unsigned char c = value[i];
+    if(fold && c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    h ^= c;
+    h *= 1099511628211ULL;
   }
-  return key;
+  return h ? h : 1;
 }
 
-static void zsv_desc_unique_key_delete(zsv_desc_unique_key *e) {
-  if(e)
-    free(e->value);
-  free(e);
+// whether a value is equal to a stored value, which if fold is set is in lower case
+static inline int zsv_desc_unique_eq(const unsigned char *stored, const unsigned char *value,
+                                     size_t len, char fold) {
+  if(!fold)
+    return !memcmp(stored, value, len);
+  for(size_t i = 0; i < len; i++) {
+    unsigned char c = value[i];
+    if(c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    if(stored[i] != c)
+      return 0;
+  }
+  return 1;
 }
 
-static int zsv_desc_unique_key_cmp(zsv_desc_unique_key *x, zsv_desc_unique_key *y) {
-  return strcmp((const char *)x->value, (const char *)y->value);
+static void zsv_desc_column_unique_values_delete(struct zsv_desc_unique_key_container *c) {
+  free(c->slots);
+  free(c->arena);
+  c->slots = NULL;
+  c->arena = NULL;
+  c->mask = c->arena_len = c->arena_size = 0;
 }
 
-SGLIB_DEFINE_RBTREE_PROTOTYPES(zsv_desc_unique_key, left, right, color, zsv_desc_unique_key_cmp);
-SGLIB_DEFINE_RBTREE_FUNCTIONS(zsv_desc_unique_key, left, right, color, zsv_desc_unique_key_cmp);
+static int zsv_desc_unique_grow(struct zsv_desc_unique_key_container *c) {
+  size_t new_count = c->slots ? (c->mask + 1) * 2 : 64;
+  struct zsv_desc_unique_slot *slots = calloc(new_count, sizeof(*slots));
+  if(!slots)
+    return 1;
+  if(c->slots) {
+    for(size_t i = 0; i <= c->mask; i++) {
+      if(c->slots[i].hash) {
+        size_t j = c->slots[i].hash & (new_count - 1);
+        while(slots[j].hash)
+          j = (j + 1) & (new_count - 1);
+        slots[j] = c->slots[i];
+      }
+    }
+    free(c->slots);
+  }
+  c->slots = slots;
+  c->mask = new_count - 1;
+  return 0;
+}
+
+/**
+ * Add a value to a hash set, if not already present. If fold is set, the value is
+ * compared and stored in ascii lower case, and must not contain non-ascii bytes
+ *
+ * @returns 1 if added, 0 if already present, -1 on out-of-memory
+ */
+static int zsv_desc_unique_add(struct zsv_desc_unique_key_container *c,
+                               const unsigned char *value, size_t len, char fold) {
+  if((c->count + 1) * 2 > (c->slots ? c->mask + 1 : 0) && zsv_desc_unique_grow(c))
+    return -1;
+
+  uint64_t h = zsv_desc_hash(value, len, fold);
+  size_t i = h & c->mask;
+  for(; c->slots[i].hash; i = (i + 1) & c->mask) {
+    struct zsv_desc_unique_slot *slot = &c->slots[i];
+    if(slot->hash == h && slot->len == len
+       && zsv_desc_unique_eq(c->arena + slot->offset, value, len, fold))
+      return 0;
+  }
+
+  if(c->arena_len + len > c->arena_size) {
+    size_t new_size = c->arena_size ? c->arena_size * 2 : 4096;
+    while(new_size < c->arena_len + len)
+      new_size *= 2;
+    unsigned char *arena = realloc(c->arena, new_size);
+    if(!arena)
+      return -1;
+    c->arena = arena;
+    c->arena_size = new_size;
+  }
+  unsigned char *stored = c->arena + c->arena_len;
+  if(!fold)
+    memcpy(stored, value, len);
+  else {
+    for(size_t k = 0; k < len; k++)
+      stored[k] = value[k] >= 'A' && value[k] <= 'Z' ? value[k] + ('a' - 'A') : value[k];
+  }
+  c->slots[i].hash = h;
+  c->slots[i].offset = c->arena_len;
+  c->slots[i].len = len;
+  c->arena_len += len;
+  c->count++;
+  return 1;
+}
 
 #define ZSV_DESC_MAX_EXAMPLE_COUNT 5 // could make this customizable...
+#define ZSV_DESC_EXAMPLE_SLOTS 16 // power of 2, at least twice ZSV_DESC_MAX_EXAMPLE_COUNT
+
+/**
+ * A column's first few distinct (case-insensitive) values, and how many more
+ * times each occurs. Values are looked up by the hash of their lower-case form
+ * in a small fixed-size table, so that each cell costs one hash and no allocation.
+ * A hash match is confirmed against the stored value (usually with a plain memcmp,
+ * as most repeats are byte-identical), so that colliding values are not merged
+ */
+struct zsv_desc_examples {
+  struct {
+    unsigned char *value;
+    size_t len;
+    size_t count; // number of occurrences after the first
+  } items[ZSV_DESC_MAX_EXAMPLE_COUNT];
+  unsigned count;
+
+  uint64_t slot_hashes[ZSV_DESC_EXAMPLE_SLOTS];
+  unsigned char slot_items[ZSV_DESC_EXAMPLE_SLOTS]; // item index + 1, or 0 if empty
+};
+
+static void zsv_desc_examples_update(struct zsv_desc_examples *e, const unsigned char *value, size_t len) {
+  uint64_t h = zsv_strihash(value, len);
+  unsigned i = h & (ZSV_DESC_EXAMPLE_SLOTS - 1);
+  for(; e->slot_items[i]; i = (i + 1) & (ZSV_DESC_EXAMPLE_SLOTS - 1)) {
+    if(e->slot_hashes[i] == h) {
+      unsigned ix = e->slot_items[i] - 1;
+      if((e->items[ix].len == len && !memcmp(e->items[ix].value, value, len))
+         || !zsv_strincmp(value, len, e->items[ix].value, e->items[ix].len)) {
+        e->items[ix].count++;
+        return;
+      }
+    }
+  }
+  if(e->count < ZSV_DESC_MAX_EXAMPLE_COUNT && (e->items[e->count].value = zsv_memdup(value, len))) {
+    e->items[e->count].len = len;
+    e->slot_hashes[i] = h;
+    e->slot_items[i] = (unsigned char)++e->count;
+  }
+}
+
+static void zsv_desc_examples_free(struct zsv_desc_examples *e) {
+  for(unsigned i = 0; i < e->count; i++)
+    free(e->items[i].value);
+}
+
+// sketch sizes: about 1.6% error on distinct counts and under 1% rank error on quantiles
+#define ZSV_DESC_HLL_PRECISION 12
+#define ZSV_DESC_QUANTILES_K 200
+#define ZSV_DESC_TOPK_CAPACITY 64
+#define ZSV_DESC_TOPK_OUTPUT_COUNT 5
 struct zsv_desc_column_data {
   char *name;
   unsigned int position;
@@ -99,9 +223,15 @@ struct zsv_desc_column_data {
 
   struct zsv_desc_unique_key_container unique_values;
   struct zsv_desc_unique_key_container unique_values_ci;
-  struct zsv_desc_string_list *examples;
-  struct zsv_desc_string_list **examples_tail;
-  unsigned int examples_count;
+  struct zsv_desc_examples examples;
+
+  // fixed-size summaries of non-blank values, used if ZSV_DESC_FLAG_SKETCH is set
+  struct {
+    zsv_hll distinct;
+    zsv_quantiles lengths;
+    zsv_quantiles numbers;
+    zsv_topk top;
+  } sketch;
 
   unsigned int total_count;
   struct {
@@ -118,21 +248,15 @@ static void zsv_desc_column_data_finalize(struct zsv_desc_column_data *col, unsi
   col->position = i;
 }
 
-static void zsv_desc_column_unique_values_delete(zsv_desc_unique_key **tree) {
-  if(tree && *tree) {
-    struct sglib_zsv_desc_unique_key_iterator it;
-    struct zsv_desc_unique_key *e;
-    for(e=sglib_zsv_desc_unique_key_it_init(&it,*tree); e; e=sglib_zsv_desc_unique_key_it_next(&it))
-      zsv_desc_unique_key_delete(e);
-    *tree = NULL;
-  }
-}
-
 static void zsv_desc_column_data_free(struct zsv_desc_column_data *e) {
   free(e->name);
-  zsv_desc_column_unique_values_delete(&e->unique_values.key);
-  zsv_desc_column_unique_values_delete(&e->unique_values_ci.key);
-  zsv_desc_string_list_free(e->examples);
+  zsv_desc_column_unique_values_delete(&e->unique_values);
+  zsv_desc_column_unique_values_delete(&e->unique_values_ci);
+  zsv_desc_examples_free(&e->examples);
+  zsv_hll_delete(e->sketch.distinct);
+  zsv_quantiles_delete(e->sketch.lengths);
+  zsv_quantiles_delete(e->sketch.numbers);
+  zsv_topk_delete(e->sketch.top);
 }
 
 struct zsv_desc_column_name {
@@ -199,6 +323,11 @@ struct zsv_desc_data {
   char *overflowed;
   size_t overflow_count;
 
+#ifndef NO_THREADING
+  struct zsv_desc_parallel *parallel;
+  unsigned thread_count;
+#endif
+
   unsigned char quick:1;
   unsigned char _:7;
 };
@@ -239,12 +368,76 @@ static void write_headers(struct zsv_desc_data *data) {
   if(data->flags & ZSV_DESC_FLAG_UNIQUE_CI)
     zsv_writer_cell_s(data->csv_writer, 0, (const unsigned char *)"Unique (case-insensitive)", 0);
 
+  if(data->flags & ZSV_DESC_FLAG_SKETCH) {
+    const char *sketch_headers[] = {
+      "Distinct (est.)",
+      "Median Length",
+      "P90 Length",
+      "Numeric Count",
+      "Numeric Min",
+      "Numeric Median",
+      "Numeric P90",
+      "Numeric Max",
+      "Top Values",
+      NULL
+    };
+    for(int i = 0; sketch_headers[i]; i++)
+      zsv_writer_cell_s(data->csv_writer, 0, (const unsigned char *)sketch_headers[i], 0);
+  }
+
   for(int i = 0; headers2[i]; i++)
     zsv_writer_cell(data->csv_writer, 0,
                       (const unsigned char *)headers2[i],
                       strlen(headers2[i]), 1);
 }
 
+static void zsv_desc_print_number(struct zsv_desc_data *data, zsv_quantiles q, double rank) {
+  if(!zsv_quantiles_count(q))
+    zsv_writer_cell(data->csv_writer, 0, NULL, 0, 0);
+  else
+    zsv_writer_cell_double(data->csv_writer, 0, zsv_quantiles_get(q, rank));
+}
+
+static void zsv_desc_print_sketch(struct zsv_desc_data *data, struct zsv_desc_column_data *c) {
+  zsv_writer_cell_zu(data->csv_writer, 0, (size_t)llround(zsv_hll_estimate(c->sketch.distinct)));
+  zsv_desc_print_number(data, c->sketch.lengths, 0.5);
+  zsv_desc_print_number(data, c->sketch.lengths, 0.9);
+  zsv_writer_cell_zu(data->csv_writer, 0, (size_t)zsv_quantiles_count(c->sketch.numbers));
+  zsv_desc_print_number(data, c->sketch.numbers, 0);
+  zsv_desc_print_number(data, c->sketch.numbers, 0.5);
+  zsv_desc_print_number(data, c->sketch.numbers, 0.9);
+  zsv_desc_print_number(data, c->sketch.numbers, 1);
+
+  // top values, with their guaranteed minimum counts. Skip any whose count is
+  // mostly estimation error, or that might not occur more than once
+  struct zsv_topk_item items[ZSV_DESC_TOPK_CAPACITY];
+  unsigned count = zsv_topk_get(c->sketch.top, items, ZSV_DESC_TOPK_CAPACITY);
+  unsigned kept = 0; // sorted in place by guaranteed count
+  for(unsigned i = 0; i < count; i++) {
+    struct zsv_topk_item item = items[i];
+    item.count -= item.error;
+    if(item.count > 1 && item.count >= item.error) {
+      unsigned j = kept++;
+      for(; j > 0 && items[j - 1].count < item.count; j--)
+        items[j] = items[j - 1];
+      items[j] = item;
+    }
+  }
+
+  if(kept > ZSV_DESC_TOPK_OUTPUT_COUNT)
+    kept = ZSV_DESC_TOPK_OUTPUT_COUNT;
+  size_t s_size = 1;
+  for(unsigned i = 0; i < kept; i++)
+    s_size += items[i].len + 26; // "; ", " (", count, ")"
+  char *s = kept ? malloc(s_size) : NULL;
+  size_t s_len = 0;
+  for(unsigned i = 0; s && i < kept; i++)
+    s_len += snprintf(s + s_len, s_size - s_len, "%s%.*s (%zu)", i ? "; " : "", (int)items[i].len,
+                      items[i].value, (size_t)items[i].count);
+  zsv_writer_cell(data->csv_writer, 0, (const unsigned char *)s, s_len, 1);
+  free(s);
+}
+
 static void zsv_desc_print(struct zsv_desc_data *data) {
   if(data->header_only) {
     for(unsigned int i = 0; i < data->col_count; i++) {
@@ -278,20 +471,22 @@ static void zsv_desc_print(struct zsv_desc_data *data) {
         zsv_writer_cell_s(data->csv_writer, 0, (const unsigned char *)s, 0);
       }
 
+      if(data->flags & ZSV_DESC_FLAG_SKETCH)
+        zsv_desc_print_sketch(data, c);
+
       // count, blank %
       zsv_writer_cell_zu(data->csv_writer, 0, c->total_count);
-      zsv_writer_cell_Lf(data->csv_writer, 0, ".2",
-                           ((long double)c->mblank.count) / (long double) (c->total_count)
-                           * (long double)100);
+      zsv_writer_cell_fixed(data->csv_writer, 0,
+                            (double)c->mblank.count / (double)c->total_count * 100, 2);
 
-      for(struct zsv_desc_string_list *sl = c->examples; sl; sl = sl->next) {
-        if(sl->count) {
+      for(unsigned j = 0; j < c->examples.count; j++) {
+        if(c->examples.items[j].count) {
           char *tmp;
-          asprintf(&tmp, "%s (%zu)", sl->value, sl->count + 1);
+          asprintf(&tmp, "%s (%zu)", c->examples.items[j].value, c->examples.items[j].count + 1);
           zsv_writer_cell_s(data->csv_writer, 0, (unsigned char *)tmp, 1);
           free(tmp);
         } else
-          zsv_writer_cell_s(data->csv_writer, 0, sl->value, 1);
+          zsv_writer_cell_s(data->csv_writer, 0, c->examples.items[j].value, 1);
       }
     }
   }
@@ -308,21 +503,126 @@ static void zsv_desc_set_err(struct zsv_desc_data *data, enum zsv_desc_status er
 }
 
 // zsv_desc_column_update_unique(): return 1 if unique, 0 if dupe
-static int zsv_desc_column_update_unique(struct zsv_desc_unique_key_container *key_container,
-                                     const unsigned char *utf8_value, size_t len) {
-  zsv_desc_unique_key *key = zsv_desc_unique_key_new(utf8_value, len);
-  if(sglib_zsv_desc_unique_key_find_member(key_container->key, key)) { // not unique
-    if(key_container->count > key_container->max_count) {
-      zsv_desc_column_unique_values_delete(&key_container->key);
-      key_container->not_enum = 1;
-    }
-    zsv_desc_unique_key_delete(key);
+static int zsv_desc_column_update_unique(enum zsv_desc_status *err,
+                                         struct zsv_desc_unique_key_container *key_container,
+                                         const unsigned char *utf8_value, size_t len, char fold) {
+  int added = zsv_desc_unique_add(key_container, utf8_value, len, fold);
+  if(added < 0) {
+    *err = zsv_desc_status_memory;
+    return 1;
+  }
+  if(!added && key_container->count > key_container->max_count) {
+    zsv_desc_column_unique_values_delete(key_container);
+    key_container->not_enum = 1;
+  }
+  return added;
+}
+
+// parse a cell as a plain decimal or scientific-notation number
+static int zsv_desc_parse_number(const unsigned char *s, size_t len, double *d) {
+  static const double powers_of_10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  char buff[64];
+  if(len >= sizeof(buff) || !(s[0] == '-' || s[0] == '+' || s[0] == '.' || (s[0] >= '0' && s[0] <= '9')))
     return 0;
-  } else {
-    sglib_zsv_desc_unique_key_add(&key_container->key, key);
-    key_container->count++;
+
+  // most numbers are short decimals, which can be converted exactly without strtod():
+  // both the digits and the power of 10 are exactly representable as doubles
+  size_t i = s[0] == '-' || s[0] == '+';
+  uint64_t digits = 0;
+  unsigned digit_count = 0, fraction_digits = 0;
+  char point = 0;
+  for(; i < len && digit_count <= 15; i++) {
+    if(s[i] >= '0' && s[i] <= '9') {
+      digits = digits * 10 + (s[i] - '0');
+      digit_count++;
+      fraction_digits += point;
+    } else if(s[i] == '.' && !point)
+      point = 1;
+    else
+      break;
+  }
+  if(i == len && digit_count <= 15) {
+    if(!digit_count)
+      return 0;
+    *d = (double)digits / powers_of_10[fraction_digits];
+    if(s[0] == '-')
+      *d = -*d;
     return 1;
   }
+
+  memcpy(buff, s, len);
+  buff[len] = '\0';
+  char *end;
+  *d = strtod(buff, &end);
+  return end == buff + len && isfinite(*d);
+}
+
+static void zsv_desc_sketch_update(enum zsv_desc_status *err, struct zsv_desc_column_data *col,
+                                   const unsigned char *value, size_t len) {
+  uint64_t hash = zsv_sketch_hash(value, len);
+  double d;
+  zsv_hll_add(col->sketch.distinct, hash);
+  if(zsv_quantiles_add(col->sketch.lengths, (double)len)
+     || (zsv_desc_parse_number(value, len, &d) && zsv_quantiles_add(col->sketch.numbers, d))
+     || zsv_topk_add(col->sketch.top, value, len, hash, 1))
+    *err = zsv_desc_status_memory;
+}
+
+/**
+ * Update a column's statistics with a (trimmed) data cell value. Errors are
+ * reported via `err` rather than `data`, as in parallel mode each worker thread
+ * updates its own columns
+ */
+static void zsv_desc_column_update(const struct zsv_desc_data *data, struct zsv_desc_column_data *col,
+                                   const unsigned char *utf8_value, size_t len,
+                                   enum zsv_desc_status *err) {
+  col->total_count++;
+  if(!len)
+    col->mblank.count++;
+  else {
+    if(col->lengths.lo == 0 || len < col->lengths.lo)
+      col->lengths.lo = len;
+    if(len > col->lengths.hi)
+      col->lengths.hi = len;
+    if(col->examples.count < ZSV_DESC_MAX_EXAMPLE_COUNT || !data->quick)
+      zsv_desc_examples_update(&col->examples, utf8_value, len);
+
+    if(data->flags & ZSV_DESC_FLAG_SKETCH)
+      zsv_desc_sketch_update(err, col, utf8_value, len);
+
+    if(data->flags & ZSV_DESC_FLAG_UNIQUE) {
+      if(!col->not_unique)
+        if(!zsv_desc_column_update_unique(err, &col->unique_values, utf8_value, len, 0)) // dupe
+          col->not_unique = 1;
+    }
+
+    if(data->flags & ZSV_DESC_FLAG_UNIQUE_CI) {
+      if(!col->not_unique_ci ||
+         !col->unique_values_ci.not_enum
+         // )
+         ) {
+        // ascii values are hashed and compared in lower case without being converted
+        unsigned char non_ascii = 0;
+        for(size_t i = 0; i < len; i++)
+          non_ascii |= utf8_value[i];
+        if(!(non_ascii & 0x80)) {
+          if(!zsv_desc_column_update_unique(err, &col->unique_values_ci, utf8_value, len, 1))
+            col->not_unique_ci = 1;
+        } else {
+          size_t lc_len = len;
+          unsigned char *lc = zsv_strtolowercase(utf8_value, &lc_len);
+          if(!lc)
+            *err = zsv_desc_status_memory;
+          else {
+            if(!zsv_desc_column_update_unique(err, &col->unique_values_ci, lc, lc_len, 0))
+              col->not_unique_ci = 1;
+            free(lc);
+          }
+        }
+      }
+    }
+  }
 }
 
 static void zsv_desc_cell(void *ctx, unsigned char *restrict utf8_value, size_t len) {
@@ -345,62 +645,8 @@ static void zsv_desc_cell(void *ctx, unsigned char *restrict utf8_value, size_t
       *data->column_names_tail = e;
       data->column_names_tail = &e->next;
     }
-  } else {
-    if(data->current_column_ix < data->col_count) {
-      struct zsv_desc_column_data *col = &data->columns[data->current_column_ix];
-      if(col) {
-        col->total_count++;
-        if(!len)
-          col->mblank.count++;
-        else {
-          if(col->lengths.lo == 0 || len < col->lengths.lo)
-            col->lengths.lo = len;
-          if(len > col->lengths.hi)
-            col->lengths.hi = len;
-          if(col->examples_count < ZSV_DESC_MAX_EXAMPLE_COUNT || !data->quick) {
-            char already_have = 0;
-            if(!col->examples_tail)
-              col->examples_tail = &col->examples;
-            for(struct zsv_desc_string_list *sl = col->examples; !already_have && sl; sl = sl->next) {
-              if(sl->value
-                 && !zsv_strincmp(utf8_value, len, sl->value, strlen((char *)sl->value))) {
-                already_have = 1;
-                sl->count++;
-              }
-            }
-            if(!already_have && col->examples_count < ZSV_DESC_MAX_EXAMPLE_COUNT) {
-              struct zsv_desc_string_list *sl;
-              if((sl = *col->examples_tail = calloc(1, sizeof(*sl)))) {
-                col->examples_tail = &sl->next;
-                sl->value = zsv_memdup(utf8_value, len);
-                col->examples_count++;
-              }
-            }
-          }
-
-          if(data->flags & ZSV_DESC_FLAG_UNIQUE) {
-            if(!col->not_unique)
-              if(!zsv_desc_column_update_unique(&col->unique_values, utf8_value, len)) // dupe
-                col->not_unique = 1;
-          }
-
-          if(data->flags & ZSV_DESC_FLAG_UNIQUE_CI) {
-            if(!col->not_unique_ci ||
-               !col->unique_values_ci.not_enum
-               // )
-               ) {
-              unsigned char *lc = zsv_strtolowercase(utf8_value, &len);
-              if(lc) {
-                if(!zsv_desc_column_update_unique(&col->unique_values_ci, lc, len))
-                  col->not_unique_ci = 1;
-                free(lc);
-              }
-            }
-          }
-        }
-      }
-    }
-  }
+  } else if(data->current_column_ix < data->col_count)
+    zsv_desc_column_update(data, &data->columns[data->current_column_ix], utf8_value, len, &data->err);
   data->current_column_ix++;
 }
 
@@ -430,6 +676,17 @@ static void zsv_desc_row(void *ctx) {
       col->unique_values_ci.max_count = data->max_enum;
     }
 
+    for(unsigned int i = 0; (data->flags & ZSV_DESC_FLAG_SKETCH) && i < data->col_count; i++) {
+      struct zsv_desc_column_data *col = &data->columns[i];
+      if(!(col->sketch.distinct = zsv_hll_new(ZSV_DESC_HLL_PRECISION))
+         || !(col->sketch.lengths = zsv_quantiles_new(ZSV_DESC_QUANTILES_K))
+         || !(col->sketch.numbers = zsv_quantiles_new(ZSV_DESC_QUANTILES_K))
+         || !(col->sketch.top = zsv_topk_new(ZSV_DESC_TOPK_CAPACITY))) {
+        zsv_desc_set_err(data, zsv_desc_status_memory, NULL);
+        return;
+      }
+    }
+
     if(data->header_only)
       data->done = 1;
   } else {
@@ -441,6 +698,145 @@ static void zsv_desc_row(void *ctx) {
   ++data->row_count;
 }
 
+#ifndef NO_THREADING
+/*
+ * parallel mode: the parser thread copies rows into blocks, and each worker
+ * thread updates the statistics of its own, disjoint range of columns from
+ * every block (using a zsv_blockpool with every_worker set). A block is reused
+ * once all workers have processed it. As no two workers share a column, each
+ * column's results are complete when the workers finish, and only their error
+ * statuses need to be combined
+ */
+#define ZSV_DESC_BLOCK_SIZE (256 * 1024)
+#define ZSV_DESC_BLOCK_COUNT 4
+#define ZSV_DESC_MAX_THREADS 64
+
+struct zsv_desc_worker {
+  unsigned col_lo; // columns [col_lo, col_hi) belong to this worker
+  unsigned col_hi;
+  enum zsv_desc_status err;
+};
+
+struct zsv_desc_parallel {
+  struct zsv_desc_data *data;
+  zsv_blockpool pool;
+  struct zsv_desc_worker *workers;
+  unsigned worker_count;
+};
+
+static int zsv_desc_process_block(void *ctx, unsigned worker, struct zsv_block *b) {
+  struct zsv_desc_parallel *par = ctx;
+  struct zsv_desc_data *data = par->data;
+  struct zsv_desc_worker *w = &par->workers[worker];
+  for(size_t r = 0, row_start = 0; r < b->row_count && !w->err; row_start = b->row_ends[r++]) {
+    size_t cols = b->row_ends[r] - row_start;
+    unsigned hi = cols < w->col_hi ? (unsigned)cols : w->col_hi;
+    for(unsigned i = w->col_lo; i < hi; i++) {
+      const struct zsv_block_cell *c = &b->cells[row_start + i];
+      size_t len = c->len;
+      const unsigned char *value = zsv_strtrim(b->raw + c->offset, &len);
+      zsv_desc_column_update(data, &data->columns[i], value, len, &w->err);
+    }
+  }
+  return w->err != zsv_desc_status_ok;
+}
+
+// process any remaining rows, stop the workers, and collect their errors
+static void zsv_desc_parallel_delete(struct zsv_desc_data *data) {
+  struct zsv_desc_parallel *par = data->parallel;
+  if(par) {
+    if(par->pool) {
+      if(!data->err)
+        zsv_blockpool_finish(par->pool);
+      zsv_blockpool_delete(par->pool);
+      for(unsigned i = 0; i < par->worker_count; i++)
+        if(par->workers[i].err && !data->err)
+          zsv_desc_set_err(data, par->workers[i].err, NULL);
+    }
+    free(par->workers);
+    free(par);
+    data->parallel = NULL;
+  }
+}
+
+// start the workers, once the header has been read and the column count is known
+static void zsv_desc_parallel_start(struct zsv_desc_data *data) {
+  unsigned thread_count = data->thread_count;
+  if(thread_count > data->col_count)
+    thread_count = data->col_count;
+  if(thread_count > ZSV_DESC_MAX_THREADS)
+    thread_count = ZSV_DESC_MAX_THREADS;
+  if(thread_count < 2)
+    return;
+
+  struct zsv_desc_parallel *par = calloc(1, sizeof(*par));
+  if(!par)
+    return;
+  data->parallel = par;
+  par->data = data;
+  if((par->workers = calloc(thread_count, sizeof(*par->workers)))) {
+    par->worker_count = thread_count;
+    for(unsigned i = 0; i < thread_count; i++) {
+      par->workers[i].col_lo = (unsigned)((size_t)data->col_count * i / thread_count);
+      par->workers[i].col_hi = (unsigned)((size_t)data->col_count * (i + 1) / thread_count);
+    }
+    struct zsv_blockpool_opts pool_opts = { 0 };
+    pool_opts.block_count = ZSV_DESC_BLOCK_COUNT;
+    pool_opts.process = zsv_desc_process_block;
+    pool_opts.ctx = par;
+    pool_opts.worker_count = thread_count;
+    pool_opts.every_worker = 1;
+    par->pool = zsv_blockpool_new(&pool_opts);
+  }
+  if(!par->pool) { // give up on parallel mode
+    zsv_desc_parallel_delete(data);
+    fprintf(stderr, "Warning: unable to start threads; continuing with one thread\n");
+  }
+}
+
+static void zsv_desc_row_parallel(void *ctx) {
+  struct zsv_desc_data *data = ctx;
+  if(!data || data->err || data->done)
+    return;
+
+  struct zsv_desc_parallel *par = data->parallel;
+  unsigned int cols = zsv_cell_count(data->parser);
+  if(!par) { // header row, or parallel mode could not be started
+    for(unsigned int i = 0; i < cols; i++) {
+      struct zsv_cell c = zsv_get_cell(data->parser, i);
+      zsv_desc_cell(data, c.str, c.len);
+    }
+    char header = data->row_count == 0;
+    zsv_desc_row(data);
+    if(header && !data->err && !data->done)
+      zsv_desc_parallel_start(data);
+    return;
+  }
+
+  struct zsv_block *b = zsv_blockpool_fill_block(par->pool);
+  if(!b) { // a worker failed
+    zsv_desc_parallel_delete(data);
+    return;
+  }
+  if(cols > data->col_count) // any further cells are ignored
+    cols = data->col_count;
+  if(zsv_block_add_row(b, data->parser, cols, 0)) {
+    zsv_desc_set_err(data, zsv_desc_status_memory, NULL);
+    return;
+  }
+
+  // blocks are sized by cell count as well as by data, since per-cell work dominates
+  if(b->raw_len + b->cell_count * sizeof(*b->cells) >= ZSV_DESC_BLOCK_SIZE && zsv_blockpool_submit(par->pool)) {
+    zsv_desc_parallel_delete(data);
+    return;
+  }
+
+  if(data->row_count % 50000 == 0 && data->opts->verbose)
+    fprintf(stderr, "%zu rows read\n", data->row_count);
+  ++data->row_count;
+}
+#endif
+
 const char *zsv_desc_usage_msg[] =
   {
    APPNAME ": get column-level information about a table's content",
@@ -455,7 +851,10 @@ const char *zsv_desc_usage_msg[] =
    "  -C <maximum_number_of_columns>: defaults to 1024",
    "  -H: only output header names",
    "  -q, --quick: minimize example counts,",
-   "  -a, --all: calculate all metadata (for now, this only adds uniqueness info)",
+   "  -s, --sketch: add estimated distinct count, length and numeric quantiles, and",
+   "               top values, using a fixed amount of memory per column",
+   "  -a, --all: calculate all metadata (uniqueness, and the above sketch values)",
+   "  --threads <n>: split the columns among n worker threads, in parallel with parsing",
    "  -o <output filename>: name of file to save output to (defaults to stdout)",
    NULL
   };
@@ -497,6 +896,12 @@ static void zsv_desc_execute(struct zsv_desc_data *data,
                              const char *opts_used) {
   data->opts->cell_handler = zsv_desc_cell;
   data->opts->row_handler = zsv_desc_row;
+#ifndef NO_THREADING
+  if(data->thread_count > 1) {
+    data->opts->cell_handler = NULL;
+    data->opts->row_handler = zsv_desc_row_parallel;
+  }
+#endif
   data->opts->ctx = data;
 
   if(!data->max_enum)
@@ -504,15 +909,20 @@ static void zsv_desc_execute(struct zsv_desc_data *data,
   if(zsv_new_with_properties(data->opts, input_path, opts_used, &data->parser)
      == zsv_status_ok) {
     FILE *input_temp_file = NULL;
-    enum zsv_status status;
+    enum zsv_status status = zsv_status_ok;
     if(input_temp_file)
       zsv_set_scan_filter(data->parser, zsv_filter_write, input_temp_file);
     while(!zsv_signal_interrupted && (status = zsv_parse_more(data->parser)) == zsv_status_ok)
       ;
+    if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+      data->err = zsv_desc_status_file;
 
     if(input_temp_file)
       fclose(input_temp_file);
     zsv_finish(data->parser);
+#ifndef NO_THREADING
+    zsv_desc_parallel_delete(data);
+#endif
     zsv_delete(data->parser);
   }
 }
@@ -547,10 +957,25 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
                                   "Unable to open for write: %s", argv[arg_i]);
       } else if(!strcmp(argv[arg_i], "-a") || !strcmp(argv[arg_i], "--all"))
         data.flags = 0xff;
+      else if(!strcmp(argv[arg_i], "-s") || !strcmp(argv[arg_i], "--sketch"))
+        data.flags |= ZSV_DESC_FLAG_SKETCH;
       else if(!strcmp(argv[arg_i], "-q") || !strcmp(argv[arg_i], "--quick"))
         data.quick = 1;
       else if(!strcmp(argv[arg_i], "-H"))
         data.header_only = 1;
+      else if(!strcmp(argv[arg_i], "--threads")) {
+        arg_i++;
+        if(!(arg_i < argc && atoi(argv[arg_i]) > 0))
+          data.err = zsv_printerr(zsv_desc_status_error, "--threads invalid: should be positive integer (got %s)",
+                                  arg_i < argc ? argv[arg_i] : "nothing");
+        else {
+#ifndef NO_THREADING
+          data.thread_count = (unsigned)atoi(argv[arg_i]);
+#else
+          fprintf(stderr, "Warning: --threads is not supported in this build and will be ignored\n");
+#endif
+        }
+      }
       else if(!strcmp(argv[arg_i], "-C")) {
         arg_i++;
         if(!(arg_i < argc && atoi(argv[arg_i]) > 9))
@@ -562,7 +987,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         if(data.opts->stream) {
           err = 1;
           fprintf(stderr, "Input file specified twice, or unrecognized argument: %s\n", argv[arg_i]);
-        } else if(!(data.opts->stream = fopen(argv[arg_i], "rb"))) {
+        } else if(!(data.opts->stream = zsv_input_open(argv[arg_i]))) {
           err = 1;
           fprintf(stderr, "Could not open for reading: %s\n", argv[arg_i]);
         } else
@@ -594,6 +1019,10 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     }
 
     zsv_desc_execute(&data, input_path, opts_used);
+    if(data.err == zsv_desc_status_file) {
+      zsv_desc_cleanup(&data);
+      return 1;
+    }
     zsv_desc_finalize(&data);
     zsv_desc_print(&data);
     zsv_desc_cleanup(&data);
@@ -20,6 +20,7 @@
 #include <zsv/utils/writer.h>
 #include <zsv/utils/string.h>
 #include <zsv/utils/mem.h>
+#include <zsv/utils/compress.h>
 
 enum zsv_echo_overwrite_input_type {
   zsv_echo_overwrite_input_type_sqlite3 = 0
@@ -213,7 +214,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         data.in = stdin;
 #endif
       if(!data.in) {
-        if(!(data.in = fopen(arg, "rb"))) {
+        if(!(data.in = zsv_input_open(arg))) {
           err = 1;
           perror(arg);
         } else
@@ -249,18 +250,14 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     return 1;
   }
 
-  // create a local csv writer buff for faster performance
-  unsigned char writer_buff[64];
-  zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
-
   // process the input data.
   zsv_handle_ctrl_c_signal();
-  enum zsv_status status;
+  enum zsv_status status = zsv_status_ok;
   while(!zsv_signal_interrupted && (status = zsv_parse_more(data.parser)) == zsv_status_ok)
     ;
 
   zsv_finish(data.parser);
   zsv_delete(data.parser);
   zsv_echo_cleanup(&data);
-  return 0;
+  return status == zsv_status_error;
 }
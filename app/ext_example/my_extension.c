@@ -176,7 +176,6 @@ static enum zsv_ext_status echo_main(zsv_execution_context ctx, int argc, const
   memset(&data, 0, sizeof(data));
 
   /* initialize a csv writer, which we add to our private data structure */
-  unsigned char writer_buff[128];
   /**
    * the the zsv_writer utility has two special optimizations: first, it
    * uses its own buffer to short-circuit costly stdio operations, and second,
@@ -185,7 +184,6 @@ static enum zsv_ext_status echo_main(zsv_execution_context ctx, int argc, const
    */
   if(!(data.csv_writer = zsv_writer_new(NULL)))
     return zsv_ext_status_memory;
-  zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
 
   /**
    * The following common parser options that are already handled by zsv (so long as we use
@@ -47,10 +47,13 @@ SQLITE_EXTENSION_INIT1
 #include <stdarg.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <zsv.h>
 #include <zsv/utils/string.h>
 #include <zsv/utils/arg.h>
 #include <zsv/utils/prop.h>
+#include <zsv/utils/compress.h>
+#include <zsv/utils/file.h>
 
 #ifndef SQLITE_OMIT_VIRTUALTABLE
 
@@ -67,6 +70,12 @@ SQLITE_EXTENSION_INIT1
 #endif
 
 
+/* Default memory limit for a table's snapshot (see zsv_vtab_snapshot) */
+#define ZSV_VTAB_DEFAULT_MAX_SNAPSHOT_MB 1024
+
+/* how much of a stream that cannot be rewound (e.g. stdin) to keep in memory, before using a temp file */
+#define ZSV_VTAB_SPOOL_MEMORY_MAX (16 * 1024 * 1024)
+
 /* Max size of the error message in a CsvReader */
 #define CSV_MXERR 200
 
@@ -94,14 +103,121 @@ static int zsvtabRowid(sqlite3_vtab_cursor*,sqlite3_int64*);
 struct zsv_vtab_cache_row {
   struct zsv_vtab_cache_row *next;
   size_t column_count;
+  size_t cells_cap;
   size_t id;
   struct zsv_cell *cells;
 };
 
-/* zsv_vtab_cache: FIFO of rows */
+/*
+** zsv_vtab_cache: FIFO of rows. Rows are consumed in the order they are added,
+** so removed rows (and their cell arrays) are kept for reuse instead of freed
+*/
 struct zsv_vtab_cache {
   struct zsv_vtab_cache_row *rows;
   struct zsv_vtab_cache_row **last;
+  struct zsv_vtab_cache_row *free_rows;
+};
+
+/* all columns, for use as a zsv_vtab_cache column mask */
+#define ZSV_VTAB_ALL_COLUMNS (~(sqlite3_uint64)0)
+
+/*
+** zsv_vtab_constraint: a WHERE-clause constraint on a column, passed from
+** xBestIndex to xFilter and checked against the raw cells of each row so that
+** rows that cannot match are dropped before they are cached. SQLite still
+** evaluates every constraint itself, so this check only needs to reject rows
+** that are certain not to match
+*/
+struct zsv_vtab_constraint {
+  int column;
+  unsigned char op;       /* SQLITE_INDEX_CONSTRAINT_xxx */
+  unsigned char *value;   /* copy of the right-hand value */
+  size_t len;
+};
+
+/* zsv_vtab_scan: what a cursor's scan needs, as passed from xBestIndex to xFilter */
+struct zsv_vtab_scan {
+  struct zsv_vtab_constraint *constraints;
+  int constraint_count;
+  sqlite3_uint64 col_used;        /* columns used by the scan, as in sqlite3_index_info.colUsed */
+  size_t col_limit;               /* one past the highest column used by the scan */
+  sqlite3_int64 rowid;            /* if have_rowid, the only rowid that can match */
+  char have_rowid;
+};
+
+/*
+** zsv_vtab_hash_index: a hash index, over the snapshot, of the values of one
+** column, so that a scan with an equality constraint on that column (such as
+** the inner loop of an equi-join) visits only rows whose value has the same
+** hash. heads[h & mask] is 1 + the first row in bucket h, and next[r] is 1 + the
+** next row in the same bucket as row r (0 = none), so that each bucket is
+** visited in row order. heads is NULL if the index would have exceeded the
+** memory limit
+*/
+struct zsv_vtab_hash_index {
+  size_t *heads;
+  size_t *next;
+  size_t mask;
+  char tried;
+};
+
+/*
+** zsv_vtab_snapshot: all data rows of the table, retained in memory so that
+** scans after the first rescan (e.g. the inner loop of a nested-loop join) do
+** not have to parse the file again. Each row's raw bytes are copied into a
+** single buffer, and each cell is stored as an offset into that buffer plus a
+** length, with row_starts[r] being the index of row r's first cell. The
+** snapshot is built during the second scan of the table and used from the
+** third scan onwards, unless it would exceed max_snapshot_mb, in which case
+** every scan parses the file
+*/
+struct zsv_vtab_snapshot {
+  unsigned char *raw;
+  size_t raw_len;
+  size_t raw_cap;
+
+  size_t *cell_offsets;
+  unsigned *cell_lens;
+  size_t cell_count;
+  size_t cell_cap;
+
+  size_t *row_starts; /* row_count + 1 entries once complete */
+  size_t row_count;
+  size_t row_cap;
+
+  struct zsv_vtab_hash_index *hash_indexes; /* one per column, built on first use */
+  size_t hash_index_count;
+  size_t hash_index_bytes;
+
+  size_t max_bytes;   /* 0 = never build */
+  unsigned scans;     /* number of scans that parsed the file */
+  char building;      /* set while a cursor's scan is adding rows to the snapshot */
+  char complete;
+  char disabled;      /* set if the snapshot exceeded max_bytes */
+};
+
+/*
+** zsv_vtab_spool: input from a stream that cannot be rewound, such as stdin.
+** Each scan reads it through its own zsv_vtab_spool_reader. A scan that has
+** caught up with what has been read so far reads straight from the stream, and
+** what it reads is kept (up to ZSV_VTAB_SPOOL_MEMORY_MAX in memory, the rest
+** in a temp file) so that later or concurrent scans can read it again
+*/
+struct zsv_vtab_spool {
+  FILE *in;
+  unsigned char *mem;
+  size_t mem_len;
+  size_t mem_cap;
+  FILE *file;
+  char *filename;
+  size_t file_len;
+  char eof;
+  char err;
+};
+
+struct zsv_vtab_spool_reader {
+  struct zsv_vtab_spool *spool;
+  size_t pos;
 };
 
 /* An instance of the CSV virtual table */
@@ -110,11 +226,11 @@ typedef struct zsvTable {
   char *zFilename;                /* Name of the CSV file */
   struct zsv_opts parser_opts;
   char *opts_used;
-  enum zsv_status parser_status;
-  zsv_parser parser;
+  zsv_parser parser;              /* parser used to read the header */
+  struct zsv_vtab_spool *spool;   /* if reading from stdin */
   struct zsv_vtab_cache header;
-  struct zsv_vtab_cache data;
-  size_t rowCount;
+  struct zsv_vtab_snapshot snapshot;
+  sqlite3_int64 file_size;        /* size of the file, or 0 if unknown (stdin) */
 } zsvTable;
 
 struct zsvTable *zsvTable_new() {
@@ -122,8 +238,8 @@ struct zsvTable *zsvTable_new() {
   if(z) {
     memset(z, 0, sizeof(*z));
     z->parser_opts = zsv_get_default_opts();
+    z->snapshot.max_bytes = (size_t)ZSV_VTAB_DEFAULT_MAX_SNAPSHOT_MB * 1024 * 1024;
     z->header.last = &z->header.rows;
-    z->data.last = &z->data.rows;
   }
   return z;
 }
@@ -131,9 +247,25 @@ struct zsvTable *zsvTable_new() {
 /* Allowed values for tstFlags */
 #define CSVTEST_FIDX  0x0001      /* Pretend that constrained searchs cost less*/
 
-/* A cursor for the CSV virtual table */
+/*
+** A cursor for the CSV virtual table. Each cursor that is not reading from the
+** snapshot parses the file with its own parser, so that more than one scan of
+** the same table (e.g. in a self-join) can be in progress at a time
+*/
 typedef struct zsvCursor {
   sqlite3_vtab_cursor base;       /* Base class.  Must be first */
+  struct zsv_vtab_scan scan;
+  FILE *stream;
+  struct zsv_vtab_spool_reader spool_reader;
+  zsv_parser parser;
+  enum zsv_status parser_status;
+  struct zsv_vtab_cache data;
+  size_t rowCount;
+  size_t snapshot_row;            /* current row, if reading from the snapshot */
+  size_t snapshot_end;
+  const size_t *hash_next;        /* if set, the hash index bucket chain that the cursor follows */
+  char from_snapshot;
+  char building;                  /* this cursor's scan is building the snapshot */
 } zsvCursor;
 
 
@@ -151,29 +283,47 @@ static int zsvtabCreate(
  return zsvtabConnect(db, pAux, argc, argv, ppVtab, pzErr);
 }
 
+/*
+** add the current row to the cache. Only the cells of columns in col_used (and
+** below col_limit) are materialized; other cells are left empty. Columns
+** above 62 are all represented by bit 63 of col_used
+*/
 static int add_row_to_cache(zsv_parser parser, struct zsv_vtab_cache *cache,
-                            size_t row_id) {
+                            size_t row_id, sqlite3_uint64 col_used, size_t col_limit) {
   size_t count = zsv_cell_count(parser);
-  struct zsv_vtab_cache_row *r = sqlite3_malloc(sizeof(*r));
-  if(!r)
-    return SQLITE_NOMEM;
-  memset(r, 0, sizeof(*r));
-  if(count) {
-    size_t cells_sz = count * sizeof(*r->cells);
-    r->cells = sqlite3_malloc(cells_sz);
-    if(!r->cells) {
+  if(count > col_limit)
+    count = col_limit;
+
+  struct zsv_vtab_cache_row *r = cache->free_rows;
+  if(r)
+    cache->free_rows = r->next;
+  else {
+    if(!(r = sqlite3_malloc(sizeof(*r))))
+      return SQLITE_NOMEM;
+    memset(r, 0, sizeof(*r));
+  }
+  if(count > r->cells_cap) {
+    struct zsv_cell *cells = sqlite3_realloc64(r->cells, count * sizeof(*r->cells));
+    if(!cells) {
+      sqlite3_free(r->cells);
       sqlite3_free(r);
       return SQLITE_NOMEM;
     }
-    memset(r->cells, 0, cells_sz);
+    r->cells = cells;
+    r->cells_cap = count;
   }
+  if(count)
+    memset(r->cells, 0, count * sizeof(*r->cells));
 
+  r->next = NULL;
   r->id = row_id;
   *cache->last = r;
   cache->last = &r->next;
 
   r->column_count = count;
   for(size_t i = 0; i < count; i++) {
+    if(i < 63 && !(col_used & ((sqlite3_uint64)1 << i)))
+      continue;
     r->cells[i] = zsv_get_cell(parser, i);
     if(r->id == 0) {
       if(r->cells[i].len) {
@@ -191,7 +341,6 @@ static int add_row_to_cache(zsv_parser parser, struct zsv_vtab_cache *cache,
   return 0;
 }
 
-/* remove_row_from_cache: return 1 if row was removed */
 /* remove_row_from_cache: return 1 if row was removed */
 static int remove_row_from_cache(struct zsv_vtab_cache *cache) {
   if(cache->rows) {
@@ -202,8 +351,8 @@ static int remove_row_from_cache(struct zsv_vtab_cache *cache) {
         if(r->cells[i].len)
           sqlite3_free(r->cells[i].str);
     }
-    sqlite3_free(r->cells);
-    sqlite3_free(r);
+    r->next = cache->free_rows;
+    cache->free_rows = r;
     if(!(cache->rows = next))
       cache->last = &cache->rows;
     return 1;
@@ -211,18 +360,246 @@ static int remove_row_from_cache(struct zsv_vtab_cache *cache) {
   return 0;
 }
 
-static void zsvTable_clear(struct zsvTable *z) {
-  while(remove_row_from_cache(&z->data)) ;
-  if(z->parser)
-    zsv_delete(z->parser);
-  z->parser = NULL;
-  z->rowCount = 0;
+static void zsv_vtab_cache_delete(struct zsv_vtab_cache *cache) {
+  while(remove_row_from_cache(cache)) ;
+  for(struct zsv_vtab_cache_row *next, *r = cache->free_rows; r; r = next) {
+    next = r->next;
+    sqlite3_free(r->cells);
+    sqlite3_free(r);
+  }
+  cache->free_rows = NULL;
+}
+
+static void zsv_vtab_scan_clear(struct zsv_vtab_scan *scan) {
+  for(int i = 0; i < scan->constraint_count; i++)
+    sqlite3_free(scan->constraints[i].value);
+  sqlite3_free(scan->constraints);
+  memset(scan, 0, sizeof(*scan));
+  scan->col_used = ZSV_VTAB_ALL_COLUMNS;
+  scan->col_limit = (size_t)-1;
+}
+
+/* free the snapshot data, but keep its settings */
+static void zsv_vtab_snapshot_clear(struct zsv_vtab_snapshot *snap) {
+  sqlite3_free(snap->raw);
+  sqlite3_free(snap->cell_offsets);
+  sqlite3_free(snap->cell_lens);
+  sqlite3_free(snap->row_starts);
+  for(size_t i = 0; i < snap->hash_index_count; i++) {
+    sqlite3_free(snap->hash_indexes[i].heads);
+    sqlite3_free(snap->hash_indexes[i].next);
+  }
+  sqlite3_free(snap->hash_indexes);
+  snap->hash_indexes = NULL;
+  snap->hash_index_count = snap->hash_index_bytes = 0;
+  snap->raw = NULL;
+  snap->cell_offsets = NULL;
+  snap->cell_lens = NULL;
+  snap->row_starts = NULL;
+  snap->raw_len = snap->raw_cap = snap->cell_count = snap->cell_cap = snap->row_count = snap->row_cap = 0;
+  snap->building = snap->complete = 0;
+}
+
+static int zsv_vtab_realloc(void *p, size_t n, size_t item_size) {
+  void *tmp = sqlite3_realloc64(*(void **)p, n * item_size);
+  if(!tmp)
+    return SQLITE_NOMEM;
+  *(void **)p = tmp;
+  return SQLITE_OK;
+}
+
+/* return the smallest power-of-two multiple of cap (or of min_cap, if cap is 0) that is >= n */
+static size_t zsv_vtab_grow_cap(size_t cap, size_t n, size_t min_cap) {
+  if(!cap)
+    cap = min_cap;
+  while(cap < n)
+    cap *= 2;
+  return cap;
+}
+
+/*
+** add the current row to the snapshot. If that fails, or would take the
+** snapshot over its memory limit, discard the snapshot and stop building it
+*/
+static void zsv_vtab_snapshot_add_row(struct zsv_vtab_snapshot *snap, zsv_parser parser) {
+  size_t count = zsv_cell_count(parser);
+  size_t row_len = 0;
+  struct zsv_cell first = { 0 };
+  if(count) {
+    first = zsv_get_cell(parser, 0);
+    struct zsv_cell last = zsv_get_cell(parser, count - 1);
+    row_len = (size_t)(last.str + last.len - first.str);
+  }
+
+  size_t raw_cap = zsv_vtab_grow_cap(snap->raw_cap, snap->raw_len + row_len + 1, 64 * 1024);
+  size_t cell_cap = zsv_vtab_grow_cap(snap->cell_cap, snap->cell_count + count, 1024);
+  size_t row_cap = zsv_vtab_grow_cap(snap->row_cap, snap->row_count + 2, 1024);
+  if(raw_cap != snap->raw_cap || cell_cap != snap->cell_cap || row_cap != snap->row_cap) {
+    size_t bytes = raw_cap + cell_cap * (sizeof(*snap->cell_offsets) + sizeof(*snap->cell_lens))
+      + row_cap * sizeof(*snap->row_starts);
+    if(bytes > snap->max_bytes
+       || (raw_cap != snap->raw_cap && zsv_vtab_realloc(&snap->raw, raw_cap, 1))
+       || (cell_cap != snap->cell_cap
+           && (zsv_vtab_realloc(&snap->cell_offsets, cell_cap, sizeof(*snap->cell_offsets))
+               || zsv_vtab_realloc(&snap->cell_lens, cell_cap, sizeof(*snap->cell_lens))))
+       || (row_cap != snap->row_cap && zsv_vtab_realloc(&snap->row_starts, row_cap, sizeof(*snap->row_starts)))) {
+      zsv_vtab_snapshot_clear(snap);
+      snap->disabled = 1;
+      return;
+    }
+    snap->raw_cap = raw_cap;
+    snap->cell_cap = cell_cap;
+    snap->row_cap = row_cap;
+  }
+
+  snap->row_starts[snap->row_count++] = snap->cell_count;
+  if(count) {
+    memcpy(snap->raw + snap->raw_len, first.str, row_len);
+    for(size_t i = 0; i < count; i++) {
+      struct zsv_cell c = zsv_get_cell(parser, i);
+      snap->cell_offsets[snap->cell_count] = snap->raw_len + (size_t)(c.str - first.str);
+      snap->cell_lens[snap->cell_count++] = (unsigned)c.len;
+    }
+    snap->raw_len += row_len;
+  }
+}
+
+/* FNV-1a */
+static sqlite3_uint64 zsv_vtab_hash(const unsigned char *s, size_t len) {
+  sqlite3_uint64 h = 14695981039346656037ULL;
+  for(size_t i = 0; i < len; i++) {
+    h ^= s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/*
+** get the hash index of a column of a complete snapshot, building it if this
+** is the first time it is needed. Returns NULL if there is no index because
+** it would take the snapshot over its memory limit, or could not be allocated
+*/
+static const struct zsv_vtab_hash_index *zsv_vtab_snapshot_hash_index(struct zsv_vtab_snapshot *snap,
+                                                                      int column, size_t column_count) {
+  if(column < 0 || (size_t)column >= column_count)
+    return NULL;
+  if(!snap->hash_indexes) {
+    if(!(snap->hash_indexes = sqlite3_malloc64(column_count * sizeof(*snap->hash_indexes))))
+      return NULL;
+    memset(snap->hash_indexes, 0, column_count * sizeof(*snap->hash_indexes));
+    snap->hash_index_count = column_count;
+  }
+
+  struct zsv_vtab_hash_index *ix = &snap->hash_indexes[column];
+  if(!ix->tried) {
+    ix->tried = 1;
+    size_t bucket_count = zsv_vtab_grow_cap(0, snap->row_count, 16);
+    size_t bytes = (bucket_count + snap->row_count) * sizeof(size_t);
+    size_t snapshot_bytes = snap->raw_cap + snap->cell_cap * (sizeof(*snap->cell_offsets) + sizeof(*snap->cell_lens))
+      + snap->row_cap * sizeof(*snap->row_starts) + snap->hash_index_bytes;
+    if(snapshot_bytes + bytes > snap->max_bytes
+       || !(ix->heads = sqlite3_malloc64(bucket_count * sizeof(*ix->heads)))
+       || !(ix->next = sqlite3_malloc64(snap->row_count * sizeof(*ix->next)))) {
+      sqlite3_free(ix->heads);
+      ix->heads = NULL;
+      return NULL;
+    }
+    snap->hash_index_bytes += bytes;
+    ix->mask = bucket_count - 1;
+    memset(ix->heads, 0, bucket_count * sizeof(*ix->heads));
+
+    /* add rows last to first, so that each bucket lists its rows in order */
+    for(size_t r = snap->row_count; r-- > 0; ) {
+      size_t c = snap->row_starts[r] + (size_t)column;
+      if(c < snap->row_starts[r + 1]) { /* else the cell is NULL, which no equality constraint matches */
+        size_t h = (size_t)zsv_vtab_hash(snap->raw + snap->cell_offsets[c], snap->cell_lens[c]) & ix->mask;
+        ix->next[r] = ix->heads[h];
+        ix->heads[h] = r + 1;
+      } else
+        ix->next[r] = 0;
+    }
+  }
+  return ix->heads ? ix : NULL;
+}
+
+static void zsv_vtab_spool_delete(struct zsv_vtab_spool *spool) {
+  if(spool) {
+    if(spool->in && spool->in != stdin)
+      fclose(spool->in);
+    sqlite3_free(spool->mem);
+    if(spool->file)
+      fclose(spool->file);
+    if(spool->filename) {
+      remove(spool->filename);
+      free(spool->filename);
+    }
+    sqlite3_free(spool);
+  }
+}
+
+/* keep data that was just read from the stream; returns 0 on success */
+static int zsv_vtab_spool_keep(struct zsv_vtab_spool *spool, const unsigned char *data, size_t len) {
+  if(!spool->file && spool->mem_len + len <= ZSV_VTAB_SPOOL_MEMORY_MAX) {
+    size_t cap = zsv_vtab_grow_cap(spool->mem_cap, spool->mem_len + len, 1024 * 1024);
+    if(cap == spool->mem_cap || !zsv_vtab_realloc(&spool->mem, cap, 1)) {
+      spool->mem_cap = cap;
+      memcpy(spool->mem + spool->mem_len, data, len);
+      spool->mem_len += len;
+      return 0;
+    }
+  }
+  if(!spool->file) {
+    if(!(spool->filename = zsv_get_temp_filename("zsv_sql")) || !(spool->file = fopen(spool->filename, "w+b")))
+      return 1;
+  }
+  if(fseek(spool->file, 0, SEEK_END) || fwrite(data, 1, len, spool->file) != len)
+    return 1;
+  spool->file_len += len;
+  return 0;
+}
+
+/*
+** Read function (see zsv_opts.read) for a scan of a spool: returns what has
+** already been read from the stream, then reads more from the stream
+*/
+static size_t zsv_vtab_spool_read(void *restrict buff, size_t size, size_t nitems, void *restrict p) {
+  struct zsv_vtab_spool_reader *r = p;
+  struct zsv_vtab_spool *spool = r->spool;
+  size_t n = size * nitems;
+  size_t got = 0;
+  if(!n)
+    return 0;
+
+  if(r->pos < spool->mem_len) {
+    got = spool->mem_len - r->pos;
+    if(got > n)
+      got = n;
+    memcpy(buff, spool->mem + r->pos, got);
+  } else if(r->pos < spool->mem_len + spool->file_len) {
+    if(fseek(spool->file, (long)(r->pos - spool->mem_len), SEEK_SET) == 0)
+      got = fread(buff, 1, n, spool->file);
+  } else if(!spool->eof && !spool->err) {
+    got = fread(buff, 1, n, spool->in);
+    if(got < n)
+      spool->eof = 1;
+    if(got && zsv_vtab_spool_keep(spool, buff, got)) {
+      fprintf(stderr, "Unable to save input for rescanning\n");
+      spool->err = 1;
+    }
+  }
+  r->pos += got;
+  return got / size;
 }
 
 static void zsvTable_delete(struct zsvTable *z) {
   if(z) {
-    zsvTable_clear(z);
-    while(remove_row_from_cache(&z->header)) ;
+    if(z->parser)
+      zsv_delete(z->parser);
+    if(z->parser_opts.stream && !z->spool)
+      fclose(z->parser_opts.stream);
+    zsv_vtab_spool_delete(z->spool);
+    zsv_vtab_snapshot_clear(&z->snapshot);
+    zsv_vtab_cache_delete(&z->header);
     sqlite3_free(z->zFilename);
     sqlite3_free(z->opts_used);
     sqlite3_free(z);
@@ -240,17 +617,95 @@ static struct zsv_cell get_cell_from_cache(struct zsv_vtab_cache *cache, int n)
   return c;
 }
 
-/* cache each row of data for use later */
+/* compare two strings the same way as SQLite's BINARY collation */
+static int zsv_vtab_binary_cmp(const unsigned char *a, size_t alen, const unsigned char *b, size_t blen) {
+  int c = (alen && blen) ? memcmp(a, b, alen < blen ? alen : blen) : 0;
+  if(c)
+    return c;
+  return alen < blen ? -1 : alen > blen ? 1 : 0;
+}
+
+/* return 1 if a cell value might satisfy a pushed-down constraint */
+static int zsv_vtab_cell_matches(const struct zsv_vtab_constraint *k, const unsigned char *str, size_t len) {
+  if(k->op == SQLITE_INDEX_CONSTRAINT_LIKE)
+    /* value is the literal prefix of the pattern; LIKE ignores ascii case by default */
+    return len >= k->len && !sqlite3_strnicmp((const char *)str, (const char *)k->value, (int)k->len);
+
+  int cmp = zsv_vtab_binary_cmp(str, len, k->value, k->len);
+  switch(k->op) {
+  case SQLITE_INDEX_CONSTRAINT_EQ: return cmp == 0;
+  case SQLITE_INDEX_CONSTRAINT_GT: return cmp > 0;
+  case SQLITE_INDEX_CONSTRAINT_GE: return cmp >= 0;
+  case SQLITE_INDEX_CONSTRAINT_LT: return cmp < 0;
+  case SQLITE_INDEX_CONSTRAINT_LE: return cmp <= 0;
+  }
+  return 1;
+}
+
+/*
+** return 1 if the current row might satisfy all of the pushed-down constraints
+** a cell beyond the end of the row is returned by zsvtabColumn() as NULL,
+** which satisfies no constraint
+*/
+static int zsv_row_matches_constraints(const struct zsv_vtab_scan *scan, zsv_parser parser) {
+  size_t count = zsv_cell_count(parser);
+  for(int i = 0; i < scan->constraint_count; i++) {
+    const struct zsv_vtab_constraint *k = &scan->constraints[i];
+    if((size_t)k->column >= count)
+      return 0;
+    struct zsv_cell c = zsv_get_cell(parser, k->column);
+    if(!zsv_vtab_cell_matches(k, c.str, c.len))
+      return 0;
+  }
+  return 1;
+}
+
+/* return 1 if a snapshot row might satisfy all of the pushed-down constraints */
+static int zsv_snapshot_row_matches_constraints(const struct zsv_vtab_scan *scan,
+                                                const struct zsv_vtab_snapshot *snap, size_t row) {
+  size_t start = snap->row_starts[row];
+  size_t count = snap->row_starts[row + 1] - start;
+  for(int i = 0; i < scan->constraint_count; i++) {
+    const struct zsv_vtab_constraint *k = &scan->constraints[i];
+    if((size_t)k->column >= count)
+      return 0;
+    size_t c = start + (size_t)k->column;
+    if(!zsv_vtab_cell_matches(k, snap->raw + snap->cell_offsets[c], snap->cell_lens[c]))
+      return 0;
+  }
+  return 1;
+}
+
+/* cache each row of data for use later, unless it cannot satisfy the query constraints */
 static void zsv_row_data(void *ctx) {
-  zsvTable *t = ctx;
-  add_row_to_cache(t->parser, &t->data, ++t->rowCount);
+  zsvCursor *pCur = ctx;
+  ++pCur->rowCount;
+  if(pCur->building) {
+    struct zsv_vtab_snapshot *snap = &((zsvTable *)pCur->base.pVtab)->snapshot;
+    zsv_vtab_snapshot_add_row(snap, pCur->parser);
+    if(!snap->building) /* the snapshot was discarded */
+      pCur->building = 0;
+  }
+
+  const struct zsv_vtab_scan *scan = &pCur->scan;
+  if(scan->have_rowid && scan->rowid != (sqlite3_int64)pCur->rowCount)
+    return;
+  if(scan->constraint_count && !zsv_row_matches_constraints(scan, pCur->parser))
+    return;
+  add_row_to_cache(pCur->parser, &pCur->data, pCur->rowCount, scan->col_used, scan->col_limit);
+}
+
+/* skip the header row of a cursor's scan */
+static void zsv_row_skip_header(void *ctx) {
+  zsvCursor *pCur = ctx;
+  zsv_set_row_handler(pCur->parser, zsv_row_data);
 }
 
 static void zsv_row_header(void *ctx) {
   zsvTable *t = ctx;
   if(!t->header.rows)
-    add_row_to_cache(t->parser, &t->header, 0);
-  zsv_set_row_handler(t->parser, zsv_row_data);
+    add_row_to_cache(t->parser, &t->header, 0, ZSV_VTAB_ALL_COLUMNS, (size_t)-1);
+  zsv_abort(t->parser); /* data rows are read by each cursor's own parser */
 }
 
 #include "vtab_helper.c"
@@ -260,9 +715,11 @@ unsigned blank_column_name_count = 0;
 
 /**
  * Parameters:
- *    filename=FILENAME          Name of file containing CSV content
+ *    filename=FILENAME          Name of file containing CSV content, or - for stdin
  *    options_used=OPTIONS_USED  Used options (passed to zsv_new_with_properties())
  *    max_columns=N              Error out if we encounter more cols than this
+ *    max_snapshot_mb=N          Memory limit for keeping the data in memory when
+ *                               the table is scanned repeatedly (0 = never keep)
  *
  * The number of columns in the first row of the input file determines the
  * column names and column count
@@ -314,6 +771,14 @@ static int zsvtabConnect(
         goto zsvtab_connect_error;
       }
     }else
+    if( (zValue = csv_parameter("max_snapshot_mb",15,z))!=0 ){
+      int mb = atoi(zValue);
+      if(mb < 0){
+        asprintf(&errmsg, "max_snapshot_mb= value must be >= 0");
+        goto zsvtab_connect_error;
+      }
+      pNew->snapshot.max_bytes = (size_t)mb * 1024 * 1024;
+    }else
     {
       asprintf(&errmsg, "bad parameter: '%s'", z);
       goto zsvtab_connect_error;
@@ -325,9 +790,27 @@ static int zsvtabConnect(
     goto zsvtab_connect_error;
   }
 
-  if(!(pNew->parser_opts.stream = fopen(CSV_FILENAME, "rb"))) {
+  struct zsv_vtab_spool_reader header_reader = { 0 };
+  if(!strcmp(CSV_FILENAME, "-")) { /* stdin */
+    FILE *in = zsv_input_open_stream(stdin, "stdin");
+    if(!in || !(pNew->spool = sqlite3_malloc(sizeof(*pNew->spool)))) {
+      if(in && in != stdin)
+        fclose(in);
+      asprintf(&errmsg, "Unable to read stdin");
+      goto zsvtab_connect_error;
+    }
+    memset(pNew->spool, 0, sizeof(*pNew->spool));
+    pNew->spool->in = in;
+    header_reader.spool = pNew->spool;
+    pNew->parser_opts.read = zsv_vtab_spool_read;
+    pNew->parser_opts.stream = &header_reader;
+  } else if(!(pNew->parser_opts.stream = zsv_input_open(CSV_FILENAME))) {
     asprintf(&errmsg, "Unable to open for reading: %s", CSV_FILENAME);
     goto zsvtab_connect_error;
+  } else {
+    struct stat st;
+    if(!stat(CSV_FILENAME, &st))
+      pNew->file_size = st.st_size;
   }
 
   pNew->parser_opts.row_handler = zsv_row_header;
@@ -339,10 +822,11 @@ static int zsvtabConnect(
                              &pNew->parser) != zsv_status_ok)
     goto zsvtab_connect_error;
 
-  pNew->parser_status = zsv_parse_more(pNew->parser);
-  if(pNew->parser_status != zsv_status_ok &&
-     pNew->parser_status != zsv_status_no_more_input) {
-    asprintf(&errmsg, "%s", zsv_parse_status_desc(pNew->parser_status));
+  enum zsv_status parser_status = zsv_parse_more(pNew->parser);
+  if(parser_status != zsv_status_ok &&
+     parser_status != zsv_status_cancelled &&
+     parser_status != zsv_status_no_more_input) {
+    asprintf(&errmsg, "%s", zsv_parse_status_desc(parser_status));
     goto zsvtab_connect_error;
   }
 
@@ -395,6 +879,14 @@ static int zsvtabConnect(
   }
   sqlite3_free(schema);
 
+  /* the header has been read; each cursor opens the file (or reads the spool) itself */
+  zsv_delete(pNew->parser);
+  pNew->parser = NULL;
+  if(!pNew->spool)
+    fclose(pNew->parser_opts.stream);
+  pNew->parser_opts.stream = NULL;
+  pNew->parser_opts.read = NULL;
+
   /* Rationale for DIRECTONLY:
   ** An attacker who controls a database schema could use this vtab
   ** to exfiltrate sensitive data from other files in the filesystem.
@@ -426,20 +918,211 @@ zsvtab_connect_error:
 }
 
 /*
-** Only a forward full table scan is supported.  xBestIndex is mostly
-** a no-op.  If CSVTEST_FIDX is set, then the presence of equality
-** constraints lowers the estimated cost, which is fiction, but is useful
-** for testing certain kinds of virtual table behavior.
+** zsvtab_can_lookup: whether equality scans can be answered from the snapshot,
+** i.e. it is complete, or it may still be built: it is enabled, has not hit
+** max_snapshot_mb, and the file is not already larger than that. For a
+** column, its hash index must not have failed either
+*/
+static int zsvtab_can_lookup(zsvTable *pTab, int column) {
+  const struct zsv_vtab_snapshot *snap = &pTab->snapshot;
+  if(column >= 0 && (size_t)column < snap->hash_index_count
+     && snap->hash_indexes[column].tried && !snap->hash_indexes[column].heads)
+    return 0;
+  return snap->complete ||
+    (snap->max_bytes && !snap->disabled && (sqlite3_uint64)pTab->file_size <= snap->max_bytes);
+}
+
+/*
+** Only a forward full table scan is supported, but equality, range and LIKE
+** constraints on columns are passed to xFilter so that non-matching rows can
+** be skipped during the scan, and only the columns that the statement uses
+** are materialized. idxStr holds colUsed in hex followed by ';', then lists
+** each constraint as "op,column;" in the same order as its argv value. The
+** constraints are not omitted, so SQLite still checks them.
+**
+** A scan with a rowid or column equality constraint is costed as an index
+** lookup if it can be answered from the snapshot (by row number or by a hash
+** index of the column), which makes SQLite run equi-joins as hash joins with
+** this table on the inner loop. Otherwise every such scan parses the whole
+** file, so it is costed above a plain full scan: SQLite runs a constraint
+** that comes from an IN list as one scan per value, and must instead prefer
+** the plan that scans once and checks the IN list itself
 */
 static int zsvtabBestIndex(
   sqlite3_vtab *tab,
   sqlite3_index_info *pIdxInfo
 ){
-  (void)(tab);
-  pIdxInfo->estimatedCost = 1000000;
+  zsvTable *pTab = (zsvTable *)tab;
+  sqlite3_str *idx = sqlite3_str_new(NULL);
+  int argc = 0;
+  char have_rowid_eq = 0, have_eq = 0, have_full_eq = 0;
+  sqlite3_str_appendf(idx, "%llx;", (unsigned long long)pIdxInfo->colUsed);
+  for(int i = 0; i < pIdxInfo->nConstraint; i++) {
+    const struct sqlite3_index_constraint *c = &pIdxInfo->aConstraint[i];
+    if(!c->usable)
+      continue;
+    if(c->iColumn < 0) {
+      /* rowid lookups are served directly from the snapshot, if there is one */
+      if(c->op != SQLITE_INDEX_CONSTRAINT_EQ)
+        continue;
+    } else switch(c->op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+    case SQLITE_INDEX_CONSTRAINT_GT:
+    case SQLITE_INDEX_CONSTRAINT_LE:
+    case SQLITE_INDEX_CONSTRAINT_LT:
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      {
+        /* comparisons that use another collation (e.g. NOCASE) cannot be checked as raw bytes */
+        const char *coll = sqlite3_vtab_collation(pIdxInfo, i);
+        if(coll && sqlite3_stricmp(coll, "BINARY"))
+          continue;
+      }
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LIKE:
+      break;
+    default:
+      continue;
+    }
+    sqlite3_str_appendf(idx, "%d,%d;", c->op, c->iColumn);
+    pIdxInfo->aConstraintUsage[i].argvIndex = ++argc;
+    if(c->op == SQLITE_INDEX_CONSTRAINT_EQ) {
+      if(!zsvtab_can_lookup(pTab, c->iColumn))
+        have_full_eq = 1;
+      else if(c->iColumn < 0)
+        have_rowid_eq = 1;
+      else
+        have_eq = 1;
+    }
+  }
+  if(!(pIdxInfo->idxStr = sqlite3_str_finish(idx)))
+    return SQLITE_NOMEM;
+  pIdxInfo->needToFreeIdxStr = 1;
+  if(have_rowid_eq) {
+    pIdxInfo->estimatedCost = 10;
+    pIdxInfo->estimatedRows = 1;
+    pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+  } else if(have_eq) {
+    pIdxInfo->estimatedCost = 100;
+    pIdxInfo->estimatedRows = 10;
+  } else {
+    pIdxInfo->estimatedCost = have_full_eq ? 2000000 : 1000000;
+    pIdxInfo->estimatedRows = 1000000;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Add a constraint passed from xBestIndex to a scan, unless the value
+** is not one that can be checked against raw cells
+*/
+static int zsvtab_add_constraint(struct zsv_vtab_scan *scan, int op, int column, sqlite3_value *v) {
+  if(column < 0) { /* rowid */
+    if(sqlite3_value_type(v) == SQLITE_INTEGER) {
+      sqlite3_int64 rowid = sqlite3_value_int64(v);
+      if(scan->have_rowid && scan->rowid != rowid)
+        rowid = 0; /* no row can match */
+      scan->rowid = rowid;
+      scan->have_rowid = 1;
+    }
+    return SQLITE_OK;
+  }
+
+  /*
+  ** a value that is not text may be compared to the (TEXT) column either as text
+  ** or numerically, depending on the affinity of its expression, so skip it
+  */
+  if(sqlite3_value_type(v) != SQLITE_TEXT)
+    return SQLITE_OK;
+
+  const unsigned char *text = sqlite3_value_text(v);
+  size_t len = (size_t)sqlite3_value_bytes(v);
+  if(op == SQLITE_INDEX_CONSTRAINT_LIKE) {
+    /* only the literal prefix of the pattern is checked */
+    size_t prefix_len = 0;
+    while(prefix_len < len && text[prefix_len] != '%' && text[prefix_len] != '_')
+      prefix_len++;
+    if(!prefix_len)
+      return SQLITE_OK;
+    len = prefix_len;
+  }
+
+  struct zsv_vtab_constraint *k = &scan->constraints[scan->constraint_count];
+  k->column = column;
+  k->op = (unsigned char)op;
+  k->len = len;
+  if(!(k->value = sqlite3_malloc64(len ? len : 1)))
+    return SQLITE_NOMEM;
+  memcpy(k->value, text, len);
+  scan->constraint_count++;
   return SQLITE_OK;
 }
 
+/*
+** Parse the next row(s) until at least one row is cached, or there is no more input
+*/
+static void zsvtab_fill(zsvCursor *pCur) {
+  while(!pCur->data.rows && pCur->parser_status == zsv_status_ok) {
+    pCur->parser_status = zsv_parse_more(pCur->parser);
+    if(pCur->parser_status == zsv_status_no_more_input) {
+      zsv_finish(pCur->parser);
+      if(pCur->building) {
+        struct zsv_vtab_snapshot *snap = &((zsvTable *)pCur->base.pVtab)->snapshot;
+        pCur->building = snap->building = 0;
+        if(snap->row_starts) { /* else there are no data rows, and nothing to gain */
+          snap->row_starts[snap->row_count] = snap->cell_count;
+          snap->complete = 1;
+        }
+      }
+    }
+  }
+}
+
+/*
+** Stop a cursor's parse, if any. If it was building the snapshot, first finish
+** reading the file into the snapshot: a scan that stops early (e.g. a rowid or
+** EXISTS lookup) would otherwise never complete it
+*/
+static void zsvtab_cursor_reset(zsvCursor *pCur) {
+  if(pCur->building) {
+    pCur->scan.have_rowid = 1; /* cache no more rows */
+    pCur->scan.rowid = 0;
+    while(remove_row_from_cache(&pCur->data)) ;
+    zsvtab_fill(pCur);
+    if(pCur->building) { /* parse error */
+      zsv_vtab_snapshot_clear(&((zsvTable *)pCur->base.pVtab)->snapshot);
+      pCur->building = 0;
+    }
+  }
+  while(remove_row_from_cache(&pCur->data)) ;
+  if(pCur->parser)
+    zsv_delete(pCur->parser);
+  pCur->parser = NULL;
+  pCur->rowCount = 0;
+}
+
+/*
+** Move a cursor that reads from the snapshot to its next row: the next row
+** in its hash index bucket, if it is using one, else simply the next row
+*/
+static void zsvtab_snapshot_step(zsvCursor *pCur) {
+  if(pCur->hash_next) {
+    size_t next = pCur->hash_next[pCur->snapshot_row];
+    pCur->snapshot_row = next ? next - 1 : pCur->snapshot_end;
+  } else
+    pCur->snapshot_row++;
+}
+
+/*
+** Move a cursor that reads from the snapshot to the first row, at or after
+** its current row, that might satisfy its constraints
+*/
+static void zsvtab_snapshot_seek(zsvCursor *pCur, const struct zsv_vtab_snapshot *snap) {
+  if(pCur->scan.constraint_count)
+    while(pCur->snapshot_row < pCur->snapshot_end
+          && !zsv_snapshot_row_matches_constraints(&pCur->scan, snap, pCur->snapshot_row))
+      zsvtab_snapshot_step(pCur);
+}
+
 /*
 ** This method is the destructor for a zsvTable object.
 */
@@ -457,6 +1140,8 @@ static int zsvtabOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
   struct zsvCursor *pCur = sqlite3_malloc64(sizeof(*pCur));
   if( pCur==0 ) return SQLITE_NOMEM;
   memset(pCur, 0, sizeof(*pCur));
+  zsv_vtab_scan_clear(&pCur->scan);
+  pCur->data.last = &pCur->data.rows;
   *ppCursor = &pCur->base;
   return SQLITE_OK;
 }
@@ -465,13 +1150,20 @@ static int zsvtabOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
 ** Destructor for a zsvCursor.
 */
 static int zsvtabClose(sqlite3_vtab_cursor *cur){
+  zsvCursor *pCur = (zsvCursor*)cur;
+  zsvtab_cursor_reset(pCur);
+  zsv_vtab_cache_delete(&pCur->data);
+  if(pCur->stream)
+    fclose(pCur->stream);
+  zsv_vtab_scan_clear(&pCur->scan);
   sqlite3_free(cur);
   return SQLITE_OK;
 }
 
 /*
-** Only a full table scan is supported.  So xFilter simply rewinds to
-** the beginning.
+** Only a full table scan is supported.  So xFilter sets up any constraints to
+** check rows against, and rewinds to the beginning: either of the snapshot,
+** if it is complete, or of the file
 */
 static int zsvtabFilter(
   sqlite3_vtab_cursor *pVtabCursor,
@@ -479,18 +1171,102 @@ static int zsvtabFilter(
   int argc, sqlite3_value **argv
 ){
   (void)(idxNum);
-  (void)(idxStr);
-  (void)(argc);
-  (void)(argv);
   zsvTable *pTab = (zsvTable*)pVtabCursor->pVtab;
+  zsvCursor *pCur = (zsvCursor*)pVtabCursor;
+  struct zsv_vtab_scan *scan = &pCur->scan;
+
+  zsvtab_cursor_reset(pCur);
+  zsv_vtab_scan_clear(scan);
+  if(idxStr) {
+    unsigned long long col_used;
+    int n;
+    if(sscanf(idxStr, "%llx;%n", &col_used, &n) == 1) {
+      idxStr += n;
+      scan->col_used = col_used;
+      if(!(col_used >> 63)) {
+        scan->col_limit = 0;
+        for(; col_used; col_used >>= 1)
+          scan->col_limit++;
+      }
+    }
+  }
+  if(idxStr && argc > 0) {
+    if(!(scan->constraints = sqlite3_malloc64(argc * sizeof(*scan->constraints))))
+      return SQLITE_NOMEM;
+    for(int i = 0; i < argc && *idxStr; i++) {
+      int op, column, n;
+      if(sscanf(idxStr, "%d,%d;%n", &op, &column, &n) != 2)
+        break;
+      idxStr += n;
+      if(zsvtab_add_constraint(scan, op, column, argv[i]) != SQLITE_OK)
+        return SQLITE_NOMEM;
+    }
+  }
+
+  struct zsv_vtab_snapshot *snap = &pTab->snapshot;
+  pCur->hash_next = NULL;
+  if(snap->complete) {
+    pCur->from_snapshot = 1;
+    pCur->snapshot_row = 0;
+    pCur->snapshot_end = snap->row_count;
+    if(scan->have_rowid) {
+      if(scan->rowid < 1 || (sqlite3_uint64)scan->rowid > snap->row_count)
+        pCur->snapshot_end = 0;
+      else {
+        pCur->snapshot_row = (size_t)scan->rowid - 1;
+        pCur->snapshot_end = (size_t)scan->rowid;
+      }
+    } else {
+      /* use the hash index of the first column with an equality constraint */
+      for(int i = 0; i < scan->constraint_count; i++) {
+        const struct zsv_vtab_constraint *k = &scan->constraints[i];
+        if(k->op != SQLITE_INDEX_CONSTRAINT_EQ)
+          continue;
+        const struct zsv_vtab_hash_index *ix =
+          zsv_vtab_snapshot_hash_index(snap, k->column, pTab->header.rows ? pTab->header.rows->column_count : 0);
+        if(ix) {
+          size_t first = ix->heads[(size_t)zsv_vtab_hash(k->value, k->len) & ix->mask];
+          pCur->snapshot_row = first ? first - 1 : pCur->snapshot_end;
+          pCur->hash_next = ix->next;
+        }
+        break;
+      }
+    }
+    zsvtab_snapshot_seek(pCur, snap);
+    return SQLITE_OK;
+  }
 
-  zsvTable_clear(pTab);
-  fseek(pTab->parser_opts.stream, 0, SEEK_SET);
+  /*
+  ** parse the file; if it has been parsed before, build the snapshot while
+  ** doing so, unless another cursor is already building it
+  */
+  pCur->from_snapshot = 0;
+  if(snap->scans++ > 0 && snap->max_bytes && !snap->disabled && !snap->building) {
+    zsv_vtab_snapshot_clear(snap);
+    snap->building = pCur->building = 1;
+  }
 
-  pTab->parser_opts.row_handler = zsv_row_header;
-  if(!(pTab->parser = zsv_new(&pTab->parser_opts)))
+  struct zsv_opts opts = pTab->parser_opts;
+  if(pTab->spool) {
+    pCur->spool_reader.spool = pTab->spool;
+    pCur->spool_reader.pos = 0;
+    opts.read = zsv_vtab_spool_read;
+    opts.stream = &pCur->spool_reader;
+  } else {
+    if(!pCur->stream || fseek(pCur->stream, 0, SEEK_SET)) { // decompressed input cannot seek, so reopen it
+      if(pCur->stream)
+        fclose(pCur->stream);
+      if(!(pCur->stream = zsv_input_open(pTab->zFilename)))
+        return SQLITE_ERROR;
+    }
+    opts.stream = pCur->stream;
+  }
+  opts.row_handler = zsv_row_skip_header;
+  opts.ctx = pCur;
+  if(!(pCur->parser = zsv_new(&opts)))
     return SQLITE_ERROR;
-  pTab->parser_status = zsv_parse_more(pTab->parser);
+  pCur->parser_status = zsv_status_ok;
+  zsvtab_fill(pCur);
   return SQLITE_OK;
 }
 
@@ -501,13 +1277,15 @@ static int zsvtabFilter(
 */
 static int zsvtabNext(sqlite3_vtab_cursor *cur){
   zsvTable *pTab = (zsvTable*)cur->pVtab;
-
-  remove_row_from_cache(&pTab->data);
-  if(!pTab->data.rows && pTab->parser_status != zsv_status_no_more_input) {
-    pTab->parser_status = zsv_parse_more(pTab->parser);
-    if(pTab->parser_status == zsv_status_no_more_input)
-      zsv_finish(pTab->parser);
+  zsvCursor *pCur = (zsvCursor*)cur;
+  if(pCur->from_snapshot) {
+    zsvtab_snapshot_step(pCur);
+    zsvtab_snapshot_seek(pCur, &pTab->snapshot);
+    return SQLITE_OK;
   }
+
+  remove_row_from_cache(&pCur->data);
+  zsvtab_fill(pCur);
   return SQLITE_OK;
 }
 
@@ -516,8 +1294,10 @@ static int zsvtabNext(sqlite3_vtab_cursor *cur){
 ** row of output.
 */
 static int zsvtabEof(sqlite3_vtab_cursor *cur){
-  zsvTable *pTab = (zsvTable*)cur->pVtab;
-  return !pTab->data.rows && pTab->parser_status == zsv_status_no_more_input;
+  zsvCursor *pCur = (zsvCursor*)cur;
+  if(pCur->from_snapshot)
+    return pCur->snapshot_row >= pCur->snapshot_end;
+  return !pCur->data.rows && pCur->parser_status != zsv_status_ok;
 }
 
 /*
@@ -530,8 +1310,19 @@ static int zsvtabColumn(
   int i                       /* Which column to return */
 ){
   zsvTable *pTab = (zsvTable*)cur->pVtab;
+  zsvCursor *pCur = (zsvCursor*)cur;
+  if(pCur->from_snapshot) {
+    const struct zsv_vtab_snapshot *snap = &pTab->snapshot;
+    size_t start = snap->row_starts[pCur->snapshot_row];
+    if(i >= 0 && (size_t)i < snap->row_starts[pCur->snapshot_row + 1] - start)
+      sqlite3_result_text(ctx, (char *)snap->raw + snap->cell_offsets[start + i],
+                          snap->cell_lens[start + i], SQLITE_STATIC);
+    else
+      sqlite3_result_null(ctx);
+    return SQLITE_OK;
+  }
 
-  struct zsv_cell c = get_cell_from_cache(&pTab->data, i);
+  struct zsv_cell c = get_cell_from_cache(&pCur->data, i);
   sqlite3_result_text(ctx, (char *)c.str, c.len, SQLITE_STATIC);
   return SQLITE_OK;
 }
@@ -540,8 +1331,12 @@ static int zsvtabColumn(
 ** Return the rowid for the current row.
 */
 static int zsvtabRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
-  zsvTable *pTab = (zsvTable*)cur->pVtab;
-  struct zsv_vtab_cache_row *r = pTab->data.rows;
+  zsvCursor *pCur = (zsvCursor*)cur;
+  if(pCur->from_snapshot) {
+    *pRowid = (sqlite_int64)pCur->snapshot_row + 1;
+    return SQLITE_OK;
+  }
+  struct zsv_vtab_cache_row *r = pCur->data.rows;
   if(r)
     *pRowid = r->id;
   else
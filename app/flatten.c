@@ -20,6 +20,7 @@
 #include <zsv/utils/utf8.h>
 #include <zsv/utils/mem.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/compress.h>
 
 enum flatten_agg_method {
   flatten_agg_method_none = 1,
@@ -693,7 +694,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         data.output_filename = argv[++arg_i];
     } else if(data.in)
       err = zsv_printerr(1, "Input file was specified, cannot also read: %s", argv[arg_i]);
-    else if(!(data.in = fopen(argv[arg_i], "rb")))
+    else if(!(data.in = zsv_input_open(argv[arg_i])))
       err = zsv_printerr(1, "Could not open for reading: %s", argv[arg_i]);
     else
       data.input_path = argv[arg_i];
@@ -750,10 +751,12 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         err = data.cancelled = zsv_printerr(1, "Unable to create csv parser");
       else {
         zsv_set_scan_filter(handle, zsv_filter_write, tmp_f);
-        enum zsv_status status;
+        enum zsv_status status = zsv_status_ok;
         while(!data.cancelled && !zsv_signal_interrupted
               && (status = zsv_parse_more(handle)) == zsv_status_ok)
           ;
+        if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+          err = data.cancelled = 1;
         zsv_finish(handle);
         zsv_delete(handle);
         fflush(tmp_f);
@@ -780,10 +783,12 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     if(!parser)
       err = data.cancelled = zsv_printerr(1, "Unable to create csv parser");
 
-    enum zsv_status status;
+    enum zsv_status status = zsv_status_ok;
     while(!data.cancelled && !zsv_signal_interrupted
           && (status = zsv_parse_more(parser)) == zsv_status_ok)
       ;
+    if(status == zsv_status_error)
+      err = 1;
     zsv_finish(parser);
     zsv_delete(parser);
     output_current_row(&data);
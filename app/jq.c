@@ -6,6 +6,7 @@
 #include "zsv_command.h"
 
 #include <zsv/utils/jq.h>
+#include <zsv/utils/compress.h>
 
 /**
  * This implementation is not intended to replicate the full functionality of the `jq`
@@ -45,7 +46,7 @@ int ZSV_MAIN_NO_OPTIONS_FUNC(ZSV_COMMAND)(int argc, const char *argv[]) {
   for(int i = 2; !err && i < argc; i++) { // jq filter filename
     const char *arg = argv[i];
     if(i == 2 && *arg != '-') {
-      if(!(f_in = fopen(arg, "rb"))) {
+      if(!(f_in = zsv_input_open(arg))) {
         err = 1;
         fprintf(stderr, "Unable to open for read: %s\n", arg);
       }
@@ -15,6 +15,7 @@
 #include "zsv_command.h"
 #include <zsv/utils/writer.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/compress.h>
 
 #define ZSV_PRETTY_DEFAULT_LINE_MAX_WIDTH 160
 #define ZSV_PRETTY_DEFAULT_COLUMN_MAX_WIDTH 35
@@ -668,7 +669,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *pa
         if(!got_opt)
           rc = zsv_printerr(1, "Unrecognized option: %s", argv[i]);
       }
-    } else if(!(in = fopen(argv[i], "rb")))
+    } else if(!(in = zsv_input_open(argv[i])))
       rc = zsv_printerr(1, "Unable to open file %s for reading", argv[i]);
     else
       input_path = argv[i];
@@ -688,13 +689,15 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *pa
   else {
     zsv_handle_ctrl_c_signal();
     rc = 0;
-    enum zsv_status status;
+    enum zsv_status status = zsv_status_ok;
     while(zsv_parse_more(h->parser) == zsv_status_ok)
       ;
 
     while(!rc && !zsv_signal_interrupted
           && (status = zsv_parse_more(h->parser)) == zsv_status_ok)
       ;
+    if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+      rc = 1;
 
     zsv_pretty_flush(h);
     zsv_pretty_destroy(h);
@@ -25,9 +25,11 @@
 #include <zsv/utils/file.h>
 #include <zsv/utils/json.h>
 #include <zsv/utils/jq.h>
+#include <zsv/utils/mem.h>
 #include <zsv/utils/dirs.h>
 #include <zsv/utils/cache.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/compress.h>
 
 const char *zsv_property_usage_msg[] = {
   APPNAME ": view or save parsing options associated with a file",
@@ -50,7 +52,11 @@ const char *zsv_property_usage_msg[] = {
   "                                    -d auto -R auto",
   "                                  when using this option, a dash (-) can be used instead",
   "                                  of a filepath to read from stdin",
-  "    --save [-f,--overwrite]     : (only applicable with --auto) save the detected result",
+  "    --column-types <value>      : detect/unset column types (\"auto\", or \"none\" or \"-\"), sampled",
+  "                                  from rows across the whole file. saved column types are",
+  "                                  used by loaders such as 2db",
+  "    --save [-f,--overwrite]     : (only applicable with --auto or --column-types auto) save",
+  "                                  the detected result",
   "    --copy <dest filepath>      : copy properties to another file", // to do: opt to check valid JSON
   "    --export <output path>      : export all properties to a single JSON file (- for stdout)", // to do: opt to check valid JSON
   "    --import <input path>       : import properties from a single JSON file (- for stdin)", // to do: opt to check valid JSON
@@ -62,6 +68,11 @@ const char *zsv_property_usage_msg[] = {
   "    file's properties",
   "  - \"auto\" to auto-detect the property value (to save, use --save/--overwrite)",
   "",
+  "Column types are detected from the initial rows and, if the file is seekable, from",
+  "  runs of rows at evenly-spaced offsets across the file. Each column is saved with its",
+  "  type (integer, real, date, bool or text), whether any value is blank (nullable) and",
+  "  the maximum length in bytes of its values (width)",
+  "",
   "If no options are provided, currently saved properties are output in JSON format.",
   "",
   "  Properties are saved in " ZSV_CACHE_DIR "/<filename>/" ZSV_CACHE_PROPERTIES_NAME,
@@ -92,160 +103,6 @@ static int show_all_properties(const unsigned char *filepath) {
   return err;
 }
 
-#define ZSV_PROP_TYPE_CHECK_NUM 1
-#define ZSV_PROP_TYPE_CHECK_DATE 2
-#define ZSV_PROP_TYPE_CHECK_BOOL 4
-#define ZSV_PROP_TYPE_CHECK_NULL 8
-
-/**
- * Very basic test to check if a string looks like a number:
- * - ignore leading whitespace and currency
- * - ignore trailing whitespace
- * - ignore leading dash or plus
- * - len < 1 or > 30 => not a number
- * - scan characters one by one:
- *     if the char isn't a digit, comma or period, it's not a number
- *     digits are ignored
- *     commas are counted (we ignore the requirement for them to be spaced out e.g. every 3 digits)
- *     periods are counted
- *     if at any point we have more than 1 comma AND more than 1 digit, it's not a number
- * @param s     input string
- * @param len   length of input
- * @param flags reserved for future use
- * @return      1 if it looks like a number, else 0
- */
-static char looks_like_num(const unsigned char *s, size_t len, unsigned flags) {
-  (void)(flags);
-  // trim
-  s = zsv_strtrim(s, &len);
-
-  // strip +/- sign, if any
-  size_t sign = zsv_strnext_is_sign(s, len);
-  if(sign) {
-    s += sign;
-    len -= sign;
-    s = zsv_strtrim_left(s, &len);
-  }
-
-  // strip currency, if any
-  size_t currency = zsv_strnext_is_currency(s, len);
-  if(currency) {
-    s += currency;
-    len -= currency;
-    s = zsv_strtrim_left(s, &len);
-  }
-
-  // strip +/- sign, if we didn't find one earlier
-  if(!sign && (sign = zsv_strnext_is_sign(s, len))) {
-    s += sign;
-    len -= sign;
-    s = zsv_strtrim_left(s, &len);
-  }
-
-  if(len < 1 || len > 30)
-    return 0;
-
-  unsigned digits = 0;
-  unsigned period = 0;
-  for(size_t i = 0; i < len; i++) {
-    unsigned char c = s[i];
-    if(c >= '0' && c <= '9') // to do: allow utf8 digits, commas, periods?
-      digits++;
-    else if(c == ',' && i > 0 && period == 0) { // comma can't be first char, or follow a period
-      // do nothing. to do: check that the last comma was either 3 or 4 numbers away?
-    } else if(c == '.' && period == 0) // only 1 period allowed (to do: relax this as it isn't true in all localities)
-      period++;
-    else
-      return 0;
-  }
-  return digits > 0 && period < 2;
-}
-
-/**
- * Super crude "test" to check if a string looks like a date or timestamp:
- * we are just going to disqualify if len < 5 or len > 30
- * or any chars are not digits, slash, dash, colon, space
- * or in any of the following which is made up of chars from the English months, plus am/pm
- *   abcdefghijlmnoprstuvy
- * @param s     input string
- * @param len   length of input
- * @param flags reserved for future use
- * @return      1 if it looks like a date, else 0
- */
-static char looks_like_date(const unsigned char *s, size_t len, unsigned flags) {
-  (void)(flags);
-  // trim
-  s = zsv_strtrim(s, &len);
-  if(len <= 5 || len > 30)
-    return 0;
-  #define LOOKS_LIKE_DATE_CHARS "0123456789-/:, abcdefghijlmnoprstuvy"
-  for(size_t i = 0; i < len; i++)
-    if(!memchr(LOOKS_LIKE_DATE_CHARS, s[i], strlen(LOOKS_LIKE_DATE_CHARS)))
-      return 0;
-  return 1;
-}
-
-/**
- * Very basic test to check if a string looks like a bool:
- * - ignore leading and trailing whitespace
- * - look for true, false, yes, no, T, F, 1, 0, Y, N
- * - to do: add localization options?
- * @param s     input string
- * @param len   length of input
- * @param flags reserved for future use
- * @return      1 if it looks like a bool, else 0
- */
-static char looks_like_bool(const unsigned char *s, size_t len, unsigned flags) {
-  (void)(flags);
-  // trim
-  s = zsv_strtrim(s, &len);
-
-  if(!len)
-    return 0;
-
-  if(len == 1)
-    return strchr("TtFf10YyNn", *s) ? 1 : 0;
-
-  if(len <= 5) {
-    char *lower = (char *)zsv_strtolowercase(s, &len);
-    if(lower) {
-      char result = 0;
-      switch(len) {
-      case 2:
-        result = !strcmp(lower, "no");
-        break;
-      case 3:
-        result = !strcmp(lower, "yes");
-        break;
-      case 4:
-        result = !strcmp(lower, "true");
-        break;
-      case 5:
-        result = !strcmp(lower, "false");
-        break;
-      }
-      free(lower);
-      return result;
-    }
-  }
-  return 0;
-}
-
-static unsigned int type_detect(const unsigned char *s, size_t slen) {
-  unsigned int result = 0;
-  if(slen == 0) {
-    result += ZSV_PROP_TYPE_CHECK_NULL;
-    return result;
-  }
-  if(looks_like_num(s, slen, 0))
-    result += ZSV_PROP_TYPE_CHECK_NUM;
-  if(looks_like_date(s, slen, 0))
-    result += ZSV_PROP_TYPE_CHECK_DATE;
-  if(looks_like_bool(s, slen, 0))
-    result += ZSV_PROP_TYPE_CHECK_BOOL;
-  return result;
-}
-
 #define ZSV_PROP_DETECT_ROW_MAX 10
 struct detect_properties_data {
   zsv_parser parser;
@@ -264,7 +121,7 @@ static void detect_properties_row(void *ctx) {
   size_t cols_used = data->rows[data->rows_processed].cols_used = zsv_cell_count(data->parser);
   for(size_t i = 0; i < cols_used; i++) {
     struct zsv_cell c = zsv_get_cell(data->parser, i);
-    unsigned int result = type_detect(c.str, c.len);
+    unsigned int result = zsv_prop_type_detect(c.str, c.len);
     if(result & ZSV_PROP_TYPE_CHECK_NULL)
       data->rows[data->rows_processed].null++;
     else {
@@ -324,7 +181,7 @@ static int detect_properties(const unsigned char *filepath,
   if(!strcmp((void *)filepath, "-"))
     opts->stream = stdin;
   else {
-    opts->stream = fopen((const char *)filepath, "rb");
+    opts->stream = zsv_input_open((const char *)filepath);
     if(!opts->stream) {
       perror((const char *)filepath);
       return 1;
@@ -346,6 +203,220 @@ static int detect_properties(const unsigned char *filepath,
   return 0;
 }
 
+/*
+ * Column type detection samples the initial rows and, if the input is seekable and
+ * was not entirely read, runs of rows starting at evenly-spaced offsets across the
+ * file. Each offset is first advanced to the start of the next line; as that might
+ * be inside a quoted value, rows whose cell count differs from the header's are
+ * ignored, as are runs in which most rows differ
+ */
+#define ZSV_PROP_SAMPLE_HEAD_ROWS 1000
+#define ZSV_PROP_SAMPLE_CHUNKS 64
+#define ZSV_PROP_SAMPLE_CHUNK_ROWS 100
+#define ZSV_PROP_SAMPLE_MAX_SKIP (1024 * 1024) // max bytes to scan for the start of a line
+
+#if defined(_WIN32) || defined(WIN32) || defined(WIN)
+#define zsv_prop_fseek _fseeki64
+#define zsv_prop_ftell _ftelli64
+#else
+#define zsv_prop_fseek fseeko
+#define zsv_prop_ftell ftello
+#endif
+
+struct detect_column_stats {
+  unsigned int mask; // zsv_prop_cell_classify() results of non-blank values, and-ed together
+  size_t width;
+  size_t values;     // number of non-blank values
+  char nullable;
+};
+
+struct detect_columns_data {
+  zsv_parser parser;
+  struct zsv_prop_columns *columns; // names are set from the header row
+  struct detect_column_stats *stats;
+  struct detect_column_stats *chunk_stats; // stats of the rows parsed since the last merge
+  size_t rows;
+  size_t rows_matched; // rows whose cells were counted
+  size_t max_rows;
+  char got_header;
+  char in_chunk;
+  char err;
+};
+
+static void detect_columns_reset_chunk(struct detect_columns_data *data) {
+  for(size_t i = 0; i < data->columns->count; i++) {
+    struct detect_column_stats *cs = &data->chunk_stats[i];
+    memset(cs, 0, sizeof(*cs));
+    cs->mask = ~0u;
+  }
+  data->rows = data->rows_matched = 0;
+}
+
+static void detect_columns_merge_chunk(struct detect_columns_data *data) {
+  for(size_t i = 0; i < data->columns->count; i++) {
+    struct detect_column_stats *cs = &data->chunk_stats[i];
+    struct detect_column_stats *total = &data->stats[i];
+    total->mask &= cs->mask;
+    if(total->width < cs->width)
+      total->width = cs->width;
+    total->values += cs->values;
+    total->nullable |= cs->nullable;
+  }
+}
+
+static void detect_columns_header(struct detect_columns_data *data) {
+  size_t cols = zsv_cell_count(data->parser);
+  data->got_header = 1;
+  if(!cols)
+    return;
+  data->columns->columns = calloc(cols, sizeof(*data->columns->columns));
+  data->stats = calloc(cols, sizeof(*data->stats));
+  data->chunk_stats = calloc(cols, sizeof(*data->chunk_stats));
+  if(!data->columns->columns || !data->stats || !data->chunk_stats) {
+    fprintf(stderr, "Out of memory!\n");
+    data->err = 1;
+    zsv_abort(data->parser);
+    return;
+  }
+  data->columns->count = cols;
+  for(size_t i = 0; i < cols; i++) {
+    struct zsv_cell c = zsv_get_cell(data->parser, i);
+    if(!(data->columns->columns[i].name = zsv_memdup(c.str, c.len))) {
+      fprintf(stderr, "Out of memory!\n");
+      data->err = 1;
+      zsv_abort(data->parser);
+      return;
+    }
+    data->stats[i].mask = ~0u;
+  }
+  detect_columns_reset_chunk(data);
+}
+
+static void detect_columns_row(void *ctx) {
+  struct detect_columns_data *data = ctx;
+  if(!data->got_header) {
+    detect_columns_header(data);
+    return;
+  }
+
+  size_t cols = zsv_cell_count(data->parser);
+  data->rows++;
+  if(!data->in_chunk || cols == data->columns->count) {
+    data->rows_matched++;
+    for(size_t i = 0; i < data->columns->count; i++) {
+      struct detect_column_stats *cs = &data->chunk_stats[i];
+      struct zsv_cell c = i < cols ? zsv_get_cell(data->parser, i) : (struct zsv_cell) { 0 };
+      unsigned int result = zsv_prop_cell_classify(c.str, c.len);
+      if(result & ZSV_PROP_CELL_NULL)
+        cs->nullable = 1;
+      else {
+        cs->mask &= result;
+        cs->values++;
+        if(cs->width < c.len)
+          cs->width = c.len;
+      }
+    }
+  }
+  if(data->rows >= data->max_rows)
+    zsv_abort(data->parser);
+}
+
+static void detect_columns_parse(struct detect_columns_data *data, struct zsv_opts *opts) {
+  opts->row_handler = detect_columns_row;
+  opts->ctx = data;
+  if(!(data->parser = zsv_new(opts))) {
+    fprintf(stderr, "Out of memory!\n");
+    data->err = 1;
+    return;
+  }
+  enum zsv_status status = zsv_status_ok;
+  while(!zsv_signal_interrupted && (status = zsv_parse_more(data->parser)) == zsv_status_ok)
+    ;
+  if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+    data->err = 1;
+  zsv_finish(data->parser);
+  zsv_delete(data->parser);
+  data->parser = NULL;
+}
+
+// advance to the start of the next line. return 0 on success
+static int detect_columns_skip_line(FILE *f) {
+  int c;
+  for(size_t i = 0; i < ZSV_PROP_SAMPLE_MAX_SKIP && (c = getc(f)) != EOF; i++) {
+    if(c == '\n')
+      return 0;
+    if(c == '\r') {
+      if((c = getc(f)) != '\n' && c != EOF)
+        ungetc(c, f);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Detect column types, using the header span and rows to skip given, rather than any
+ * saved properties
+ */
+static int detect_column_types(const unsigned char *filepath, struct zsv_prop_columns *columns,
+                               unsigned header_span, unsigned skip,
+                               const struct zsv_opts *base_opts) {
+  FILE *f;
+  if(!strcmp((void *)filepath, "-"))
+    f = stdin;
+  else if(!(f = zsv_input_open((const char *)filepath))) {
+    perror((const char *)filepath);
+    return 1;
+  }
+
+  struct detect_columns_data data = { 0 };
+  data.columns = columns;
+  data.max_rows = ZSV_PROP_SAMPLE_HEAD_ROWS;
+  struct zsv_opts opts = *base_opts;
+  opts.stream = f;
+  opts.header_span = header_span;
+  opts.rows_to_ignore = skip;
+  detect_columns_parse(&data, &opts);
+  if(!data.err && !data.got_header) {
+    fprintf(stderr, "%s: no header row found\n", filepath);
+    data.err = 1;
+  }
+  if(!data.err && columns->count) {
+    detect_columns_merge_chunk(&data);
+    int64_t size;
+    if(data.rows >= data.max_rows && f != stdin
+       && !zsv_prop_fseek(f, 0, SEEK_END) && (size = zsv_prop_ftell(f)) > 0) {
+      // the initial rows did not include the whole file: sample from across it
+      opts = *base_opts;
+      opts.stream = f;
+      opts.header_span = opts.rows_to_ignore = 0;
+      opts.insert_header_row = NULL;
+      data.in_chunk = 1;
+      data.max_rows = ZSV_PROP_SAMPLE_CHUNK_ROWS;
+      for(unsigned i = 1; !data.err && !zsv_signal_interrupted && i <= ZSV_PROP_SAMPLE_CHUNKS; i++) {
+        int64_t offset = size * i / (ZSV_PROP_SAMPLE_CHUNKS + 1);
+        if(zsv_prop_fseek(f, offset, SEEK_SET) || detect_columns_skip_line(f))
+          continue;
+        detect_columns_reset_chunk(&data);
+        detect_columns_parse(&data, &opts);
+        if(data.rows && data.rows_matched * 2 > data.rows)
+          detect_columns_merge_chunk(&data);
+      }
+    }
+    for(size_t i = 0; i < columns->count; i++) {
+      struct zsv_prop_column *c = &columns->columns[i];
+      c->type = data.stats[i].values ? zsv_prop_column_type_from_mask(data.stats[i].mask) : zsv_prop_column_type_text;
+      c->width = data.stats[i].width;
+      c->nullable = data.stats[i].nullable;
+    }
+  }
+  free(data.stats);
+  free(data.chunk_stats);
+  if(f != stdin)
+    fclose(f);
+  return data.err;
+}
+
 #define ZSV_PROP_ARG_NONE -1
 #define ZSV_PROP_ARG_AUTO -2
 #define ZSV_PROP_ARG_REMOVE -3
@@ -415,9 +486,23 @@ static int merge_properties(int64_t values[2],
   return err;
 }
 
+static void print_columns(FILE *f, const struct zsv_prop_columns *columns) {
+  fprintf(f, "  \"columns\": [\n");
+  for(size_t i = 0; i < columns->count; i++) {
+    const struct zsv_prop_column *c = &columns->columns[i];
+    unsigned char *name = c->name ? zsv_json_from_str(c->name) : NULL;
+    fprintf(f, "    { \"name\": %s, \"type\": \"%s\", \"nullable\": %s, \"width\": %zu }%s\n",
+            name ? (char *)name : "null", zsv_prop_column_type_str(c->type),
+            c->nullable ? "true" : "false", c->width, i + 1 < columns->count ? "," : "");
+    free(name);
+  }
+  fprintf(f, "  ]");
+}
+
 // print_properties: return 1 if something was printed
 static char print_properties_helper(FILE *f, int64_t values[2], char keep[2],
-                                    const char *prop_id[2]) {
+                                    const char *prop_id[2],
+                                    const struct zsv_prop_columns *columns) {
   char started = 0;
   for(int i = 0; i < 2; i++) {
     if(keep[i]) {
@@ -429,6 +514,11 @@ static char print_properties_helper(FILE *f, int64_t values[2], char keep[2],
       fprintf(f, "  \"%s\": %u", prop_id[i], (unsigned)values[i]);
     }
   }
+  if(columns && columns->count) {
+    fprintf(f, started ? ",\n" : "{\n");
+    started = 1;
+    print_columns(f, columns);
+  }
   if(started)
     fprintf(f, "\n}\n");
   return started;
@@ -438,18 +528,24 @@ static char print_properties_helper(FILE *f, int64_t values[2], char keep[2],
 // print to stdout
 // in addition, print to f, if provided
 static char print_properties(FILE *f, int64_t values[2], char keep[2],
-                             const char *prop_id[2]) {
+                             const char *prop_id[2],
+                             const struct zsv_prop_columns *columns) {
   char result = 0;
   if(f)
-    result = print_properties_helper(f, values, keep, prop_id);
-  if(!print_properties_helper(stdout, values, keep, prop_id))
+    result = print_properties_helper(f, values, keep, prop_id, columns);
+  if(!print_properties_helper(stdout, values, keep, prop_id, columns))
     printf("{}\n");
   return result;
 }
 
+/**
+ * @param column_types: ZSV_PROP_ARG_NONE to keep any saved columns, ZSV_PROP_ARG_REMOVE
+ *                      to remove them, or ZSV_PROP_ARG_AUTO to replace them with `columns`
+ */
 static int merge_and_save_properties(const unsigned char *filepath,
                                      char save, char overwrite,
-                                     int64_t d, int64_t R) {
+                                     int64_t d, int64_t R,
+                                     int64_t column_types, const struct zsv_prop_columns *columns) {
   int err = 0;
   unsigned char *props_fn = zsv_cache_filepath(filepath, zsv_cache_type_property, 0, 0);
   if(!props_fn)
@@ -457,11 +553,15 @@ static int merge_and_save_properties(const unsigned char *filepath,
   else {
     struct zsv_file_properties fp = { 0 };
     struct zsv_opts zsv_opts = { 0 };
+    struct zsv_prop_columns saved_columns = { 0 };
     err = zsv_cache_load_props((const char *)filepath, &zsv_opts, &fp, NULL);
+    if(!err)
+      err = zsv_cache_load_columns((const char *)filepath, &saved_columns);
     if(!err) {
       if(save && !overwrite) {
-        if((fp.header_span_specified && d)
-           || (fp.skip_specified && R)) {
+        if((fp.header_span_specified && d > 0)
+           || (fp.skip_specified && R > 0)
+           || (saved_columns.count && column_types == ZSV_PROP_ARG_AUTO)) {
           fprintf(stderr, "Properties for this file already exist; use -f or --overwrite option to overwrite\n");
           err = 1;
         }
@@ -483,10 +583,17 @@ static int merge_and_save_properties(const unsigned char *filepath,
           const char *prop_id[2] = { "header-row-span", "skip-head" };
           char keep[2] = { '\0', '\0' };
           int remove_any = 0;
+          const struct zsv_prop_columns *columns_to_save = NULL;
           err = merge_properties(final_values, &fp, keep, &remove_any);
+          if(column_types == ZSV_PROP_ARG_AUTO)
+            columns_to_save = columns;
+          else if(column_types == ZSV_PROP_ARG_REMOVE)
+            remove_any = 1;
+          else
+            columns_to_save = &saved_columns;
           char printed_something = 0;
           if(!err)
-            printed_something = print_properties(f, final_values, keep, prop_id);
+            printed_something = print_properties(f, final_values, keep, prop_id, columns_to_save);
           if(f)
             fclose(f);
 
@@ -503,6 +610,7 @@ static int merge_and_save_properties(const unsigned char *filepath,
         free(props_fn_tmp);
       }
     }
+    zsv_prop_columns_free(&saved_columns);
     free(props_fn);
   }
   return err;
@@ -531,6 +639,7 @@ static enum zsv_prop_mode zsv_prop_get_mode(const char *opt) {
 struct prop_opts {
   int64_t d; // ZSV_PROP_ARG_AUTO, ZSV_PROP_ARG_REMOVE or > 0
   int64_t R; // ZSV_PROP_ARG_AUTO, ZSV_PROP_ARG_REMOVE or > 0
+  int64_t column_types; // ZSV_PROP_ARG_NONE, ZSV_PROP_ARG_AUTO or ZSV_PROP_ARG_REMOVE
   unsigned char clear:1;
   unsigned char save:1;
   unsigned char overwrite:1;
@@ -540,9 +649,15 @@ struct prop_opts {
 static int zsv_prop_execute_default(const unsigned char *filepath, struct zsv_opts zsv_opts, struct prop_opts opts) {
   int err = 0;
   struct zsv_file_properties fp = { 0 };
+  struct zsv_prop_columns columns = { 0 };
+  struct zsv_opts column_types_opts = zsv_opts; // before detect_properties() modifies zsv_opts
   if(opts.d >= 0 || opts.R >= 0 || opts.d == ZSV_PROP_ARG_REMOVE || opts.R == ZSV_PROP_ARG_REMOVE)
     opts.overwrite = 1;
   if(opts.d == ZSV_PROP_ARG_AUTO || opts.R == ZSV_PROP_ARG_AUTO) {
+    if(opts.column_types == ZSV_PROP_ARG_AUTO && !strcmp((const char *)filepath, "-")) {
+      fprintf(stderr, "--column-types auto cannot be used with --auto when reading from stdin\n");
+      return 1;
+    }
     err = detect_properties(filepath, &fp,
                             opts.d == ZSV_PROP_ARG_AUTO,
                             opts.R == ZSV_PROP_ARG_AUTO,
@@ -555,8 +670,24 @@ static int zsv_prop_execute_default(const unsigned char *filepath, struct zsv_op
 
     if(opts.R == ZSV_PROP_ARG_AUTO)
       opts.R = fp.skip;
-    err = merge_and_save_properties(filepath, opts.save, opts.overwrite, opts.d, opts.R);
   }
+
+  if(!err && opts.column_types == ZSV_PROP_ARG_AUTO) {
+    // detect using the header span and rows to skip that will be in effect after this command
+    struct zsv_file_properties saved = { 0 };
+    if(!(err = zsv_cache_load_props((const char *)filepath, NULL, &saved, NULL))) {
+      unsigned header_span = opts.d >= 0 ? (unsigned)opts.d :
+        opts.d == ZSV_PROP_ARG_NONE && saved.header_span_specified ? saved.header_span : 0;
+      unsigned skip = opts.R >= 0 ? (unsigned)opts.R :
+        opts.R == ZSV_PROP_ARG_NONE && saved.skip_specified ? saved.skip : 0;
+      err = detect_column_types(filepath, &columns, header_span, skip, &column_types_opts);
+    }
+  }
+
+  if(!err)
+    err = merge_and_save_properties(filepath, opts.save, opts.overwrite, opts.d, opts.R,
+                                    opts.column_types, &columns);
+  zsv_prop_columns_free(&columns);
   return err;
 }
 
@@ -875,6 +1006,7 @@ int ZSV_MAIN_NO_OPTIONS_FUNC(ZSV_COMMAND)(int m_argc, const char *m_argv[]) {
     struct prop_opts opts = { 0 };
     opts.d = ZSV_PROP_ARG_NONE;
     opts.R = ZSV_PROP_ARG_NONE;
+    opts.column_types = ZSV_PROP_ARG_NONE;
 
     const unsigned char *filepath = (const unsigned char *)m_argv[1];
     if(m_argc == 2)
@@ -892,6 +1024,11 @@ int ZSV_MAIN_NO_OPTIONS_FUNC(ZSV_COMMAND)(int m_argc, const char *m_argv[]) {
         err = prop_arg_value(++i, m_argc, m_argv, &opts.d);
       else if(!strcmp(opt, "-R") || !strcmp(opt, "--skip-head"))
         err = prop_arg_value(++i, m_argc, m_argv, &opts.R);
+      else if(!strcmp(opt, "--column-types")) {
+        if(!(err = prop_arg_value(++i, m_argc, m_argv, &opts.column_types))
+           && opts.column_types != ZSV_PROP_ARG_AUTO && opts.column_types != ZSV_PROP_ARG_REMOVE)
+          err = fprintf(stderr, "Invalid --column-types value '%s'. Please use 'auto', 'none', or '-'\n", m_argv[i]);
+      }
       else if(zsv_prop_get_mode(opt)) {
         if(mode_arg)
           err = fprintf(stderr, "Option %s cannot be used together with %s\n", opt, mode_arg);
@@ -932,15 +1069,16 @@ int ZSV_MAIN_NO_OPTIONS_FUNC(ZSV_COMMAND)(int m_argc, const char *m_argv[]) {
       char have_auto = opts.d == ZSV_PROP_ARG_AUTO || opts.R == ZSV_PROP_ARG_AUTO;
       char have_specified = opts.d >= 0 || opts.R >= 0;
       char have_remove = opts.d == ZSV_PROP_ARG_REMOVE || opts.R == ZSV_PROP_ARG_REMOVE;
+      char have_column_types = opts.column_types != ZSV_PROP_ARG_NONE;
 
       if(have_auto && (have_specified || have_remove)) {
         fprintf(stderr, "Non-auto options may not be mixed with auto options\n");
         err = 1;
-      } else if((have_auto || have_specified || have_remove || opts.save)
+      } else if((have_auto || have_specified || have_remove || have_column_types || opts.save)
                 && mode != zsv_prop_mode_default)
         err = fprintf(stderr, "Invalid options in combination with %s\n", mode_arg);
 
-      if(have_specified || have_remove) {
+      if(have_specified || have_remove || opts.column_types == ZSV_PROP_ARG_REMOVE) {
         opts.save = 1;
         opts.overwrite = 1;
       }
@@ -955,6 +1093,7 @@ int ZSV_MAIN_NO_OPTIONS_FUNC(ZSV_COMMAND)(int m_argc, const char *m_argv[]) {
           struct prop_opts opts2 = { 0 };
           opts2.d = ZSV_PROP_ARG_NONE;
           opts2.R = ZSV_PROP_ARG_NONE;
+          opts2.column_types = ZSV_PROP_ARG_NONE;
           if(memcmp(&opts, &opts2, sizeof(opts)))
             err = fprintf(stderr, "--clear cannot be used in conjunction with any other options\n");
           else {
@@ -24,6 +24,7 @@
 #include <zsv/utils/utf8.h>
 #include <zsv/utils/string.h>
 #include <zsv/utils/mem.h>
+#include <zsv/utils/compress.h>
 
 struct zsv_select_search_str {
   struct zsv_select_search_str *next;
@@ -705,7 +706,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       stat = zsv_printerr(1, "Unrecognized argument: %s", argv[arg_i]);
     else if(data.opts->stream)
       stat = zsv_printerr(1, "Input file was specified, cannot also read: %s", argv[arg_i]);
-    else if(!(data.opts->stream = fopen(argv[arg_i], "rb")))
+    else if(!(data.opts->stream = zsv_input_open(argv[arg_i])))
       stat = zsv_printerr(1, "Could not open for reading: %s", argv[arg_i]);
     else
       input_path = argv[arg_i];
@@ -757,10 +758,6 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
           data.cancelled = 1;
           */
 
-        // create a local csv writer buff quoted values
-        unsigned char writer_buff[512];
-        zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
-
         // process the input data
         zsv_handle_ctrl_c_signal();
         enum zsv_status status = zsv_next_row(parser);
@@ -769,6 +766,8 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         while((status = zsv_next_row(parser)) == zsv_status_row)
           zsv_select_data_row(&data, parser);
         zsv_delete(parser);
+        if(status == zsv_status_error)
+          stat = zsv_status_error;
       }
     }
   }
@@ -21,6 +21,7 @@
 #include "zsv_command.h"
 
 #include <zsv/utils/writer.h>
+#include <zsv/utils/compress.h>
 #include <zsv/utils/utf8.h>
 #include <zsv/utils/string.h>
 #include <zsv/utils/mem.h>
@@ -559,7 +560,7 @@ const char *zsv_select_usage_msg[] = {
   "  -L,--max-row-size <n>: set the maximum memory used for a single row",
   "                          defaults to " ZSV_ROW_MAX_SIZE_DEFAULT_S ", min " ZSV_ROW_MAX_SIZE_MIN_S ")",
 #endif
-  "  -o <output filename>: name of file to save output to",
+  "  -o <output filename>: name of file to save output to (compressed if it ends in .gz or .zst)",
   NULL
 };
 
@@ -726,6 +727,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
   data.opts = opts;
   const char *input_path = NULL;
   struct zsv_csv_writer_options writer_opts = zsv_writer_get_default_opts();
+  zsv_output_sink out = NULL;
   int col_index_arg_i = 0;
   unsigned char *preview_buff = NULL;
   size_t preview_buff_len = 0;
@@ -774,12 +776,16 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     else if(!strcmp(argv[arg_i], "-o") || !strcmp(argv[arg_i], "--output")) {
       if(++arg_i >= argc)
         stat = zsv_printerr(1, "%s option requires parameter", argv[arg_i-1]);
-      else if(writer_opts.stream && writer_opts.stream != stdout)
+      else if(out)
         stat = zsv_printerr(1, "Output file specified more than once");
-      else if(!(writer_opts.stream = fopen(argv[arg_i], "wb")))
-        stat = zsv_printerr(1, "Unable to open for writing: %s", argv[arg_i]);
-      else if(data.opts->verbose)
-        fprintf(stderr, "Opened %s for write\n", argv[arg_i]);
+      else if(!(out = zsv_output_sink_open(argv[arg_i])))
+        stat = zsv_status_error;
+      else {
+        writer_opts.write = zsv_output_sink_write;
+        writer_opts.stream = out;
+        if(data.opts->verbose)
+          fprintf(stderr, "Opened %s for write\n", argv[arg_i]);
+      }
     } else if(!strcmp(argv[arg_i], "-N") || !strcmp(argv[arg_i], "--line-number")) {
       data.prepend_line_number = 1;
     } else if(!strcmp(argv[arg_i], "-n"))
@@ -852,7 +858,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       stat = zsv_printerr(1, "Unrecognized argument: %s", argv[arg_i]);
     else if(data.opts->stream)
       stat = zsv_printerr(1, "Input file was specified, cannot also read: %s", argv[arg_i]);
-    else if(!(data.opts->stream = fopen(argv[arg_i], "rb")))
+    else if(!(data.opts->stream = zsv_input_open(argv[arg_i])))
       stat = zsv_printerr(1, "Could not open for reading: %s", argv[arg_i]);
     else
       input_path = argv[arg_i];
@@ -919,10 +925,6 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
            != zsv_status_ok)
           data.cancelled = 1;
 
-        // create a local csv writer buff quoted values
-        unsigned char writer_buff[512];
-        zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
-
         // process the input data
         zsv_handle_ctrl_c_signal();
         enum zsv_status status = zsv_status_ok;
@@ -934,12 +936,14 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
           status = zsv_parse_more(data.parser);
         zsv_finish(data.parser);
         zsv_delete(data.parser);
+        if(status == zsv_status_error)
+          stat = zsv_status_error;
       }
     }
   }
   free(preview_buff);
   zsv_select_cleanup(&data);
-  if(writer_opts.stream && writer_opts.stream != stdout)
-    fclose(writer_opts.stream);
+  if(zsv_output_sink_close(out) && stat == zsv_status_ok)
+    stat = zsv_status_error;
   return stat;
 }
@@ -17,6 +17,7 @@
 
 #include <zsv/utils/writer.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/compress.h>
 
 struct output_header_name {
   unsigned char *str;
@@ -310,7 +311,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       else if(data.in) {
         err = 1;
         fprintf(stderr, "Input file specified twice, or unrecognized argument: %s\n", argv[arg_i]);
-      } else if(!(data.in = fopen(argv[arg_i], "rb"))) {
+      } else if(!(data.in = zsv_input_open(argv[arg_i]))) {
         err = 1;
         fprintf(stderr, "Could not open for reading: %s\n", argv[arg_i]);
       } else
@@ -351,13 +352,9 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       return 1;
     }
 
-    // create a local csv writer buff for faster performance
-    unsigned char writer_buff[64];
-    zsv_writer_set_temp_buff(data.csv_writer, writer_buff, sizeof(writer_buff));
-
     // process the input data
     zsv_handle_ctrl_c_signal();
-    enum zsv_status status;
+    enum zsv_status status = zsv_status_ok;
     while(!zsv_signal_interrupted && (status = zsv_parse_more(data.parser)) == zsv_status_ok)
       ;
 
@@ -366,6 +363,8 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     zsv_finish(data.parser);
     zsv_delete(data.parser);
     serialize_cleanup(&data);
+    if(status == zsv_status_error)
+      return 1;
   }
   return 0;
 }
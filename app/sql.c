@@ -15,11 +15,8 @@
 #include "zsv_command.h"
 
 #include <zsv/utils/writer.h>
-#include <zsv/utils/file.h>
 #include <zsv/utils/string.h>
 
-#include <unistd.h> // unlink
-
 extern sqlite3_module CsvModule;
 
 #ifndef STRING_LIST
@@ -54,6 +51,10 @@ const char *zsv_sql_usage_msg[] =
    "  -C, --max-cols <n>    : change the maximum allowable columns. must be > 0 and < 2000",
    "  -o <output filename>  : name of file to save output to",
    "  --memory              : use in-memory instead of temporary db (see https://www.sqlite.org/inmemorydb.html)",
+   "  --max-snapshot-mb <n> : memory limit (default 1024) for keeping a file's data in memory when",
+   "                          it is scanned more than twice, e.g. in a join. Equality joins",
+   "                          (e.g. data.a = data2.b) on a kept file use an in-memory hash index.",
+   "                          Use 0 to never keep file data, and always re-read the file",
    NULL
 };
 
@@ -102,8 +103,8 @@ static void zsv_sql_cleanup(struct zsv_sql_data *data) {
 
 static int create_virtual_csv_table(const char *fname, sqlite3 *db,
                                     const char *opts_used,
-                                    int max_columns, char **err_msg,
-                                    int table_ix) {
+                                    int max_columns, int max_snapshot_mb,
+                                    char **err_msg, int table_ix) {
   // TO DO: set customizable maximum number of columns to prevent
   // runaway in case no line ends found
   char *sql = NULL;
@@ -116,10 +117,14 @@ static int create_virtual_csv_table(const char *fname, sqlite3 *db,
   else
     snprintf(table_name_suffix, sizeof(table_name_suffix), "%i", table_ix + 1);
 
+  sqlite3_str *pStr = sqlite3_str_new(db);
+  sqlite3_str_appendf(pStr, "CREATE VIRTUAL TABLE data%s USING csv(filename=%Q,options_used=%Q", table_name_suffix, fname, opts_used);
   if(max_columns)
-    sql = sqlite3_mprintf("CREATE VIRTUAL TABLE data%s USING csv(filename=%Q,options_used=%Q,max_columns=%i)", table_name_suffix, fname, opts_used, max_columns);
-  else
-    sql = sqlite3_mprintf("CREATE VIRTUAL TABLE data%s USING csv(filename=%Q,options_used=%Q)", table_name_suffix, fname, opts_used);
+    sqlite3_str_appendf(pStr, ",max_columns=%i", max_columns);
+  if(max_snapshot_mb >= 0)
+    sqlite3_str_appendf(pStr, ",max_snapshot_mb=%i", max_snapshot_mb);
+  sqlite3_str_appendf(pStr, ")");
+  sql = sqlite3_str_finish(pStr);
 
   int rc = sqlite3_exec(db, sql, NULL, NULL, err_msg);
   sqlite3_free(sql);
@@ -154,6 +159,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
   else {
     struct zsv_sql_data data = { 0 };
     int max_cols = 0; // to do: remove this; use parser_opts.max_columns
+    int max_snapshot_mb = -1; // use the csv module's default
     const char *input_filename = NULL;
     const char *my_sql = NULL;
     struct string_list **next_input_filename = &data.more_input_filenames;
@@ -233,6 +239,14 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         }
       } else if(!strcmp(arg, "--memory"))
         data.in_memory = 1;
+      else if(!strcmp(arg, "--max-snapshot-mb")) {
+        if(arg_i+1 < argc && atoi(argv[arg_i+1]) >= 0 && *argv[arg_i+1] >= '0' && *argv[arg_i+1] <= '9')
+          max_snapshot_mb = atoi(argv[++arg_i]);
+        else {
+          fprintf(stderr, "%s requires a non-negative integer value\n", arg);
+          err = 1;
+        }
+      }
       else if(!strcmp(arg, "-b"))
         writer_opts.with_bom = 1;
       else if(!strcmp(arg, "-C") || !strcmp(arg, "--max-cols")) {
@@ -297,8 +311,9 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       data.in = NULL;
     }
 
+    // stdin is read by the virtual table itself ("-"), which keeps what it reads (in memory up to
+    // 16MB, then in a temp file) so that later scans can replay it
     FILE *f = NULL;
-    char *tmpfn = NULL;
     if(input_filename) {
       f = fopen(input_filename, "rb");
       if(!f)
@@ -306,45 +321,26 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
     } else
       f = stdin;
 
-    if(f == stdin) {
-      tmpfn = zsv_get_temp_filename("zsv_sql_XXXXXXXX");
-      if(!tmpfn) {
-        fprintf(stderr, "Unable to create temp file name\n");
-      } else {
-        FILE *tmpf = fopen(tmpfn, "wb");
-        if(!tmpf)
-          fprintf(stderr, "Unable to open temp file %s\n", tmpfn);
-        else {
-          char rbuff[1024];
-          size_t bytes_read;
-          while((bytes_read = fread(rbuff, 1, sizeof(rbuff), stdin)))
-            fwrite(rbuff, 1, bytes_read, tmpf);
-          f = tmpf;
-        }
-      }
-    }
-
     if(f) {
-      fclose(f); // to do: don't open in the first place
+      if(f != stdin)
+        fclose(f); // to do: don't open in the first place
       f = NULL;
 
       sqlite3 *db = NULL;
       int rc;
 
       zsv_csv_writer cw = zsv_writer_new(&writer_opts);
-      unsigned char cw_buff[1024];
-      zsv_writer_set_temp_buff(cw, cw_buff, sizeof(cw_buff));
 
       char *err_msg = NULL;
       const char *db_url = data.in_memory ? "file::memory:" : "";
       if((rc = sqlite3_open_v2(db_url, &db, SQLITE_OPEN_URI | SQLITE_OPEN_READWRITE, NULL)) == SQLITE_OK
          && db
          && (rc = sqlite3_create_module(db, "csv", &CsvModule, 0) == SQLITE_OK)
-         && (rc = create_virtual_csv_table(tmpfn ? tmpfn : input_filename, db, opts_used, max_cols, &err_msg, 0)) == SQLITE_OK
+         && (rc = create_virtual_csv_table(input_filename ? input_filename : "-", db, opts_used, max_cols, max_snapshot_mb, &err_msg, 0)) == SQLITE_OK
          ) {
         int i = 1;
         for(struct string_list *sl = data.more_input_filenames; sl; sl = sl->next)
-          if(create_virtual_csv_table(sl->value, db, opts_used, max_cols, &err_msg, i++) != SQLITE_OK)
+          if(create_virtual_csv_table(sl->value, db, opts_used, max_cols, max_snapshot_mb, &err_msg, i++) != SQLITE_OK)
             rc = SQLITE_ERROR;
       }
 
@@ -434,9 +430,13 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
 
           while(sqlite3_step(stmt) == SQLITE_ROW) {
             for(int i = 0; i < col_count; i++) {
-              const unsigned char *text = sqlite3_column_text(stmt, i);
-              int len = text ? sqlite3_column_bytes(stmt, i) : 0;
-              zsv_writer_cell(cw, !i, text, len, 1);
+              if(sqlite3_column_type(stmt, i) == SQLITE_INTEGER) // skip sqlite's own conversion to text
+                zsv_writer_cell_i64(cw, !i, (int64_t)sqlite3_column_int64(stmt, i));
+              else {
+                const unsigned char *text = sqlite3_column_text(stmt, i);
+                int len = text ? sqlite3_column_bytes(stmt, i) : 0;
+                zsv_writer_cell(cw, !i, text, len, 1);
+              }
             }
           }
           sqlite3_finalize(stmt);
@@ -455,15 +455,9 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
 
       zsv_writer_delete(cw);
     }
-    if(f)
-      fclose(f);
     zsv_sql_finalize(&data);
     zsv_sql_cleanup(&data);
 
-    if(tmpfn) {
-      unlink(tmpfn);
-      free(tmpfn);
-    }
     zsv_set_default_opts(original_default_opts); // restore default options
   }
   return 0;
@@ -14,6 +14,7 @@
 #include "zsv_command.h"
 
 #include <zsv/utils/writer.h>
+#include <zsv/utils/compress.h>
 #include <zsv/utils/mem.h>
 #include <zsv/utils/string.h>
 
@@ -24,7 +25,7 @@ const char *zsv_stack_usage_msg[] =
    "Usage: " APPNAME " [options] filename [filename...]",
    "",
    "Options:",
-   "  -o <filename>: output file",
+   "  -o <filename>: output file (compressed if it ends in .gz or .zst)",
    "  -b: output with BOM",
    "  -q: always add double-quotes",
    "  -T: input is tab-delimited, instead of comma-delimited",
@@ -253,6 +254,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
   char delimiter = 0; // defaults to csv
   struct zsv_csv_writer_options writer_opts = zsv_writer_get_default_opts();
   writer_opts.stream = stdout;
+  zsv_output_sink out = NULL;
 
   for(int arg_i = 1; !data.err && arg_i < argc; arg_i++) {
     const char *arg = argv[arg_i];
@@ -264,11 +266,14 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
       arg_i++;
       if(arg_i >= argc)
         fprintf(stderr, "-o option: no filename specified\n");
+      else if(out) {
+        fprintf(stderr, "Output file specified more than once\n");
+        data.err = 1;
+      } else if(!(out = zsv_output_sink_open(argv[arg_i])))
+        data.err = 1;
       else {
-        if(!(writer_opts.stream = fopen(argv[arg_i], "wb"))){
-          data.err = 1;
-          fprintf(stderr, "Unable to open file for writing: %s\n", argv[arg_i]);
-        }
+        writer_opts.write = zsv_output_sink_write;
+        writer_opts.stream = out;
       }
     }
   }
@@ -286,7 +291,7 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         continue;
       }
 
-      FILE *f = fopen(arg, "rb");
+      FILE *f = zsv_input_open(arg);
       if(!f) {
         fprintf(stderr, "Could not open file for reading: %s\n", arg);
         data.err = 1;
@@ -389,6 +394,8 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
         while(status == zsv_status_ok && !data.err
               && (status = zsv_parse_more(input->parser)) == zsv_status_ok)
           ;
+        if(status == zsv_status_error) // e.g. corrupt compressed input; the error was already printed
+          data.err = 1;
         zsv_finish(input->parser);
         zsv_delete(input->parser);
         input->parser = NULL;
@@ -398,8 +405,8 @@ int ZSV_MAIN_FUNC(ZSV_COMMAND)(int argc, const char *argv[], struct zsv_opts *op
   err = data.err;
   zsv_stack_cleanup(&data);
 
-  if(writer_opts.stream && writer_opts.stream != stdout)
-    fclose(writer_opts.stream);
+  if(zsv_output_sink_close(out) && !err)
+    err = 1;
 
   return err;
 }
@@ -0,0 +1,13 @@
+#!/bin/sh
+
+# rows whose cells need escaping in TSV output: embedded tabs, newlines, CRs
+# and backslashes (including a cell of only backslashes, whose escaped size is
+# double its input size), interleaved with rows that need no escaping
+awk 'BEGIN {
+  for(i = 0; i < 40000; i++) {
+    if(i % 3 == 0)
+      printf "%d,plain,text,row\n", i
+    else
+      printf "%d,\"a\tb\",\"line1\nline2\",\"cr\r\nlf\",c:\\dir\\file,\\\\\\\\\\\\\\\\,\"q\"\"\t\\\"\n", i
+  }
+}'
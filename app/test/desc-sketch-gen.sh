@@ -0,0 +1,23 @@
+#!/bin/sh
+
+# 5000 rows with known sketch results:
+#  id: 5000 distinct values
+#  grp: "a" x 2500, "b" x 1250, "c" x 625, and 625 values that occur once (628 distinct)
+#  x: 0.1 to 500.0 in steps of 0.1
+#  e: 1000 each of five values at the extremes of double formatting
+#  b: blank in every third row (33.32% blank)
+awk 'BEGIN {
+  split("-1.7976931348623157e308,5e-324,0.30000000000000004,123456.789,1e21", e, ",")
+  print "id,grp,x,e,b"
+  for(i = 1; i <= 5000; i++) {
+    if(i % 2 == 0)
+      g = "a"
+    else if(i % 4 == 1)
+      g = "b"
+    else if(i % 8 == 3)
+      g = "c"
+    else
+      g = "d" i
+    printf "%d,%s,%.1f,%s,%s\n", i, g, i / 10, e[i % 5 + 1], i % 3 ? "x" i % 7 : ""
+  }
+}'
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Check that sketches of two halves of a stream, once merged, agree with a
+ * sketch of the whole stream to within each sketch's error bounds
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zsv/utils/sketch.h>
+
+#define N 200000
+#define QUANTILES_K 200
+#define TOPK_CAPACITY 64
+
+static uint64_t rng = 0x2545f4914f6cdd1dULL;
+static uint64_t next_random(void) {
+  rng ^= rng << 13, rng ^= rng >> 7, rng ^= rng << 17;
+  return rng;
+}
+
+static int failures;
+#define CHECK(cond, ...) do { if(!(cond)) { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); failures++; } } while(0)
+
+static int test_hll(void) {
+  zsv_hll whole = zsv_hll_new(12), a = zsv_hll_new(12), b = zsv_hll_new(12);
+  if(!whole || !a || !b)
+    return 1;
+  for(unsigned i = 0; i < N; i++) {
+    char s[16];
+    int len = snprintf(s, sizeof(s), "%u", i);
+    uint64_t h = zsv_sketch_hash((const unsigned char *)s, (size_t)len);
+    zsv_hll_add(whole, h);
+    zsv_hll_add(i % 2 ? a : b, h);
+  }
+  CHECK(!zsv_hll_merge(a, b), "hll: merge failed");
+
+  // merging takes the max of each register, so the result is exactly the whole-stream sketch
+  double merged = zsv_hll_estimate(a), single = zsv_hll_estimate(whole);
+  CHECK(merged == single, "hll: merged estimate %.1f != single-stream estimate %.1f", merged, single);
+  CHECK(fabs(merged - N) <= 3 * 0.0163 * N, "hll: estimate %.1f is not within 3 standard errors of %u",
+        merged, N);
+
+  zsv_hll other = zsv_hll_new(10);
+  CHECK(other && zsv_hll_merge(a, other), "hll: merge of different precisions did not fail");
+  zsv_hll_delete(other);
+  zsv_hll_delete(whole);
+  zsv_hll_delete(a);
+  zsv_hll_delete(b);
+  return 0;
+}
+
+static int test_quantiles(void) {
+  double *values = malloc(N * sizeof(*values));
+  zsv_quantiles whole = zsv_quantiles_new(QUANTILES_K);
+  zsv_quantiles a = zsv_quantiles_new(QUANTILES_K), b = zsv_quantiles_new(QUANTILES_K);
+  if(!values || !whole || !a || !b)
+    return 1;
+
+  // 0 .. N-1 in random order, so that a value's true rank is value / N
+  for(unsigned i = 0; i < N; i++)
+    values[i] = i;
+  for(unsigned i = N - 1; i > 0; i--) {
+    unsigned j = (unsigned)(next_random() % (i + 1));
+    double tmp = values[i];
+    values[i] = values[j];
+    values[j] = tmp;
+  }
+  for(unsigned i = 0; i < N; i++) {
+    if(zsv_quantiles_add(whole, values[i]) || zsv_quantiles_add(i < N / 2 ? a : b, values[i]))
+      return 1;
+  }
+  CHECK(!zsv_quantiles_merge(a, b), "quantiles: merge failed");
+  CHECK(zsv_quantiles_count(a) == N, "quantiles: merged count %llu != %u",
+        (unsigned long long)zsv_quantiles_count(a), N);
+  CHECK(zsv_quantiles_get(a, 0) == 0 && zsv_quantiles_get(a, 1) == N - 1,
+        "quantiles: merged min/max %g/%g are not exact", zsv_quantiles_get(a, 0), zsv_quantiles_get(a, 1));
+
+  // each sketch has a rank error of about 1.7 / k; allow twice that
+  double max_err = 2 * 1.7 / QUANTILES_K;
+  for(unsigned pct = 1; pct < 100; pct++) {
+    double rank = pct / 100.0;
+    double merged_rank = zsv_quantiles_get(a, rank) / N;
+    double single_rank = zsv_quantiles_get(whole, rank) / N;
+    CHECK(fabs(merged_rank - rank) <= max_err, "quantiles: merged rank %.4f for %.2f", merged_rank, rank);
+    CHECK(fabs(merged_rank - single_rank) <= max_err, "quantiles: merged rank %.4f vs single-stream %.4f for %.2f",
+          merged_rank, single_rank, rank);
+  }
+  free(values);
+  zsv_quantiles_delete(whole);
+  zsv_quantiles_delete(a);
+  zsv_quantiles_delete(b);
+  return 0;
+}
+
+/*
+ * value v (1 .. 8) occurs N / 2^(v+1) times, and the rest of the stream is
+ * values that occur once. Only values that occur more than N / TOPK_CAPACITY
+ * times (1 .. 5) are guaranteed to be tracked
+ */
+#define TOPK_GUARANTEED 5
+
+static int test_topk(void) {
+  unsigned *values = malloc(N * sizeof(*values));
+  uint64_t true_counts[9] = { 0 };
+  zsv_topk whole = zsv_topk_new(TOPK_CAPACITY);
+  zsv_topk a = zsv_topk_new(TOPK_CAPACITY), b = zsv_topk_new(TOPK_CAPACITY);
+  if(!values || !whole || !a || !b)
+    return 1;
+
+  unsigned i = 0;
+  for(unsigned v = 1; v <= 8; v++)
+    for(unsigned j = 0; j < (unsigned)N >> (v + 1); j++)
+      values[i++] = v;
+  for(unsigned unique = 100; i < N; i++)
+    values[i] = unique++;
+  for(i = N - 1; i > 0; i--) {
+    unsigned j = (unsigned)(next_random() % (i + 1));
+    unsigned tmp = values[i];
+    values[i] = values[j];
+    values[j] = tmp;
+  }
+  for(i = 0; i < N; i++) {
+    char s[16];
+    int len = snprintf(s, sizeof(s), "%u", values[i]);
+    uint64_t h = zsv_sketch_hash((const unsigned char *)s, (size_t)len);
+    if(zsv_topk_add(whole, (const unsigned char *)s, (size_t)len, h, 1)
+       || zsv_topk_add(i < N / 2 ? a : b, (const unsigned char *)s, (size_t)len, h, 1))
+      return 1;
+    if(values[i] <= 8)
+      true_counts[values[i]]++;
+  }
+  CHECK(!zsv_topk_merge(a, b), "topk: merge failed");
+
+  struct zsv_topk_item merged[TOPK_CAPACITY], single[TOPK_CAPACITY];
+  unsigned merged_n = zsv_topk_get(a, merged, TOPK_CAPACITY);
+  unsigned single_n = zsv_topk_get(whole, single, TOPK_CAPACITY);
+  CHECK(merged_n >= TOPK_GUARANTEED && single_n >= TOPK_GUARANTEED, "topk: %u / %u items", merged_n, single_n);
+  for(unsigned v = 1; v <= 8; v++) {
+    char s[16];
+    int len = snprintf(s, sizeof(s), "%u", v);
+    if(v <= TOPK_GUARANTEED && v <= merged_n && v <= single_n) {
+      // the guaranteed values lead both sketches, in order of frequency
+      CHECK(merged[v - 1].len == (size_t)len && !memcmp(merged[v - 1].value, s, (size_t)len),
+            "topk: merged item %u is %.*s, expected %s", v, (int)merged[v - 1].len, merged[v - 1].value, s);
+      CHECK(single[v - 1].len == (size_t)len && !memcmp(single[v - 1].value, s, (size_t)len),
+            "topk: single-stream item %u is %.*s, expected %s", v, (int)single[v - 1].len, single[v - 1].value, s);
+    }
+
+    // a tracked count is never under-estimated, and is over-estimated by at most its error
+    for(unsigned j = 0; j < merged_n; j++) {
+      if(merged[j].len == (size_t)len && !memcmp(merged[j].value, s, (size_t)len)) {
+        uint64_t count = merged[j].count, error = merged[j].error;
+        CHECK(count >= true_counts[v] && count - error <= true_counts[v],
+              "topk: %s has merged count %llu (error %llu), true count %llu", s,
+              (unsigned long long)count, (unsigned long long)error, (unsigned long long)true_counts[v]);
+      }
+    }
+  }
+  free(values);
+  zsv_topk_delete(whole);
+  zsv_topk_delete(a);
+  zsv_topk_delete(b);
+  return 0;
+}
+
+int main() {
+  if(test_hll() || test_quantiles() || test_topk()) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
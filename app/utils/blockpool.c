@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NO_THREADING
+#include <pthread.h>
+#endif
+
+#include <zsv/utils/blockpool.h>
+
+int zsv_reserve(void **p, size_t *cap, size_t n, size_t item_size) {
+  if(n > *cap) {
+    size_t new_cap = *cap ? *cap * 2 : 256;
+    while(new_cap < n)
+      new_cap *= 2;
+    void *tmp = realloc(*p, new_cap * item_size);
+    if(!tmp)
+      return 1;
+    *p = tmp;
+    *cap = new_cap;
+  }
+  return 0;
+}
+
+int zsv_block_add_row(struct zsv_block *b, zsv_parser parser, unsigned cols, char terminate) {
+  if(zsv_reserve((void **)&b->cells, &b->cell_cap, b->cell_count + cols, sizeof(*b->cells))
+     || zsv_reserve((void **)&b->row_ends, &b->row_cap, b->row_count + 1, sizeof(*b->row_ends)))
+    return 1;
+  if(cols) {
+    // copy the whole row at once
+    struct zsv_cell first = zsv_get_cell(parser, 0);
+    struct zsv_cell last = zsv_get_cell(parser, cols - 1);
+    size_t row_len = last.str + last.len - first.str;
+    if(zsv_reserve((void **)&b->raw, &b->raw_cap, b->raw_len + row_len + (terminate ? 1 : 0), 1))
+      return 1;
+    memcpy(b->raw + b->raw_len, first.str, row_len);
+    for(unsigned i = 0; i < cols; i++) {
+      struct zsv_cell cell = zsv_get_cell(parser, i);
+      struct zsv_block_cell *c = &b->cells[b->cell_count++];
+      c->offset = b->raw_len + (size_t)(cell.str - first.str);
+      c->len = cell.len;
+      c->quoted = cell.quoted;
+      if(terminate) // overwrites the delimiter that follows the cell in the copy
+        b->raw[c->offset + c->len] = '\0';
+    }
+    b->raw_len += row_len + (terminate ? 1 : 0);
+  }
+  b->row_ends[b->row_count++] = b->cell_count;
+  return 0;
+}
+
+void zsv_block_clear(struct zsv_block *b) {
+  b->raw_len = b->cell_count = b->row_count = 0;
+}
+
+void zsv_block_free(struct zsv_block *b) {
+  free(b->raw);
+  free(b->cells);
+  free(b->row_ends);
+  memset(b, 0, sizeof(*b));
+}
+
+#ifndef NO_THREADING
+enum zsv_blockpool_state {
+  zsv_blockpool_state_empty = 0, // free to be filled
+  zsv_blockpool_state_filled,    // submitted, and being processed
+  zsv_blockpool_state_processed  // waiting to be taken and released
+};
+
+struct zsv_blockpool_slot {
+  enum zsv_blockpool_state state;
+  unsigned pending; // number of workers that have yet to process the block
+};
+
+struct zsv_blockpool_worker {
+  struct zsv_blockpool *pool;
+  unsigned ix;
+  size_t processed; // with every_worker, the number of blocks this worker has processed
+};
+
+/*
+ * blocks are used in turn: the n-th block submitted is block n % block_count.
+ * The counts below only grow, and a block is not refilled until it is free,
+ * so no count is more than block_count ahead of another
+ */
+struct zsv_blockpool {
+  struct zsv_blockpool_opts opts;
+  unsigned char *blocks; // block_count blocks of opts.block_size bytes
+  struct zsv_blockpool_slot *slots;
+
+  size_t submitted; // blocks submitted by the producer
+  size_t claimed;   // unless every_worker, blocks taken by a worker
+  size_t taken;     // with ordered, blocks taken with zsv_blockpool_next()
+  size_t freed;     // blocks freed for reuse since the pool started
+
+  struct zsv_blockpool_worker *workers;
+  pthread_t *threads;
+  unsigned thread_count;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  char fill_ready; // the block to fill is known to be free. Only used by the producer
+  char done;       // the producer has finished
+  char stopped;
+  char err;        // a worker failed to process a block
+};
+
+static inline struct zsv_block *zsv_blockpool_nth(struct zsv_blockpool *pool, size_t n) {
+  return (struct zsv_block *)(pool->blocks + (n % pool->opts.block_count) * pool->opts.block_size);
+}
+
+// call with the mutex held
+static void zsv_blockpool_free_block(struct zsv_blockpool *pool, struct zsv_block *b) {
+  size_t ix = ((unsigned char *)b - pool->blocks) / pool->opts.block_size;
+  zsv_block_clear(b);
+  pool->slots[ix].state = zsv_blockpool_state_empty;
+  pool->freed++;
+  pthread_cond_broadcast(&pool->cond);
+}
+
+static void *zsv_blockpool_worker_run(void *p) {
+  struct zsv_blockpool_worker *w = p;
+  struct zsv_blockpool *pool = w->pool;
+  pthread_mutex_lock(&pool->mutex);
+  for(;;) {
+    size_t *next = pool->opts.every_worker ? &w->processed : &pool->claimed;
+    while(!pool->stopped && !pool->done && *next == pool->submitted)
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+    if(pool->stopped || *next == pool->submitted)
+      break;
+    size_t n = (*next)++;
+    struct zsv_block *b = zsv_blockpool_nth(pool, n);
+    pthread_mutex_unlock(&pool->mutex);
+
+    int err = pool->opts.process(pool->opts.ctx, w->ix, b);
+
+    pthread_mutex_lock(&pool->mutex);
+    if(err) {
+      pool->err = pool->stopped = 1;
+      pthread_cond_broadcast(&pool->cond);
+      break;
+    }
+    struct zsv_blockpool_slot *slot = &pool->slots[n % pool->opts.block_count];
+    if(--slot->pending == 0) {
+      if(pool->opts.ordered) {
+        slot->state = zsv_blockpool_state_processed;
+        pthread_cond_broadcast(&pool->cond);
+      } else
+        zsv_blockpool_free_block(pool, b);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+zsv_blockpool zsv_blockpool_new(const struct zsv_blockpool_opts *opts) {
+  struct zsv_blockpool *pool = calloc(1, sizeof(*pool));
+  if(!pool)
+    return NULL;
+  pool->opts = *opts;
+  if(pool->opts.block_size < sizeof(struct zsv_block))
+    pool->opts.block_size = sizeof(struct zsv_block);
+  if(!pool->opts.process) { // blocks can only be taken in order
+    pool->opts.worker_count = 0;
+    pool->opts.ordered = 1;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+  if(!pool->opts.block_count
+     || !(pool->blocks = calloc(pool->opts.block_count, pool->opts.block_size))
+     || !(pool->slots = calloc(pool->opts.block_count, sizeof(*pool->slots)))
+     || (pool->opts.worker_count
+         && (!(pool->workers = calloc(pool->opts.worker_count, sizeof(*pool->workers)))
+             || !(pool->threads = calloc(pool->opts.worker_count, sizeof(*pool->threads)))))) {
+    zsv_blockpool_delete(pool);
+    return NULL;
+  }
+  for(; pool->thread_count < pool->opts.worker_count; pool->thread_count++) {
+    struct zsv_blockpool_worker *w = &pool->workers[pool->thread_count];
+    w->pool = pool;
+    w->ix = pool->thread_count;
+    if(pthread_create(&pool->threads[pool->thread_count], NULL, zsv_blockpool_worker_run, w)) {
+      zsv_blockpool_delete(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+struct zsv_block *zsv_blockpool_fill_block(zsv_blockpool pool) {
+  if(!pool->fill_ready) {
+    struct zsv_blockpool_slot *slot = &pool->slots[pool->submitted % pool->opts.block_count];
+    pthread_mutex_lock(&pool->mutex);
+    while(!pool->stopped && slot->state != zsv_blockpool_state_empty)
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+    pool->fill_ready = !pool->stopped;
+    pthread_mutex_unlock(&pool->mutex);
+    if(!pool->fill_ready)
+      return NULL;
+  }
+  return zsv_blockpool_nth(pool, pool->submitted);
+}
+
+int zsv_blockpool_submit(zsv_blockpool pool) {
+  struct zsv_blockpool_slot *slot = &pool->slots[pool->submitted % pool->opts.block_count];
+  pthread_mutex_lock(&pool->mutex);
+  if(pool->opts.worker_count) {
+    slot->state = zsv_blockpool_state_filled;
+    slot->pending = pool->opts.every_worker ? pool->opts.worker_count : 1;
+  } else
+    slot->state = zsv_blockpool_state_processed;
+  pool->submitted++;
+  pool->fill_ready = 0;
+  pthread_cond_broadcast(&pool->cond);
+  int stopped = pool->stopped;
+  pthread_mutex_unlock(&pool->mutex);
+  return stopped;
+}
+
+char zsv_blockpool_full(zsv_blockpool pool) {
+  pthread_mutex_lock(&pool->mutex);
+  char full = pool->slots[pool->submitted % pool->opts.block_count].state != zsv_blockpool_state_empty;
+  pthread_mutex_unlock(&pool->mutex);
+  return full;
+}
+
+struct zsv_block *zsv_blockpool_next(zsv_blockpool pool) {
+  struct zsv_block *b = NULL;
+  pthread_mutex_lock(&pool->mutex);
+  while(!pool->stopped) {
+    if(pool->taken < pool->submitted) {
+      if(pool->slots[pool->taken % pool->opts.block_count].state == zsv_blockpool_state_processed) {
+        b = zsv_blockpool_nth(pool, pool->taken++);
+        break;
+      }
+    } else if(pool->done)
+      break;
+    pthread_cond_wait(&pool->cond, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return b;
+}
+
+void zsv_blockpool_release(zsv_blockpool pool, struct zsv_block *b) {
+  pthread_mutex_lock(&pool->mutex);
+  zsv_blockpool_free_block(pool, b);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+int zsv_blockpool_finish(zsv_blockpool pool) {
+  if(pool->fill_ready && zsv_blockpool_nth(pool, pool->submitted)->row_count)
+    zsv_blockpool_submit(pool);
+  pthread_mutex_lock(&pool->mutex);
+  pool->done = 1;
+  pthread_cond_broadcast(&pool->cond);
+  while(!pool->opts.ordered && !pool->stopped && pool->freed < pool->submitted)
+    pthread_cond_wait(&pool->cond, &pool->mutex);
+  int err = pool->err;
+  pthread_mutex_unlock(&pool->mutex);
+  return err;
+}
+
+void zsv_blockpool_stop(zsv_blockpool pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopped = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void zsv_blockpool_delete(zsv_blockpool pool) {
+  if(pool) {
+    zsv_blockpool_stop(pool);
+    for(unsigned i = 0; i < pool->thread_count; i++)
+      pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    for(unsigned i = 0; pool->blocks && i < pool->opts.block_count; i++) {
+      struct zsv_block *b = zsv_blockpool_nth(pool, i);
+      if(pool->opts.free_block)
+        pool->opts.free_block(b);
+      zsv_block_free(b);
+    }
+    free(pool->blocks);
+    free(pool->slots);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+  }
+}
+#endif
@@ -0,0 +1,1067 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#if defined(HAVE_FOPENCOOKIE) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifndef NO_THREADING
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_DEFLATE
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+#include <zstd.h>
+#endif
+
+#include <zsv/utils/compress.h>
+#include <zsv/utils/os.h>
+
+static const char *zsv_compression_name(enum zsv_compression c) {
+  return c == zsv_compression_gzip ? "gzip" : c == zsv_compression_zstd ? "zstd" : "uncompressed";
+}
+
+static int zsv_ends_with(const char *s, const char *suffix) {
+  size_t len = strlen(s), suffix_len = strlen(suffix);
+  return len > suffix_len && !strcmp(s + len - suffix_len, suffix);
+}
+
+enum zsv_compression zsv_compression_from_filename(const char *filename) {
+  if(filename) {
+    if(zsv_ends_with(filename, ".gz"))
+      return zsv_compression_gzip;
+    if(zsv_ends_with(filename, ".zst"))
+      return zsv_compression_zstd;
+  }
+  return zsv_compression_none;
+}
+
+int zsv_compression_supported(enum zsv_compression c) {
+  switch(c) {
+  case zsv_compression_none:
+    return 1;
+  case zsv_compression_gzip:
+#ifdef HAVE_DEFLATE
+    return 1;
+#else
+    return 0;
+#endif
+  case zsv_compression_zstd:
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    return 1;
+#else
+    return 0;
+#endif
+  }
+  return 0;
+}
+
+/*
+ * uncompressed data is copied into a ring of blocks; each full block is handed
+ * to the compressor thread, which compresses it and writes the result to the file
+ */
+#define ZSV_OUTPUT_SINK_BLOCK_SIZE (1024 * 1024)
+#define ZSV_OUTPUT_SINK_BLOCK_COUNT 4
+
+struct zsv_output_sink_block {
+  unsigned char *data;
+  size_t used;
+};
+
+struct zsv_output_sink {
+  FILE *f;
+  enum zsv_compression compression;
+
+#ifdef HAVE_DEFLATE
+  z_stream gz;
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  ZSTD_CCtx *zstd;
+#endif
+  unsigned char *out;    // compressed output staging buffer
+  size_t out_size;
+
+  struct zsv_output_sink_block blocks[ZSV_OUTPUT_SINK_BLOCK_COUNT];
+  unsigned producer_ix;  // block currently being filled by zsv_output_sink_write()
+  unsigned consumer_ix;  // next block to compress
+  unsigned ready;        // number of full blocks queued or being compressed
+
+#ifndef NO_THREADING
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  char thread_started;
+  char finishing;
+#endif
+  char compressor_initd;
+  char err;  // when threaded, only accessed while holding the mutex
+};
+
+static int zsv_output_sink_fwrite(struct zsv_output_sink *sink, const unsigned char *s, size_t n) {
+  if(n && fwrite(s, 1, n, sink->f) != n) {
+    perror("Unable to write output");
+    return 1;
+  }
+  return 0;
+}
+
+// compress `len` bytes of data and write the result; if finish is set, also end the stream
+static int zsv_output_sink_compress(struct zsv_output_sink *sink, const unsigned char *data, size_t len,
+                                    char finish) {
+  (void)finish;
+  switch(sink->compression) {
+  case zsv_compression_none:
+    return zsv_output_sink_fwrite(sink, data, len);
+#ifdef HAVE_DEFLATE
+  case zsv_compression_gzip:
+    sink->gz.next_in = (unsigned char *)data;
+    sink->gz.avail_in = (uInt)len;
+    do {
+      sink->gz.next_out = sink->out;
+      sink->gz.avail_out = (uInt)sink->out_size;
+      if(deflate(&sink->gz, finish ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR) {
+        fprintf(stderr, "gzip compression error\n");
+        return 1;
+      }
+      if(zsv_output_sink_fwrite(sink, sink->out, sink->out_size - sink->gz.avail_out))
+        return 1;
+    } while(sink->gz.avail_out == 0);
+    return 0;
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  case zsv_compression_zstd:
+    {
+      ZSTD_inBuffer in = { data, len, 0 };
+      for(;;) {
+        ZSTD_outBuffer out = { sink->out, sink->out_size, 0 };
+        size_t remaining = ZSTD_compressStream2(sink->zstd, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+        if(ZSTD_isError(remaining)) {
+          fprintf(stderr, "zstd compression error: %s\n", ZSTD_getErrorName(remaining));
+          return 1;
+        }
+        if(zsv_output_sink_fwrite(sink, sink->out, out.pos))
+          return 1;
+        if(finish ? remaining == 0 : in.pos == in.size)
+          break;
+      }
+    }
+    return 0;
+#endif
+  default:
+    break;
+  }
+  return 1;
+}
+
+#ifndef NO_THREADING
+static void *zsv_output_sink_compressor(void *p) {
+  struct zsv_output_sink *sink = p;
+  for(;;) {
+    pthread_mutex_lock(&sink->mutex);
+    while(!sink->ready && !sink->finishing)
+      pthread_cond_wait(&sink->cond, &sink->mutex);
+    if(!sink->ready) { // finishing, and nothing left to compress
+      pthread_mutex_unlock(&sink->mutex);
+      break;
+    }
+    struct zsv_output_sink_block *b = &sink->blocks[sink->consumer_ix];
+    char err = sink->err;
+    pthread_mutex_unlock(&sink->mutex);
+
+    if(!err)
+      err = zsv_output_sink_compress(sink, b->data, b->used, 0);
+
+    pthread_mutex_lock(&sink->mutex);
+    if(err)
+      sink->err = 1;
+    b->used = 0;
+    sink->consumer_ix = (sink->consumer_ix + 1) % ZSV_OUTPUT_SINK_BLOCK_COUNT;
+    sink->ready--;
+    pthread_cond_signal(&sink->cond);
+    pthread_mutex_unlock(&sink->mutex);
+  }
+  return NULL;
+}
+#endif
+
+// hand off the block currently being filled
+static int zsv_output_sink_submit(struct zsv_output_sink *sink) {
+#ifndef NO_THREADING
+  if(sink->thread_started) {
+    pthread_mutex_lock(&sink->mutex);
+    sink->ready++;
+    sink->producer_ix = (sink->producer_ix + 1) % ZSV_OUTPUT_SINK_BLOCK_COUNT;
+    pthread_cond_signal(&sink->cond);
+    while(sink->ready == ZSV_OUTPUT_SINK_BLOCK_COUNT) // wait for the next block to be free
+      pthread_cond_wait(&sink->cond, &sink->mutex);
+    int err = sink->err;
+    pthread_mutex_unlock(&sink->mutex);
+    return err;
+  }
+#endif
+  struct zsv_output_sink_block *b = &sink->blocks[sink->producer_ix];
+  if(!sink->err && zsv_output_sink_compress(sink, b->data, b->used, 0))
+    sink->err = 1;
+  b->used = 0;
+  return sink->err;
+}
+
+static int zsv_output_sink_init_compressor(struct zsv_output_sink *sink) {
+  switch(sink->compression) {
+  case zsv_compression_none:
+    return 0;
+#ifdef HAVE_DEFLATE
+  case zsv_compression_gzip:
+    // windowBits 15 + 16: write a gzip header and trailer
+    if(deflateInit2(&sink->gz, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return 1;
+    sink->out_size = ZSV_OUTPUT_SINK_BLOCK_SIZE / 4;
+    break;
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  case zsv_compression_zstd:
+    if(!(sink->zstd = ZSTD_createCCtx()))
+      return 1;
+    sink->out_size = ZSTD_CStreamOutSize();
+    break;
+#endif
+  default:
+    return 1;
+  }
+  sink->compressor_initd = 1;
+  if(!(sink->out = malloc(sink->out_size)))
+    return 1;
+  for(unsigned i = 0; i < ZSV_OUTPUT_SINK_BLOCK_COUNT; i++)
+    if(!(sink->blocks[i].data = malloc(ZSV_OUTPUT_SINK_BLOCK_SIZE)))
+      return 1;
+
+#ifndef NO_THREADING
+  pthread_mutex_init(&sink->mutex, NULL);
+  pthread_cond_init(&sink->cond, NULL);
+  if(!pthread_create(&sink->thread, NULL, zsv_output_sink_compressor, sink))
+    sink->thread_started = 1;
+  else { // compress synchronously instead
+    pthread_mutex_destroy(&sink->mutex);
+    pthread_cond_destroy(&sink->cond);
+  }
+#endif
+  return 0;
+}
+
+static void zsv_output_sink_free(struct zsv_output_sink *sink) {
+  if(sink->compressor_initd) {
+#ifdef HAVE_DEFLATE
+    if(sink->compression == zsv_compression_gzip)
+      deflateEnd(&sink->gz);
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    if(sink->compression == zsv_compression_zstd)
+      ZSTD_freeCCtx(sink->zstd);
+#endif
+  }
+  free(sink->out);
+  for(unsigned i = 0; i < ZSV_OUTPUT_SINK_BLOCK_COUNT; i++)
+    free(sink->blocks[i].data);
+  free(sink);
+}
+
+zsv_output_sink zsv_output_sink_new(FILE *f, enum zsv_compression compression) {
+  if(!zsv_compression_supported(compression)) {
+    fprintf(stderr, "%s compression not supported in this build\n", zsv_compression_name(compression));
+    return NULL;
+  }
+  struct zsv_output_sink *sink = calloc(1, sizeof(*sink));
+  if(!sink)
+    fprintf(stderr, "Out of memory!\n");
+  else {
+    sink->f = f;
+    sink->compression = compression;
+    if(zsv_output_sink_init_compressor(sink)) {
+      fprintf(stderr, "Unable to initialize compressor\n");
+      zsv_output_sink_free(sink);
+      sink = NULL;
+    }
+  }
+  return sink;
+}
+
+zsv_output_sink zsv_output_sink_open(const char *filename) {
+  enum zsv_compression compression = zsv_compression_from_filename(filename);
+  if(!zsv_compression_supported(compression)) {
+    fprintf(stderr, "Unable to write %s: %s compression not supported in this build\n", filename,
+            zsv_compression_name(compression));
+    return NULL;
+  }
+  FILE *f = fopen(filename, "wb");
+  if(!f) {
+    fprintf(stderr, "Unable to open for writing: %s (%s)\n", filename, strerror(errno));
+    return NULL;
+  }
+  zsv_output_sink sink = zsv_output_sink_new(f, compression);
+  if(!sink)
+    fclose(f);
+  return sink;
+}
+
+size_t zsv_output_sink_write(const void *restrict ptr, size_t size, size_t nitems, void *restrict p) {
+  struct zsv_output_sink *sink = p;
+  if(sink->compression == zsv_compression_none)
+    return fwrite(ptr, size, nitems, sink->f);
+
+  const unsigned char *s = ptr;
+  size_t len = size * nitems;
+  while(len) {
+    struct zsv_output_sink_block *b = &sink->blocks[sink->producer_ix];
+    size_t n = ZSV_OUTPUT_SINK_BLOCK_SIZE - b->used;
+    if(n > len)
+      n = len;
+    memcpy(b->data + b->used, s, n);
+    b->used += n;
+    s += n;
+    len -= n;
+    if(b->used == ZSV_OUTPUT_SINK_BLOCK_SIZE && zsv_output_sink_submit(sink))
+      return 0;
+  }
+  return nitems;
+}
+
+int zsv_output_sink_close(zsv_output_sink sink) {
+  if(!sink)
+    return 0;
+
+  int err = 0;
+  if(sink->compression != zsv_compression_none) {
+    struct zsv_output_sink_block *b = &sink->blocks[sink->producer_ix];
+#ifndef NO_THREADING
+    if(sink->thread_started) {
+      pthread_mutex_lock(&sink->mutex);
+      if(b->used) {
+        sink->ready++;
+        sink->producer_ix = (sink->producer_ix + 1) % ZSV_OUTPUT_SINK_BLOCK_COUNT;
+      }
+      sink->finishing = 1;
+      pthread_cond_signal(&sink->cond);
+      pthread_mutex_unlock(&sink->mutex);
+      pthread_join(sink->thread, NULL);
+      pthread_mutex_destroy(&sink->mutex);
+      pthread_cond_destroy(&sink->cond);
+      b = NULL;
+    }
+#endif
+    if(b && b->used && !sink->err && zsv_output_sink_compress(sink, b->data, b->used, 0))
+      sink->err = 1;
+    if(!sink->err && zsv_output_sink_compress(sink, NULL, 0, 1))
+      sink->err = 1;
+    err = sink->err;
+  }
+
+  if(sink->f == stdout) {
+    if(fflush(sink->f))
+      err = 1;
+  } else if(fclose(sink->f))
+    err = 1;
+  zsv_output_sink_free(sink);
+  return err;
+}
+
+enum zsv_compression zsv_compression_from_magic(const unsigned char *s, size_t len) {
+  if(len >= 3 && s[0] == 0x1f && s[1] == 0x8b && s[2] == 8)
+    return zsv_compression_gzip;
+  if(len >= 4 && s[0] == 0x28 && s[1] == 0xb5 && s[2] == 0x2f && s[3] == 0xfd)
+    return zsv_compression_zstd;
+  return zsv_compression_none;
+}
+
+/*
+ * Compressed input: zsv_input_open() returns a FILE whose reads are served
+ * from a ring of blocks of decompressed data that are filled by background
+ * decoder thread(s).
+ *
+ * In streaming mode, a single decoder decompresses the input sequentially,
+ * one block at a time. In parallel mode, each gzip member or zstd frame is
+ * read as a whole (its size being known from its headers) and decompressed
+ * into its own block by one of several workers; blocks are handed to the
+ * reader in input order
+ */
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+# define ZSV_INPUT_COOKIE
+#endif
+
+#if defined(ZSV_INPUT_COOKIE) && (defined(HAVE_DEFLATE) || defined(HAVE_ZSTD_COMPRESSSTREAM2))
+# define ZSV_INPUT_DECOMPRESS
+#endif
+
+#define ZSV_INPUT_PREFIX_SIZE 18 // enough for a BGZF member header or a zstd frame header
+
+#ifdef ZSV_INPUT_DECOMPRESS
+
+#define ZSV_INPUT_BLOCK_SIZE (1024 * 1024)
+#ifdef NO_THREADING
+# define ZSV_INPUT_STREAM_BLOCK_COUNT 1
+#else
+# define ZSV_INPUT_STREAM_BLOCK_COUNT 4
+#endif
+#define ZSV_INPUT_MAX_WORKERS 8
+
+// in parallel mode, the largest frame content size for which a zstd input will be decoded in parallel
+#define ZSV_INPUT_PARALLEL_FRAME_MAX (8 * 1024 * 1024)
+
+struct zsv_input_block {
+  unsigned char *data;
+  size_t cap;
+  size_t len;
+  size_t seq;  // sequence number of the data held in this block
+  char ready;
+};
+
+struct zsv_input_decoder {
+  struct zsv_input_source *src;
+#ifdef HAVE_DEFLATE
+  z_stream gz;
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  ZSTD_DCtx *zstd;
+#endif
+  unsigned char *in; // compressed data
+  size_t in_cap;
+  size_t in_len;
+  size_t in_pos;
+#ifndef NO_THREADING
+  pthread_t thread;
+#endif
+  char initd;
+  char member_done;  // streaming mode: the last gzip member or zstd frame was completed
+};
+
+struct zsv_input_source {
+  FILE *f;
+  char *filename;
+  enum zsv_compression compression;
+
+  // leading bytes that zsv_input_open() already read from f
+  unsigned char prefix[ZSV_INPUT_PREFIX_SIZE];
+  size_t prefix_len;
+  size_t prefix_pos;
+
+  struct zsv_input_block *blocks;
+  unsigned block_count;
+  size_t read_seq;  // sequence number of the block being read
+  size_t read_pos;  // position within that block
+  size_t next_seq;  // next sequence number to be claimed by a decoder
+  size_t end_seq;   // once input_done is set, the total count of sequence numbers
+
+  struct zsv_input_decoder *decoders;
+  unsigned decoder_count;
+
+#ifndef NO_THREADING
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned threads_started;
+#endif
+  char parallel;
+  char input_done;
+  char closing;
+  char err; // when threaded, only accessed while holding the mutex
+};
+
+static int zsv_input_reserve(unsigned char **buff, size_t *cap, size_t n) {
+  if(n > *cap) {
+    unsigned char *tmp = realloc(*buff, n);
+    if(!tmp) {
+      fprintf(stderr, "Out of memory!\n");
+      return 1;
+    }
+    *buff = tmp;
+    *cap = n;
+  }
+  return 0;
+}
+
+// read raw (compressed) bytes, starting with any that zsv_input_open() already consumed
+static size_t zsv_input_raw_read(struct zsv_input_source *src, unsigned char *buff, size_t n) {
+  size_t got = 0;
+  if(src->prefix_pos < src->prefix_len) {
+    got = src->prefix_len - src->prefix_pos;
+    if(got > n)
+      got = n;
+    memcpy(buff, src->prefix + src->prefix_pos, got);
+    src->prefix_pos += got;
+  }
+  if(got < n)
+    got += fread(buff + got, 1, n - got, src->f);
+  return got;
+}
+
+#ifndef NO_THREADING // parallel mode
+
+// append exactly n raw bytes to d->in; returns 0 on success
+static int zsv_input_raw_append(struct zsv_input_decoder *d, size_t n) {
+  struct zsv_input_source *src = d->src;
+  if(zsv_input_reserve(&d->in, &d->in_cap, d->in_len + n))
+    return 1;
+  if(zsv_input_raw_read(src, d->in + d->in_len, n) != n) {
+    fprintf(stderr, "%s: unexpected end of %s data\n", src->filename, zsv_compression_name(src->compression));
+    return 1;
+  }
+  d->in_len += n;
+  return 0;
+}
+
+/*
+ * if s begins with a BGZF member header (a gzip header whose extra field holds
+ * the compressed member size), return the total member size, else 0
+ */
+static size_t zsv_bgzf_member_size(const unsigned char *s, size_t len) {
+  if(len < 12 || zsv_compression_from_magic(s, len) != zsv_compression_gzip || !(s[3] & 4))
+    return 0;
+  size_t xlen = s[10] | (s[11] << 8);
+  if(len < 12 + xlen)
+    return 0;
+  for(size_t i = 12; i + 4 <= 12 + xlen; ) {
+    size_t slen = s[i+2] | (s[i+3] << 8);
+    if(s[i] == 'B' && s[i+1] == 'C' && slen == 2 && i + 6 <= 12 + xlen)
+      return (size_t)(s[i+4] | (s[i+5] << 8)) + 1;
+    i += 4 + slen;
+  }
+  return 0;
+}
+
+/*
+ * parallel mode: read the next complete gzip member or zstd frame into d->in
+ * returns 1 if a member was read, 0 at end of input, -1 on error
+ * *out_size is set to the member's decompressed size if known, else 0
+ */
+static int zsv_input_read_member(struct zsv_input_decoder *d, size_t *out_size) {
+  struct zsv_input_source *src = d->src;
+  d->in_len = 0;
+  *out_size = 0;
+  if(zsv_input_reserve(&d->in, &d->in_cap, ZSV_INPUT_PREFIX_SIZE))
+    return -1;
+  size_t n = zsv_input_raw_read(src, d->in, 4);
+  if(n == 0)
+    return 0;
+  d->in_len = n;
+  if(n < 4) {
+    fprintf(stderr, "%s: unexpected end of %s data\n", src->filename, zsv_compression_name(src->compression));
+    return -1;
+  }
+
+  if(src->compression == zsv_compression_gzip) {
+    size_t member_size;
+    if(zsv_input_raw_append(d, 8) || zsv_input_raw_append(d, d->in[10] | (d->in[11] << 8)))
+      return -1;
+    if(!(member_size = zsv_bgzf_member_size(d->in, d->in_len)) || member_size < d->in_len + 8) {
+      fprintf(stderr, "%s: invalid BGZF member\n", src->filename);
+      return -1;
+    }
+    if(zsv_input_raw_append(d, member_size - d->in_len))
+      return -1;
+    const unsigned char *isize = d->in + d->in_len - 4;
+    *out_size = (size_t)isize[0] | ((size_t)isize[1] << 8) | ((size_t)isize[2] << 16) | ((size_t)isize[3] << 24);
+    return 1;
+  }
+
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  const unsigned char *s = d->in;
+  unsigned long magic = s[0] | (s[1] << 8) | ((unsigned long)s[2] << 16) | ((unsigned long)s[3] << 24);
+  if((magic & ZSTD_MAGIC_SKIPPABLE_MASK) == ZSTD_MAGIC_SKIPPABLE_START) {
+    // skippable frame: 4-byte size followed by content that we ignore
+    if(zsv_input_raw_append(d, 4))
+      return -1;
+    s = d->in;
+    size_t skip = s[4] | (s[5] << 8) | ((size_t)s[6] << 16) | ((size_t)s[7] << 24);
+    if(zsv_input_raw_append(d, skip))
+      return -1;
+    d->in_len = 0; // nothing to decompress
+    return 1;
+  }
+  if(magic != ZSTD_MAGICNUMBER) {
+    fprintf(stderr, "%s: invalid zstd frame\n", src->filename);
+    return -1;
+  }
+
+  // frame header: descriptor, then optional window descriptor, dictionary id and content size
+  if(zsv_input_raw_append(d, 1))
+    return -1;
+  unsigned char fhd = d->in[4];
+  unsigned fcs_flag = fhd >> 6, single_segment = (fhd >> 5) & 1;
+  static const unsigned did_sizes[] = { 0, 1, 2, 4 };
+  if(zsv_input_raw_append(d, !single_segment + did_sizes[fhd & 3] + (fcs_flag ? 1u << fcs_flag : single_segment)))
+    return -1;
+
+  // blocks: 3-byte header (last-block flag, type, size) followed by the block content
+  for(char last = 0; !last; ) {
+    if(zsv_input_raw_append(d, 3))
+      return -1;
+    const unsigned char *bh = d->in + d->in_len - 3;
+    unsigned long block_header = bh[0] | (bh[1] << 8) | ((unsigned long)bh[2] << 16);
+    unsigned type = (block_header >> 1) & 3;
+    if(type == 3) {
+      fprintf(stderr, "%s: invalid zstd block\n", src->filename);
+      return -1;
+    }
+    last = block_header & 1;
+    if(zsv_input_raw_append(d, type == 1 ? 1 : block_header >> 3)) // RLE blocks hold a single byte
+      return -1;
+  }
+  if((fhd & 4) && zsv_input_raw_append(d, 4)) // content checksum
+    return -1;
+
+  unsigned long long content_size = ZSTD_getFrameContentSize(d->in, d->in_len);
+  if(content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR
+     && content_size <= ZSV_INPUT_PARALLEL_FRAME_MAX)
+    *out_size = (size_t)content_size;
+  return 1;
+#else
+  return -1;
+#endif
+}
+#endif // NO_THREADING
+
+static int zsv_input_decode_error(struct zsv_input_source *src, const char *msg) {
+  fprintf(stderr, "%s: %s decompression error%s%s\n", src->filename, zsv_compression_name(src->compression),
+          msg ? ": " : "", msg ? msg : "");
+  return 1;
+}
+
+// streaming mode: decompress the next block's worth of data
+static int zsv_input_decode_stream(struct zsv_input_decoder *d, struct zsv_input_block *b, char *done) {
+  struct zsv_input_source *src = d->src;
+  b->len = 0;
+  while(b->len < b->cap) {
+    if(d->in_pos == d->in_len) {
+      d->in_pos = 0;
+      if(!(d->in_len = zsv_input_raw_read(src, d->in, d->in_cap))) {
+        *done = 1;
+        if(ferror(src->f)) {
+          fprintf(stderr, "%s: read error\n", src->filename);
+          return 1;
+        }
+        if(!d->member_done)
+          return zsv_input_decode_error(src, "unexpected end of input");
+        return 0;
+      }
+    }
+
+    switch(src->compression) {
+#ifdef HAVE_DEFLATE
+    case zsv_compression_gzip:
+      {
+        if(d->member_done) {
+          // another member may follow; anything else is trailing garbage that, like gzip, we ignore
+          if(d->in[d->in_pos] != 0x1f) {
+            *done = 1;
+            return 0;
+          }
+          inflateReset(&d->gz);
+          d->member_done = 0;
+        }
+        d->gz.next_in = d->in + d->in_pos;
+        d->gz.avail_in = (uInt)(d->in_len - d->in_pos);
+        d->gz.next_out = b->data + b->len;
+        d->gz.avail_out = (uInt)(b->cap - b->len);
+        int rc = inflate(&d->gz, Z_NO_FLUSH);
+        d->in_pos = d->in_len - d->gz.avail_in;
+        b->len = b->cap - d->gz.avail_out;
+        if(rc == Z_STREAM_END)
+          d->member_done = 1;
+        else if(rc != Z_OK && rc != Z_BUF_ERROR)
+          return zsv_input_decode_error(src, d->gz.msg);
+      }
+      break;
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    case zsv_compression_zstd:
+      {
+        ZSTD_inBuffer in = { d->in, d->in_len, d->in_pos };
+        ZSTD_outBuffer out = { b->data, b->cap, b->len };
+        size_t rc = ZSTD_decompressStream(d->zstd, &out, &in);
+        if(ZSTD_isError(rc))
+          return zsv_input_decode_error(src, ZSTD_getErrorName(rc));
+        d->in_pos = in.pos;
+        b->len = out.pos;
+        d->member_done = rc == 0;
+      }
+      break;
+#endif
+    default:
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#ifndef NO_THREADING
+// parallel mode: decompress the member in d->in, whose decompressed size is out_size (or 0 if unknown)
+static int zsv_input_decode_member(struct zsv_input_decoder *d, struct zsv_input_block *b, size_t out_size) {
+  struct zsv_input_source *src = d->src;
+  b->len = 0;
+  if(!d->in_len)
+    return 0;
+  if(zsv_input_reserve(&b->data, &b->cap, out_size ? out_size + 1 : ZSV_INPUT_BLOCK_SIZE))
+    return 1;
+  switch(src->compression) {
+#ifdef HAVE_DEFLATE
+  case zsv_compression_gzip:
+    inflateReset(&d->gz);
+    d->gz.next_in = d->in;
+    d->gz.avail_in = (uInt)d->in_len;
+    for(;;) {
+      d->gz.next_out = b->data + b->len;
+      d->gz.avail_out = (uInt)(b->cap - b->len);
+      int rc = inflate(&d->gz, Z_NO_FLUSH);
+      b->len = b->cap - d->gz.avail_out;
+      if(rc == Z_STREAM_END)
+        return 0;
+      if(rc != Z_OK && rc != Z_BUF_ERROR)
+        return zsv_input_decode_error(src, d->gz.msg);
+      if(!d->gz.avail_out) {
+        if(zsv_input_reserve(&b->data, &b->cap, b->cap * 2))
+          return 1;
+      } else if(!d->gz.avail_in)
+        return zsv_input_decode_error(src, "unexpected end of input");
+    }
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  case zsv_compression_zstd:
+    {
+      ZSTD_DCtx_reset(d->zstd, ZSTD_reset_session_only);
+      ZSTD_inBuffer in = { d->in, d->in_len, 0 };
+      for(;;) {
+        ZSTD_outBuffer out = { b->data, b->cap, b->len };
+        size_t rc = ZSTD_decompressStream(d->zstd, &out, &in);
+        b->len = out.pos;
+        if(ZSTD_isError(rc))
+          return zsv_input_decode_error(src, ZSTD_getErrorName(rc));
+        if(rc == 0)
+          return 0;
+        if(out.pos == out.size) {
+          if(zsv_input_reserve(&b->data, &b->cap, b->cap * 2))
+            return 1;
+        } else if(in.pos == in.size)
+          return zsv_input_decode_error(src, "unexpected end of input");
+      }
+    }
+#endif
+  default:
+    break;
+  }
+  return 1;
+}
+
+static void *zsv_input_decoder_thread(void *p) {
+  struct zsv_input_decoder *d = p;
+  struct zsv_input_source *src = d->src;
+  pthread_mutex_lock(&src->mutex);
+  for(;;) {
+    // wait for a free block
+    while(!src->closing && !src->input_done && src->next_seq >= src->read_seq + src->block_count)
+      pthread_cond_wait(&src->cond, &src->mutex);
+    if(src->closing || src->input_done)
+      break;
+
+    size_t seq = src->next_seq++;
+    struct zsv_input_block *b = &src->blocks[seq % src->block_count];
+    size_t out_size = 0;
+    if(src->parallel) {
+      // members are read from the file in order, so this is done while holding the lock
+      int rc = zsv_input_read_member(d, &out_size);
+      if(rc <= 0) {
+        if(rc < 0)
+          src->err = 1;
+        src->input_done = 1;
+        src->end_seq = seq;
+        pthread_cond_broadcast(&src->cond);
+        break;
+      }
+    }
+    pthread_mutex_unlock(&src->mutex);
+
+    char done = 0;
+    int err = src->parallel ? zsv_input_decode_member(d, b, out_size) : zsv_input_decode_stream(d, b, &done);
+
+    pthread_mutex_lock(&src->mutex);
+    if(err)
+      src->err = 1;
+    if(err || done) {
+      src->input_done = 1;
+      src->end_seq = seq + 1;
+    }
+    b->seq = seq;
+    b->ready = 1;
+    pthread_cond_broadcast(&src->cond);
+  }
+  pthread_mutex_unlock(&src->mutex);
+  return NULL;
+}
+#endif
+
+// get the block with sequence number read_seq, waiting for it if needed; NULL at end of data or on error
+static struct zsv_input_block *zsv_input_current_block(struct zsv_input_source *src) {
+  struct zsv_input_block *b = &src->blocks[src->read_seq % src->block_count];
+#ifndef NO_THREADING
+  if(src->threads_started) {
+    pthread_mutex_lock(&src->mutex);
+    while(!b->ready && !src->err && !(src->input_done && src->read_seq >= src->end_seq))
+      pthread_cond_wait(&src->cond, &src->mutex);
+    if(!b->ready) // end of data, or error: data decompressed before an error is still returned
+      b = NULL;
+    pthread_mutex_unlock(&src->mutex);
+    return b;
+  }
+#endif
+  if(!b->ready) { // decompress synchronously
+    char done = 0;
+    if(src->err || src->input_done)
+      return NULL;
+    if(zsv_input_decode_stream(&src->decoders[0], b, &done))
+      src->err = done = 1;
+    src->input_done = done;
+    b->ready = 1;
+  }
+  return b;
+}
+
+static void zsv_input_release_block(struct zsv_input_source *src, struct zsv_input_block *b) {
+#ifndef NO_THREADING
+  if(src->threads_started)
+    pthread_mutex_lock(&src->mutex);
+#endif
+  b->ready = 0;
+  src->read_seq++;
+  src->read_pos = 0;
+#ifndef NO_THREADING
+  if(src->threads_started) {
+    pthread_cond_broadcast(&src->cond);
+    pthread_mutex_unlock(&src->mutex);
+  }
+#endif
+}
+
+static ssize_t zsv_input_read(void *cookie, char *buff, size_t n) {
+  struct zsv_input_source *src = cookie;
+  if(src->compression == zsv_compression_none)
+    return (ssize_t)zsv_input_raw_read(src, (unsigned char *)buff, n);
+
+  size_t got = 0;
+  while(got < n) {
+    struct zsv_input_block *b = zsv_input_current_block(src);
+    if(!b)
+      break;
+    size_t avail = b->len - src->read_pos;
+    if(avail > n - got)
+      avail = n - got;
+    if(avail) {
+      memcpy(buff + got, b->data + src->read_pos, avail);
+      got += avail;
+      src->read_pos += avail;
+    }
+    if(src->read_pos == b->len) // includes blocks with no data, e.g. from a skippable zstd frame
+      zsv_input_release_block(src, b);
+  }
+  if(!got && src->err)
+    return -1;
+  return (ssize_t)got;
+}
+
+static int zsv_input_close(void *cookie) {
+  struct zsv_input_source *src = cookie;
+#ifndef NO_THREADING
+  if(src->threads_started) {
+    pthread_mutex_lock(&src->mutex);
+    src->closing = 1;
+    pthread_cond_broadcast(&src->cond);
+    pthread_mutex_unlock(&src->mutex);
+    for(unsigned i = 0; i < src->threads_started; i++)
+      pthread_join(src->decoders[i].thread, NULL);
+    pthread_mutex_destroy(&src->mutex);
+    pthread_cond_destroy(&src->cond);
+  }
+#endif
+  for(unsigned i = 0; i < src->decoder_count; i++) {
+    struct zsv_input_decoder *d = &src->decoders[i];
+    if(d->initd) {
+#ifdef HAVE_DEFLATE
+      if(src->compression == zsv_compression_gzip)
+        inflateEnd(&d->gz);
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+      if(src->compression == zsv_compression_zstd)
+        ZSTD_freeDCtx(d->zstd);
+#endif
+    }
+    free(d->in);
+  }
+  free(src->decoders);
+  for(unsigned i = 0; i < src->block_count; i++)
+    free(src->blocks[i].data);
+  free(src->blocks);
+  int err = fclose(src->f);
+  free(src->filename);
+  free(src);
+  return err;
+}
+
+#ifdef HAVE_FUNOPEN
+static int zsv_input_read_funopen(void *cookie, char *buff, int n) {
+  return (int)zsv_input_read(cookie, buff, (size_t)n);
+}
+#endif
+
+static int zsv_input_decoder_init(struct zsv_input_source *src, struct zsv_input_decoder *d) {
+  d->src = src;
+  switch(src->compression) {
+#ifdef HAVE_DEFLATE
+  case zsv_compression_gzip:
+    // windowBits 15 + 16: expect a gzip header and trailer
+    if(inflateInit2(&d->gz, 15 + 16) != Z_OK)
+      return 1;
+    break;
+#endif
+#ifdef HAVE_ZSTD_COMPRESSSTREAM2
+  case zsv_compression_zstd:
+    if(!(d->zstd = ZSTD_createDCtx()))
+      return 1;
+    break;
+#endif
+  default:
+    return 0;
+  }
+  d->initd = 1;
+  // in parallel mode, d->in grows to hold one member
+  return src->parallel ? 0 : zsv_input_reserve(&d->in, &d->in_cap, ZSV_INPUT_BLOCK_SIZE / 4);
+}
+
+static int zsv_input_init(struct zsv_input_source *src) {
+  unsigned workers = 1;
+#ifndef NO_THREADING
+  unsigned cpus = zsv_cpu_count();
+  workers = cpus > 2 ? cpus - 1 : 1; // leave a processor for the parser
+  if(workers > ZSV_INPUT_MAX_WORKERS)
+    workers = ZSV_INPUT_MAX_WORKERS;
+  if(workers > 1) {
+    if(src->compression == zsv_compression_gzip)
+      src->parallel = zsv_bgzf_member_size(src->prefix, src->prefix_len) > 0;
+# ifdef HAVE_ZSTD_COMPRESSSTREAM2
+    else if(src->compression == zsv_compression_zstd) {
+      unsigned long long content_size = ZSTD_getFrameContentSize(src->prefix, src->prefix_len);
+      src->parallel = content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR
+        && content_size <= ZSV_INPUT_PARALLEL_FRAME_MAX;
+    }
+# endif
+  }
+#endif
+  if(!src->parallel)
+    workers = 1;
+
+  src->decoder_count = workers;
+  src->block_count = src->parallel ? workers * 2 : ZSV_INPUT_STREAM_BLOCK_COUNT;
+  if(!(src->decoders = calloc(src->decoder_count, sizeof(*src->decoders)))
+     || !(src->blocks = calloc(src->block_count, sizeof(*src->blocks))))
+    return 1;
+  for(unsigned i = 0; i < src->decoder_count; i++)
+    if(zsv_input_decoder_init(src, &src->decoders[i]))
+      return 1;
+  if(!src->parallel) // in parallel mode, each block grows to hold one member
+    for(unsigned i = 0; i < src->block_count; i++)
+      if(zsv_input_reserve(&src->blocks[i].data, &src->blocks[i].cap, ZSV_INPUT_BLOCK_SIZE))
+        return 1;
+
+#ifndef NO_THREADING
+  pthread_mutex_init(&src->mutex, NULL);
+  pthread_cond_init(&src->cond, NULL);
+  for(unsigned i = 0; i < src->decoder_count; i++) {
+    if(pthread_create(&src->decoders[i].thread, NULL, zsv_input_decoder_thread, &src->decoders[i]))
+      break;
+    src->threads_started++;
+  }
+  if(!src->threads_started) { // decompress synchronously instead, in streaming mode
+    pthread_mutex_destroy(&src->mutex);
+    pthread_cond_destroy(&src->cond);
+    if(src->parallel) {
+      src->parallel = 0;
+      if(zsv_input_reserve(&src->decoders[0].in, &src->decoders[0].in_cap, ZSV_INPUT_BLOCK_SIZE / 4))
+        return 1;
+      for(unsigned i = 0; i < src->block_count; i++)
+        if(zsv_input_reserve(&src->blocks[i].data, &src->blocks[i].cap, ZSV_INPUT_BLOCK_SIZE))
+          return 1;
+    }
+  }
+#endif
+  return 0;
+}
+
+#endif // ZSV_INPUT_DECOMPRESS
+
+FILE *zsv_input_open(const char *filename) {
+  FILE *f = fopen(filename, "rb");
+  if(!f)
+    return NULL;
+  return zsv_input_open_stream(f, filename);
+}
+
+FILE *zsv_input_open_stream(FILE *f, const char *filename) {
+  long start = ftell(f); // -1 if the stream is not seekable
+#ifndef ZSV_INPUT_DECOMPRESS
+  if(start < 0) // nothing could be decompressed, and the magic bytes could not be replayed
+    return f;
+#endif
+  unsigned char prefix[ZSV_INPUT_PREFIX_SIZE];
+  size_t prefix_len = fread(prefix, 1, sizeof(prefix), f);
+  enum zsv_compression compression = zsv_compression_from_magic(prefix, prefix_len);
+  if(compression == zsv_compression_none && start >= 0 && !fseek(f, start, SEEK_SET))
+    return f;
+
+#ifdef ZSV_INPUT_DECOMPRESS
+  if(zsv_compression_supported(compression)) {
+    struct zsv_input_source *src = calloc(1, sizeof(*src));
+    if(!src || !(src->filename = strdup(filename))) {
+      fprintf(stderr, "Out of memory!\n");
+      free(src);
+      fclose(f);
+      return NULL;
+    }
+    src->f = f;
+    src->compression = compression;
+    // rather than seek (which may not be possible, e.g. for a named pipe), replay the prefix
+    memcpy(src->prefix, prefix, prefix_len);
+    src->prefix_len = prefix_len;
+
+    FILE *result = NULL;
+    if(compression == zsv_compression_none || !zsv_input_init(src)) {
+# ifdef HAVE_FOPENCOOKIE
+      cookie_io_functions_t fns = { zsv_input_read, NULL, NULL, zsv_input_close };
+      result = fopencookie(src, "rb", fns);
+# else
+      result = funopen(src, zsv_input_read_funopen, NULL, NULL, zsv_input_close);
+# endif
+    } else
+      fprintf(stderr, "%s: unable to initialize decompression\n", filename);
+    if(!result)
+      zsv_input_close(src);
+    return result;
+  }
+#endif
+
+  if(compression == zsv_compression_none) // not seekable and cannot replay the prefix
+    fprintf(stderr, "%s: unable to rewind input\n", filename);
+  else
+    fprintf(stderr, "%s: %s-compressed input is not supported in this build\n", filename,
+            zsv_compression_name(compression));
+  fclose(f);
+  return NULL;
+}
@@ -6,11 +6,30 @@
  * https://opensource.org/licenses/MIT
  */
 
-#ifdef _WIN32
+#ifndef _WIN32
+#include <unistd.h>
+#include <zsv/utils/os.h>
+
+unsigned zsv_cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if(n > 0)
+    return (unsigned)n;
+#endif
+  return 1;
+}
+
+#else
 #include <zsv/utils/os.h>
 #include <windows.h>
 #include <strsafe.h>
 
+unsigned zsv_cpu_count(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1;
+}
+
 static void strlcpy(register char *dst, register const char *src, size_t n) {
   for (; *src != '\0' && n > 1; n--) {
     *dst++ = *src++;
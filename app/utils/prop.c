@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
@@ -6,6 +7,8 @@
 #include <zsv/utils/prop.h>
 #include <zsv/utils/cache.h>
 #include <zsv/utils/file.h>
+#include <zsv/utils/string.h>
+#include <zsv/utils/vector.h>
 #include <yajl_helper.h>
 
 // to do: import these through a proper header
@@ -17,6 +20,9 @@ unsigned char *zsv_cache_filepath(const unsigned char *data_filepath,
 struct zsv_properties_parser {
   struct yajl_helper_parse_state st;
   yajl_status stat;
+  struct zsv_file_properties *fp;
+  struct zsv_prop_columns *columns; // if non-NULL, load the "columns" property
+  size_t columns_size;
 };
 
 /**
@@ -33,7 +39,8 @@ struct zsv_properties_parser *zsv_properties_parser_new(struct zsv_file_properti
                                    NULL, // start_array,
                                    NULL, // end_array,
                                    zsv_properties_parse_process_value,
-                                   fp);
+                                   parser);
+    parser->fp = fp;
   }
   return parser;
 }
@@ -72,10 +79,11 @@ enum zsv_status zsv_properties_parser_destroy(struct zsv_properties_parser *pars
  * @param cmd_opts_used (optional) cmd option codes to skip + warn if found
  * @return zsv_status_ok on success
  */
-enum zsv_status zsv_cache_load_props(const char *data_filepath,
-                                     struct zsv_opts *opts,
-                                     struct zsv_file_properties *fp,
-                                     const char *cmd_opts_used) {
+static enum zsv_status zsv_cache_load_props_aux(const char *data_filepath,
+                                                struct zsv_opts *opts,
+                                                struct zsv_file_properties *fp,
+                                                struct zsv_prop_columns *columns,
+                                                const char *cmd_opts_used) {
   // we need some memory to save the parsed properties
   // if the caller did not provide that, use our own
   struct zsv_file_properties tmp = { 0 };
@@ -104,6 +112,7 @@ enum zsv_status zsv_cache_load_props(const char *data_filepath,
       else if(p->stat != yajl_status_ok)
         stat = zsv_status_error;
       else {
+        p->columns = columns;
         unsigned char buff[1024];
         size_t bytes_read;
         while((bytes_read = fread(buff, 1, sizeof(buff), f))) {
@@ -142,9 +151,83 @@ enum zsv_status zsv_cache_load_props(const char *data_filepath,
   return stat;
 }
 
+enum zsv_status zsv_cache_load_props(const char *data_filepath,
+                                     struct zsv_opts *opts,
+                                     struct zsv_file_properties *fp,
+                                     const char *cmd_opts_used) {
+  return zsv_cache_load_props_aux(data_filepath, opts, fp, NULL, cmd_opts_used);
+}
+
+/**
+ * Load the cached "columns" property of a file. If none was saved,
+ * columns->count will be zero. Call zsv_prop_columns_free() when done
+ */
+enum zsv_status zsv_cache_load_columns(const char *data_filepath,
+                                       struct zsv_prop_columns *columns) {
+  memset(columns, 0, sizeof(*columns));
+  enum zsv_status stat = zsv_cache_load_props_aux(data_filepath, NULL, NULL, columns, NULL);
+  if(stat != zsv_status_ok)
+    zsv_prop_columns_free(columns);
+  return stat;
+}
+
+void zsv_prop_columns_free(struct zsv_prop_columns *columns) {
+  for(size_t i = 0; i < columns->count; i++)
+    free(columns->columns[i].name);
+  free(columns->columns);
+  columns->columns = NULL;
+  columns->count = 0;
+}
+
+// process a value in one of the objects in the "columns" property array
+static void zsv_properties_parse_column_value(struct zsv_properties_parser *parser, struct json_value *value) {
+  struct yajl_helper_parse_state *st = &parser->st;
+  size_t ix = yajl_helper_array_index_plus_1(st, 1);
+  if(!ix)
+    return;
+  ix--;
+  if(ix >= parser->columns_size) {
+    size_t new_size = parser->columns_size ? parser->columns_size * 2 : 32;
+    while(new_size <= ix)
+      new_size *= 2;
+    struct zsv_prop_column *tmp = realloc(parser->columns->columns, new_size * sizeof(*tmp));
+    if(!tmp) {
+      fprintf(stderr, "Out of memory!\n");
+      parser->fp->err = 1;
+      return;
+    }
+    memset(tmp + parser->columns_size, 0, (new_size - parser->columns_size) * sizeof(*tmp));
+    parser->columns->columns = tmp;
+    parser->columns_size = new_size;
+  }
+  if(ix >= parser->columns->count)
+    parser->columns->count = ix + 1;
+
+  struct zsv_prop_column *c = &parser->columns->columns[ix];
+  const char *key = yajl_helper_get_map_key(st, 0);
+  if(!strcmp(key, "name")) {
+    free(c->name);
+    c->name = json_str_dup_if_len(value);
+  } else if(!strcmp(key, "type")) {
+    struct json_value_string jvs;
+    size_t len = json_value_to_string(value, &jvs, 0);
+    c->type = zsv_prop_column_type_from_str(jvs.s, len);
+  } else if(!strcmp(key, "nullable"))
+    c->nullable = json_value_truthy(value);
+  else if(!strcmp(key, "width")) {
+    int err = 0;
+    long long i = json_value_long(value, &err);
+    if(!err && i >= 0)
+      c->width = (size_t)i;
+  }
+}
+
 static int zsv_properties_parse_process_value(struct yajl_helper_parse_state *st, struct json_value *value) {
-  struct zsv_file_properties *fp = st->data;
-  if(st->level == 1) {
+  struct zsv_properties_parser *parser = st->data;
+  struct zsv_file_properties *fp = parser->fp;
+  if(parser->columns && yajl_helper_got_path(st, 3, "{columns[{"))
+    zsv_properties_parse_column_value(parser, value);
+  else if(st->level == 1) {
     const char *prop_name = yajl_helper_get_map_key(st, 0);
     unsigned int *target = NULL;
     if(!strcmp(prop_name, "skip-head")) {
@@ -191,3 +274,355 @@ enum zsv_status zsv_new_with_properties(struct zsv_opts *opts,
     return zsv_status_ok;
   return zsv_status_memory;
 }
+
+/**
+ * Very basic test to check if a string looks like a number:
+ * - ignore leading whitespace and currency
+ * - ignore trailing whitespace
+ * - ignore leading dash or plus
+ * - len < 1 or > 30 => not a number
+ * - scan characters one by one:
+ *     if the char isn't a digit, comma or period, it's not a number
+ *     digits are ignored
+ *     commas are counted (we ignore the requirement for them to be spaced out e.g. every 3 digits)
+ *     periods are counted
+ *     if at any point we have more than 1 comma AND more than 1 digit, it's not a number
+ * @param s     input string
+ * @param len   length of input
+ * @param flags reserved for future use
+ * @return      1 if it looks like a number, else 0
+ */
+static char looks_like_num(const unsigned char *s, size_t len, unsigned flags) {
+  (void)(flags);
+  // trim
+  s = zsv_strtrim(s, &len);
+
+  // strip +/- sign, if any
+  size_t sign = zsv_strnext_is_sign(s, len);
+  if(sign) {
+    s += sign;
+    len -= sign;
+    s = zsv_strtrim_left(s, &len);
+  }
+
+  // strip currency, if any
+  size_t currency = zsv_strnext_is_currency(s, len);
+  if(currency) {
+    s += currency;
+    len -= currency;
+    s = zsv_strtrim_left(s, &len);
+  }
+
+  // strip +/- sign, if we didn't find one earlier
+  if(!sign && (sign = zsv_strnext_is_sign(s, len))) {
+    s += sign;
+    len -= sign;
+    s = zsv_strtrim_left(s, &len);
+  }
+
+  if(len < 1 || len > 30)
+    return 0;
+
+  unsigned digits = 0;
+  unsigned period = 0;
+  for(size_t i = 0; i < len; i++) {
+    unsigned char c = s[i];
+    if(c >= '0' && c <= '9') // to do: allow utf8 digits, commas, periods?
+      digits++;
+    else if(c == ',' && i > 0 && period == 0) { // comma can't be first char, or follow a period
+      // do nothing. to do: check that the last comma was either 3 or 4 numbers away?
+    } else if(c == '.' && period == 0) // only 1 period allowed (to do: relax this as it isn't true in all localities)
+      period++;
+    else
+      return 0;
+  }
+  return digits > 0 && period < 2;
+}
+
+/**
+ * Super crude "test" to check if a string looks like a date or timestamp:
+ * we are just going to disqualify if len < 5 or len > 30
+ * or any chars are not digits, slash, dash, colon, space
+ * or in any of the following which is made up of chars from the English months, plus am/pm
+ *   abcdefghijlmnoprstuvy
+ * @param s     input string
+ * @param len   length of input
+ * @param flags reserved for future use
+ * @return      1 if it looks like a date, else 0
+ */
+static char looks_like_date(const unsigned char *s, size_t len, unsigned flags) {
+  (void)(flags);
+  // trim
+  s = zsv_strtrim(s, &len);
+  if(len <= 5 || len > 30)
+    return 0;
+  #define LOOKS_LIKE_DATE_CHARS "0123456789-/:, abcdefghijlmnoprstuvy"
+  for(size_t i = 0; i < len; i++)
+    if(!memchr(LOOKS_LIKE_DATE_CHARS, s[i], strlen(LOOKS_LIKE_DATE_CHARS)))
+      return 0;
+  return 1;
+}
+
+/**
+ * Very basic test to check if a string looks like a bool:
+ * - ignore leading and trailing whitespace
+ * - look for true, false, yes, no, T, F, 1, 0, Y, N
+ * - to do: add localization options?
+ * @param s     input string
+ * @param len   length of input
+ * @param flags reserved for future use
+ * @return      1 if it looks like a bool, else 0
+ */
+static char looks_like_bool(const unsigned char *s, size_t len, unsigned flags) {
+  (void)(flags);
+  // trim
+  s = zsv_strtrim(s, &len);
+
+  if(!len)
+    return 0;
+
+  if(len == 1)
+    return strchr("TtFf10YyNn", *s) ? 1 : 0;
+
+  if(len <= 5) {
+    char *lower = (char *)zsv_strtolowercase(s, &len);
+    if(lower) {
+      char result = 0;
+      switch(len) {
+      case 2:
+        result = !strcmp(lower, "no");
+        break;
+      case 3:
+        result = !strcmp(lower, "yes");
+        break;
+      case 4:
+        result = !strcmp(lower, "true");
+        break;
+      case 5:
+        result = !strcmp(lower, "false");
+        break;
+      }
+      free(lower);
+      return result;
+    }
+  }
+  return 0;
+}
+
+unsigned int zsv_prop_type_detect(const unsigned char *s, size_t slen) {
+  unsigned int result = 0;
+  if(slen == 0) {
+    result += ZSV_PROP_TYPE_CHECK_NULL;
+    return result;
+  }
+  if(looks_like_num(s, slen, 0))
+    result += ZSV_PROP_TYPE_CHECK_NUM;
+  if(looks_like_date(s, slen, 0))
+    result += ZSV_PROP_TYPE_CHECK_DATE;
+  if(looks_like_bool(s, slen, 0))
+    result += ZSV_PROP_TYPE_CHECK_BOOL;
+  return result;
+}
+
+/*
+ * zsv_prop_cell_classify(): each value of up to ZSV_PROP_CLASSIFY_MAX bytes is
+ * loaded into vectors, from which bitmasks of the positions of digits and of each
+ * separator are taken. Most values are then classified with a few mask tests
+ * rather than a char-by-char scan; only values whose characters could form a date
+ * are also checked char by char
+ */
+#define ZSV_PROP_CLASSIFY_MAX 64
+
+struct zsv_prop_masks {
+  uint64_t digit;
+  uint64_t dot;
+  uint64_t dash;
+  uint64_t slash;
+  uint64_t colon;
+  uint64_t space; // space or 'T' (between a date and a time)
+  uint64_t other;
+};
+
+static void zsv_prop_get_masks(const unsigned char *s, size_t len, struct zsv_prop_masks *m) {
+  zsv_uc_vector zero, nine, dot, dash, slash, colon, space, t;
+  memset(&zero, '0', sizeof(zero));
+  memset(&nine, '9', sizeof(nine));
+  memset(&dot, '.', sizeof(dot));
+  memset(&dash, '-', sizeof(dash));
+  memset(&slash, '/', sizeof(slash));
+  memset(&colon, ':', sizeof(colon));
+  memset(&space, ' ', sizeof(space));
+  memset(&t, 'T', sizeof(t));
+  memset(m, 0, sizeof(*m));
+  for(size_t i = 0; i < len; i += ZSV_VECTOR_BYTES) {
+    zsv_uc_vector v = { 0 };
+    memcpy(&v, s + i, len - i < ZSV_VECTOR_BYTES ? len - i : ZSV_VECTOR_BYTES);
+    zsv_uc_vector is_digit = (zsv_uc_vector)((v >= zero) & (v <= nine));
+    zsv_uc_vector is_dot = (zsv_uc_vector)(v == dot);
+    zsv_uc_vector is_dash = (zsv_uc_vector)(v == dash);
+    zsv_uc_vector is_slash = (zsv_uc_vector)(v == slash);
+    zsv_uc_vector is_colon = (zsv_uc_vector)(v == colon);
+    zsv_uc_vector is_space = (zsv_uc_vector)((v == space) | (v == t));
+    m->digit |= zsv_vector_mask(is_digit) << i;
+    m->dot |= zsv_vector_mask(is_dot) << i;
+    m->dash |= zsv_vector_mask(is_dash) << i;
+    m->slash |= zsv_vector_mask(is_slash) << i;
+    m->colon |= zsv_vector_mask(is_colon) << i;
+    m->space |= zsv_vector_mask(is_space) << i;
+    m->other |= zsv_vector_mask(~(is_digit | is_dot | is_dash | is_slash | is_colon | is_space)) << i;
+  }
+  if(len < 64)
+    m->other &= (1ULL << len) - 1; // ignore the padding
+}
+
+static size_t zsv_prop_skip_digits(const unsigned char *s, size_t len, size_t i) {
+  while(i < len && s[i] >= '0' && s[i] <= '9')
+    i++;
+  return i;
+}
+
+static size_t zsv_prop_parse_digits(const unsigned char *s, size_t len, size_t i, unsigned *value) {
+  for(*value = 0; i < len && s[i] >= '0' && s[i] <= '9'; i++)
+    *value = *value * 10 + (s[i] - '0');
+  return i;
+}
+
+static char zsv_prop_is_valid_date(unsigned year, unsigned month, unsigned day) {
+  static const unsigned char days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  if(month < 1 || month > 12 || day < 1)
+    return 0;
+  if(month == 2 && day == 29)
+    return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+  return day <= days[month - 1];
+}
+
+/**
+ * Check for a valid date in y-m-d or m/d/y form (with either '-' or '/'), optionally
+ * followed by a space or 'T' and a time in hh:mm[:ss[.fff]] form
+ */
+static char zsv_prop_is_datetime(const unsigned char *s, size_t len) {
+  size_t n[3];
+  unsigned v[3];
+  size_t i = 0;
+  unsigned char sep = 0;
+  for(int part = 0; part < 3; part++) {
+    size_t start = i;
+    i = zsv_prop_parse_digits(s, len, i, &v[part]);
+    if(!(n[part] = i - start))
+      return 0;
+    if(part < 2) {
+      if(i == len || (s[i] != '-' && s[i] != '/') || (sep && s[i] != sep))
+        return 0;
+      sep = s[i++];
+    }
+  }
+  if(n[0] == 4 && n[1] <= 2 && n[2] <= 2) {
+    if(!zsv_prop_is_valid_date(v[0], v[1], v[2]))
+      return 0;
+  } else if(n[0] <= 2 && n[1] <= 2 && n[2] == 4) {
+    if(!zsv_prop_is_valid_date(v[2], v[0], v[1]))
+      return 0;
+  } else
+    return 0;
+  if(i == len)
+    return 1;
+  if(s[i] != ' ' && s[i] != 'T')
+    return 0;
+
+  // time
+  unsigned t;
+  size_t start = ++i;
+  i = zsv_prop_parse_digits(s, len, i, &t);
+  if(i - start < 1 || i - start > 2 || t > 23 || i == len || s[i] != ':')
+    return 0;
+  start = ++i;
+  if((i = zsv_prop_parse_digits(s, len, i, &t)) - start != 2 || t > 59)
+    return 0;
+  if(i < len && s[i] == ':') {
+    start = ++i;
+    if((i = zsv_prop_parse_digits(s, len, i, &t)) - start != 2 || t > 60) // allow a leap second
+      return 0;
+    if(i < len && s[i] == '.') { // fractional seconds
+      start = ++i;
+      if((i = zsv_prop_skip_digits(s, len, i)) == start)
+        return 0;
+    }
+  }
+  return i == len;
+}
+
+static char zsv_prop_is_bool_word(const unsigned char *s, size_t len) {
+  static const char *words[] = { "t", "f", "y", "n", "no", "yes", "true", "false", NULL };
+  for(int i = 0; words[i]; i++)
+    if(strlen(words[i]) == len && !zsv_strincmp_ascii(s, len, (const unsigned char *)words[i], len))
+      return 1;
+  return 0;
+}
+
+unsigned int zsv_prop_cell_classify(const unsigned char *s, size_t len) {
+  if(!len)
+    return ZSV_PROP_CELL_NULL;
+  if(len > ZSV_PROP_CLASSIFY_MAX)
+    return 0;
+
+  struct zsv_prop_masks m;
+  zsv_prop_get_masks(s, len, &m);
+  if(m.other || !m.digit)
+    return len <= 5 && zsv_prop_is_bool_word(s, len) ? ZSV_PROP_CELL_BOOL : 0;
+
+  uint64_t all = len < 64 ? (1ULL << len) - 1 : ~0ULL;
+  uint64_t sign = m.dash & 1;
+  size_t first = (size_t)sign; // index of the first digit or period
+  if((m.digit | sign) == all) {
+    if(len - first > 18 || (s[first] == '0' && len > first + 1))
+      return 0;
+    return ZSV_PROP_CELL_INTEGER | ZSV_PROP_CELL_REAL;
+  }
+  if((m.digit | sign | m.dot) == all) {
+    if(m.dot & (m.dot - 1)) // more than one period
+      return 0;
+    if(s[first] == '0' && len > first + 1 && s[first + 1] >= '0' && s[first + 1] <= '9')
+      return 0;
+    return ZSV_PROP_CELL_REAL;
+  }
+  if(__builtin_popcountll(m.dash | m.slash) == 2 && zsv_prop_is_datetime(s, len))
+    return ZSV_PROP_CELL_DATE;
+  return 0;
+}
+
+enum zsv_prop_column_type zsv_prop_column_type_from_mask(unsigned int mask) {
+  if(mask & ZSV_PROP_CELL_INTEGER)
+    return zsv_prop_column_type_integer;
+  if(mask & ZSV_PROP_CELL_REAL)
+    return zsv_prop_column_type_real;
+  if(mask & ZSV_PROP_CELL_DATE)
+    return zsv_prop_column_type_date;
+  if(mask & ZSV_PROP_CELL_BOOL)
+    return zsv_prop_column_type_bool;
+  return zsv_prop_column_type_text;
+}
+
+const char *zsv_prop_column_type_str(enum zsv_prop_column_type t) {
+  switch(t) {
+  case zsv_prop_column_type_integer:
+    return "integer";
+  case zsv_prop_column_type_real:
+    return "real";
+  case zsv_prop_column_type_date:
+    return "date";
+  case zsv_prop_column_type_bool:
+    return "bool";
+  case zsv_prop_column_type_text:
+    break;
+  }
+  return "text";
+}
+
+enum zsv_prop_column_type zsv_prop_column_type_from_str(const unsigned char *s, size_t len) {
+  for(enum zsv_prop_column_type t = zsv_prop_column_type_integer; t <= zsv_prop_column_type_bool; t++) {
+    const char *name = zsv_prop_column_type_str(t);
+    if(strlen(name) == len && !memcmp(s, name, len))
+      return t;
+  }
+  return zsv_prop_column_type_text;
+}
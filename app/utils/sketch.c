@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zsv/utils/sketch.h>
+
+uint64_t zsv_sketch_hash(const unsigned char *s, size_t len) {
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  for(size_t i = 0; i < len; i++) {
+    h ^= s[i];
+    h *= 1099511628211ULL;
+  }
+  // FNV's high bits are weak, and HyperLogLog depends on them, so finish with
+  // the murmur3 mixer
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/*
+ * HyperLogLog
+ */
+struct zsv_hll {
+  unsigned precision;
+  unsigned char *registers;
+};
+
+zsv_hll zsv_hll_new(unsigned precision) {
+  if(precision < 4 || precision > 18)
+    return NULL;
+  struct zsv_hll *hll = calloc(1, sizeof(*hll));
+  if(hll) {
+    hll->precision = precision;
+    if(!(hll->registers = calloc((size_t)1 << precision, 1))) {
+      free(hll);
+      hll = NULL;
+    }
+  }
+  return hll;
+}
+
+void zsv_hll_add(zsv_hll hll, uint64_t hash) {
+  size_t ix = hash >> (64 - hll->precision);
+  uint64_t rest = hash << hll->precision;
+  unsigned char rank = rest ? (unsigned)__builtin_clzll(rest) + 1 : 64 - hll->precision + 1;
+  if(rank > hll->registers[ix])
+    hll->registers[ix] = rank;
+}
+
+double zsv_hll_estimate(zsv_hll hll) {
+  size_t m = (size_t)1 << hll->precision;
+  double sum = 0;
+  size_t zeros = 0;
+  for(size_t i = 0; i < m; i++) {
+    sum += ldexp(1.0, -(int)hll->registers[i]);
+    if(!hll->registers[i])
+      zeros++;
+  }
+  double alpha = 0.7213 / (1 + 1.079 / (double)m);
+  double estimate = alpha * (double)m * (double)m / sum;
+  if(estimate <= 2.5 * (double)m && zeros) // small range correction (linear counting)
+    estimate = (double)m * log((double)m / (double)zeros);
+  return estimate;
+}
+
+int zsv_hll_merge(zsv_hll dest, zsv_hll src) {
+  if(dest->precision != src->precision)
+    return 1;
+  for(size_t i = 0, m = (size_t)1 << dest->precision; i < m; i++)
+    if(src->registers[i] > dest->registers[i])
+      dest->registers[i] = src->registers[i];
+  return 0;
+}
+
+void zsv_hll_delete(zsv_hll hll) {
+  if(hll) {
+    free(hll->registers);
+    free(hll);
+  }
+}
+
+/*
+ * KLL quantiles sketch: a stack of compactors, each of whose items stands for
+ * 2^level values. When a level fills up, it is sorted and every other item
+ * (starting from a random one of the first two) is promoted to the next level.
+ * Level capacities shrink geometrically below the top level
+ */
+#define ZSV_QUANTILES_MIN_CAPACITY 8
+
+struct zsv_quantiles_level {
+  double *items;
+  unsigned size;
+  unsigned alloc;
+};
+
+struct zsv_quantiles {
+  unsigned k;
+  unsigned level_count;
+  struct zsv_quantiles_level *levels;
+  size_t total_size;
+  size_t total_capacity;
+
+  uint64_t n;
+  double min;
+  double max;
+  uint64_t rng; // deterministic, so that results are reproducible
+};
+
+static unsigned zsv_quantiles_capacity(struct zsv_quantiles *q, unsigned level) {
+  double c = q->k;
+  for(unsigned depth = q->level_count - 1 - level; depth; depth--)
+    c *= 2.0 / 3.0;
+  unsigned capacity = (unsigned)ceil(c);
+  return capacity < ZSV_QUANTILES_MIN_CAPACITY ? ZSV_QUANTILES_MIN_CAPACITY : capacity;
+}
+
+static int zsv_quantiles_add_level(struct zsv_quantiles *q) {
+  struct zsv_quantiles_level *levels = realloc(q->levels, (q->level_count + 1) * sizeof(*levels));
+  if(!levels)
+    return 1;
+  q->levels = levels;
+  memset(&q->levels[q->level_count++], 0, sizeof(*levels));
+  q->total_capacity = 0;
+  for(unsigned i = 0; i < q->level_count; i++)
+    q->total_capacity += zsv_quantiles_capacity(q, i);
+  return 0;
+}
+
+static int zsv_quantiles_push(struct zsv_quantiles_level *level, double value) {
+  if(level->size == level->alloc) {
+    unsigned new_alloc = level->alloc ? level->alloc * 2 : ZSV_QUANTILES_MIN_CAPACITY;
+    double *items = realloc(level->items, new_alloc * sizeof(*items));
+    if(!items)
+      return 1;
+    level->items = items;
+    level->alloc = new_alloc;
+  }
+  level->items[level->size++] = value;
+  return 0;
+}
+
+static int zsv_quantiles_double_cmp(const void *x, const void *y) {
+  double a = *(const double *)x, b = *(const double *)y;
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static void zsv_quantiles_sort(double *items, unsigned n) {
+  if(n > 32) {
+    qsort(items, n, sizeof(*items), zsv_quantiles_double_cmp);
+    return;
+  }
+  // lower levels are compacted often and are small, so avoid qsort()'s overhead
+  for(unsigned i = 1; i < n; i++) {
+    double v = items[i];
+    unsigned j = i;
+    for(; j > 0 && items[j - 1] > v; j--)
+      items[j] = items[j - 1];
+    items[j] = v;
+  }
+}
+
+// compact the lowest level that is at capacity
+static int zsv_quantiles_compress(struct zsv_quantiles *q) {
+  for(unsigned h = 0; h < q->level_count; h++) {
+    if(q->levels[h].size >= zsv_quantiles_capacity(q, h)) {
+      if(h + 1 == q->level_count && zsv_quantiles_add_level(q))
+        return 1;
+      struct zsv_quantiles_level *level = &q->levels[h];
+      zsv_quantiles_sort(level->items, level->size);
+
+      q->rng ^= q->rng << 13, q->rng ^= q->rng >> 7, q->rng ^= q->rng << 17;
+      unsigned keep = level->size & 1; // an odd item out stays at this level
+      unsigned offset = keep + (unsigned)(q->rng & 1);
+      for(unsigned i = offset; i < level->size; i += 2)
+        if(zsv_quantiles_push(&q->levels[h + 1], level->items[i]))
+          return 1;
+      level->size = keep;
+      q->total_size = 0;
+      for(unsigned i = 0; i < q->level_count; i++)
+        q->total_size += q->levels[i].size;
+      return 0;
+    }
+  }
+  return 0;
+}
+
+zsv_quantiles zsv_quantiles_new(unsigned k) {
+  if(k < ZSV_QUANTILES_MIN_CAPACITY)
+    return NULL;
+  struct zsv_quantiles *q = calloc(1, sizeof(*q));
+  if(q) {
+    q->k = k;
+    q->rng = 0x9e3779b97f4a7c15ULL;
+    if(zsv_quantiles_add_level(q)) {
+      free(q);
+      q = NULL;
+    }
+  }
+  return q;
+}
+
+int zsv_quantiles_add(zsv_quantiles q, double value) {
+  if(!q->n || value < q->min)
+    q->min = value;
+  if(!q->n || value > q->max)
+    q->max = value;
+  q->n++;
+  if(zsv_quantiles_push(&q->levels[0], value))
+    return 1;
+  if(++q->total_size >= q->total_capacity)
+    return zsv_quantiles_compress(q);
+  return 0;
+}
+
+int zsv_quantiles_merge(zsv_quantiles dest, zsv_quantiles src) {
+  if(!src->n)
+    return 0;
+  while(dest->level_count < src->level_count)
+    if(zsv_quantiles_add_level(dest))
+      return 1;
+  for(unsigned h = 0; h < src->level_count; h++) {
+    for(unsigned i = 0; i < src->levels[h].size; i++)
+      if(zsv_quantiles_push(&dest->levels[h], src->levels[h].items[i]))
+        return 1;
+    dest->total_size += src->levels[h].size;
+  }
+  if(!dest->n || src->min < dest->min)
+    dest->min = src->min;
+  if(!dest->n || src->max > dest->max)
+    dest->max = src->max;
+  dest->n += src->n;
+  while(dest->total_size >= dest->total_capacity) {
+    size_t before = dest->total_size;
+    if(zsv_quantiles_compress(dest))
+      return 1;
+    if(dest->total_size == before) // every level is below capacity
+      break;
+  }
+  return 0;
+}
+
+uint64_t zsv_quantiles_count(zsv_quantiles q) {
+  return q->n;
+}
+
+struct zsv_quantiles_weighted {
+  double value;
+  uint64_t weight;
+};
+
+static int zsv_quantiles_weighted_cmp(const void *x, const void *y) {
+  return zsv_quantiles_double_cmp(&((const struct zsv_quantiles_weighted *)x)->value,
+                                  &((const struct zsv_quantiles_weighted *)y)->value);
+}
+
+double zsv_quantiles_get(zsv_quantiles q, double rank) {
+  if(!q->n)
+    return NAN;
+  if(rank <= 0)
+    return q->min;
+  if(rank >= 1)
+    return q->max;
+
+  struct zsv_quantiles_weighted *items = malloc(q->total_size * sizeof(*items));
+  if(!items)
+    return NAN;
+  size_t count = 0;
+  uint64_t total = 0;
+  for(unsigned h = 0; h < q->level_count; h++) {
+    for(unsigned i = 0; i < q->levels[h].size; i++) {
+      items[count].value = q->levels[h].items[i];
+      items[count++].weight = (uint64_t)1 << h;
+      total += (uint64_t)1 << h;
+    }
+  }
+  qsort(items, count, sizeof(*items), zsv_quantiles_weighted_cmp);
+
+  double result = q->max;
+  double target = rank * (double)total;
+  uint64_t cumulative = 0;
+  for(size_t i = 0; i < count; i++) {
+    cumulative += items[i].weight;
+    if((double)cumulative >= target) {
+      result = items[i].value;
+      break;
+    }
+  }
+  free(items);
+  return result;
+}
+
+void zsv_quantiles_delete(zsv_quantiles q) {
+  if(q) {
+    for(unsigned i = 0; i < q->level_count; i++)
+      free(q->levels[i].items);
+    free(q->levels);
+    free(q);
+  }
+}
+
+/*
+ * Space-Saving heavy hitters. Entries are found by hash via an open-addressing
+ * index, and kept in a min-heap by count so that the least frequent entry can
+ * be replaced in O(log(capacity))
+ */
+struct zsv_topk_entry {
+  uint64_t hash;
+  uint64_t count;
+  uint64_t error;
+  unsigned char *value;
+  size_t len;
+  size_t size;
+  unsigned heap_ix;
+};
+
+struct zsv_topk_heap_node {
+  uint64_t count; // copy of the entry's count, so that sifting stays within the heap
+  unsigned entry_ix;
+};
+
+struct zsv_topk {
+  unsigned capacity;
+  unsigned used;
+  struct zsv_topk_entry *entries;
+  struct zsv_topk_heap_node *heap; // least count first
+  unsigned *index; // entry index + 1, or 0 if empty
+  unsigned index_mask;
+};
+
+zsv_topk zsv_topk_new(unsigned capacity) {
+  if(!capacity)
+    return NULL;
+  struct zsv_topk *t = calloc(1, sizeof(*t));
+  if(t) {
+    unsigned index_size = 4;
+    while(index_size < capacity * 2)
+      index_size *= 2;
+    t->capacity = capacity;
+    t->index_mask = index_size - 1;
+    if(!(t->entries = calloc(capacity, sizeof(*t->entries)))
+       || !(t->heap = calloc(capacity, sizeof(*t->heap)))
+       || !(t->index = calloc(index_size, sizeof(*t->index)))) {
+      zsv_topk_delete(t);
+      t = NULL;
+    }
+  }
+  return t;
+}
+
+static void zsv_topk_heap_set(struct zsv_topk *t, unsigned heap_ix, struct zsv_topk_heap_node node) {
+  t->heap[heap_ix] = node;
+  t->entries[node.entry_ix].heap_ix = heap_ix;
+}
+
+// restore heap order after a node's count has increased
+static void zsv_topk_sift_down(struct zsv_topk *t, unsigned heap_ix) {
+  struct zsv_topk_heap_node node = t->heap[heap_ix];
+  while(1) {
+    unsigned child = heap_ix * 2 + 1;
+    if(child >= t->used)
+      break;
+    if(child + 1 < t->used && t->heap[child + 1].count < t->heap[child].count)
+      child++;
+    if(t->heap[child].count >= node.count)
+      break;
+    zsv_topk_heap_set(t, heap_ix, t->heap[child]);
+    heap_ix = child;
+  }
+  zsv_topk_heap_set(t, heap_ix, node);
+}
+
+static void zsv_topk_sift_up(struct zsv_topk *t, unsigned heap_ix) {
+  struct zsv_topk_heap_node node = t->heap[heap_ix];
+  while(heap_ix) {
+    unsigned parent = (heap_ix - 1) / 2;
+    if(t->heap[parent].count <= node.count)
+      break;
+    zsv_topk_heap_set(t, heap_ix, t->heap[parent]);
+    heap_ix = parent;
+  }
+  zsv_topk_heap_set(t, heap_ix, node);
+}
+
+// find the index slot holding a value, or the empty slot where it belongs
+static unsigned *zsv_topk_find(struct zsv_topk *t, const unsigned char *s, size_t len, uint64_t hash) {
+  for(unsigned i = (unsigned)hash & t->index_mask;; i = (i + 1) & t->index_mask) {
+    if(!t->index[i])
+      return &t->index[i];
+    struct zsv_topk_entry *e = &t->entries[t->index[i] - 1];
+    if(e->hash == hash && e->len == len && (!len || !memcmp(e->value, s, len)))
+      return &t->index[i];
+  }
+}
+
+// remove an entry from the index, shifting back any later entries in its probe sequence
+static void zsv_topk_unindex(struct zsv_topk *t, unsigned entry_ix) {
+  unsigned i = (unsigned)t->entries[entry_ix].hash & t->index_mask;
+  while(t->index[i] != entry_ix + 1)
+    i = (i + 1) & t->index_mask;
+  for(unsigned j = (i + 1) & t->index_mask; t->index[j]; j = (j + 1) & t->index_mask) {
+    unsigned home = (unsigned)t->entries[t->index[j] - 1].hash & t->index_mask;
+    if(((j - home) & t->index_mask) >= ((j - i) & t->index_mask)) {
+      t->index[i] = t->index[j];
+      i = j;
+    }
+  }
+  t->index[i] = 0;
+}
+
+static int zsv_topk_reserve(struct zsv_topk_entry *e, size_t len) {
+  if(len > e->size) {
+    unsigned char *value = realloc(e->value, len);
+    if(!value)
+      return 1;
+    e->value = value;
+    e->size = len;
+  }
+  return 0;
+}
+
+static int zsv_topk_add_counted(struct zsv_topk *t, const unsigned char *s, size_t len, uint64_t hash,
+                                uint64_t count, uint64_t error) {
+  unsigned *slot = zsv_topk_find(t, s, len, hash);
+  if(*slot) {
+    struct zsv_topk_entry *e = &t->entries[*slot - 1];
+    e->count += count;
+    e->error += error;
+    t->heap[e->heap_ix].count = e->count;
+    zsv_topk_sift_down(t, e->heap_ix);
+    return 0;
+  }
+
+  char replace = t->used == t->capacity;
+  unsigned entry_ix = replace ? t->heap[0].entry_ix : t->used;
+  struct zsv_topk_entry *e = &t->entries[entry_ix];
+  if(zsv_topk_reserve(e, len))
+    return 1;
+  if(replace) { // replace the least frequent value, which this value may have displaced
+    zsv_topk_unindex(t, entry_ix);
+    error += e->count;
+    count += e->count;
+    slot = zsv_topk_find(t, s, len, hash);
+  } else
+    e->heap_ix = t->used++;
+
+  if(len)
+    memcpy(e->value, s, len);
+  e->len = len;
+  e->hash = hash;
+  e->count = count;
+  e->error = error;
+  *slot = entry_ix + 1;
+  t->heap[e->heap_ix] = (struct zsv_topk_heap_node){ .count = count, .entry_ix = entry_ix };
+  if(replace)
+    zsv_topk_sift_down(t, e->heap_ix);
+  else
+    zsv_topk_sift_up(t, e->heap_ix);
+  return 0;
+}
+
+int zsv_topk_add(zsv_topk t, const unsigned char *s, size_t len, uint64_t hash, uint64_t count) {
+  return zsv_topk_add_counted(t, s, len, hash, count, 0);
+}
+
+int zsv_topk_merge(zsv_topk dest, zsv_topk src) {
+  for(unsigned i = 0; i < src->used; i++) {
+    struct zsv_topk_entry *e = &src->entries[i];
+    if(zsv_topk_add_counted(dest, e->value, e->len, e->hash, e->count, e->error))
+      return 1;
+  }
+  return 0;
+}
+
+static int zsv_topk_item_cmp(const void *x, const void *y) {
+  const struct zsv_topk_item *a = x, *b = y;
+  if(a->count != b->count)
+    return a->count > b->count ? -1 : 1;
+  // break ties by value, so that results do not depend on the order of input
+  int cmp = memcmp(a->value, b->value, a->len < b->len ? a->len : b->len);
+  return cmp ? cmp : a->len < b->len ? -1 : a->len > b->len ? 1 : 0;
+}
+
+unsigned zsv_topk_get(zsv_topk t, struct zsv_topk_item *items, unsigned max) {
+  struct zsv_topk_item *all = malloc(t->used * sizeof(*all));
+  if(!all)
+    return 0;
+  for(unsigned i = 0; i < t->used; i++) {
+    all[i].value = t->entries[i].value;
+    all[i].len = t->entries[i].len;
+    all[i].count = t->entries[i].count;
+    all[i].error = t->entries[i].error;
+  }
+  qsort(all, t->used, sizeof(*all), zsv_topk_item_cmp);
+  unsigned count = t->used < max ? t->used : max;
+  memcpy(items, all, count * sizeof(*items));
+  free(all);
+  return count;
+}
+
+void zsv_topk_delete(zsv_topk t) {
+  if(t) {
+    for(unsigned i = 0; t->entries && i < t->capacity; i++)
+      free(t->entries[i].value);
+    free(t->entries);
+    free(t->heap);
+    free(t->index);
+    free(t);
+  }
+}
@@ -15,6 +15,7 @@
 #include <zsv/utils/compiler.h>
 #include <zsv/utils/utf8.h>
 #include <zsv/utils/string.h>
+#include <zsv/utils/vector.h>
 
 #ifndef NO_UTF8PROC
 #include <utf8proc.h>
@@ -102,15 +103,76 @@ int zsv_strincmp_ascii(const unsigned char *s1, size_t len1, const unsigned char
   return len1 > len2 ? 1 : len1 < len2 ? -1 : 0;
 }
 
+static inline unsigned char zsv_ascii_tolower(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+/*
+ * zsv_strincmp_prefix(): get the length of the leading portion of s1 and s2 that
+ * is the same after converting ascii letters to lower case, a vector at a time.
+ * If ascii_only is set, stop at the first non-ascii byte
+ */
+static size_t zsv_strincmp_prefix(const unsigned char *s1, const unsigned char *s2,
+                                  size_t len, int ascii_only) {
+  size_t i = 0;
+  for(; i + sizeof(zsv_uc_vector) <= len; i += sizeof(zsv_uc_vector)) {
+    zsv_uc_vector v1, v2;
+    memcpy(&v1, s1 + i, sizeof(v1));
+    memcpy(&v2, s2 + i, sizeof(v2));
+    v1 |= (zsv_uc_vector)((v1 >= 'A') & (v1 <= 'Z')) & 0x20;
+    v2 |= (zsv_uc_vector)((v2 >= 'A') & (v2 <= 'Z')) & 0x20;
+    zsv_uc_vector v = (v1 ^ v2);
+    if(ascii_only)
+      v |= (v1 | v2) & 0x80;
+    if(zsv_vector_any(v))
+      break;
+  }
+  for(; i < len; i++) {
+    if(ascii_only && ((s1[i] | s2[i]) & 0x80))
+      break;
+    if(zsv_ascii_tolower(s1[i]) != zsv_ascii_tolower(s2[i]))
+      break;
+  }
+  return i;
+}
+
+/*
+ * Compare, after converting ascii letters to lower case, the bytes at the end
+ * of a common prefix of length i
+ */
+static int zsv_strincmp_at(const unsigned char *s1, size_t len1, const unsigned char *s2, size_t len2,
+                           size_t i) {
+  if(i < len1 && i < len2) {
+    unsigned char c1 = zsv_ascii_tolower(s1[i]);
+    unsigned char c2 = zsv_ascii_tolower(s2[i]);
+    if(c1 != c2)
+      return c1 < c2 ? -1 : 1;
+  }
+  return len1 > len2 ? 1 : len1 < len2 ? -1 : 0;
+}
+
 int zsv_strincmp(const unsigned char *s1, size_t len1, const unsigned char *s2, size_t len2) {
 #ifndef NO_UTF8PROC
+  // compare the leading ascii portion without converting (and allocating)
+  size_t i = zsv_strincmp_prefix(s1, s2, len1 < len2 ? len1 : len2, 1);
+  if(i == len1 || i == len2 || !((s1[i] | s2[i]) & 0x80))
+    return zsv_strincmp_at(s1, len1, s2, len2, i);
+
+  // the remainder starts at a character boundary and contains non-ascii text
+  s1 += i, len1 -= i;
+  s2 += i, len2 -= i;
+  if(len1 == len2 && !memcmp(s1, s2, len1))
+    return 0;
+
   unsigned char *lc1 = zsv_strtolowercase(s1, &len1);
   unsigned char *lc2 = zsv_strtolowercase(s2, &len2);
   int result;
   if(VERY_UNLIKELY(!lc1 || !lc2))
     fprintf(stderr, "Out of memory!\n"), result = -2;
-  else
+  else {
     result = strcmp((char *)lc1, (char *)lc2);
+    result = result < 0 ? -1 : result > 0 ? 1 : 0;
+  }
   free(lc1);
   free(lc2);
   return result;
@@ -119,6 +181,44 @@ int zsv_strincmp(const unsigned char *s1, size_t len1, const unsigned char *s2,
 #endif
 }
 
+int zsv_strincmp_lower(const unsigned char *s1, size_t len1, const unsigned char *s2, size_t len2) {
+  size_t i = zsv_strincmp_prefix(s1, s2, len1 < len2 ? len1 : len2, 0);
+  return zsv_strincmp_at(s1, len1, s2, len2, i);
+}
+
+uint64_t zsv_strihash(const unsigned char *s, size_t len) {
+  uint64_t h = 14695981039346656037ULL; // FNV-1a
+  size_t i = 0;
+  for(; i < len && !(s[i] & 0x80); i++) {
+    h ^= zsv_ascii_tolower(s[i]);
+    h *= 1099511628211ULL;
+  }
+#ifndef NO_UTF8PROC
+  // hash the rest one lower-cased character at a time
+  while(i < len) {
+    utf8proc_int32_t codepoint;
+    utf8proc_ssize_t n = utf8proc_iterate(s + i, (utf8proc_ssize_t)(len - i), &codepoint);
+    utf8proc_uint8_t lc[4];
+    utf8proc_ssize_t lc_len = 1;
+    if(n <= 0) // malformed: hash the byte as is
+      n = 1, lc[0] = s[i];
+    else
+      lc_len = utf8proc_encode_char(utf8proc_tolower(codepoint), lc);
+    for(utf8proc_ssize_t j = 0; j < lc_len; j++) {
+      h ^= lc[j];
+      h *= 1099511628211ULL;
+    }
+    i += (size_t)n;
+  }
+#else
+  for(; i < len; i++) {
+    h ^= (unsigned char)tolower(s[i]);
+    h *= 1099511628211ULL;
+  }
+#endif
+  return h ? h : 1;
+}
+
 __attribute__((always_inline)) static inline const unsigned char *zsv_strtrim_left_inline(const char unsigned * restrict s, size_t *lenp) {
   utf8proc_ssize_t bytes_read;
   utf8proc_int32_t codepoint = 0;
@@ -11,21 +11,9 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
-
-///
-/* return 0 on eof, +1 on error, > 0 if valid utf8 first byte read */
-static inline char UTF8_charLenC_noerr(int c) {
-  char len;
-  if(c == EOF) len = 0;
-  else if(!(c & 128)) len = 1;
-  else if((c & 224) == 192) len = 2; /* 110xxxxx */
-  else if((c & 240) == 224) len = 3; /* 1110xxxx */
-  else if((c & 248) == 240) len = 4; /* 11110xxx */
-  else if((c & 252) == 248) len = 5; /* 111110xx */
-  else if((c & 254) == 252) len = 6; /* 1111110x */
-  else len = 1; // error, but we are going to ignore and just call it a 1-byte char
-  return len;
-}
+#include <stdint.h>
+#include <math.h>
+#include <zsv/utils/vector.h>
 
 static struct zsv_csv_writer_options zsv_csv_writer_default_opts = { 0 };
 static char zsv_writer_default_opts_initd = 0;
@@ -43,6 +31,39 @@ struct zsv_csv_writer_options zsv_writer_get_default_opts() {
   return zsv_csv_writer_default_opts;
 }
 
+/*
+ * vectorized scan for bytes that require a CSV value to be quoted
+ * (comma, dquote, CR or LF). Multi-byte UTF8 sequences never contain any of
+ * these ascii values, so the scan can operate on raw bytes
+ */
+static inline char zsv_csv_needs_quoting(const unsigned char *s, size_t len) {
+  size_t i = 0;
+  if(len >= sizeof(zsv_uc_vector)) {
+    zsv_uc_vector comma, dquote, lf, cr;
+    memset(&comma, ',', sizeof(comma));
+    memset(&dquote, '"', sizeof(dquote));
+    memset(&lf, '\n', sizeof(lf));
+    memset(&cr, '\r', sizeof(cr));
+    for(; i + sizeof(zsv_uc_vector) <= len; i += sizeof(zsv_uc_vector)) {
+      zsv_uc_vector v;
+      memcpy(&v, s + i, sizeof(v));
+      zsv_uc_vector m = (zsv_uc_vector)((v == comma) | (v == dquote) | (v == lf) | (v == cr));
+      if(zsv_vector_any(m))
+        return 1;
+    }
+  }
+  for(; i < len; i++) {
+    switch(s[i]) {
+    case ',':
+    case '"':
+    case '\n':
+    case '\r':
+      return 1;
+    }
+  }
+  return 0;
+}
+
 // zsv_csv_quote() returns:
 //   NULL if no quoting needed
 //   buff if buff size was large enough to hold result
@@ -51,46 +72,32 @@ struct zsv_csv_writer_options zsv_writer_get_default_opts() {
 unsigned char *zsv_csv_quote(const unsigned char *utf8_value,
                              size_t len,
                              unsigned char *buff, size_t buffsize) {
-  char need = 0;
-  unsigned quotes = 0;
-  char clen;
-  for(unsigned int i = 0; i < len; i+=clen) {
-    if((clen = UTF8_charLenC_noerr(utf8_value[i])) == 1)
-      switch(utf8_value[i]) {
-      case ',':
-      case '\n':
-      case '\r':
-        need = 1;
-        break;
-      case '"':
-        need = 1;
-        quotes++;
-        break;
-      }
-  }
-  if(!need)
+  if(!zsv_csv_needs_quoting(utf8_value, len))
     return NULL;
 
+  unsigned quotes = 0;
+  const unsigned char *end = utf8_value + len;
+  for(const unsigned char *q = utf8_value; (q = memchr(q, '"', end - q)); q++)
+    quotes++;
+
   unsigned char *target;
-  unsigned mem_length = len + quotes + 3; // str + 2 quotes + terminating null
+  size_t mem_length = len + quotes + 3; // str + 2 quotes + terminating null
   if(mem_length < buffsize)
     target = buff;
   else
     target = malloc(mem_length * sizeof(*target));
 
   if(target) {
-    *target = '"';
-    if(!quotes)
-      memcpy(target + 1, utf8_value, len);
-    else {
-      for(unsigned int i = 0, j = 0; i < len; i+=clen, j += clen) {
-        if(utf8_value[i] == '"')
-          target[++j] = '"';
-        clen = UTF8_charLenC_noerr(utf8_value[i]);
-        if(i + clen > len) // safety in case of invalid utf8 input
-          clen = len - i;
-        memcpy(target + 1 + j, utf8_value + i, clen);
+    unsigned char *t = target;
+    *t++ = '"';
+    for(const unsigned char *s = utf8_value, *q; s < end; s = q + 1) {
+      if(!(q = memchr(s, '"', end - s))) {
+        memcpy(t, s, end - s);
+        break;
       }
+      memcpy(t, s, q - s + 1);
+      t += q - s + 1;
+      *t++ = '"';
     }
     target[mem_length - 2] = '"';
     target[mem_length - 1] = '\0';
@@ -108,14 +115,17 @@ struct zsv_output_buff {
 };
 
 struct zsv_writer_data {
-  size_t buffsize; // corresponds to buf
-  unsigned char *buff; // option
-
   struct zsv_output_buff out;
 
   void (*table_init)(void *);
   void *table_init_ctx;
 
+  struct {
+    char spec[16];  // fmt_spec passed to zsv_writer_cell_Lf(), e.g. ".2"
+    char fmt[24];   // corresponding printf format, e.g. "%.2Lf"
+    int precision;  // N if spec is ".N" and eligible for zsv_fixed_to_str(), else -1
+  } Lf_cache;
+
   unsigned char with_bom:1;
   unsigned char started:1;
   unsigned char _:6;
@@ -144,10 +154,47 @@ static inline void zsv_output_buff_write(struct zsv_output_buff *b, const unsign
   }
 }
 
+/*
+ * write a value that requires quoting, escaping embedded dquotes as we go.
+ * If the worst-case quoted length fits in the output buffer, the value is
+ * escaped directly into it; otherwise, it is written in segments
+ */
+static void zsv_output_buff_write_quoted(struct zsv_output_buff *b, const unsigned char *s, size_t n) {
+  const unsigned char *end = s + n;
+  const unsigned char *q;
+  size_t max_len = n * 2 + 2;
+  if(max_len > ZSV_OUTPUT_BUFF_SIZE - b->used)
+    zsv_output_buff_flush(b);
+
+  if(max_len <= ZSV_OUTPUT_BUFF_SIZE) {
+    unsigned char *target = (unsigned char *)b->buff + b->used;
+    *target++ = '"';
+    for(; (q = memchr(s, '"', end - s)); s = q + 1) {
+      memcpy(target, s, q - s + 1);
+      target += q - s + 1;
+      *target++ = '"';
+    }
+    memcpy(target, s, end - s);
+    target += end - s;
+    *target++ = '"';
+    b->used = target - (unsigned char *)b->buff;
+  } else {
+    zsv_output_buff_write(b, (const unsigned char *)"\"", 1);
+    for(; (q = memchr(s, '"', end - s)); s = q + 1) {
+      zsv_output_buff_write(b, s, q - s + 1);
+      zsv_output_buff_write(b, (const unsigned char *)"\"", 1);
+    }
+    zsv_output_buff_write(b, s, end - s);
+    zsv_output_buff_write(b, (const unsigned char *)"\"", 1);
+  }
+}
+
 void zsv_writer_set_temp_buff(zsv_csv_writer w, unsigned char *buff,
                                 size_t buffsize) {
-  w->buff = buff;
-  w->buffsize = buffsize;
+  // no longer used: quoted values are escaped directly into the output buffer
+  (void)(w);
+  (void)(buff);
+  (void)(buffsize);
 }
 
 zsv_csv_writer zsv_writer_new(struct zsv_csv_writer_options *opts) {
@@ -214,31 +261,395 @@ enum zsv_writer_status zsv_writer_cell(zsv_csv_writer w, char new_row,
     zsv_output_buff_write(&w->out, (const unsigned char *)",", 1);
 
   if(len) {
-    if(check_if_needs_quoting) {
-      unsigned char *quoted_s = zsv_csv_quote(s, len, w->buff, w->buffsize);
-      if(!quoted_s)
-        zsv_output_buff_write(&w->out, s, len);
-      else {
-        zsv_output_buff_write(&w->out, quoted_s, strlen((char *)quoted_s));
-        if(!(w->buff && quoted_s == w->buff))
-          free(quoted_s);
-      }
-    } else
+    if(check_if_needs_quoting && zsv_csv_needs_quoting(s, len))
+      zsv_output_buff_write_quoted(&w->out, s, len);
+    else
       zsv_output_buff_write(&w->out, s, len);
   }
   return zsv_writer_status_ok;
 }
 
+/*** numeric formatting ***/
+
+static const char zsv_digits_lut[200] = {
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899"
+};
+
+// write the decimal representation of v to out (which must hold 20 bytes); return length
+static unsigned zsv_u64_to_str(uint64_t v, char *out) {
+  char tmp[20];
+  char *p = tmp + sizeof(tmp);
+  while(v >= 100) {
+    p -= 2;
+    memcpy(p, zsv_digits_lut + (v % 100) * 2, 2);
+    v /= 100;
+  }
+  if(v >= 10) {
+    p -= 2;
+    memcpy(p, zsv_digits_lut + v * 2, 2);
+  } else
+    *--p = (char)('0' + v);
+  unsigned len = (unsigned)(tmp + sizeof(tmp) - p);
+  memcpy(out, p, len);
+  return len;
+}
+
+static unsigned zsv_i64_to_str(int64_t v, char *out) {
+  if(v < 0) {
+    *out = '-';
+    return 1 + zsv_u64_to_str(~(uint64_t)v + 1, out + 1);
+  }
+  return zsv_u64_to_str((uint64_t)v, out);
+}
+
+/*
+ * Shortest round-trip double formatting, using the Grisu2 algorithm
+ * (Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers", PLDI 2010). The output always reads back as the same double,
+ * and is the shortest such representation in all but a tiny fraction of cases
+ */
+struct zsv_diy_fp {
+  uint64_t f;
+  int e;
+};
+
+#define ZSV_DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define ZSV_DP_EXPONENT_MASK    0x7FF0000000000000ULL
+#define ZSV_DP_HIDDEN_BIT       0x0010000000000000ULL
+#define ZSV_DP_EXPONENT_BIAS    (0x3FF + 52)
+#define ZSV_DP_MIN_EXPONENT     (-ZSV_DP_EXPONENT_BIAS)
+
+// cached powers of ten: 10^k for k = -348, -340, ..., 340, normalized to 64-bit significands
+static const uint64_t zsv_cached_powers_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+static const int16_t zsv_cached_powers_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint32_t zsv_pow10_u32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static const uint64_t zsv_pow10_u64[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+  1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static inline struct zsv_diy_fp zsv_diy_fp_mul(struct zsv_diy_fp x, struct zsv_diy_fp y) {
+  const uint64_t M32 = 0xFFFFFFFF;
+  uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+  tmp += 1U << 31; // round
+  struct zsv_diy_fp r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+  return r;
+}
+
+static inline struct zsv_diy_fp zsv_diy_fp_normalize(struct zsv_diy_fp x) {
+  int shift = __builtin_clzll(x.f);
+  x.f <<= shift;
+  x.e -= shift;
+  return x;
+}
+
+static unsigned zsv_count_digits_u32(uint32_t n) {
+  unsigned count = 1;
+  while(count < 10 && n >= zsv_pow10_u32[count])
+    count++;
+  return count;
+}
+
+static inline void zsv_grisu_round(char *buff, int len, uint64_t delta, uint64_t rest,
+                                   uint64_t ten_kappa, uint64_t wp_w) {
+  while(rest < wp_w && delta - rest >= ten_kappa &&
+        (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buff[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static void zsv_grisu_digit_gen(struct zsv_diy_fp W, struct zsv_diy_fp Mp, uint64_t delta,
+                                char *buff, int *len, int *K) {
+  struct zsv_diy_fp one = { (uint64_t)1 << -Mp.e, Mp.e };
+  uint64_t wp_w = Mp.f - W.f;
+  uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+  uint64_t p2 = Mp.f & (one.f - 1);
+  int kappa = (int)zsv_count_digits_u32(p1);
+  *len = 0;
+
+  while(kappa > 0) {
+    uint32_t d = p1 / zsv_pow10_u32[kappa - 1];
+    p1 %= zsv_pow10_u32[kappa - 1];
+    if(d || *len)
+      buff[(*len)++] = (char)('0' + d);
+    kappa--;
+    uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+    if(tmp <= delta) {
+      *K += kappa;
+      zsv_grisu_round(buff, *len, delta, tmp, (uint64_t)zsv_pow10_u32[kappa] << -one.e, wp_w);
+      return;
+    }
+  }
+
+  for(;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = (char)(p2 >> -one.e);
+    if(d || *len)
+      buff[(*len)++] = (char)('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if(p2 < delta) {
+      *K += kappa;
+      int index = -kappa;
+      zsv_grisu_round(buff, *len, delta, p2, one.f, wp_w * (index < 20 ? zsv_pow10_u64[index] : 0));
+      return;
+    }
+  }
+}
+
+// v must be finite and positive. Writes digits to buff and returns the count; *K is the decimal exponent
+static int zsv_grisu2(double v, char *buff, int *K) {
+  uint64_t u;
+  memcpy(&u, &v, sizeof(u));
+  int biased_e = (int)((u & ZSV_DP_EXPONENT_MASK) >> 52);
+  uint64_t significand = u & ZSV_DP_SIGNIFICAND_MASK;
+  struct zsv_diy_fp x;
+  if(biased_e) {
+    x.f = significand + ZSV_DP_HIDDEN_BIT;
+    x.e = biased_e - ZSV_DP_EXPONENT_BIAS;
+  } else {
+    x.f = significand;
+    x.e = ZSV_DP_MIN_EXPONENT + 1;
+  }
+
+  // normalized boundaries m- and m+
+  struct zsv_diy_fp pl = { (x.f << 1) + 1, x.e - 1 };
+  while(!(pl.f & (ZSV_DP_HIDDEN_BIT << 1))) {
+    pl.f <<= 1;
+    pl.e--;
+  }
+  pl.f <<= 64 - 52 - 2;
+  pl.e -= 64 - 52 - 2;
+  struct zsv_diy_fp mi;
+  if(x.f == ZSV_DP_HIDDEN_BIT) {
+    mi.f = (x.f << 2) - 1;
+    mi.e = x.e - 2;
+  } else {
+    mi.f = (x.f << 1) - 1;
+    mi.e = x.e - 1;
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+
+  // cached power c_mk such that the product exponent lands in [-60, -32]
+  double dk = (-61 - pl.e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  if(dk - k > 0.0)
+    k++;
+  unsigned index = (unsigned)((k >> 3) + 1);
+  *K = -(-348 + (int)(index << 3));
+  struct zsv_diy_fp c_mk = { zsv_cached_powers_f[index], zsv_cached_powers_e[index] };
+
+  struct zsv_diy_fp W = zsv_diy_fp_mul(zsv_diy_fp_normalize(x), c_mk);
+  struct zsv_diy_fp Wp = zsv_diy_fp_mul(pl, c_mk);
+  struct zsv_diy_fp Wm = zsv_diy_fp_mul(mi, c_mk);
+  Wm.f++;
+  Wp.f--;
+  int len;
+  zsv_grisu_digit_gen(W, Wp, Wp.f - Wm.f, buff, &len, K);
+  return len;
+}
+
+/*
+ * format a double as the shortest string that reads back as the same value.
+ * Uses plain decimal notation for decimal exponents in [-6, 21), and
+ * d[.ddd]e[+-]XX otherwise. out must hold at least 32 bytes; returns length
+ */
+static unsigned zsv_double_to_str(double v, char *out) {
+  char *p = out;
+  if(isnan(v)) {
+    memcpy(out, "nan", 3);
+    return 3;
+  }
+  if(signbit(v)) {
+    *p++ = '-';
+    v = -v;
+  }
+  if(isinf(v)) {
+    memcpy(p, "inf", 3);
+    return (unsigned)(p - out) + 3;
+  }
+  if(v == 0) {
+    *p++ = '0';
+    return (unsigned)(p - out);
+  }
+
+  char digits[20];
+  int K;
+  int len = zsv_grisu2(v, digits, &K);
+  int kk = len + K; // position of the decimal point relative to the first digit
+
+  if(kk > 0 && kk <= 21) {
+    if(len <= kk) { // integer: digits followed by K zeros
+      memcpy(p, digits, len);
+      memset(p + len, '0', kk - len);
+      p += kk;
+    } else { // decimal point within the digits
+      memcpy(p, digits, kk);
+      p[kk] = '.';
+      memcpy(p + kk + 1, digits + kk, len - kk);
+      p += len + 1;
+    }
+  } else if(kk <= 0 && kk > -6) { // 0.000ddd
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -kk);
+    p += -kk;
+    memcpy(p, digits, len);
+    p += len;
+  } else { // exponential notation
+    *p++ = digits[0];
+    if(len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    int exp10 = kk - 1;
+    *p++ = 'e';
+    if(exp10 < 0) {
+      *p++ = '-';
+      exp10 = -exp10;
+    } else
+      *p++ = '+';
+    if(exp10 < 10)
+      *p++ = '0';
+    p += zsv_u64_to_str((uint64_t)exp10, p);
+  }
+  return (unsigned)(p - out);
+}
+
+/*
+ * format a double with a fixed number of decimal places, without printf.
+ * Returns the length written to out (which must hold at least 32 bytes), or 0
+ * if the value cannot be formatted exactly this way (too large, not finite, or
+ * too close to a rounding tie for the scaled value to be trusted), in which
+ * case the caller should fall back to printf
+ */
+static unsigned zsv_fixed_to_str(double v, unsigned precision, char *out) {
+  static const double pow10_dbl[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+  if(precision >= sizeof(pow10_dbl) / sizeof(*pow10_dbl) || !isfinite(v))
+    return 0;
+
+  double scaled = fabs(v) * pow10_dbl[precision];
+  if(!(scaled < 1e15))
+    return 0;
+  double fl = floor(scaled);
+  double frac = scaled - fl;
+  if(fabs(frac - 0.5) <= scaled * 4.5e-16 + 1e-300)
+    return 0; // printf rounds based on the exact binary value; let it decide
+
+  uint64_t u = (uint64_t)fl + (frac > 0.5);
+  char *p = out;
+  if(signbit(v))
+    *p++ = '-';
+  uint64_t int_part = u / zsv_pow10_u32[precision];
+  p += zsv_u64_to_str(int_part, p);
+  if(precision) {
+    uint64_t frac_part = u - int_part * zsv_pow10_u32[precision];
+    *p++ = '.';
+    char digits[20];
+    unsigned n = zsv_u64_to_str(frac_part, digits);
+    memset(p, '0', precision - n);
+    memcpy(p + precision - n, digits, n);
+    p += precision;
+  }
+  return (unsigned)(p - out);
+}
+
+// get the printf format for zsv_writer_cell_Lf(), caching the most recently used one
+static const char *zsv_writer_Lf_fmt(zsv_csv_writer w, const char *fmt_spec,
+                                     char *tmp, size_t tmp_size, int *precision) {
+  *precision = -1;
+  if(w && !strcmp(w->Lf_cache.spec, fmt_spec) && *w->Lf_cache.fmt) {
+    *precision = w->Lf_cache.precision;
+    return w->Lf_cache.fmt;
+  }
+
+  int n = snprintf(tmp, tmp_size, "%%%sLf", fmt_spec);
+  if(!(n > 0 && n < (int)tmp_size))
+    return NULL;
+
+  if(fmt_spec[0] == '.' && fmt_spec[1] >= '0' && fmt_spec[1] <= '9' && !fmt_spec[2])
+    *precision = fmt_spec[1] - '0';
+
+  if(w && strlen(fmt_spec) < sizeof(w->Lf_cache.spec) && n < (int)sizeof(w->Lf_cache.fmt)) {
+    strcpy(w->Lf_cache.spec, fmt_spec);
+    strcpy(w->Lf_cache.fmt, tmp);
+    w->Lf_cache.precision = *precision;
+    return w->Lf_cache.fmt;
+  }
+  return tmp;
+}
+
 enum zsv_writer_status zsv_writer_cell_Lf(zsv_csv_writer w, char new_row, const char *fmt_spec,
                                               long double ldbl) {
   char s[128];
-  char fmt[64];
-  int n = snprintf(fmt, sizeof(fmt), "%%%sLf", fmt_spec);
-  if(!(n > 0 && n < (int)sizeof(fmt)))
+  char tmp[64];
+  int precision;
+  const char *fmt = zsv_writer_Lf_fmt(w, fmt_spec, tmp, sizeof(tmp), &precision);
+  if(!fmt)
     fprintf(stderr, "Invalid format specifier, should be X for format %%XLf e.g. '.2'\n");
   else {
-    n = snprintf(s, sizeof(s), fmt, ldbl);
-    if(!(n > 0 && n < (int)sizeof(fmt)))
+    int n = 0;
+    if(precision >= 0)
+      n = (int)zsv_fixed_to_str((double)ldbl, (unsigned)precision, s);
+    if(!n)
+      n = snprintf(s, sizeof(s), fmt, ldbl);
+    if(!(n > 0 && n < (int)sizeof(s)))
       fprintf(stderr, "Unable to format value with fmt %s: %Lf\n", fmt, ldbl);
     else
       return zsv_writer_cell(w, new_row, (unsigned char *)s, n, 0);
@@ -252,13 +663,46 @@ enum zsv_writer_status zsv_writer_cell_blank(zsv_csv_writer w, char new_row) {
 }
 
 enum zsv_writer_status zsv_writer_cell_zu(zsv_csv_writer w, char new_row, size_t zu) {
-  char s[64];
-  int n = snprintf(s, sizeof(s), "%zu", zu);
-  if(n < 1 || n >= (int)sizeof(s))
-    n = 0; // unexpected overflow
+  char s[32];
+  unsigned n = zsv_u64_to_str((uint64_t)zu, s);
   return zsv_writer_cell(w, new_row, (unsigned char *)s, n, 0);
 }
 
+enum zsv_writer_status zsv_writer_cell_i64(zsv_csv_writer w, char new_row, int64_t i) {
+  char s[32];
+  unsigned n = zsv_i64_to_str(i, s);
+  return zsv_writer_cell(w, new_row, (unsigned char *)s, n, 0);
+}
+
+enum zsv_writer_status zsv_writer_cell_double(zsv_csv_writer w, char new_row, double d) {
+  char s[32];
+  unsigned n = zsv_double_to_str(d, s);
+  return zsv_writer_cell(w, new_row, (unsigned char *)s, n, 0);
+}
+
+enum zsv_writer_status zsv_writer_cell_fixed(zsv_csv_writer w, char new_row, double d,
+                                             unsigned precision) {
+  char buff[128];
+  char *s = buff;
+  size_t n = zsv_fixed_to_str(d, precision, buff);
+  if(!n) {
+    // printf fallback: a large value or precision may need more than buff, e.g.
+    // DBL_MAX needs DBL_MAX_10_EXP + precision + 3 bytes
+    int rc = snprintf(buff, sizeof(buff), "%.*f", (int)precision, d);
+    if(rc >= (int)sizeof(buff) && (s = malloc((size_t)rc + 1)))
+      rc = snprintf(s, (size_t)rc + 1, "%.*f", (int)precision, d);
+    if(!s || rc <= 0) {
+      zsv_writer_cell(w, new_row, NULL, 0, 0);
+      return zsv_writer_status_error;
+    }
+    n = (size_t)rc;
+  }
+  enum zsv_writer_status stat = zsv_writer_cell(w, new_row, (unsigned char *)s, n, 0);
+  if(s != buff)
+    free(s);
+  return stat;
+}
+
 enum zsv_writer_status zsv_writer_cell_s(zsv_csv_writer w, char new_row,
                                              const unsigned char *s,
                                              char check_if_needs_quoting) {
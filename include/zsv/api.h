@@ -62,6 +62,8 @@ zsv_parser zsv_new(struct zsv_opts *opts);
  * @param parser
  * @returns zsv_status_ok if more data remains to be parsed,
  *          zsv_status_no_more_input if the stream's EOF has been reached,
+ *          zsv_status_error if the stream is read with the default (fread)
+ *          reader and a read error occurred (see `ferror()`),
  *          or other zsv status code in the event of error or cancellation
  */
 ZSV_EXPORT enum zsv_status zsv_parse_more(zsv_parser parser);
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#ifndef ZSV_BLOCKPOOL_H
+#define ZSV_BLOCKPOOL_H
+
+#include <stddef.h>
+#include <zsv.h>
+
+/**
+ * Grow an array, if needed, to hold at least `n` items of `item_size` bytes.
+ * The capacity starts at 256 and doubles
+ * @returns 0 on success, non-zero if out of memory
+ */
+int zsv_reserve(void **p, size_t *cap, size_t n, size_t item_size);
+
+/**
+ * zsv_block: rows copied from a parser, so that they can be handled after the
+ * parser has moved on (e.g. in another thread). Each row's data is copied into
+ * `raw` at once, and each cell is an offset into `raw` plus a length, with
+ * row_ends[r] being the index one past row r's last cell
+ */
+struct zsv_block_cell {
+  size_t offset;
+  size_t len;
+  char quoted;
+};
+
+struct zsv_block {
+  unsigned char *raw;
+  size_t raw_len;
+  size_t raw_cap;
+
+  struct zsv_block_cell *cells;
+  size_t cell_count;
+  size_t cell_cap;
+
+  size_t *row_ends;
+  size_t row_count;
+  size_t row_cap;
+};
+
+/**
+ * Copy the first `cols` cells of the parser's current row into a block
+ * @param terminate: if non-zero, follow each copied cell with a NUL
+ * @returns 0 on success, non-zero if out of memory
+ */
+int zsv_block_add_row(struct zsv_block *b, zsv_parser parser, unsigned cols, char terminate);
+
+/**
+ * Remove all rows from a block, keeping its memory for reuse
+ */
+void zsv_block_clear(struct zsv_block *b);
+
+/**
+ * Free a block's memory (but not the block itself)
+ */
+void zsv_block_free(struct zsv_block *b);
+
+#ifndef NO_THREADING
+/**
+ * zsv_blockpool: a fixed ring of blocks that a producer thread (usually the
+ * parser's) fills and hands on, to be processed by worker threads and/or taken
+ * in order by a consumer
+ *
+ * The producer fills the block returned by zsv_blockpool_fill_block(), which
+ * waits until that block is free, then hands it on with zsv_blockpool_submit().
+ * If `process` is set, each submitted block is then processed by one of the
+ * worker threads or, with `every_worker`, by each of them (e.g. each for its
+ * own range of columns). With `ordered`, processed blocks are then taken in
+ * the order they were submitted, using zsv_blockpool_next(), and are freed for
+ * reuse with zsv_blockpool_release(). Otherwise, they are freed as soon as
+ * they have been processed
+ */
+typedef struct zsv_blockpool *zsv_blockpool;
+
+/**
+ * Process a block, in a worker thread
+ * @param ctx: zsv_blockpool_opts.ctx
+ * @param worker: index of the worker thread, from 0 to worker_count - 1
+ * @returns 0 on success; anything else stops the pool
+ */
+typedef int (*zsv_blockpool_process)(void *ctx, unsigned worker, struct zsv_block *b);
+
+struct zsv_blockpool_opts {
+  /**
+   * Size of each block, if blocks are the first member of a larger struct
+   * that holds per-block data; 0 for sizeof(struct zsv_block)
+   */
+  size_t block_size;
+  unsigned block_count;
+
+  zsv_blockpool_process process; /* if NULL, blocks are only taken in order */
+  void *ctx;
+  unsigned worker_count;
+  char every_worker;
+
+  char ordered;
+
+  /* if set, called for each block when the pool is deleted, to free per-block data */
+  void (*free_block)(struct zsv_block *b);
+};
+
+/**
+ * Create a pool and start its worker threads
+ * @returns NULL if out of memory, or if a thread could not be started
+ */
+zsv_blockpool zsv_blockpool_new(const struct zsv_blockpool_opts *opts);
+
+/**
+ * Get the block to fill, waiting until it is free
+ * @returns NULL if the pool has been stopped
+ */
+struct zsv_block *zsv_blockpool_fill_block(zsv_blockpool pool);
+
+/**
+ * Hand on the block being filled
+ * @returns non-zero if the pool has been stopped
+ */
+int zsv_blockpool_submit(zsv_blockpool pool);
+
+/**
+ * With `ordered`, check whether the next block to fill is still in use. A
+ * producer that is also the consumer must then take a block before filling
+ */
+char zsv_blockpool_full(zsv_blockpool pool);
+
+/**
+ * With `ordered`, wait for the oldest block that has not been taken to be
+ * processed, and take it
+ * @returns NULL if all submitted blocks have been taken and the producer has
+ *          finished, or if the pool has been stopped
+ */
+struct zsv_block *zsv_blockpool_next(zsv_blockpool pool);
+
+/**
+ * Free a block taken with zsv_blockpool_next() for reuse
+ */
+void zsv_blockpool_release(zsv_blockpool pool, struct zsv_block *b);
+
+/**
+ * Called by the producer when it is done: submit the block being filled, if
+ * it has any rows, and unless `ordered`, wait for all blocks to be processed
+ * @returns non-zero if a worker failed to process a block
+ */
+int zsv_blockpool_finish(zsv_blockpool pool);
+
+/**
+ * Stop the pool: waits in the producer, workers and consumer end
+ */
+void zsv_blockpool_stop(zsv_blockpool pool);
+
+/**
+ * Stop the pool, wait for its worker threads to exit, and free it
+ */
+void zsv_blockpool_delete(zsv_blockpool pool);
+#endif
+
+#endif
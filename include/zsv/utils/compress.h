@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#ifndef ZSV_COMPRESS_H
+#define ZSV_COMPRESS_H
+
+#include <stdio.h>
+
+enum zsv_compression {
+  zsv_compression_none = 0,
+  zsv_compression_gzip,
+  zsv_compression_zstd
+};
+
+/**
+ * Get the compression implied by a filename's extension (.gz or .zst)
+ */
+enum zsv_compression zsv_compression_from_filename(const char *filename);
+
+/**
+ * Check whether zsv was built with support for a given compression type
+ * (zlib for gzip, libzstd for zstd)
+ *
+ * @returns: true (1) if supported
+ */
+int zsv_compression_supported(enum zsv_compression c);
+
+/**
+ * Output sink: a write destination that can be used as
+ * `zsv_csv_writer_options.write` / `.stream` (or with any other
+ * fwrite-compatible interface, such as `jsonwriter_new_stream()`), and that
+ * optionally compresses its output in-process. Unless built with NO_THREADING,
+ * compression runs in a background thread so that it overlaps with parsing
+ * and output formatting
+ */
+typedef struct zsv_output_sink *zsv_output_sink;
+
+/**
+ * Open a file for output. If the filename ends in .gz or .zst, output
+ * is compressed accordingly
+ *
+ * On error, prints an error message and returns NULL
+ */
+zsv_output_sink zsv_output_sink_open(const char *filename);
+
+/**
+ * Create an output sink that writes to an already-open file
+ * The sink will fclose() the file when the sink is closed, unless it is stdout
+ */
+zsv_output_sink zsv_output_sink_new(FILE *f, enum zsv_compression compression);
+
+/**
+ * Write to an output sink. Same signature as `fwrite()`
+ * Returns the number of items written, or 0 on error
+ */
+size_t zsv_output_sink_write(const void *restrict ptr, size_t size, size_t nitems, void *restrict sink);
+
+/**
+ * Flush any pending data, finish the compressed stream (if any),
+ * close the underlying file and free the sink
+ *
+ * @returns: 0 on success, non-zero on error
+ */
+int zsv_output_sink_close(zsv_output_sink sink);
+
+/**
+ * Get the compression of data, based on its leading (magic) bytes
+ */
+enum zsv_compression zsv_compression_from_magic(const unsigned char *s, size_t len);
+
+/**
+ * Open a file for reading, in lieu of fopen(filename, "rb"). If the file
+ * content is gzip- or zstd-compressed (as determined by its magic bytes,
+ * regardless of filename), the returned FILE yields the decompressed data.
+ *
+ * Decompression runs in background thread(s) that stay ahead of the reader.
+ * gzip members and zstd frames whose boundaries can be found without
+ * decompressing them (BGZF files, or zstd frames with a known content size)
+ * are decompressed in parallel
+ *
+ * The returned FILE should be closed with fclose()
+ *
+ * On error, returns NULL; if the file was opened but could not be
+ * decompressed, also prints an error message
+ */
+FILE *zsv_input_open(const char *filename);
+
+/**
+ * Same as zsv_input_open(), but for a stream that is already open, such as
+ * stdin, and that need not be seekable. `filename` is only used in messages
+ *
+ * The stream is closed when the returned FILE is closed. On error, the stream
+ * is closed and NULL is returned
+ */
+FILE *zsv_input_open_stream(FILE *f, const char *filename);
+
+#endif
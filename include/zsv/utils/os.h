@@ -9,6 +9,11 @@
 #ifndef ZSV_OS_H
 #define ZSV_OS_H
 
+/**
+ * Get the number of online processors, or 1 if unknown
+ */
+unsigned zsv_cpu_count(void);
+
 #ifndef _WIN32
 # define zsv_replace_file(src, dest) (rename((const char *)src, (const char *)dest))
 
@@ -1,6 +1,8 @@
 #ifndef ZSV_PROP_H
 #define ZSV_PROP_H
 
+#include <stddef.h>
+
 struct zsv_file_properties {
   unsigned int skip;
   unsigned int header_span;
@@ -12,6 +14,82 @@ struct zsv_file_properties {
   unsigned int _:6;
 };
 
+/**
+ * Guess the type of a cell value. Returns a bitmask of ZSV_PROP_TYPE_CHECK_XXX
+ * values; NULL (blank) is exclusive of the others, whereas a value might look
+ * like more than one of number, date or bool (e.g. "1")
+ */
+#define ZSV_PROP_TYPE_CHECK_NUM 1
+#define ZSV_PROP_TYPE_CHECK_DATE 2
+#define ZSV_PROP_TYPE_CHECK_BOOL 4
+#define ZSV_PROP_TYPE_CHECK_NULL 8
+unsigned int zsv_prop_type_detect(const unsigned char *s, size_t len);
+
+/**
+ * Classify a cell value for column type detection. Unlike zsv_prop_type_detect(),
+ * values are not trimmed, and a number must be in a form that a loader can convert
+ * without loss (no leading zeros, commas or currency, and at most 18 digits if an
+ * integer). Returns ZSV_PROP_CELL_NULL if blank, else a bitmask of the
+ * ZSV_PROP_CELL_XXX types that the value is valid for (an integer is also a valid
+ * real), or 0 if the value is only valid as text
+ */
+#define ZSV_PROP_CELL_INTEGER 1
+#define ZSV_PROP_CELL_REAL 2
+#define ZSV_PROP_CELL_DATE 4
+#define ZSV_PROP_CELL_BOOL 8
+#define ZSV_PROP_CELL_NULL 16
+unsigned int zsv_prop_cell_classify(const unsigned char *s, size_t len);
+
+/**
+ * Column types, as detected from a sample of a file's rows by
+ * `prop --column-types auto` and saved in its "columns" property
+ */
+enum zsv_prop_column_type {
+  zsv_prop_column_type_text = 0,
+  zsv_prop_column_type_integer,
+  zsv_prop_column_type_real,
+  zsv_prop_column_type_date,
+  zsv_prop_column_type_bool
+};
+
+/**
+ * Get the type of a column, given the zsv_prop_cell_classify() results of all of its
+ * non-blank values and-ed together
+ */
+enum zsv_prop_column_type zsv_prop_column_type_from_mask(unsigned int mask);
+
+/**
+ * Get the name of a column type as saved in the "columns" property, or vice versa
+ * (zsv_prop_column_type_from_str() returns zsv_prop_column_type_text if unrecognized)
+ */
+const char *zsv_prop_column_type_str(enum zsv_prop_column_type t);
+enum zsv_prop_column_type zsv_prop_column_type_from_str(const unsigned char *s, size_t len);
+
+struct zsv_prop_column {
+  unsigned char *name;
+  enum zsv_prop_column_type type;
+  size_t width; /* maximum length, in bytes, of any value */
+  unsigned int nullable:1; /* whether any value was blank or missing */
+  unsigned int _:7;
+};
+
+struct zsv_prop_columns {
+  struct zsv_prop_column *columns;
+  size_t count;
+};
+
+/**
+ * Load the cached "columns" property of a file. If none was saved,
+ * columns->count will be zero. Call zsv_prop_columns_free() when done
+ *
+ * @param data_filepath required file path
+ * @param columns       columns to load
+ * @return zsv_status_ok on success
+ */
+enum zsv_status zsv_cache_load_columns(const char *data_filepath,
+                                       struct zsv_prop_columns *columns);
+void zsv_prop_columns_free(struct zsv_prop_columns *columns);
+
 /**
  * Load cached file properties into a zsp_opts and/or zsv_file_properties struct
  * If cmd_opts_used is provided, then do not set any zsv_opts values, if the
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#ifndef ZSV_SKETCH_H
+#define ZSV_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fixed-size summaries ("sketches") of a stream of values, for profiling data
+ * that is too large to hold in memory. Each sketch can be merged with another
+ * sketch of the same kind, so that sketches of separate parts of the data (such
+ * as partial runs, or chunks processed in parallel) can be combined
+ */
+
+/**
+ * Hash a value for use with zsv_hll_add() or zsv_topk_add()
+ */
+uint64_t zsv_sketch_hash(const unsigned char *s, size_t len);
+
+/**
+ * HyperLogLog distinct-count estimator. Uses 2^precision bytes; the standard
+ * error of the estimate is about 1.04 / sqrt(2^precision) (1.6% for 12)
+ */
+typedef struct zsv_hll *zsv_hll;
+
+/**
+ * @param precision: 4 to 18
+ * @returns NULL on error
+ */
+zsv_hll zsv_hll_new(unsigned precision);
+void zsv_hll_add(zsv_hll hll, uint64_t hash);
+double zsv_hll_estimate(zsv_hll hll);
+
+/**
+ * Add the values counted by `src` to `dest`
+ * @returns 0 on success, or non-zero if the precisions differ
+ */
+int zsv_hll_merge(zsv_hll dest, zsv_hll src);
+void zsv_hll_delete(zsv_hll hll);
+
+/**
+ * Streaming quantiles (KLL sketch). Memory is O(k), plus O(log(n)) for very
+ * large n, and the rank error is roughly 1.7 / k (0.85% for 200). The minimum
+ * and maximum values are exact
+ */
+typedef struct zsv_quantiles *zsv_quantiles;
+
+/**
+ * @param k: accuracy parameter, at least 8. 200 is a reasonable default
+ * @returns NULL on error
+ */
+zsv_quantiles zsv_quantiles_new(unsigned k);
+
+/**
+ * @returns 0 on success, non-zero on out-of-memory
+ */
+int zsv_quantiles_add(zsv_quantiles q, double value);
+
+/**
+ * Add the values counted by `src` to `dest`
+ * @returns 0 on success, non-zero on out-of-memory
+ */
+int zsv_quantiles_merge(zsv_quantiles dest, zsv_quantiles src);
+
+/**
+ * Number of values added
+ */
+uint64_t zsv_quantiles_count(zsv_quantiles q);
+
+/**
+ * Get the (approximate) value at a given rank, e.g. 0.5 for the median. A rank of
+ * 0 or 1 returns the exact minimum or maximum
+ * @returns NAN if no values were added
+ */
+double zsv_quantiles_get(zsv_quantiles q, double rank);
+void zsv_quantiles_delete(zsv_quantiles q);
+
+/**
+ * Heavy hitters (Space-Saving). Tracks up to `capacity` values; any value whose
+ * frequency exceeds 1 / capacity of the total is guaranteed to be tracked. A
+ * tracked value's count may be over-estimated by at most its `error`
+ */
+typedef struct zsv_topk *zsv_topk;
+
+struct zsv_topk_item {
+  const unsigned char *value;
+  size_t len;
+  uint64_t count;
+  uint64_t error;
+};
+
+/**
+ * @returns NULL on error
+ */
+zsv_topk zsv_topk_new(unsigned capacity);
+
+/**
+ * Count `count` occurrences of a value
+ * @param hash: zsv_sketch_hash(s, len)
+ * @returns 0 on success, non-zero on out-of-memory
+ */
+int zsv_topk_add(zsv_topk t, const unsigned char *s, size_t len, uint64_t hash, uint64_t count);
+
+/**
+ * Add the values counted by `src` to `dest`
+ * @returns 0 on success, non-zero on out-of-memory
+ */
+int zsv_topk_merge(zsv_topk dest, zsv_topk src);
+
+/**
+ * Get the tracked values, in descending order of count. Item values remain
+ * valid until the next call to zsv_topk_add(), zsv_topk_merge() or zsv_topk_delete()
+ *
+ * @param items: array of at least `max` items
+ * @returns the number of items set
+ */
+unsigned zsv_topk_get(zsv_topk t, struct zsv_topk_item *items, unsigned max);
+void zsv_topk_delete(zsv_topk t);
+
+#endif
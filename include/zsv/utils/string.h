@@ -40,6 +40,21 @@ int zsv_stricmp(const unsigned char *s1, const unsigned char *s2);
 int zsv_strincmp(const unsigned char *s1, size_t len1, const unsigned char *s2, size_t len2);
 int zsv_strincmp_ascii(const unsigned char *s1, size_t len1, const unsigned char *s2, size_t len2);
 
+/*
+ * zsv_strincmp_lower(): same as zsv_strincmp(), for strings whose non-ascii
+ * characters are already lower case (e.g. ascii text, or the output of
+ * zsv_strtolowercase()). Does not convert or allocate
+ */
+int zsv_strincmp_lower(const unsigned char *s1, size_t len1, const unsigned char *s2, size_t len2);
+
+/*
+ * zsv_strihash(): 64-bit hash of a string's lower-case form, so that strings
+ * that zsv_strincmp() considers equal have the same hash. Does not allocate
+ *
+ * @returns a non-zero hash
+ */
+uint64_t zsv_strihash(const unsigned char *s, size_t len);
+
 #define ZSV_STRWHITE_FLAG_NO_EMBEDDED_NEWLINE 1
 /**
  * zsv_strwhite(): convert consecutive white to single space
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2021 Liquidaty and the zsv/lib contributors
+ * All rights reserved
+ *
+ * This file is part of zsv/lib, distributed under the license defined at
+ * https://opensource.org/licenses/MIT
+ */
+
+#ifndef ZSV_UTILS_VECTOR_H
+#define ZSV_UTILS_VECTOR_H
+
+/*
+ * GCC vector type used for byte scans, and portable helpers to test its bytes.
+ * Values are loaded with memcpy, so no alignment is required
+ *
+ * ZSV_VECTOR_BYTES may be defined before this file is included, as the parser
+ * does to match the width of its movemask intrinsics
+ */
+#include <stdint.h>
+#include <string.h>
+
+#ifndef ZSV_VECTOR_BYTES
+# if defined(HAVE_AVX512) && defined(__AVX512BW__)
+#  define ZSV_VECTOR_BYTES 64
+# elif defined(__AVX2__)
+#  define ZSV_VECTOR_BYTES 32
+# else
+#  define ZSV_VECTOR_BYTES 16
+# endif
+#endif
+
+typedef unsigned char zsv_uc_vector __attribute__ ((vector_size (ZSV_VECTOR_BYTES)));
+
+// non-zero if any byte of v is non-zero
+static inline char zsv_vector_any(zsv_uc_vector v) {
+  uint64_t words[ZSV_VECTOR_BYTES / sizeof(uint64_t)];
+  uint64_t any = 0;
+  memcpy(words, &v, sizeof(words));
+  for(unsigned i = 0; i < sizeof(words) / sizeof(*words); i++)
+    any |= words[i];
+  return any != 0;
+}
+
+// bitmask of a comparison result: bit i is set if byte i is non-zero
+static inline uint64_t zsv_vector_mask(zsv_uc_vector v) {
+  zsv_uc_vector one;
+  memset(&one, 1, sizeof(one));
+  v = (zsv_uc_vector)(v != 0) & one;
+  uint64_t words[ZSV_VECTOR_BYTES / sizeof(uint64_t)];
+  memcpy(words, &v, sizeof(words));
+  uint64_t mask = 0;
+  for(unsigned i = 0; i < sizeof(words) / sizeof(*words); i++) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    words[i] = __builtin_bswap64(words[i]);
+#endif
+    // gather the low bit of each byte into the top byte
+    mask |= ((words[i] * 0x0102040810204080ULL) >> 56) << (i * 8);
+  }
+  return mask;
+}
+
+#endif
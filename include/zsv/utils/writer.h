@@ -10,6 +10,7 @@
 #define ZSV_WRITER_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 #define ZSV_WRITER_NEW_ROW 1
 #define ZSV_WRITER_SAME_ROW 0
@@ -41,6 +42,10 @@ enum zsv_writer_status zsv_writer_delete(zsv_csv_writer w);
 
 enum zsv_writer_status zsv_writer_flush(zsv_csv_writer w);
 
+/*
+ * deprecated: the writer now escapes quoted values directly into its output
+ * buffer, so a temp buffer is no longer needed. Retained for compatibility
+ */
 void zsv_writer_set_temp_buff(zsv_csv_writer w, unsigned char *buff,
                                 size_t buffsize);
 
@@ -61,15 +66,25 @@ unsigned char *zsv_csv_quote(const unsigned char *utf8_value, size_t len,
 
 
 // zsv_writer_cell convenience funcs: zsv_writer_cell_XX where XX = printf specifier
+// numeric values are formatted without printf, except in rare edge cases
 enum zsv_writer_status zsv_writer_cell_zu(zsv_csv_writer w, char new_row, size_t zu);
 
+enum zsv_writer_status zsv_writer_cell_i64(zsv_csv_writer w, char new_row, int64_t i);
+
+// write the shortest representation of `d` that reads back as the same double
+enum zsv_writer_status zsv_writer_cell_double(zsv_csv_writer w, char new_row, double d);
+
+// write `d` with a fixed number of decimal places, equivalent to printf("%.*f", precision, d)
+enum zsv_writer_status zsv_writer_cell_fixed(zsv_csv_writer w, char new_row, double d,
+                                             unsigned precision);
+
 enum zsv_writer_status zsv_writer_cell_s(zsv_csv_writer w, char new_row,
                                                     const unsigned char *s,
                                                     char check_if_needs_quoting);
 
 enum zsv_writer_status zsv_writer_cell_Lf(zsv_csv_writer w, char new_row,
                                                      const char *fmt_spec, // provide X in %XLf e.g. ".2" or ""
-                                                     long double ldbl);
+                                                     long double ldbl); // the format is cached across calls
 
 // write a blank cell
 enum zsv_writer_status zsv_writer_cell_blank(zsv_csv_writer w, char new_row);
@@ -40,7 +40,7 @@ size_t zsv_strencode(unsigned char *s, size_t n, unsigned char replace,
     clen = ZSV_UTF8_CHARLEN(s[i2]);
     if(LIKELY(clen == 1))
       s[new_len++] = s[i2];
-    else if(UNLIKELY(clen < 0) || UNLIKELY(i2 + clen >= n)) {
+    else if(UNLIKELY(clen < 0) || UNLIKELY(i2 + clen > n)) {
       if(malformed_handler)
         malformed_handler(handler_ctx, s, n, new_len);
       if(replace)
@@ -173,6 +173,8 @@ enum zsv_status zsv_parse_more(struct zsv_scanner *scanner) {
     return zsv_scan(scanner, scanner->buff.buff, bytes_read);
 
   scanner->scanned_length = scanner->partial_row_length;
+  if(VERY_UNLIKELY(scanner->read == (zsv_generic_read)fread && ferror((FILE *)scanner->in)))
+    return zsv_status_error; // e.g. a decompression error (see zsv_input_open())
   return zsv_status_no_more_input;
 }
 
@@ -55,7 +55,8 @@
 # define NEXT_BIT __builtin_ffs
 #endif
 
-typedef unsigned char zsv_uc_vector __attribute__ ((vector_size (VECTOR_BYTES)));
+#define ZSV_VECTOR_BYTES VECTOR_BYTES
+#include <zsv/utils/vector.h> // zsv_uc_vector
 
 struct zsv_row {
   size_t used, allocated, overflow;